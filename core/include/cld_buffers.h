@@ -0,0 +1,228 @@
+/** \file cld_buffers.h
+  *
+  * \brief Handles compact list data (.cld) files
+  *
+  * The compact list data format stores each complete spill contiguously,
+  * rather than splitting it into fixed length chunks as is done in .ldf
+  * files, so that a spill may be passed to the unpacker directly after it
+  * is read. Every spill is preceded by a fixed length spill header which
+  * contains the length of the spill, a CRC32 of the spill data, and the
+  * first and last pixie timestamps found in the spill. The spill data may
+  * optionally be compressed using the LZ4 block format. An index of all
+  * spills is written at the end of the file.
+  *
+  * File layout:
+  *  "CLDF" (4 bytes), format version (2 bytes), compression type (2 bytes)
+  *  PLD style HEAD buffer containing the run information
+  *  Spill 0: CLD spill header (40 bytes) followed by the (padded) spill data
+  *  ...
+  *  Spill N-1
+  *  "INDX" (4 bytes), number of spills (4 bytes), one 32 byte entry per spill
+  *  Index offset (8 bytes), CRC32 of the index entries (4 bytes), "CLDE" (4 bytes)
+  *
+  * Stored spills always end with the two word end of spill marker, so that
+  * spills converted from .ldf and .pld files are read in the same way.
+  *
+  * \author Cory R. Thornsberry
+  *
+  * \date Oct. 19th, 2026
+  *
+  * \version 1.0.00
+*/
+
+#ifndef CLD_BUFFERS_H
+#define CLD_BUFFERS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define CLD_BUFFERS_VERSION "1.0.00"
+#define CLD_BUFFERS_DATE "Oct. 19th, 2026"
+
+#define CLD_FORMAT_VERSION 1 /// Version of the compact list data format
+
+class SpillBuffer;
+class PLD_header;
+
+/// Spill compression types.
+enum CLD_compression {CLD_NONE=0, CLD_LZ4=1};
+
+/** Compute the CRC32 (IEEE 802.3) of an array.
+  * \param[in]  data_ Pointer to the array.
+  * \param[in]  nBytes_ Length of the array (in bytes).
+  * \param[in]  crc_ CRC of any preceding data (used to compute the CRC of data in several pieces).
+  * \return The CRC32 of the array.
+  */
+unsigned int cld_crc32(const char *data_, const size_t &nBytes_, const unsigned int &crc_=0);
+
+/** Compress an array using the LZ4 block format.
+  * \param[in]  src_ Pointer to the uncompressed data.
+  * \param[in]  srcSize_ Length of the uncompressed data (in bytes).
+  * \param[out] dest_ Output array. It is resized to the length of the compressed data.
+  * \return The length of the compressed data (in bytes).
+  */
+size_t cld_compress(const char *src_, const size_t &srcSize_, std::vector<char> &dest_);
+
+/** Decompress an LZ4 block.
+  * \param[in]  src_ Pointer to the compressed data.
+  * \param[in]  srcSize_ Length of the compressed data (in bytes).
+  * \param[out] dest_ Output array.
+  * \param[in]  destSize_ Length of the uncompressed data (in bytes).
+  * \return True if exactly destSize_ bytes were decompressed and false otherwise.
+  */
+bool cld_decompress(const char *src_, const size_t &srcSize_, char *dest_, const size_t &destSize_);
+
+/// The file header of a .cld file. The run information is stored in a PLD style HEAD buffer.
+class CLD_header{
+  private:
+	unsigned int version; /// Version of the file format.
+	unsigned int compression; /// Compression used for spills written to the file (see CLD_compression).
+
+  public:
+	CLD_header() : version(CLD_FORMAT_VERSION), compression(CLD_NONE) { }
+
+	unsigned int GetVersion(){ return version; }
+
+	unsigned int GetCompression(){ return compression; }
+
+	/// Return the name of the compression used for the file.
+	std::string GetCompressionName();
+
+	void SetCompression(const unsigned int &compression_){ compression = compression_; }
+
+	/// Write the file header followed by the run information.
+	bool Write(std::ofstream *file_, PLD_header *head_);
+
+	/// Read the file header and the run information. Return false if the file is not a valid .cld file.
+	bool Read(std::ifstream *file_, PLD_header *head_);
+
+	/// Overwrite the maximum spill size and the run time in the run information of an existing file.
+	void OverwriteValues(std::ofstream *file_, PLD_header *head_);
+};
+
+/// A single entry in the spill index.
+class CLD_index_entry{
+  public:
+	unsigned long long offset; /// Offset of the spill header from the start of the file (in bytes).
+	unsigned long long firstTime; /// Earliest pixie timestamp in the spill.
+	unsigned long long lastTime; /// Latest pixie timestamp in the spill.
+	unsigned int nWords; /// Length of the uncompressed spill (in words).
+	unsigned int nBytes; /// Length of the stored spill data (in bytes).
+
+	CLD_index_entry() : offset(0), firstTime(0), lastTime(0), nWords(0), nBytes(0) { }
+};
+
+/// The index of all spills, written at the end of a .cld file.
+class CLD_index{
+  private:
+	std::vector<CLD_index_entry> entries; /// One entry for each spill.
+
+  public:
+	CLD_index() : entries() { }
+
+	/// Return the number of spills in the index.
+	size_t GetNumSpills() const { return entries.size(); }
+
+	/// Return a spill index entry.
+	const CLD_index_entry &GetEntry(const size_t &index_) const { return entries.at(index_); }
+
+	/// Return the total length of all uncompressed spills (in words).
+	unsigned long long GetTotalWords() const ;
+
+	/// Add a spill to the index.
+	void Add(const CLD_index_entry &entry_){ entries.push_back(entry_); }
+
+	/** Find the spill which contains a given file offset.
+	  * \param[in]  offset_ Offset from the start of the file (in bytes).
+	  * \return The offset of the start of the spill, or the first spill if the offset is before the first spill.
+	  */
+	unsigned long long FindSpill(const unsigned long long &offset_) const ;
+
+	/** Find the first spill which contains events with timestamps at or after a given time.
+	  * \param[in]  time_ Pixie timestamp.
+	  * \return The index of the spill, or the number of spills if no such spill exists.
+	  */
+	size_t FindTime(const unsigned long long &time_) const ;
+
+	/// Remove all entries.
+	void Clear(){ entries.clear(); }
+
+	/// Write the index and the file trailer at the current position of the file.
+	bool Write(std::ofstream *file_);
+
+	/** Read the index from the end of a file. The position of the file is not changed.
+	  * Return false if the file does not have a valid index (e.g. the file was not closed).
+	  */
+	bool Read(std::ifstream *file_);
+};
+
+/// Reads and writes complete spills in a .cld file.
+class CLD_data{
+  private:
+	std::vector<char> scratch; /// Array used for compressed spill data.
+
+	CLD_index index; /// Index of all spills written to the file.
+
+	int retval; /// The return value of the most recent call to Read.
+
+	unsigned long numCrcErrors; /// Number of spills with an incorrect CRC.
+	unsigned long numResync; /// Number of times the reader had to search for the next spill header.
+
+	bool debug_mode; /// Set to true if debug information is to be printed.
+
+  public:
+	CLD_data() : scratch(), index(), retval(0), numCrcErrors(0), numResync(0), debug_mode(false) { }
+
+	/** Write a spill to the file and add it to the index.
+	  * \param[in]  file_ Pointer to the output file.
+	  * \param[in]  data_ Pointer to the spill data (including the end of spill marker).
+	  * \param[in]  nWords_ Length of the spill (in words).
+	  * \param[in]  compression_ Compression to use for this spill (see CLD_compression).
+	  * \return True if the spill was written successfully and false otherwise.
+	  */
+	bool Write(std::ofstream *file_, unsigned int *data_, const unsigned int &nWords_, const unsigned int &compression_=CLD_NONE);
+
+	/** Read the next spill from the file. The end of spill marker is included in the spill data.
+	  * Use GetRetval() to determine why a read failed:
+	  *  1: The spill index (the end of the spills) was reached.
+	  *  2: Failed to read from the file.
+	  *  3: The spill failed the CRC check and was skipped.
+	  *  4: Failed to decompress the spill, it was skipped.
+	  *  5: The spill is larger than the maximum buffer size, it was skipped.
+	  * \param[in]  file_ Pointer to the input file.
+	  * \param[out] buffer_ Buffer to read the spill into. It is enlarged to hold the entire spill.
+	  * \param[out] nWords_ Length of the spill (in words).
+	  * \param[in]  dry_run_mode If set to true, the spill is skipped without being read.
+	  * \return True if the spill was read successfully and false otherwise.
+	  */
+	bool Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nWords_, bool dry_run_mode=false);
+
+	/// Return the index of all spills written to the file.
+	CLD_index *GetIndex(){ return &index; }
+
+	/// Return the return value of the most recent call to Read.
+	int GetRetval(){ return retval; }
+
+	/// Return the number of spills with an incorrect CRC.
+	unsigned long GetNumCrcErrors(){ return numCrcErrors; }
+
+	/// Return the number of times the reader had to search for the next spill header.
+	unsigned long GetNumResync(){ return numResync; }
+
+	void SetDebugMode(bool debug_=true){ debug_mode = debug_; }
+
+	/// Reset the counters and the index.
+	void Reset();
+};
+
+/** Find the earliest and latest pixie timestamps in a spill.
+  * \param[in]  data_ Pointer to the spill data.
+  * \param[in]  nWords_ Length of the spill (in words).
+  * \param[out] first_ Earliest pixie timestamp.
+  * \param[out] last_ Latest pixie timestamp.
+  * \return The number of pixie events found in the spill.
+  */
+unsigned int cld_get_timestamps(const unsigned int *data_, const unsigned int &nWords_, unsigned long long &first_, unsigned long long &last_);
+
+#endif
@@ -0,0 +1,147 @@
+/** \file hist_snapshot.h
+  *
+  * \brief Binary snapshots of online histograms
+  *
+  * The classes within this file are used to encode the contents of a
+  * set of online histograms into versioned binary frames which may be
+  * sent to remote viewers. A keyframe contains the definition and the
+  * full contents of every histogram. A delta frame contains only the bins
+  * which have changed since the previous frame, so that a viewer which
+  * has received a keyframe may follow the scan at very low bandwidth.
+  *
+  * Every frame starts with a fixed length header (HistFrameHeader)
+  * followed by the payload. All integers in the payload are written as
+  * variable length (LEB128) integers, and differences of bin contents are
+  * zig-zag encoded so that small changes of either sign are short.
+  *
+  * \author Cory R. Thornsberry
+  *
+  * \date Oct. 19th, 2026
+  *
+  * \version 1.0.00
+*/
+
+#ifndef HIST_SNAPSHOT_H
+#define HIST_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define HIST_SNAPSHOT_VERSION "1.0.00"
+#define HIST_SNAPSHOT_DATE "Oct. 19th, 2026"
+
+#define HIST_FRAME_MAGIC 0x504E5348 /// "HSNP"
+#define HIST_FRAME_VERSION 1 /// Version of the frame format
+#define HIST_FRAME_MAX_LENGTH 268435456 /// Maximum length of a frame payload (in bytes, 256 MB)
+#define HIST_SNAPSHOT_MAX_CELLS (HIST_FRAME_MAX_LENGTH/8) /// Maximum number of cells of all histograms in a decoded snapshot
+
+/// Types of histogram snapshot frames.
+enum HistFrameTypes {HIST_KEYFRAME=0, HIST_DELTA=1};
+
+/// Fixed length header at the start of every frame.
+class HistFrameHeader{
+  public:
+	uint32_t magic; /// Magic number (HIST_FRAME_MAGIC).
+	uint16_t version; /// Version of the frame format.
+	uint16_t type; /// Type of frame (see HistFrameTypes).
+	uint32_t sequence; /// Sequence number of the frame.
+	uint32_t length; /// Length of the payload (in bytes).
+
+	HistFrameHeader() : magic(HIST_FRAME_MAGIC), version(HIST_FRAME_VERSION), type(0), sequence(0), length(0) { }
+
+	/** Read the header from the start of a frame.
+	  * \param[in]  data_ Pointer to at least GetSize() bytes.
+	  * \return True if the magic number and version are correct and return false otherwise.
+	  */
+	bool Read(const char *data_);
+
+	/** Write the header to the start of a frame.
+	  * \param[out] data_ Pointer to at least GetSize() bytes.
+	  * \return Nothing.
+	  */
+	void Write(char *data_) const ;
+
+	/// Return the length of the header (in bytes).
+	static size_t GetSize(){ return 16; }
+};
+
+/// Definition of a single histogram.
+class HistInfo{
+  public:
+	std::string name; /// Name of the histogram.
+	std::string title; /// Title of the histogram.
+	std::string xtitle; /// Title of the x-axis.
+	std::string ytitle; /// Title of the y-axis.
+	std::string opt; /// ROOT draw option.
+
+	int location; /// Detector location of a sub-histogram (-1 for the main histogram).
+
+	unsigned short dim; /// Dimension of the histogram (1 or 2).
+
+	int xbins; /// Number of bins along the x-axis.
+	double xmin; /// Minimum value along the x-axis.
+	double xmax; /// Maximum value along the x-axis.
+
+	int ybins; /// Number of bins along the y-axis.
+	double ymin; /// Minimum value along the y-axis.
+	double ymax; /// Maximum value along the y-axis.
+
+	HistInfo() : location(-1), dim(1), xbins(0), xmin(0), xmax(0), ybins(0), ymin(0), ymax(0) { }
+
+	/// Return the number of cells (including under and overflow bins) in the histogram.
+	size_t GetNumCells() const { return (xbins+2)*(dim == 2 ? ybins+2 : 1); }
+};
+
+/// Contents of a set of histograms at one point in time.
+class HistSnapshot{
+  public:
+	std::vector<HistInfo> info; /// Definition of each histogram.
+	std::vector<std::vector<double> > contents; /// Contents of each cell of each histogram (ROOT global bin ordering).
+	std::vector<double> entries; /// Number of entries in each histogram.
+
+	uint32_t sequence; /// Sequence number of the most recent frame.
+
+	HistSnapshot() : sequence(0) { }
+
+	/** Add a histogram to the snapshot. The contents are set to zero.
+	  * \param[in]  info_ The definition of the histogram.
+	  * \return The index of the new histogram.
+	  */
+	size_t Add(const HistInfo &info_);
+
+	/// Return the number of histograms in the snapshot.
+	size_t GetNumHists() const { return info.size(); }
+
+	/** Find a histogram by name.
+	  * \param[in]  name_ The name of the histogram.
+	  * \return The index of the histogram, or -1 if it does not exist.
+	  */
+	int Find(const std::string &name_) const ;
+
+	/// Remove all histograms.
+	void Clear();
+
+	/** Encode the definitions and the full contents of all histograms.
+	  * \param[out] frame_ The encoded frame (including the header).
+	  * \return Nothing.
+	  */
+	void EncodeKeyframe(std::string &frame_) const ;
+
+	/** Encode the bins which have changed since a previous snapshot of the same histograms.
+	  * \param[in]  prev_ The previous snapshot.
+	  * \param[out] frame_ The encoded frame (including the header).
+	  * \return The number of histograms which have changed.
+	  */
+	size_t EncodeDelta(const HistSnapshot &prev_, std::string &frame_) const ;
+
+	/** Apply a frame to the snapshot. A keyframe replaces all histograms.
+	  * \param[in]  header_ The header of the frame.
+	  * \param[in]  payload_ Pointer to the payload of the frame.
+	  * \param[out] changed_ Flags for each histogram which has changed.
+	  * \return True if the frame is decoded successfully and return false otherwise.
+	  */
+	bool Decode(const HistFrameHeader &header_, const char *payload_, std::vector<bool> &changed_);
+};
+
+#endif
@@ -23,15 +23,114 @@
 #define HRIBF_BUFFERS_H
 
 #include <fstream>
+#include <string>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
 
 #define HRIBF_BUFFERS_VERSION "1.3.00"
 #define HRIBF_BUFFERS_DATE "Sept. 19th, 2016"
 
 #define ACTUAL_BUFF_SIZE 8194 /// HRIBF .ldf file format
+#define SPILL_BUFFER_LIMIT 67108864 /// Maximum size of a single spill buffer (in 4 byte words, 256 MB)
 
 class Client;
 
+/** A contiguous array used to hold the data from a single spill. Owned buffers grow
+  * geometrically when a larger spill is encountered (up to a fixed limit), so that
+  * the largest spill in a file sets the size of the buffer. A SpillBuffer may also
+  * wrap a fixed size array owned by the caller, in which case it will not grow.
+  */
+class SpillBuffer{
+  private:
+	unsigned int *data; /// Pointer to the spill data.
+	unsigned int size; /// Current size of the data array (in 4 byte words).
+	unsigned int limit; /// Maximum size the data array is allowed to grow to (in 4 byte words).
+	unsigned int numGrow; /// Number of times the data array was re-allocated.
+	bool owner; /// Set to true if the data array is owned (and may be re-allocated) by this object.
+
+  public:
+	/// Construct an owned buffer with an initial size (in words).
+	SpillBuffer(const unsigned int &size_=0, const unsigned int &limit_=SPILL_BUFFER_LIMIT);
+
+	/// Wrap a fixed size array owned by the caller.
+	SpillBuffer(unsigned int *data_, const unsigned int &size_);
+
+	/// Destructor.
+	~SpillBuffer();
+
+	/// Return a pointer to the spill data. The pointer is invalidated by any call to Reserve.
+	unsigned int *GetData(){ return data; }
+
+	/// Return the current size of the data array (in words).
+	unsigned int GetSize() const { return size; }
+
+	/// Return the maximum size of the data array (in words).
+	unsigned int GetLimit() const { return limit; }
+
+	/// Return the number of times the data array was re-allocated.
+	unsigned int GetNumGrow() const { return numGrow; }
+
+	/** Make sure the data array can hold at least nWords_ words. The existing contents
+	  * of the array are preserved. Returns false if the requested size is larger than
+	  * the buffer limit or if the array is not owned by this object.
+	  */
+	bool Reserve(const unsigned int &nWords_);
+};
+
+/** A bounded free-list of SpillBuffers. Buffers are recycled rather than re-allocated
+  * for each spill, and at most maxBuffers buffers are ever allocated. The free-list is
+  * locked so that the pool may be used from more than one thread, but the scan currently
+  * only takes and returns buffers on the thread which reads and unpacks the spills.
+  */
+class SpillBufferPool{
+  private:
+	std::vector<SpillBuffer*> buffers; /// All buffers allocated by the pool.
+	std::vector<SpillBuffer*> freeList; /// Buffers which are not currently in use.
+
+	size_t maxBuffers; /// Maximum number of buffers allocated by the pool.
+	unsigned int initialSize; /// Initial size of newly allocated buffers (in words).
+	unsigned int limit; /// Maximum size of a single buffer (in words).
+	unsigned int highWater; /// Largest buffer size requested from the pool (in words).
+
+	std::mutex pool_mutex; /// Mutex protecting the free-list.
+	std::condition_variable buffer_free; /// Signalled when a buffer is returned to the free-list.
+
+  public:
+	/// Constructor.
+	SpillBufferPool(const size_t &maxBuffers_=2, const unsigned int &limit_=SPILL_BUFFER_LIMIT);
+
+	/// Destructor.
+	~SpillBufferPool();
+
+	/** Get a buffer which is able to hold at least nWords_ words. If no buffer is free and the
+	  * maximum number of buffers has already been allocated, wait until one is released.
+	  * Returns NULL if a buffer of the requested size may not be allocated.
+	  */
+	SpillBuffer *Get(const unsigned int &nWords_=0);
+
+	/// Return a buffer to the free-list.
+	void Release(SpillBuffer *buffer_);
+
+	/// Set the initial size of new buffers (in words), e.g. from PLD_header::GetMaxSpillSize.
+	void SetInitialSize(const unsigned int &nWords_);
+
+	/// Set the maximum number of buffers. May not be smaller than the number already allocated.
+	void SetMaxBuffers(const size_t &maxBuffers_);
+
+	/// Return the number of buffers allocated by the pool.
+	size_t GetNumBuffers();
+
+	/// Return the largest buffer size requested from the pool (in words).
+	unsigned int GetHighWater();
+
+	/// Return the total memory allocated by the pool (in words).
+	unsigned long GetTotalSize();
+
+	/// Print the size and usage of the pool.
+	void Print(const std::string &prefix_="");
+};
+
 class BufferType{
   protected:
 	unsigned int bufftype;
@@ -152,6 +251,10 @@ class PLD_data : public BufferType{
 	/// Read a data spill from a file
 	virtual bool Read(std::ifstream *file_, char *data_, unsigned int &nBytes, unsigned int max_bytes_, bool dry_run_mode=false);
 
+	/** Read a data spill from a file into a growable buffer. The buffer is enlarged to hold the entire
+	  * spill. Returns false if the spill could not be read or if it is larger than the buffer limit. */
+	virtual bool Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nBytes, bool dry_run_mode=false);
+
 	/// Set initial values.
 	virtual void Reset(){ }
 };
@@ -260,6 +363,8 @@ class DATA_buffer : public BufferType{
 
 	unsigned int buff_pos; /// The actual position in the current ldf buffer.
 
+	std::streampos buff_offset; /// Offset of the current ldf buffer from the start of the file (in bytes).
+
 	/// DATA buffer (1 word buffer type, 1 word buffer size)
 	bool open_(std::ofstream *file_);
 
@@ -284,6 +389,7 @@ class DATA_buffer : public BufferType{
 	  *  4 - Encountered invalid spill chunk
 	  *  5 - Received bad spill footer size
 	  *  6 - Failed to read buffer from file
+	  *  7 - Spill is larger than the output buffer
 	  */
 	int GetRetval(){ return retval; }
 	
@@ -299,6 +405,28 @@ class DATA_buffer : public BufferType{
 	/// Read a data spill from a file
 	virtual bool Read(std::ifstream *file_, char *data_, unsigned int &nBytes_, unsigned int max_bytes_, bool &full_spill, bool &bad_spill, bool dry_run_mode=false);
 
+	/** Read a data spill from a file into a growable buffer. The buffer is enlarged as spill chunks are
+	  * read so that the spill is never truncated. */
+	virtual bool Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nBytes_, bool &full_spill, bool &bad_spill, bool dry_run_mode=false);
+
+	/** Get the position of the next spill chunk to be read. Unlike the position of the input file,
+	  * which is always at the end of a buffer, this position may be used to resume reading
+	  * from a spill which starts in the middle of a buffer.
+	  * \param[out] offset_ Offset of the current ldf buffer from the start of the file (in bytes).
+	  * \param[out] word_ Position of the next word in the current ldf buffer.
+	  * \return True if at least one buffer has been read and false otherwise.
+	  */
+	bool GetPosition(std::streampos &offset_, unsigned int &word_);
+
+	/** Resume reading at a position returned by GetPosition(). The reader is reset before
+	  * the buffer is read.
+	  * \param[in]  file_ Pointer to the input file.
+	  * \param[in]  offset_ Offset of the ldf buffer from the start of the file (in bytes).
+	  * \param[in]  word_ Position of the next word in the ldf buffer.
+	  * \return True if the buffer was read successfully and false otherwise.
+	  */
+	bool SetPosition(std::ifstream *file_, const std::streampos &offset_, const unsigned int &word_);
+
 	/// Set initial values.
 	virtual void Reset();
 };
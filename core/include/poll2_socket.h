@@ -20,6 +20,8 @@
 #define POLL2_SOCKET_VERSION "1.1.01"
 #define POLL2_SOCKET_DATE "May 11th, 2015"
 
+struct mmsghdr;
+
 class Server{
   private:
 	int sock, length, n;
@@ -52,6 +54,16 @@ class Server{
 
 	bool Select(int &retval);
 
+	/** Wait for up to timeout_ milliseconds for the socket to become readable, and then receive
+	  * as many as count_ messages with a single system call (recvmmsg). The length of
+	  * each received message is stored in the msg_len field of its header. Returns the number of
+	  * messages received, zero on timeout, or -1 if the receive fails or if the object was not initialized. */
+	int RecvMessages(struct mmsghdr *msgs_, const unsigned int &count_, const int &timeout_);
+
+	/** Request a kernel receive buffer of size_ bytes (SO_RCVBUF). The kernel may clamp the
+	  * requested size, so the actual size is returned. Returns -1 on failure. */
+	int SetRecvBufferSize(const int &size_);
+
 	/// Close the socket.
 	void Close();
 };
@@ -0,0 +1,571 @@
+/** \file cld_buffers.cpp
+  *
+  * \brief Handles compact list data (.cld) files
+  *
+  * \author Cory R. Thornsberry
+  *
+  * \date Oct. 19th, 2026
+  *
+  * \version 1.0.00
+*/
+
+#include <iostream>
+#include <string.h>
+
+#include "cld_buffers.h"
+#include "hribf_buffers.h"
+
+#define CLD_FILE_MAGIC 0x46444C43 // "CLDF"
+#define CLD_SPILL_MAGIC 0x4C495053 // "SPIL"
+#define CLD_INDEX_MAGIC 0x58444E49 // "INDX"
+#define CLD_TRAILER_MAGIC 0x45444C43 // "CLDE"
+
+#define CLD_INDEX_ENTRY_LENGTH 32 // Length of a single index entry (in bytes)
+#define CLD_TRAILER_LENGTH 16 // Length of the file trailer (in bytes)
+
+#define CLD_FLAG_COMPRESSED 0x1 // Spill data is compressed
+
+// LZ4 block format constants.
+#define LZ4_MIN_MATCH 4 // Minimum length of a match
+#define LZ4_LAST_LITERALS 5 // The last 5 bytes of a block are always literals
+#define LZ4_MF_LIMIT 12 // A match may not start within the last 12 bytes of a block
+#define LZ4_MAX_OFFSET 65535 // Maximum distance to a match
+#define LZ4_HASH_BITS 14 // Size of the match finder hash table (in bits)
+
+/////////////////////////////////////////////////////////////////////
+// CRC32
+/////////////////////////////////////////////////////////////////////
+
+class CrcTable{
+  public:
+	unsigned int values[256];
+
+	CrcTable(){
+		for(unsigned int i = 0; i < 256; i++){
+			unsigned int crc = i;
+			for(int j = 0; j < 8; j++)
+				crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+			values[i] = crc;
+		}
+	}
+};
+
+unsigned int cld_crc32(const char *data_, const size_t &nBytes_, const unsigned int &crc_/*=0*/){
+	static const CrcTable table; // Built on first use (thread-safe in C++11).
+	const unsigned int *crcTable = table.values;
+	unsigned int crc = ~crc_;
+	const unsigned char *ptr = (const unsigned char *)data_;
+	for(size_t i = 0; i < nBytes_; i++)
+		crc = crcTable[(crc ^ ptr[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/////////////////////////////////////////////////////////////////////
+// LZ4 block compression
+/////////////////////////////////////////////////////////////////////
+
+static inline unsigned int read32(const char *ptr_){
+	unsigned int val;
+	memcpy(&val, ptr_, 4);
+	return val;
+}
+
+static inline unsigned int hash32(const unsigned int &val_){
+	return (val_ * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Write a length which does not fit into the 4 bit token field.
+static inline void writeLength(char *&out_, size_t len_){
+	while(len_ >= 255){
+		*out_++ = (char)255;
+		len_ -= 255;
+	}
+	*out_++ = (char)len_;
+}
+
+// Write a sequence of literals, optionally followed by a match.
+static inline void writeSequence(char *&out_, const char *literals_, const size_t &nLiterals_, const size_t &offset_, const size_t &matchLength_){
+	char *token = out_++;
+	*token = (char)((nLiterals_ >= 15 ? 15 : nLiterals_) << 4);
+	if(nLiterals_ >= 15) writeLength(out_, nLiterals_ - 15);
+	memcpy(out_, literals_, nLiterals_);
+	out_ += nLiterals_;
+
+	if(matchLength_ == 0) return; // The last sequence of a block.
+
+	*out_++ = (char)(offset_ & 0xFF);
+	*out_++ = (char)(offset_ >> 8);
+	size_t len = matchLength_ - LZ4_MIN_MATCH;
+	*token |= (char)(len >= 15 ? 15 : len);
+	if(len >= 15) writeLength(out_, len - 15);
+}
+
+size_t cld_compress(const char *src_, const size_t &srcSize_, std::vector<char> &dest_){
+	dest_.resize(srcSize_ + srcSize_/255 + 16);
+	char *out = dest_.data();
+
+	size_t anchor = 0;
+	if(srcSize_ > LZ4_MF_LIMIT){
+		std::vector<int> table(1 << LZ4_HASH_BITS, -1);
+		const size_t matchLimit = srcSize_ - LZ4_LAST_LITERALS;
+		const size_t mfLimit = srcSize_ - LZ4_MF_LIMIT;
+
+		size_t ip = 0;
+		while(ip < mfLimit){
+			unsigned int seq = read32(&src_[ip]);
+			unsigned int h = hash32(seq);
+			int ref = table[h];
+			table[h] = (int)ip;
+
+			if(ref < 0 || ip - ref > LZ4_MAX_OFFSET || read32(&src_[ref]) != seq){
+				ip += 1 + ((ip - anchor) >> 6); // Skip faster through incompressible data.
+				continue;
+			}
+
+			// Extend the match backwards and forwards.
+			while(ip > anchor && ref > 0 && src_[ip-1] == src_[ref-1]){ ip--; ref--; }
+			size_t length = LZ4_MIN_MATCH;
+			while(ip + length < matchLimit && src_[ref+length] == src_[ip+length]) length++;
+
+			writeSequence(out, &src_[anchor], ip - anchor, ip - ref, length);
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	// The remaining bytes are written as literals.
+	writeSequence(out, &src_[anchor], srcSize_ - anchor, 0, 0);
+
+	dest_.resize(out - dest_.data());
+	return dest_.size();
+}
+
+bool cld_decompress(const char *src_, const size_t &srcSize_, char *dest_, const size_t &destSize_){
+	const unsigned char *ip = (const unsigned char *)src_;
+	const unsigned char *ipEnd = ip + srcSize_;
+	char *op = dest_;
+	char *opEnd = dest_ + destSize_;
+
+	while(ip < ipEnd){
+		unsigned int token = *ip++;
+
+		// Copy the literals.
+		size_t length = token >> 4;
+		if(length == 15){
+			unsigned char byte;
+			do{
+				if(ip >= ipEnd) return false;
+				byte = *ip++;
+				length += byte;
+			} while(byte == 255);
+		}
+		if(length > (size_t)(ipEnd - ip) || length > (size_t)(opEnd - op)) return false;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		if(ip >= ipEnd) break; // The last sequence has no match.
+
+		// Copy the match.
+		if(ipEnd - ip < 2) return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (size_t)(op - dest_)) return false;
+
+		length = token & 0xF;
+		if(length == 15){
+			unsigned char byte;
+			do{
+				if(ip >= ipEnd) return false;
+				byte = *ip++;
+				length += byte;
+			} while(byte == 255);
+		}
+		length += LZ4_MIN_MATCH;
+		if(length > (size_t)(opEnd - op)) return false;
+
+		// A match which overlaps the output must be copied one byte at a time.
+		const char *match = op - offset;
+		if(offset >= length){
+			memcpy(op, match, length);
+			op += length;
+		}
+		else{
+			for(size_t i = 0; i < length; i++) *op++ = *match++;
+		}
+	}
+
+	return (op == opEnd);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Spill timestamps
+/////////////////////////////////////////////////////////////////////
+
+unsigned int cld_get_timestamps(const unsigned int *data_, const unsigned int &nWords_, unsigned long long &first_, unsigned long long &last_){
+	unsigned int numEvents = 0;
+	first_ = 0;
+	last_ = 0;
+
+	unsigned int index = 0;
+	while(index + 1 < nWords_){
+		unsigned int lenRec = data_[index];
+		unsigned int vsn = data_[index+1];
+
+		if(lenRec < 2 || index + lenRec > nWords_) break; // Bad module length.
+		if(vsn == 9999) break; // End of spill.
+
+		// Loop over the events in this module.
+		unsigned int evt = index + 2;
+		unsigned int modEnd = index + lenRec;
+		while(evt + 2 < modEnd){
+			unsigned int eventLength = (data_[evt] & 0x1FFE0000) >> 17;
+			if(eventLength < 4 || evt + eventLength > modEnd) break;
+
+			unsigned long long time = ((unsigned long long)(data_[evt+2] & 0x0000FFFF) << 32) + data_[evt+1];
+			if(numEvents == 0 || time < first_) first_ = time;
+			if(numEvents == 0 || time > last_) last_ = time;
+			numEvents++;
+
+			evt += eventLength;
+		}
+
+		index += lenRec;
+	}
+
+	return numEvents;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLD_header
+/////////////////////////////////////////////////////////////////////
+
+std::string CLD_header::GetCompressionName(){
+	if(compression == CLD_NONE) return "none";
+	else if(compression == CLD_LZ4) return "lz4";
+	return "unknown";
+}
+
+bool CLD_header::Write(std::ofstream *file_, PLD_header *head_){
+	if(!file_ || !file_->is_open() || !file_->good() || !head_){ return false; }
+
+	unsigned int magic = CLD_FILE_MAGIC;
+	unsigned short vers = version;
+	unsigned short comp = compression;
+	file_->write((char*)&magic, 4);
+	file_->write((char*)&vers, 2);
+	file_->write((char*)&comp, 2);
+
+	return head_->Write(file_);
+}
+
+bool CLD_header::Read(std::ifstream *file_, PLD_header *head_){
+	if(!file_ || !file_->is_open() || !file_->good() || !head_){ return false; }
+
+	unsigned int magic;
+	unsigned short vers, comp;
+	file_->read((char*)&magic, 4);
+	file_->read((char*)&vers, 2);
+	file_->read((char*)&comp, 2);
+
+	if(file_->eof() || magic != CLD_FILE_MAGIC) return false;
+	if(vers > CLD_FORMAT_VERSION){
+		std::cout << " CLD_header: Unsupported file format version (" << vers << ").\n";
+		return false;
+	}
+
+	version = vers;
+	compression = comp;
+
+	return head_->Read(file_);
+}
+
+void CLD_header::OverwriteValues(std::ofstream *file_, PLD_header *head_){
+	if(!file_ || !file_->is_open() || !file_->good() || !head_){ return; }
+
+	unsigned int max_spill_size = head_->GetMaxSpillSize();
+	float run_time = head_->GetRunTime();
+
+	// Skip the file header, the HEAD buffer type and the run number.
+	file_->seekp(16, std::ios::beg);
+	file_->write((char *)&max_spill_size, 4);
+	file_->write((char *)&run_time, 4);
+
+	// Seek back to the end of the file.
+	file_->seekp(0, std::ios::end);
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLD_index
+/////////////////////////////////////////////////////////////////////
+
+unsigned long long CLD_index::GetTotalWords() const {
+	unsigned long long total = 0;
+	for(std::vector<CLD_index_entry>::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+		total += iter->nWords;
+	return total;
+}
+
+unsigned long long CLD_index::FindSpill(const unsigned long long &offset_) const {
+	if(entries.empty()) return offset_;
+
+	// Binary search for the last spill starting at or before the offset.
+	size_t low = 0, high = entries.size();
+	while(high - low > 1){
+		size_t mid = (low + high) / 2;
+		if(entries[mid].offset <= offset_) low = mid;
+		else high = mid;
+	}
+
+	return entries[low].offset;
+}
+
+size_t CLD_index::FindTime(const unsigned long long &time_) const {
+	for(size_t i = 0; i < entries.size(); i++){
+		if(entries[i].lastTime >= time_) return i;
+	}
+	return entries.size();
+}
+
+bool CLD_index::Write(std::ofstream *file_){
+	if(!file_ || !file_->is_open() || !file_->good()){ return false; }
+
+	unsigned long long indexOffset = file_->tellp();
+	unsigned int magic = CLD_INDEX_MAGIC;
+	unsigned int numSpills = entries.size();
+	file_->write((char*)&magic, 4);
+	file_->write((char*)&numSpills, 4);
+
+	char entry[CLD_INDEX_ENTRY_LENGTH];
+	unsigned int crc = 0;
+	for(std::vector<CLD_index_entry>::iterator iter = entries.begin(); iter != entries.end(); iter++){
+		memcpy(&entry[0], &iter->offset, 8);
+		memcpy(&entry[8], &iter->firstTime, 8);
+		memcpy(&entry[16], &iter->lastTime, 8);
+		memcpy(&entry[24], &iter->nWords, 4);
+		memcpy(&entry[28], &iter->nBytes, 4);
+		crc = cld_crc32(entry, CLD_INDEX_ENTRY_LENGTH, crc);
+		file_->write(entry, CLD_INDEX_ENTRY_LENGTH);
+	}
+
+	// Write the file trailer.
+	magic = CLD_TRAILER_MAGIC;
+	file_->write((char*)&indexOffset, 8);
+	file_->write((char*)&crc, 4);
+	file_->write((char*)&magic, 4);
+
+	return file_->good();
+}
+
+bool CLD_index::Read(std::ifstream *file_){
+	if(!file_ || !file_->is_open()){ return false; }
+
+	entries.clear();
+
+	file_->clear();
+	std::streampos position = file_->tellg();
+
+	// Read the file trailer.
+	file_->seekg(0, std::ios::end);
+	unsigned long long fileLength = file_->tellg();
+	if(fileLength < CLD_TRAILER_LENGTH){
+		file_->seekg(position);
+		return false;
+	}
+
+	unsigned long long indexOffset;
+	unsigned int crc, magic;
+	file_->seekg(fileLength - CLD_TRAILER_LENGTH, std::ios::beg);
+	file_->read((char*)&indexOffset, 8);
+	file_->read((char*)&crc, 4);
+	file_->read((char*)&magic, 4);
+
+	bool retval = false;
+	if(magic == CLD_TRAILER_MAGIC && indexOffset + 8 <= fileLength - CLD_TRAILER_LENGTH){
+		unsigned int numSpills;
+		file_->seekg(indexOffset, std::ios::beg);
+		file_->read((char*)&magic, 4);
+		file_->read((char*)&numSpills, 4);
+
+		if(magic == CLD_INDEX_MAGIC && indexOffset + 8 + (unsigned long long)numSpills * CLD_INDEX_ENTRY_LENGTH + CLD_TRAILER_LENGTH == fileLength){
+			char entry[CLD_INDEX_ENTRY_LENGTH];
+			CLD_index_entry spill;
+			unsigned int check = 0;
+			entries.reserve(numSpills);
+			for(unsigned int i = 0; i < numSpills; i++){
+				file_->read(entry, CLD_INDEX_ENTRY_LENGTH);
+				check = cld_crc32(entry, CLD_INDEX_ENTRY_LENGTH, check);
+				memcpy(&spill.offset, &entry[0], 8);
+				memcpy(&spill.firstTime, &entry[8], 8);
+				memcpy(&spill.lastTime, &entry[16], 8);
+				memcpy(&spill.nWords, &entry[24], 4);
+				memcpy(&spill.nBytes, &entry[28], 4);
+				entries.push_back(spill);
+			}
+			retval = (file_->good() && check == crc);
+		}
+	}
+
+	if(!retval) entries.clear();
+
+	// Return to the original position.
+	file_->clear();
+	file_->seekg(position);
+
+	return retval;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLD_data
+/////////////////////////////////////////////////////////////////////
+
+bool CLD_data::Write(std::ofstream *file_, unsigned int *data_, const unsigned int &nWords_, const unsigned int &compression_/*=CLD_NONE*/){
+	if(!file_ || !file_->is_open() || !file_->good() || !data_ || nWords_ == 0){ return false; }
+
+	CLD_index_entry entry;
+	entry.offset = file_->tellp();
+	entry.nWords = nWords_;
+	cld_get_timestamps(data_, nWords_, entry.firstTime, entry.lastTime);
+
+	const char *payload = (const char *)data_;
+	unsigned int nBytes = nWords_ * 4;
+	unsigned int crc = cld_crc32(payload, nBytes);
+
+	// Only store the compressed spill if it is actually smaller.
+	unsigned int flags = 0;
+	if(compression_ == CLD_LZ4 && cld_compress(payload, nBytes, scratch) < nBytes){
+		payload = scratch.data();
+		nBytes = scratch.size();
+		flags |= CLD_FLAG_COMPRESSED;
+	}
+	entry.nBytes = nBytes;
+
+	unsigned int magic = CLD_SPILL_MAGIC;
+	unsigned int reserved = 0;
+	file_->write((char*)&magic, 4);
+	file_->write((char*)&flags, 4);
+	file_->write((char*)&entry.nWords, 4);
+	file_->write((char*)&nBytes, 4);
+	file_->write((char*)&crc, 4);
+	file_->write((char*)&reserved, 4);
+	file_->write((char*)&entry.firstTime, 8);
+	file_->write((char*)&entry.lastTime, 8);
+	file_->write(payload, nBytes);
+
+	// Pad the spill to a whole number of words.
+	const char padding[4] = {0, 0, 0, 0};
+	if(nBytes % 4 != 0) file_->write(padding, 4 - nBytes % 4);
+
+	if(debug_mode){ std::cout << "debug: writing spill of " << nWords_ << " words (" << nBytes << " bytes stored)\n"; }
+
+	index.Add(entry);
+
+	return file_->good();
+}
+
+bool CLD_data::Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nWords_, bool dry_run_mode/*=false*/){
+	retval = 0;
+	nWords_ = 0;
+
+	if(!file_ || !file_->is_open() || !file_->good() || !buffer_){
+		retval = 2;
+		return false;
+	}
+
+	// Search for the next spill header. This will only be required if the file is damaged.
+	unsigned int magic;
+	file_->read((char*)&magic, 4);
+	if(magic != CLD_SPILL_MAGIC){
+		while(file_->good()){
+			if(magic == CLD_INDEX_MAGIC){ // Reached the spill index.
+				retval = 1;
+				return false;
+			}
+			if(magic == CLD_SPILL_MAGIC) break;
+			file_->read((char*)&magic, 4);
+		}
+		if(!file_->good()){
+			retval = (file_->eof() ? 1 : 2);
+			return false;
+		}
+		if(debug_mode){ std::cout << "debug: found spill header after searching file\n"; }
+		numResync++;
+	}
+
+	unsigned int flags, nWords, nBytes, crc, reserved;
+	unsigned long long firstTime, lastTime;
+	file_->read((char*)&flags, 4);
+	file_->read((char*)&nWords, 4);
+	file_->read((char*)&nBytes, 4);
+	file_->read((char*)&crc, 4);
+	file_->read((char*)&reserved, 4);
+	file_->read((char*)&firstTime, 8);
+	file_->read((char*)&lastTime, 8);
+
+	if(!file_->good()){
+		retval = 2;
+		return false;
+	}
+
+	unsigned int padding = (nBytes % 4 != 0 ? 4 - nBytes % 4 : 0);
+
+	if(dry_run_mode){ // Skip the spill.
+		file_->seekg(nBytes + padding, std::ios::cur);
+		nWords_ = nWords;
+		return true;
+	}
+
+	if(!buffer_->Reserve(nWords)){
+		if(debug_mode){ std::cout << "debug: spill of " << nWords << " words is larger than the buffer limit\n"; }
+		file_->seekg(nBytes + padding, std::ios::cur);
+		retval = 5;
+		return false;
+	}
+
+	char *dest = (char *)buffer_->GetData();
+	if(flags & CLD_FLAG_COMPRESSED){
+		scratch.resize(nBytes);
+		file_->read(scratch.data(), nBytes);
+		if(!file_->good()){
+			retval = 2;
+			return false;
+		}
+		if(!cld_decompress(scratch.data(), nBytes, dest, nWords * 4)){
+			if(debug_mode){ std::cout << "debug: failed to decompress spill\n"; }
+			file_->seekg(padding, std::ios::cur);
+			retval = 4;
+			return false;
+		}
+	}
+	else{
+		if(nBytes != nWords * 4){
+			file_->seekg(nBytes + padding, std::ios::cur);
+			retval = 4;
+			return false;
+		}
+		file_->read(dest, nBytes);
+		if(!file_->good()){
+			retval = 2;
+			return false;
+		}
+	}
+	file_->seekg(padding, std::ios::cur);
+
+	if(cld_crc32(dest, nWords * 4) != crc){
+		if(debug_mode){ std::cout << "debug: spill failed CRC check\n"; }
+		numCrcErrors++;
+		retval = 3;
+		return false;
+	}
+
+	nWords_ = nWords;
+
+	return true;
+}
+
+void CLD_data::Reset(){
+	index.Clear();
+	numCrcErrors = 0;
+	numResync = 0;
+	retval = 0;
+}
@@ -0,0 +1,283 @@
+/** \file hist_snapshot.cpp
+  *
+  * \brief Binary snapshots of online histograms
+  *
+  * \author Cory R. Thornsberry
+  *
+  * \date Oct. 19th, 2026
+  *
+  * \version 1.0.00
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "hist_snapshot.h"
+
+/////////////////////////////////////////////////////////////////////
+// Encoding helpers
+/////////////////////////////////////////////////////////////////////
+
+static void writeVarint(std::string &frame_, uint64_t val_){
+	while(val_ >= 0x80){
+		frame_.push_back((char)((val_ & 0x7F) | 0x80));
+		val_ >>= 7;
+	}
+	frame_.push_back((char)val_);
+}
+
+static void writeSigned(std::string &frame_, const int64_t &val_){
+	writeVarint(frame_, ((uint64_t)val_ << 1) ^ (uint64_t)(val_ >> 63));
+}
+
+static void writeDouble(std::string &frame_, const double &val_){
+	frame_.append((const char*)&val_, sizeof(double));
+}
+
+static void writeString(std::string &frame_, const std::string &str_){
+	writeVarint(frame_, str_.length());
+	frame_.append(str_);
+}
+
+/** Write the change of a single cell. Integral changes are written as a zig-zag
+  * encoded integer. Any other value is written in full.
+  */
+static void writeCell(std::string &frame_, const double &prev_, const double &curr_){
+	double diff = curr_ - prev_;
+	if(diff == floor(diff) && fabs(diff) < 4.5E15){
+		int64_t idiff = (int64_t)diff;
+		writeVarint(frame_, ((((uint64_t)idiff << 1) ^ (uint64_t)(idiff >> 63)) << 1));
+	}
+	else{
+		writeVarint(frame_, 1);
+		writeDouble(frame_, curr_);
+	}
+}
+
+/** Write all cells which differ between two arrays of bin contents.
+  * \return The number of cells written.
+  */
+static size_t writeCells(std::string &frame_, const double *prev_, const std::vector<double> &curr_){
+	// Count the changed cells first, since the count precedes the cells.
+	size_t nChanged = 0;
+	for(size_t i = 0; i < curr_.size(); i++){
+		if(curr_[i] != (prev_ ? prev_[i] : 0)) nChanged++;
+	}
+	writeVarint(frame_, nChanged);
+
+	size_t last = 0;
+	for(size_t i = 0; i < curr_.size(); i++){
+		double prev = (prev_ ? prev_[i] : 0);
+		if(curr_[i] == prev) continue;
+		writeVarint(frame_, i - last); // Offset from the previous changed cell.
+		writeCell(frame_, prev, curr_[i]);
+		last = i;
+	}
+	return nChanged;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Decoding helpers
+/////////////////////////////////////////////////////////////////////
+
+static bool readVarint(const char *&ptr_, const char *end_, uint64_t &val_){
+	val_ = 0;
+	for(int shift = 0; shift < 64; shift += 7){
+		if(ptr_ >= end_) return false;
+		unsigned char byte = (unsigned char)(*ptr_++);
+		val_ |= (uint64_t)(byte & 0x7F) << shift;
+		if(!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+static bool readSigned(const char *&ptr_, const char *end_, int64_t &val_){
+	uint64_t zz;
+	if(!readVarint(ptr_, end_, zz)) return false;
+	val_ = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 0x1);
+	return true;
+}
+
+static bool readDouble(const char *&ptr_, const char *end_, double &val_){
+	if(end_ - ptr_ < (long)sizeof(double)) return false;
+	memcpy(&val_, ptr_, sizeof(double));
+	ptr_ += sizeof(double);
+	return true;
+}
+
+static bool readString(const char *&ptr_, const char *end_, std::string &str_){
+	uint64_t len;
+	if(!readVarint(ptr_, end_, len) || len > (uint64_t)(end_ - ptr_)) return false;
+	str_.assign(ptr_, len);
+	ptr_ += len;
+	return true;
+}
+
+static bool readCells(const char *&ptr_, const char *end_, std::vector<double> &contents_){
+	uint64_t nChanged, offset, token;
+	if(!readVarint(ptr_, end_, nChanged) || nChanged > contents_.size()) return false;
+	size_t cell = 0;
+	for(uint64_t i = 0; i < nChanged; i++){
+		if(!readVarint(ptr_, end_, offset) || !readVarint(ptr_, end_, token)) return false;
+		cell += offset;
+		if(cell >= contents_.size()) return false;
+		if(token & 0x1){ // The full value of the cell.
+			if(!readDouble(ptr_, end_, contents_[cell])) return false;
+		}
+		else{ // An integral change of the cell.
+			token >>= 1;
+			contents_[cell] += (double)((int64_t)(token >> 1) ^ -(int64_t)(token & 0x1));
+		}
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// class HistFrameHeader
+/////////////////////////////////////////////////////////////////////
+
+bool HistFrameHeader::Read(const char *data_){
+	memcpy(&magic, &data_[0], 4);
+	memcpy(&version, &data_[4], 2);
+	memcpy(&type, &data_[6], 2);
+	memcpy(&sequence, &data_[8], 4);
+	memcpy(&length, &data_[12], 4);
+	return (magic == HIST_FRAME_MAGIC && version == HIST_FRAME_VERSION && length <= HIST_FRAME_MAX_LENGTH);
+}
+
+void HistFrameHeader::Write(char *data_) const {
+	memcpy(&data_[0], &magic, 4);
+	memcpy(&data_[4], &version, 2);
+	memcpy(&data_[6], &type, 2);
+	memcpy(&data_[8], &sequence, 4);
+	memcpy(&data_[12], &length, 4);
+}
+
+/////////////////////////////////////////////////////////////////////
+// class HistSnapshot
+/////////////////////////////////////////////////////////////////////
+
+size_t HistSnapshot::Add(const HistInfo &info_){
+	info.push_back(info_);
+	contents.push_back(std::vector<double>(info_.GetNumCells(), 0));
+	entries.push_back(0);
+	return info.size()-1;
+}
+
+int HistSnapshot::Find(const std::string &name_) const {
+	for(size_t i = 0; i < info.size(); i++){
+		if(info[i].name == name_) return (int)i;
+	}
+	return -1;
+}
+
+void HistSnapshot::Clear(){
+	info.clear();
+	contents.clear();
+	entries.clear();
+}
+
+void HistSnapshot::EncodeKeyframe(std::string &frame_) const {
+	HistFrameHeader header;
+	header.type = HIST_KEYFRAME;
+	header.sequence = sequence;
+
+	frame_.assign(HistFrameHeader::GetSize(), 0);
+	writeVarint(frame_, info.size());
+	for(size_t i = 0; i < info.size(); i++){
+		const HistInfo &hist = info[i];
+		writeString(frame_, hist.name);
+		writeString(frame_, hist.title);
+		writeString(frame_, hist.xtitle);
+		writeString(frame_, hist.ytitle);
+		writeString(frame_, hist.opt);
+		writeSigned(frame_, hist.location);
+		writeVarint(frame_, hist.dim);
+		writeVarint(frame_, hist.xbins);
+		writeDouble(frame_, hist.xmin);
+		writeDouble(frame_, hist.xmax);
+		writeVarint(frame_, hist.ybins);
+		writeDouble(frame_, hist.ymin);
+		writeDouble(frame_, hist.ymax);
+		writeDouble(frame_, entries[i]);
+		writeCells(frame_, NULL, contents[i]);
+	}
+
+	header.length = frame_.length() - HistFrameHeader::GetSize();
+	header.Write(&frame_[0]);
+}
+
+size_t HistSnapshot::EncodeDelta(const HistSnapshot &prev_, std::string &frame_) const {
+	HistFrameHeader header;
+	header.type = HIST_DELTA;
+	header.sequence = sequence;
+
+	// Find the histograms which have changed.
+	std::vector<size_t> changed;
+	for(size_t i = 0; i < info.size() && i < prev_.info.size(); i++){
+		if(entries[i] != prev_.entries[i] || contents[i] != prev_.contents[i])
+			changed.push_back(i);
+	}
+
+	frame_.assign(HistFrameHeader::GetSize(), 0);
+	writeVarint(frame_, changed.size());
+	for(std::vector<size_t>::iterator iter = changed.begin(); iter != changed.end(); iter++){
+		writeVarint(frame_, *iter);
+		writeDouble(frame_, entries[*iter]);
+		writeCells(frame_, prev_.contents[*iter].data(), contents[*iter]);
+	}
+
+	header.length = frame_.length() - HistFrameHeader::GetSize();
+	header.Write(&frame_[0]);
+
+	return changed.size();
+}
+
+bool HistSnapshot::Decode(const HistFrameHeader &header_, const char *payload_, std::vector<bool> &changed_){
+	const char *ptr = payload_;
+	const char *end = payload_ + header_.length;
+
+	uint64_t nHists;
+	if(!readVarint(ptr, end, nHists)) return false;
+
+	if(header_.type == HIST_KEYFRAME){
+		Clear();
+		uint64_t numCells = 0;
+		for(uint64_t i = 0; i < nHists; i++){
+			HistInfo hist;
+			int64_t location;
+			uint64_t dim, xbins, ybins;
+			if(!readString(ptr, end, hist.name) || !readString(ptr, end, hist.title) || !readString(ptr, end, hist.xtitle) ||
+			   !readString(ptr, end, hist.ytitle) || !readString(ptr, end, hist.opt) || !readSigned(ptr, end, location) ||
+			   !readVarint(ptr, end, dim) || !readVarint(ptr, end, xbins) || !readDouble(ptr, end, hist.xmin) || !readDouble(ptr, end, hist.xmax) ||
+			   !readVarint(ptr, end, ybins) || !readDouble(ptr, end, hist.ymin) || !readDouble(ptr, end, hist.ymax)) return false;
+			if((dim != 1 && dim != 2) || xbins > 16777216 || ybins > 16777216) return false;
+
+			// Empty cells are not stored in the payload, so the number of cells is checked (in 64-bit)
+			// against the largest snapshot which could be sent before the contents are allocated.
+			numCells += (xbins+2)*(dim == 2 ? ybins+2 : 1);
+			if(numCells > HIST_SNAPSHOT_MAX_CELLS) return false;
+			hist.location = location;
+			hist.dim = dim;
+			hist.xbins = xbins;
+			hist.ybins = ybins;
+			size_t index = Add(hist);
+			if(!readDouble(ptr, end, entries[index]) || !readCells(ptr, end, contents[index])) return false;
+		}
+		changed_.assign(info.size(), true);
+	}
+	else if(header_.type == HIST_DELTA){
+		changed_.assign(info.size(), false);
+		uint64_t index;
+		for(uint64_t i = 0; i < nHists; i++){
+			if(!readVarint(ptr, end, index) || index >= info.size()) return false;
+			if(!readDouble(ptr, end, entries[index]) || !readCells(ptr, end, contents[index])) return false;
+			changed_[index] = true;
+		}
+	}
+	else return false;
+
+	sequence = header_.sequence;
+
+	return (ptr == end);
+}
@@ -64,6 +64,163 @@ bool is_hribf_buffer(const unsigned int &input_){
 	return (input_==HEAD || input_==DATA || input_==SCAL || input_==DEAD || input_==DIR || input_==PAC || input_==ENDFILE);
 }
 
+/** Construct an owned buffer with an initial size.
+  * \param[in]  size_ Initial size of the data array (in words).
+  * \param[in]  limit_ Maximum size the data array is allowed to grow to (in words).
+  */
+SpillBuffer::SpillBuffer(const unsigned int &size_/*=0*/, const unsigned int &limit_/*=SPILL_BUFFER_LIMIT*/) : data(NULL), size(0), limit(limit_), numGrow(0), owner(true) {
+	if(size_ > 0){
+		size = (size_ < limit ? size_ : limit);
+		data = new unsigned int[size];
+	}
+}
+
+/** Wrap a fixed size array owned by the caller. The array will not be re-allocated or deleted.
+  * \param[in]  data_ Pointer to the array.
+  * \param[in]  size_ Size of the array (in words).
+  */
+SpillBuffer::SpillBuffer(unsigned int *data_, const unsigned int &size_) : data(data_), size(size_), limit(size_), numGrow(0), owner(false) { }
+
+SpillBuffer::~SpillBuffer(){
+	if(owner && data){ delete[] data; }
+}
+
+/** Make sure the data array can hold at least nWords_ words. The array size is doubled
+  * until it is large enough (but never beyond the buffer limit).
+  * \param[in]  nWords_ The required size of the data array (in words).
+  * \return True if the array is large enough and false otherwise.
+  */
+bool SpillBuffer::Reserve(const unsigned int &nWords_){
+	if(nWords_ <= size){ return true; }
+	if(!owner || nWords_ > limit){ return false; }
+
+	unsigned long newSize = (size > 0 ? size : 1024);
+	while(newSize < nWords_){ newSize *= 2; }
+	if(newSize > limit){ newSize = limit; }
+
+	unsigned int *newData = new unsigned int[newSize];
+	if(data){
+		memcpy(newData, data, 4*size);
+		delete[] data;
+	}
+	data = newData;
+	size = newSize;
+	numGrow++;
+
+	return true;
+}
+
+/** Constructor.
+  * \param[in]  maxBuffers_ Maximum number of buffers allocated by the pool.
+  * \param[in]  limit_ Maximum size of a single buffer (in words).
+  */
+SpillBufferPool::SpillBufferPool(const size_t &maxBuffers_/*=2*/, const unsigned int &limit_/*=SPILL_BUFFER_LIMIT*/) : maxBuffers(maxBuffers_ > 0 ? maxBuffers_ : 1), initialSize(0), limit(limit_), highWater(0) { }
+
+SpillBufferPool::~SpillBufferPool(){
+	for(std::vector<SpillBuffer*>::iterator iter = buffers.begin(); iter != buffers.end(); iter++){
+		delete (*iter);
+	}
+}
+
+/** Get a buffer which is able to hold at least nWords_ words.
+  * \param[in]  nWords_ The required size of the buffer (in words).
+  * \return A pointer to the buffer, or NULL if the requested size is larger than the buffer limit.
+  */
+SpillBuffer *SpillBufferPool::Get(const unsigned int &nWords_/*=0*/){
+	unsigned int required = (nWords_ > initialSize ? nWords_ : initialSize);
+	if(required > limit){ return NULL; }
+
+	SpillBuffer *buffer = NULL;
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		if(freeList.empty() && buffers.size() < maxBuffers){ // Allocate a new buffer.
+			buffer = new SpillBuffer(required, limit);
+			buffers.push_back(buffer);
+		}
+		else{ // Wait for a buffer to be released.
+			while(freeList.empty()){ buffer_free.wait(lock); }
+			buffer = freeList.back();
+			freeList.pop_back();
+		}
+	}
+
+	buffer->Reserve(required);
+
+	return buffer;
+}
+
+/** Return a buffer to the free-list.
+  * \param[in]  buffer_ Pointer to a buffer returned by Get().
+  * \return Nothing.
+  */
+void SpillBufferPool::Release(SpillBuffer *buffer_){
+	if(!buffer_){ return; }
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		if(buffer_->GetSize() > highWater){ highWater = buffer_->GetSize(); }
+		freeList.push_back(buffer_);
+	}
+	buffer_free.notify_one();
+}
+
+/** Set the initial size of new buffers. Buffers in the free-list are not resized until they are requested.
+  * \param[in]  nWords_ Initial buffer size (in words).
+  * \return Nothing.
+  */
+void SpillBufferPool::SetInitialSize(const unsigned int &nWords_){
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	initialSize = (nWords_ < limit ? nWords_ : limit);
+}
+
+/** Set the maximum number of buffers.
+  * \param[in]  maxBuffers_ Maximum number of buffers allocated by the pool.
+  * \return Nothing.
+  */
+void SpillBufferPool::SetMaxBuffers(const size_t &maxBuffers_){
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	maxBuffers = (maxBuffers_ > buffers.size() ? maxBuffers_ : buffers.size());
+	if(maxBuffers == 0){ maxBuffers = 1; }
+}
+
+size_t SpillBufferPool::GetNumBuffers(){
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	return buffers.size();
+}
+
+unsigned int SpillBufferPool::GetHighWater(){
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	unsigned int retval = highWater;
+	for(std::vector<SpillBuffer*>::iterator iter = buffers.begin(); iter != buffers.end(); iter++){
+		if((*iter)->GetSize() > retval){ retval = (*iter)->GetSize(); }
+	}
+	return retval;
+}
+
+unsigned long SpillBufferPool::GetTotalSize(){
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	unsigned long retval = 0;
+	for(std::vector<SpillBuffer*>::iterator iter = buffers.begin(); iter != buffers.end(); iter++){
+		retval += (*iter)->GetSize();
+	}
+	return retval;
+}
+
+/** Print the size and usage of the pool.
+  * \param[in]  prefix_ String to print at the start of each line.
+  * \return Nothing.
+  */
+void SpillBufferPool::Print(const std::string &prefix_/*=""*/){
+	unsigned int numGrow = 0;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		for(std::vector<SpillBuffer*>::iterator iter = buffers.begin(); iter != buffers.end(); iter++){
+			numGrow += (*iter)->GetNumGrow();
+		}
+	}
+	std::cout << prefix_ << "Spill buffers      - " << GetNumBuffers() << " (" << GetTotalSize()*4/1E6 << " MB, " << numGrow << " resizes)\n";
+	std::cout << prefix_ << "Buffer high-water  - " << GetHighWater() << " words\n";
+}
+
 /// Generic BufferType constructor.
 BufferType::BufferType(unsigned int bufftype_, unsigned int buffsize_, unsigned int buffend_/*=0xFFFFFFFF*/){
 	bufftype = bufftype_; 
@@ -304,6 +461,12 @@ bool PLD_data::Write(std::ofstream *file_, char *data_, unsigned int nWords_){
 
 /// Read a pld style data buffer from file.
 bool PLD_data::Read(std::ifstream *file_, char *data_, unsigned int &nBytes, unsigned int max_bytes_, bool dry_run_mode/*=false*/){
+	SpillBuffer buffer((unsigned int*)data_, max_bytes_/4);
+	return Read(file_, &buffer, nBytes, dry_run_mode);
+}
+
+/// Read a pld style data buffer from file into a growable buffer.
+bool PLD_data::Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nBytes, bool dry_run_mode/*=false*/){
 	if(!file_ || !file_->is_open() || !file_->good()){ return false; }
 
 	unsigned int check_bufftype;	
@@ -329,13 +492,13 @@ bool PLD_data::Read(std::ifstream *file_, char *data_, unsigned int &nBytes, uns
 	
 	if(debug_mode){ std::cout << "debug: reading spill of " << nBytes << " bytes\n"; }
 	
-	if(nBytes > max_bytes_){
-		if(debug_mode){ std::cout << "debug: spill size is greater than size of data array!\n"; }
+	if(!dry_run_mode && !buffer_->Reserve(nBytes/4)){
+		if(debug_mode){ std::cout << "debug: spill size is greater than maximum size of data array (" << 4*buffer_->GetLimit() << " bytes)!\n"; }
 		return false;
 	}
 	
 	unsigned int end_buff_check;
-	if(!dry_run_mode){ file_->read(data_, nBytes); }
+	if(!dry_run_mode){ file_->read((char*)buffer_->GetData(), nBytes); }
 	else{ file_->seekg(nBytes, std::ios::cur); }
 	file_->read((char*)&end_buff_check, 4);
 	
@@ -569,6 +732,7 @@ bool DATA_buffer::read_next_buffer(std::ifstream *f_, bool force_/*=false*/){
 	if(!f_ || !f_->good() || f_->eof()){ return false; }
 
 	if(bcount == 0){
+		buff_offset = f_->tellg();
 		f_->read((char *)buffer1, ACTUAL_BUFF_SIZE*4);
 	}
 	else if(buff_pos + 3 <= ACTUAL_BUFF_SIZE-1 && !force_){
@@ -586,6 +750,10 @@ bool DATA_buffer::read_next_buffer(std::ifstream *f_, bool force_/*=false*/){
 		}
 	}
 	
+	// The buffer which was read ahead is now the current buffer.
+	if(bcount > 0)
+		buff_offset += ACTUAL_BUFF_SIZE*4;
+
 	// Read the buffer into memory.
 	if(bcount % 2 == 0){
 		f_->read((char *)buffer2, ACTUAL_BUFF_SIZE*4);
@@ -620,6 +788,7 @@ DATA_buffer::DATA_buffer() : BufferType(DATA, NO_HEADER_SIZE){ // 0x41544144 "DA
 	good_chunks = 0;
 	missing_chunks = 0;
 	buff_pos = 0;
+	buff_offset = 0;
 }
 
 /// Close a ldf data buffer by padding with 0xFFFFFFFF.
@@ -754,6 +923,12 @@ bool DATA_buffer::Write(std::ofstream *file_, char *data_, unsigned int nWords_,
 
 /// Read a ldf data spill from a file.
 bool DATA_buffer::Read(std::ifstream *file_, char *data_, unsigned int &nBytes, unsigned int max_bytes_, bool &full_spill, bool &bad_spill, bool dry_run_mode/*=false*/){
+	SpillBuffer buffer((unsigned int*)data_, max_bytes_/4);
+	return Read(file_, &buffer, nBytes, full_spill, bad_spill, dry_run_mode);
+}
+
+/// Read a ldf data spill from a file into a growable buffer.
+bool DATA_buffer::Read(std::ifstream *file_, SpillBuffer *buffer_, unsigned int &nBytes, bool &full_spill, bool &bad_spill, bool dry_run_mode/*=false*/){
 	if(!file_ || !file_->is_open() || !file_->good()){ 
 		retval = 6;
 		return false; 
@@ -848,7 +1023,14 @@ bool DATA_buffer::Read(std::ifstream *file_, char *data_, unsigned int &nBytes,
 				}
 			
 				// Copy data into the output array.
-				if(!dry_run_mode){ memcpy(&data_[nBytes], &curr_buffer[buff_pos], 8); }
+				if(!dry_run_mode){
+					if(!buffer_->Reserve((nBytes+8)/4)){
+						if(debug_mode){ std::cout << "debug: spill size is greater than maximum size of data array (" << 4*buffer_->GetLimit() << " bytes)!\n"; }
+						retval = 7;
+						return false;
+					}
+					memcpy(&((char*)buffer_->GetData())[nBytes], &curr_buffer[buff_pos], 8);
+				}
 				if(debug_mode){ std::cout << "debug: spill footer words are " << curr_buffer[buff_pos] << " and " << curr_buffer[buff_pos+1] << std::endl; }
 				nBytes += 8;
 				buff_pos += 2;
@@ -872,7 +1054,14 @@ bool DATA_buffer::Read(std::ifstream *file_, char *data_, unsigned int &nBytes,
 				good_chunks++;
 			
 				copied_bytes = this_chunk_sizeB - 12;
-				if(!dry_run_mode){ memcpy(&data_[nBytes], &curr_buffer[buff_pos], copied_bytes); }
+				if(!dry_run_mode){
+					if(!buffer_->Reserve((nBytes+copied_bytes+3)/4)){
+						if(debug_mode){ std::cout << "debug: spill size is greater than maximum size of data array (" << 4*buffer_->GetLimit() << " bytes)!\n"; }
+						retval = 7;
+						return false;
+					}
+					memcpy(&((char*)buffer_->GetData())[nBytes], &curr_buffer[buff_pos], copied_bytes);
+				}
 				nBytes += copied_bytes;
 				buff_pos += copied_bytes/4;
 			}
@@ -912,10 +1101,32 @@ bool DATA_buffer::Read(std::ifstream *file_, char *data_, unsigned int &nBytes,
 }
 
 /// Set initial values.
+bool DATA_buffer::GetPosition(std::streampos &offset_, unsigned int &word_){
+	if(bcount == 0){ return false; }
+	offset_ = buff_offset;
+	word_ = buff_pos;
+	return true;
+}
+
+bool DATA_buffer::SetPosition(std::ifstream *file_, const std::streampos &offset_, const unsigned int &word_){
+	if(!file_ || !file_->is_open() || word_ > ACTUAL_BUFF_SIZE){ return false; }
+
+	Reset();
+	file_->clear();
+	file_->seekg(offset_, file_->beg);
+	if(!read_next_buffer(file_)){ return false; }
+	
+	if(debug_mode){ std::cout << "debug: resuming at word " << word_ << " of buffer at byte " << offset_ << std::endl; }
+	buff_pos = word_;
+
+	return true;
+}
+
 void DATA_buffer::Reset(){
 	curr_buffer = buffer1;
 	next_buffer = buffer2;
 	buff_pos = 0;
+	buff_offset = 0;
 	bcount = 0;
 	retval = 0;
 	good_chunks = 0;
@@ -1059,7 +1270,7 @@ bool PollOutputFile::overwrite_dir(int total_buffers_/*=-1*/){
 
 /// Initialize the output file with initial parameters
 void PollOutputFile::initialize(){
-	max_spill_size = -9999;
+	max_spill_size = 0;
 	current_file_num = 0; 
 	output_format = 0;
 	number_spills = 0;
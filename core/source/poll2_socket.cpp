@@ -20,6 +20,8 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <stdio.h>
@@ -90,10 +92,51 @@ bool Server::Select(int &retval){
 	return false;
 }
 
+/**
+ *	\param[in,out] msgs_ Array of message headers. The iovecs of each header must point to the receive buffers.
+ *	\param[in] count_ The maximum number of messages to receive.
+ *	\param[in] timeout_ The number of milliseconds to wait for the first message.
+ *	\return The number of messages received, zero on timeout, or -1 on failure.
+ */
+int Server::RecvMessages(struct mmsghdr *msgs_, const unsigned int &count_, const int &timeout_){
+	if(!init){ return -1; }
+
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	int retval = poll(&pfd, 1, timeout_);
+	if(retval <= 0){ return (retval == 0 || errno == EINTR ? 0 : -1); } // Timeout or error.
+
+	// Receive all available messages (up to count_) without blocking.
+	retval = recvmmsg(sock, msgs_, count_, MSG_DONTWAIT, NULL);
+	if(retval < 0){ return ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1); }
+
+	return retval;
+}
+
+/**
+ *	\param[in] size_ The requested size of the kernel receive buffer (in bytes).
+ *	\return The actual size of the receive buffer, or -1 on failure.
+ */
+int Server::SetRecvBufferSize(const int &size_){
+	if(!init){ return -1; }
+
+	if(setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size_, sizeof(size_)) < 0){ return -1; }
+
+	int actual = 0;
+	socklen_t optlen = sizeof(actual);
+	if(getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &optlen) < 0){ return -1; }
+
+	return actual;
+}
+
 void Server::Close(){
 	if(!init){ return; }
 
 	close(sock);
+	init = false;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -0,0 +1,121 @@
+#ifndef COMPACT_HIST_HPP
+#define COMPACT_HIST_HPP
+
+#include <string>
+#include <vector>
+
+class TH1;
+
+/** @class CompactHist2d
+  * @author Cory R. Thornsberry
+  * @date October 19, 2026
+  * @brief A 2d histogram with integer counters which is converted to a root histogram when written
+  *
+  * The bins of each row (y-axis bin) are stored as 32-bit counters and are only
+  * allocated once the first count is added to the row. Large histograms with many
+  * empty rows (e.g. channel vs. energy for a partially used crate) therefore use
+  * only a fraction of the memory of the equivalent root histogram, and filling a
+  * bin is a single increment. The binning (including underflow and overflow bins)
+  * is identical to that of a TH2F with the same axes.
+  */
+class CompactHist2d{
+  public:
+	/** Constructor
+	  * @param name_ Name of the root histogram
+	  * @param title_ Title of the root histogram
+	  * @param xtitle_ Title of the x-axis
+	  * @param xunits_ Unit name used for the x-axis
+	  * @param xbins_ Number of bins along the x-axis
+	  * @param xmin_ Minimum value along the x-axis
+	  * @param xmax_ Maximum value along the x-axis
+	  * @param ytitle_ Title of the y-axis
+	  * @param yunits_ Unit name used for the y-axis
+	  * @param ybins_ Number of bins along the y-axis
+	  * @param ymin_ Minimum value along the y-axis
+	  * @param ymax_ Maximum value along the y-axis
+	  */
+	CompactHist2d(const std::string &name_, const std::string &title_, const std::string &xtitle_, const std::string &xunits_,
+	              const int &xbins_, const double &xmin_, const double &xmax_, const std::string &ytitle_, const std::string &yunits_,
+	              const int &ybins_, const double &ymin_, const double &ymax_);
+
+	/** Destructor
+	  */
+	~CompactHist2d();
+
+	/** Get the name of the histogram
+	  */
+	std::string GetName() const { return name; }
+
+	/** Get the total number of counts added to the histogram (including underflow and overflow)
+	  */
+	double GetEntries() const { return entries; }
+
+	/** Get the number of bytes used by the counters
+	  */
+	size_t GetMemoryUsage() const ;
+
+	/** Add a count to the bin containing (x, y)
+	  * @param x_ Value along the x-axis
+	  * @param y_ Value along the y-axis
+	  */
+	void Fill(const double &x_, const double &y_){
+		std::vector<unsigned int> &row = rows[findBin(y_, ybins, ymin, ymax)];
+		if(row.empty()) row.assign(xbins+2, 0);
+		row[findBin(x_, xbins, xmin, xmax)]++;
+		entries++;
+	}
+
+	/** Add the contents of a root histogram with identical binning to the counters
+	  * @param hist_ Pointer to the root histogram
+	  * @return True if the binning of the histogram matches and false otherwise
+	  */
+	bool Add(const TH1 *hist_);
+
+	/** Copy the counters into a root histogram with identical binning, replacing its contents
+	  * @param hist_ Pointer to the root histogram
+	  * @return True if the binning of the histogram matches and false otherwise
+	  */
+	bool CopyTo(TH1 *hist_) const ;
+
+	/** Zero all counters
+	  */
+	void Zero();
+
+	/** Copy the counters into the root histogram, creating it if necessary
+	  * @return Pointer to the root histogram, which is owned by this object
+	  */
+	TH1 *GetHist();
+
+  private:
+	int xbins; ///< Number of bins along the x-axis
+	int ybins; ///< Number of bins along the y-axis
+
+	double xmin; ///< Minimum value along the x-axis
+	double xmax; ///< Maximum value along the x-axis
+	double ymin; ///< Minimum value along the y-axis
+	double ymax; ///< Maximum value along the y-axis
+
+	double entries; ///< Total number of counts
+
+	std::string name; ///< Name of the root histogram
+	std::string title; ///< Title of the root histogram
+	std::string xtitle; ///< Title of the x-axis
+	std::string ytitle; ///< Title of the y-axis
+	std::string xunits; ///< Unit name used for the x-axis
+	std::string yunits; ///< Unit name used for the y-axis
+
+	std::vector<std::vector<unsigned int> > rows; ///< Counters for each row, including the underflow and overflow rows (empty until filled)
+
+	TH1 *hist; ///< Root histogram used for output
+
+	/** Return the bin containing a value, following the root convention where bin 0 is the underflow
+	  * bin and bin (N+1) is the overflow bin
+	  */
+	static int findBin(const double &val_, const int &bins_, const double &min_, const double &max_){
+		if(!(val_ >= min_)) return 0;
+		if(val_ >= max_) return bins_+1;
+		return 1 + (int)(bins_*(val_-min_)/(max_-min_));
+	}
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef HIST_SERVER_HPP
+#define HIST_SERVER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "hist_snapshot.h"
+
+class Plotter;
+
+class TH1;
+
+/** @class HistClient
+  * @author Cory R. Thornsberry
+  * @date October 19, 2026
+  * @brief A single viewer connected to the histogram server
+  */
+class HistClient{
+  public:
+	int fd; ///< File descriptor of the client socket
+	size_t offset; ///< Number of bytes of the front frame which have already been sent
+	bool needKeyframe; ///< Set to true if the client must be sent a keyframe before any delta frames
+
+	std::deque<std::shared_ptr<const std::string> > queue; ///< Encoded frames waiting to be sent
+
+	/** Default constructor
+	  */
+	HistClient() : fd(-1), offset(0), needKeyframe(true), queue() { }
+
+	/** Socket constructor
+	  */
+	HistClient(const int &fd_) : fd(fd_), offset(0), needKeyframe(true), queue() { }
+};
+
+/** @class HistServer
+  * @author Cory R. Thornsberry
+  * @date October 19, 2026
+  * @brief Publishes snapshots of the online histograms to remote viewers
+  *
+  * Snapshots of the online histograms are taken by the scan thread and encoded
+  * as keyframes (for newly connected viewers) or delta frames (containing only
+  * the bins which changed since the previous snapshot). The frames are sent to
+  * all connected viewers by a separate thread, so that a slow viewer never
+  * blocks the scan. A viewer which falls too far behind has its pending frames
+  * dropped and is sent a new keyframe.
+  */
+class HistServer{
+  public:
+	/** Default constructor
+	  */
+	HistServer();
+
+	/** Destructor
+	  */
+	~HistServer();
+
+	/** Add a histogram (and all of its per-detector sub-histograms) to the list of published histograms.
+	  * Histograms may only be added before the server is opened.
+	  * @param plot_ Pointer to the histogram
+	  * @return True if the histogram is added and return false otherwise
+	  */
+	bool AddHist(Plotter *plot_);
+
+	/** Open the server socket and start the sender thread
+	  * @param address_ A TCP port number, or the path of a local (unix domain) socket
+	  * @return True if the socket is opened successfully and return false otherwise
+	  */
+	bool Open(const std::string &address_);
+
+	/** Stop the sender thread and close all sockets
+	  */
+	void Close();
+
+	/** Take a snapshot of all histograms and queue it for every connected viewer. Does nothing
+	  * if there are no viewers or if the minimum time between snapshots has not yet elapsed.
+	  * @param force_ If set to true, the snapshot is taken regardless of the time since the previous snapshot
+	  * @return True if a snapshot was taken and return false otherwise
+	  */
+	bool Publish(const bool &force_=false);
+
+	/** Set the minimum time between snapshots (in ms)
+	  */
+	int SetMinInterval(const int &interval_){ return (minInterval = interval_); }
+
+	/** Return true if the server socket is open and return false otherwise
+	  */
+	bool IsOpen() const { return running; }
+
+	/** Return the number of connected viewers
+	  */
+	unsigned int GetNumClients() const { return numClients; }
+
+	/** Return the number of published histograms
+	  */
+	size_t GetNumHists() const { return hists.size(); }
+
+	/** Print the number of frames and bytes sent
+	  * @param prefix_ String to print at the start of each line
+	  */
+	void Print(const std::string &prefix_="");
+
+  private:
+	std::vector<TH1*> hists; ///< Pointers to all published ROOT histograms
+
+	HistSnapshot curr; ///< The most recent snapshot
+	HistSnapshot prev; ///< The previous snapshot
+	bool havePrev; ///< Set to true if the previous snapshot is valid
+
+	std::string address; ///< Address of the server socket
+	int listenfd; ///< File descriptor of the listening socket
+	bool localSocket; ///< Set to true if the server uses a unix domain socket
+
+	int minInterval; ///< Minimum time between snapshots (in ms)
+	size_t maxQueued; ///< Maximum number of frames queued for a single viewer
+
+	std::chrono::steady_clock::time_point lastPublish; ///< Time of the most recent snapshot
+
+	std::vector<HistClient> clients; ///< All connected viewers
+
+	std::atomic<bool> running; ///< Set to true while the sender thread is running
+	std::atomic<unsigned int> numClients; ///< Number of connected viewers
+
+	unsigned long numKeyframes; ///< Number of keyframes encoded
+	unsigned long numDeltas; ///< Number of delta frames encoded
+	unsigned long numDropped; ///< Number of times a slow viewer had its pending frames dropped
+	std::atomic<unsigned long long> bytesSent; ///< Total number of bytes sent to all viewers
+
+	std::mutex client_mutex; ///< Mutex protecting the list of viewers
+
+	std::thread worker; ///< The sender thread
+
+	/** Copy the contents of all histograms into the current snapshot
+	  */
+	void Snapshot();
+
+	/** Main loop of the sender thread
+	  */
+	void Serve();
+};
+
+#endif
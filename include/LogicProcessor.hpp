@@ -11,6 +11,12 @@ class LogicProcessor : public Processor{
   
 	// Handle an individual event.
 	virtual bool HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEvtR=NULL);
+
+	// Handle all hits of a batch of raw events.
+	virtual bool HandleBatch();
+
+	// Copy the results of a single raw event into the root structure.
+	virtual bool FillBatchEvent(const size_t &event_);
 	
   public:
 	LogicProcessor(MapFile *map_);
@@ -214,12 +214,18 @@ class MapFile{
 private:
   	bool init; ///< Flag indicating that the map has been properly initialized
 
-	static const int max_modules = 14; ///< The maximum number of digitizer modules in the system
+	static const int max_crates = 4; ///< The maximum number of crates in the system (module numbers are offset by 100 for each crate)
+	static const int max_modules = 14; ///< The maximum number of digitizer modules in a single crate
 	static const int max_channels = 16; ///< The maximum number of channels in a single digitizer module
+	static const int max_indices = max_crates*max_modules; ///< The maximum number of digitizer modules in the system
   
-	MapEntry detectors[max_modules][max_channels]; ///< Matrix of all individual channel map entries
+	MapEntry detectors[max_indices][max_channels]; ///< Matrix of all individual channel map entries (indexed by module index)
 	std::vector<std::string> types; ///< Vector of defined detector types
-	int max_defined_module; ///< Index of the highest module with defined entries
+	int max_defined_module; ///< Number of the highest module with defined entries
+
+	/** Get the module number (offset by 100 for each crate) of a module index
+	  */
+	int getModuleNumber(const int &index_) const { return 100*(index_/max_modules) + index_%max_modules; }
 	
 	/** Clear all detector entries in the map
 	  */
@@ -250,10 +256,20 @@ public:
 	  */
 	~MapFile(){ }
 
-	/** Get the index of the maximum defined module in the map
+	/** Get the number of the maximum defined module in the map
 	  */
 	int GetMaxModule() const { return max_defined_module; }
 
+	/** Get the index of a module in the map, where the modules of each crate follow those of the previous crate
+	  * @param mod_ Module number (offset by 100 for each crate)
+	  * @return The module index, which is equal to the module number for the first crate, or -1 if the module number is invalid
+	  */
+	int GetModuleIndex(const int &mod_) const ;
+
+	/** Get the number of module indices needed to hold all modules up to the maximum defined module
+	  */
+	int GetNumModuleIndices() const { return GetModuleIndex(max_defined_module)+1; }
+
 	/** Get a pointer to a map entry at a specified module and channel or a NULL pointer if the entry is not found
 	  */
 	MapEntry *GetMapEntry(int mod_, int chan_);
@@ -282,7 +298,7 @@ public:
 	  */	
 	void GetModChan(const int &location, int &mod, int &chan) const ;
 
-	/** Get the maximum number of digitizer module in the system
+	/** Get the maximum number of digitizer modules in a single crate
 	  */
 	const int GetMaxModules() const { return max_modules; }
 	
@@ -112,6 +112,12 @@ class OnlineProcessor : public TApplication {
 	  */
 	Plotter* GetPlot(const unsigned int &index_);
 
+	/** Get a pointer to a histogram in the list of all histograms
+	  * @param hist_id_ Index of the requested histogram in the list of histograms
+	  * @return A pointer to the histogram and return NULL in the event that it does not exist
+	  */
+	Plotter* GetHistogram(const unsigned int &hist_id_){ return (hist_id_ < plottable_hists.size() ? plottable_hists[hist_id_] : NULL); }
+
 	/** Return the number of histograms which are currently defined
 	  */
 	unsigned int GetNumHistograms() const { return plottable_hists.size(); }
@@ -36,6 +36,9 @@ class PhoswichProcessor : public Processor{
 	/// Set the CFD parameters for the current event.
 	virtual bool SetCfdParameters(ChanEvent *event_, MapEntry *entry_);
 
+	/// Set the fast and slow QDCs from the onboard QDC sums.
+	virtual bool SetOnboardParameters(ChanEvent *event_, MapEntry *entry_);
+
 	// Handle an individual event.
 	virtual bool HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEvtR=NULL);
 	
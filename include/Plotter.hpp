@@ -57,6 +57,8 @@ class Plotter{
 	
 	TH1 *GetHist(const int &location);
 	
+	TH1 *GetSubHist(const size_t &index, int &location);
+	
 	int GetNdim(){ return dim; }
 	
 	double GetXmin(){ return xmin; }
@@ -2,7 +2,9 @@
 #define PROCESSOR_HPP
 
 #include <string>
+#include <vector>
 #include <deque>
+#include <map>
 
 #include "XiaData.hpp"
 #include "TraceFitter.hpp"
@@ -21,6 +23,8 @@ class TTree;
 class TBranch;
 class TH1;
 
+class ScanCheckpoint;
+
 extern Structure dummyStructure;
 extern Trace dummyTrace;
 
@@ -29,7 +33,33 @@ extern const double twoPi;
 
 typedef ChannelEvent ChanEvent;
 
-enum TimingAnalyzer { POLY=0, CFD=1, FIT=2 };
+enum TimingAnalyzer { POLY=0, CFD=1, FIT=2, ONBOARD=3 };
+
+/** @class OnboardSettings
+  * @brief Per-channel settings for trace-less analysis using the onboard QDC and energy sums
+  *
+  * Settings are read from comma-delimited "key=value" map file tags (e.g. liquid::short=1-2,long=1-7,blen=32)
+  *  short=<a>-<b> : QDC sums summed for the QDC (default is 0-7)
+  *  long=<a>-<b>  : QDC sums summed for the QDC2 (default is none)
+  *  blen=<N>      : Length of the trailing energy sum used for the baseline (in ADC samples)
+  *  qlen=<N>[/..] : Length of each of the 8 QDC sums (in ADC samples), required for baseline subtraction
+  */
+class OnboardSettings{
+  public:
+	size_t start; ///< First QDC sum used for the QDC
+	size_t stop; ///< Last QDC sum used for the QDC
+	int start2; ///< First QDC sum used for the QDC2 (-1 if unused)
+	int stop2; ///< Last QDC sum used for the QDC2 (-1 if unused)
+	double baselineLength; ///< Length of the trailing energy sum (in ADC samples)
+	double sumLengths[8]; ///< Lengths of the QDC sums (in ADC samples)
+	bool useLengths; ///< Set to true if the QDC sum lengths are specified
+
+	/// Default constructor.
+	OnboardSettings();
+
+	/// Read settings from a map file tag string.
+	bool Parse(const std::string &tags_);
+};
 
 class ChannelEventPair{
   public:
@@ -49,6 +79,62 @@ class ChannelEventPair{
 	static bool CompareChannel(ChannelEventPair *lhs, ChannelEventPair *rhs){ return ((lhs->channelEvent->modNum*16+lhs->channelEvent->chanNum) < (rhs->channelEvent->modNum*16+rhs->channelEvent->chanNum)); }
 };
 
+/** @class HitBatch
+  * @brief All hits of a single processor for a batch of raw events, stored as columns
+  *
+  * The hits of raw event i are stored at indices [GetFirst(i), GetLast(i)). Input columns
+  * are filled from the channel events (after preprocessing) by Fill(). Output columns are
+  * filled by Processor::HandleBatch.
+  */
+class HitBatch{
+  public:
+	std::vector<ChannelEventPair*> hits; ///< All hits in the batch, in order of raw event
+	std::vector<size_t> eventStart; ///< Index of the first hit of each raw event (one extra entry for the end of the batch)
+	std::vector<ChannelEventPair*> starts; ///< Start of each raw event
+
+	// Input columns (one entry per hit).
+	std::vector<int> location; ///< Detector location
+	std::vector<double> time; ///< Trigger time (in filter clock ticks)
+	std::vector<float> phase; ///< Trace phase (in ADC clock ticks)
+	std::vector<float> qdc; ///< Trace integral
+	std::vector<float> qdc2; ///< Second trace integral
+	std::vector<float> maximum; ///< Baseline corrected trace maximum
+	std::vector<unsigned short> energy; ///< Raw pixie filter energy
+	std::vector<unsigned short> maxADC; ///< Uncorrected maximum ADC value
+	std::vector<char> hasTrace; ///< Non-zero if the hit has an ADC trace
+	std::vector<char> valid; ///< Non-zero if the hit passed preprocessing
+	std::vector<double> startTime; ///< Trigger time of the start of the raw event (in filter clock ticks)
+	std::vector<float> startPhase; ///< Trace phase of the start of the raw event (in ADC clock ticks)
+	std::vector<char> startHasTrace; ///< Non-zero if the start of the raw event has an ADC trace
+
+	// Output columns (one entry per hit).
+	std::vector<double> tof; ///< Time difference between the hit and the start (in ns)
+	std::vector<char> accepted; ///< Non-zero if the hit was handled successfully (initialized to valid)
+
+	HitBatch(){ Clear(); }
+
+	/// Return the number of raw events in the batch.
+	size_t GetNumEvents() const { return starts.size(); }
+
+	/// Return the total number of hits in the batch.
+	size_t GetNumHits() const { return hits.size(); }
+
+	/// Return the index of the first hit of a raw event.
+	size_t GetFirst(const size_t &event_) const { return eventStart[event_]; }
+
+	/// Return one past the index of the last hit of a raw event.
+	size_t GetLast(const size_t &event_) const { return eventStart[event_+1]; }
+
+	/// Append the hits of a single raw event to the batch.
+	void AddEvent(const std::deque<ChannelEventPair*> &events_, ChannelEventPair *start_);
+
+	/// Fill the input columns and reset the output columns.
+	void Fill();
+
+	/// Remove all hits from the batch.
+	void Clear();
+};
+
 class Processor{
   protected:
 	std::deque<ChannelEventPair*> events;	  
@@ -71,6 +157,7 @@ class Processor{
 	unsigned long preprocess_badBaseline;
 	unsigned long preprocess_badFit;
 	unsigned long preprocess_badCfd;
+	unsigned long preprocess_noOnboard;
 
 	TBranch *local_branch;
 	TBranch *trace_branch;
@@ -91,7 +178,10 @@ class Processor{
 
 	float defaultCFD[3]; /// Default CFD parameters (F, D, L)
 
+	std::map<MapEntry*, OnboardSettings> onboardSettings; /// Onboard QDC sum settings for each channel.
+
 	bool use_trace; /// Force the use of the ADC trace. Any events without a trace will be rejected.
+	unsigned short traceQuantities; /// Trace quantities used by this processor (see TraceQuantity). Only these are computed during preprocessing.
 	bool write_waveform;
 	bool isSingleEnded;
 	bool histsEnabled;
@@ -106,6 +196,9 @@ class Processor{
 
 	MapFile *mapfile;
 
+	HitBatch batch; /// Hits queued for batch processing.
+	bool use_batch; /// Set to true if this processor implements HandleBatch and FillBatchEvent.
+
 	// Return a random number between low and high.
 	double drand(const double &low_, const double &high_);
 
@@ -145,9 +238,29 @@ class Processor{
 	/// Perform CFD analysis on a single trace.
 	virtual bool CfdPulse(ChanEvent *event_, MapEntry *entry_);
 
+	/// Set processor specific values after onboard analysis of the current event.
+	virtual bool SetOnboardParameters(ChanEvent *event_, MapEntry *entry_){ return true; }
+
+	/// Compute the phase, baseline, and QDCs used by this processor from onboard quantities (no trace is required).
+	virtual bool OnboardPulse(ChanEvent *event_, MapEntry *entry_, const unsigned short &quantities_=TRACE_ALL);
+
 	/// Process an individual events.
 	virtual bool HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEvtR=NULL){ return false; }
 
+	/** Process all hits in the batch at once. Should fill the output columns of the batch
+	  * (and any diagnostic histograms) for every valid hit.
+	  * @return False if not overloaded by child class
+	  */
+	virtual bool HandleBatch(){ return false; }
+
+	/** Copy the output columns of a single raw event from the batch into the root structure.
+	  * @return False if not overloaded by child class
+	  */
+	virtual bool FillBatchEvent(const size_t &event_){ return false; }
+
+	/// Compute the trace quantities of a single event.
+	void PreProcessEvent(ChannelEventPair *pair_);
+
   public:
 	Processor(std::string name_, std::string type_, MapFile *map_);
 	
@@ -204,11 +317,39 @@ class Processor{
 
 	float Status(unsigned long global_events_);
 
-	void AddEvent(ChannelEventPair *event_){ events.push_back(event_); }
+	unsigned short GetTraceQuantities() const { return traceQuantities; }
+
+	void AddEvent(ChannelEventPair *event_){ 
+		events.push_back(event_); 
+		total_events++;
+	}
 	
 	void PreProcess();
 
 	bool Process(ChannelEventPair *start_);
+
+	/// Return true if this processor handles batches of raw events with a single call.
+	bool UsesBatch() const { return use_batch; }
+
+	/// Return the number of raw events in the current batch.
+	size_t GetBatchSize() const { return batch.GetNumEvents(); }
+
+	/// Move the events of the current raw event into the batch.
+	void QueueEvent(ChannelEventPair *start_);
+
+	/// Compute the trace quantities of every hit in the batch.
+	void PreProcessBatch();
+
+	/// Call HandleBatch for the entire batch (if supported). Must be called after PreProcessBatch().
+	bool ProcessBatch();
+
+	/** Process a single raw event of the batch. Processors which do not support batch
+	  * processing are passed the events of the raw event using the per-event interface.
+	  */
+	bool ProcessBatchEvent(const size_t &event_);
+
+	/// Remove all events from the batch.
+	void ClearBatch(){ batch.Clear(); }
 	
 	/// Finish processing of events by clearing the event list.
 	void WrapUp();
@@ -217,6 +358,19 @@ class Processor{
 
 	virtual void Reset(){ }
 
+	/** Add the event counters of the processor to a scan checkpoint.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  * @param prefix_ Prefix added to the name of each value.
+	  */
+	void SaveState(ScanCheckpoint *ckpt_, const std::string &prefix_);
+
+	/** Restore the event counters of the processor from a scan checkpoint.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  * @param prefix_ Prefix added to the name of each value.
+	  * @return True if all counters were found and false otherwise.
+	  */
+	bool LoadState(ScanCheckpoint *ckpt_, const std::string &prefix_);
+
 	void RemoveByTag(const std::string &tag_, const bool &withTag_=true);
 };
 
@@ -9,6 +9,7 @@ class ChannelEventPair;
 class MapEntry;
 class MapFile;
 class Processor;
+class ScanCheckpoint;
 
 class ProcessorEntry{
   public:
@@ -30,6 +31,10 @@ class ProcessorHandler{
 	double delta_event_time; /// Time since the first start event (in s)
 	bool untriggered; /// True if a "start" detector is not used.
 	bool untrigChannel; /// True if at least one untriggered channel was added.
+	size_t batch_events; /// Number of raw events in the current batch.
+
+	/// Select the start of the current raw event. Returns false if the raw event has no start.
+	bool SelectStart();
 
   public:
 	ProcessorHandler();
@@ -63,6 +68,26 @@ class ProcessorHandler{
 	bool PreProcess();
 	
 	bool Process();
+
+	/** Move the current raw event into the batch of every processor. Raw events which have
+	  * no start are discarded.
+	  * @return True if the raw event was added to the batch and false otherwise.
+	  */
+	bool QueueEvent();
+
+	/// Preprocess all hits in the batch and call the batch processors.
+	bool ProcessBatch();
+
+	/** Process a single raw event of the batch. Must be called after ProcessBatch().
+	  * @return True if at least one processor handled the raw event and false otherwise.
+	  */
+	bool ProcessBatchEvent(const size_t &index_);
+
+	/// Remove all raw events from the batch.
+	void ClearBatch();
+
+	/// Return the number of raw events in the current batch.
+	size_t GetBatchSize(){ return batch_events; }
 	
 	unsigned long GetTotalEvents(){ return total_events; }
 	
@@ -73,6 +98,17 @@ class ProcessorHandler{
 	double GetDeltaEventTime();
 	
 	void ZeroAll();
+
+	/** Add the event counters of the handler and of all processors to a scan checkpoint.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  */
+	void SaveState(ScanCheckpoint *ckpt_);
+
+	/** Restore the event counters of the handler and of all processors from a scan checkpoint.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  * @return True if the checkpoint was written with the same list of processors and false otherwise.
+	  */
+	bool LoadState(ScanCheckpoint *ckpt_);
 };
 
 #endif
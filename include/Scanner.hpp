@@ -19,10 +19,13 @@ class MapFile;
 class ConfigFile;
 class ProcessorHandler;
 class OnlineProcessor;
+class HistServer;
 class Plotter;
+class CompactHist2d;
 
 class TFile;
 class TCanvas;
+class TH1;
 
 ///////////////////////////////////////////////////////////////////////////////
 // class extTree
@@ -114,6 +117,12 @@ class simpleUnpacker : public Unpacker {
 	  * @return Nothing.
 	  */
 	virtual void RawStats(XiaData *event_, ScanInterface *addr_=NULL){  }
+
+	/** Process the current batch of raw events at the end of each spill.
+	  * @param addr_ Pointer to a ScanInterface object.
+	  * @return Nothing.
+	  */
+	virtual void EndSpill(ScanInterface *addr_=NULL);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -220,11 +229,37 @@ class simpleScanner : public ScanInterface {
 	  */
 	virtual bool ProcessEvents();
 
+	/** Process all raw events in the current batch and fill the output trees.
+	  * Does nothing unless batch processing is enabled.
+	  * @return Nothing.
+	  */
+	void FlushBatch();
+
+	/** Copy the channel rates, dead time, pileup, and time between hits to the online histograms.
+	  * Does nothing unless rates are monitored in online mode.
+	  * @return Nothing.
+	  */
+	void UpdateRates();
+
+	/** Flush the output trees to disk and write the histograms and processor counters
+	  * to the output file so that the scan may be resumed from this point.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  * @return True upon success and false otherwise.
+	  */
+	virtual bool SaveCheckpoint(ScanCheckpoint *ckpt_);
+
+	/** Copy the output trees and histograms of an interrupted scan into the output file.
+	  * @param ckpt_ Pointer to the checkpoint.
+	  * @return True upon success and false otherwise.
+	  */
+	virtual bool LoadCheckpoint(ScanCheckpoint *ckpt_);
+
   private:
 	MapFile *mapfile; ///< Pointer to the map file to use for channel mapping.
 	ConfigFile *configfile; ///< Pointer to the configuration file to use for setting default parameters.
 	ProcessorHandler *handler; ///< Pointer to the processor handler to use for controlling detector processors.
 	OnlineProcessor *online; ///< Pointer to the online processor to use for online plotting.
+	HistServer *histServer; ///< Pointer to the server which publishes online histograms to remote viewers.
 	
 	std::deque<ChannelEventPair*> chanEventList;
 	
@@ -243,13 +278,24 @@ class simpleScanner : public ScanInterface {
 	Plotter *chanCounts; ///< 2d root histogram to store number of total channel counts found.
 	Plotter *chanMaxADC; ///< 2d root histogram to store the energy spectra from all channels.
 	Plotter *chanEnergy; ///< 2d histogram to store filter energy from all channels.
+
+	CompactHist2d *compCounts; ///< Integer version of chanCounts filled in histogram-only mode (copied to chanCounts when refreshed in online mode).
+	CompactHist2d *compMaxADC; ///< Integer version of chanMaxADC filled in histogram-only mode (copied to chanMaxADC when refreshed in online mode).
+	CompactHist2d *compEnergy; ///< Integer version of chanEnergy filled in histogram-only mode (copied to chanEnergy when refreshed in online mode).
+
+	Plotter *chanRate; ///< 1d histogram of the decaying rate of all channels (online mode with rate monitoring).
+	Plotter *chanDeadTime; ///< 1d histogram of the estimated dead time of all channels.
+	Plotter *chanPileup; ///< 1d histogram of the pileup fraction of all channels.
+	Plotter *chanInterval; ///< 2d histogram of the time between hits of all channels.
 	
 	int events_since_last_update; ///< The number of processed events since the last online histogram update.
 	int events_between_updates; ///< The number of events to process before updating online histograms.
 	
 	int loaded_files; ///< The number of files which have been processed.
+
+	unsigned int spill_weight; ///< The number of received spills represented by the spill currently being processed (shm mode).
 	
-	unsigned short xia_data_location; ///< ID = (16*mod + chan); taken from the channel event.
+	unsigned short xia_data_location; ///< ID = map location (16*mod + chan for the first crate); taken from the channel event.
 	unsigned short xia_data_energy; ///< Raw pixie energy taken directly from the module (a.u.).
 	double xia_data_time; ///< Raw pixie time taken directly from the module and converted to seconds.
 	float defaultCFDparameter; ///< The default CFD parameter to use for high-resolution timing.
@@ -261,15 +307,58 @@ class simpleScanner : public ScanInterface {
 	bool untriggered_mode; ///< Set to true if a start detector is not to be used.
 	bool force_overwrite; ///< Set to true if existing output files will be overwritten.
 	bool online_mode; ///< Set to true if online mode is to be used.
+	bool headless_mode; ///< Set to true if online histograms are filled without opening a root canvas.
 	bool use_root_fitting; ///< Set to true if root TF1 fitting is to be used for trace analysis.
 	bool use_traditional_cfd; ///< Set to true if the traditional CFD algorithm is to be used for trace analysis.
+	bool use_onboard_sums; ///< Set to true if the onboard CFD and QDC sums are to be used instead of trace analysis.
 	bool write_traces; ///< Set to true if ADC traces are to be written to the output file.
 	bool write_raw; ///< Set to true if raw pixie module data is to be written to the output file.
 	bool write_stats; ///< Set to true if event builder information is to be written to the output file.
+	bool hist_only; ///< Set to true if only histograms are to be written to the output file (no output trees).
 	bool init; ///< Set to true when the initialization process successfully completes.
 	
+	int batch_size; ///< Number of raw events per processing batch (0 for one batch per spill, -1 to process one raw event at a time).
+	
 	std::string head_path;
 	std::string outputFilenamePrefix;
+	std::string histServerAddress; ///< TCP port or local socket path of the online histogram server.
+
+	std::string partialFilename; ///< Name of the output file of an interrupted scan which is being resumed.
+	int checkpoint_id; ///< Number of the last checkpoint (used to name the checkpoint directory of the output file).
+
+	/** Delete all channel events in the event list.
+	  * @return Nothing.
+	  */
+	void ClearEventList();
+
+	/** Refresh the online histograms and publish them to remote viewers if enough events have been processed.
+	  * @return Nothing.
+	  */
+	void UpdateOnline();
+
+	/** Get all histograms which are written to the output file at the end of the scan. These must be
+	  * stored in the output file when a checkpoint is written.
+	  * @param hists_ Vector of histograms.
+	  * @return Nothing.
+	  */
+	void GetCheckpointHists(std::vector<TH1*> &hists_);
+
+	/** Get the compact histograms which are used in place of the debug histograms in histogram-only mode.
+	  * @param hists_ Vector of compact histograms (empty if the compact histograms are not used).
+	  * @return Nothing.
+	  */
+	void GetCompactHists(std::vector<CompactHist2d*> &hists_);
+
+	/** Copy the compact histograms into the online debug histograms, if both are in use.
+	  * @return Nothing.
+	  */
+	void CopyCompactHists();
+
+	/** Zero the compact histogram which is drawn by an online histogram, so that it is not copied back when refreshed.
+	  * @param index_ Index of the online histogram.
+	  * @return Nothing.
+	  */
+	void ZeroCompactHist(const unsigned int &index_);
 };
 
 #endif
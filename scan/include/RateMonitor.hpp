@@ -0,0 +1,154 @@
+/** \file RateMonitor.hpp
+ * \brief Online estimate of channel rates, pileup, and dead time from the raw hit stream.
+ *
+ * The RateMonitor is updated with every decoded channel event and keeps an exponentially
+ * decaying rate, a histogram of the time between hits, and the pileup fraction of each
+ * channel. Every update takes a constant amount of time. At the end of each spill, the
+ * rate of each channel in the spill is compared with the median of all channels and with
+ * its own decaying average, so that hot channels, dead channels, and channels whose rate
+ * suddenly drops are reported as spills arrive.
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#ifndef RATEMONITOR_HPP
+#define RATEMONITOR_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#define RATE_INTERVAL_DECADES 9 // Number of decades of the time between hits (1 ns to 1 s).
+#define RATE_INTERVAL_BINS_PER_DECADE 10 // Number of bins per decade of the time between hits.
+#define RATE_INTERVAL_BINS (RATE_INTERVAL_DECADES*RATE_INTERVAL_BINS_PER_DECADE)
+
+class XiaData;
+
+/// Rate bookkeeping for a single channel.
+class ChannelRate{
+  public:
+	unsigned int modNum; /// Module number of the channel (offset by 100 for each crate).
+	unsigned int chanNum; /// Channel number.
+
+	double rate; /// Exponentially decaying rate at the time of the last hit (in Hz).
+	double lastTime; /// Time of the last hit (in system clock ticks), or -1 if there has been no hit.
+
+	double spillRate; /// Rate in the most recent spill (in Hz).
+	double meanRate; /// Decaying average of the rate of all previous spills (in Hz).
+	double pileupFraction; /// Decaying average of the fraction of hits with the pileup flag set.
+
+	unsigned long numHits; /// Total number of hits.
+	unsigned long numPileup; /// Total number of hits with the pileup flag set.
+	unsigned long spillHits; /// Number of hits in the current spill.
+	unsigned long spillPileup; /// Number of hits with the pileup flag set in the current spill.
+
+	unsigned int flags; /// Anomalies flagged in the most recent spill.
+
+	std::vector<unsigned long> intervals; /// Histogram of the log10 of the time between hits (in ns).
+
+	ChannelRate();
+
+	/// Return the decaying rate at a given time (in Hz).
+	double GetRate(const double &time_, const double &clockPeriod_, const double &decayTime_) const ;
+
+	/// Reset all counters.
+	void Reset();
+};
+
+class RateMonitor{
+  public:
+	enum RateFlags {RATE_OK=0x0, RATE_HOT=0x1, RATE_DEAD=0x2, RATE_DROP=0x4};
+
+	/** Constructor.
+	  * \param[in]  decayTime_ Decay time of the channel rates (in seconds).
+	  * \param[in]  resolvingTime_ Time after each hit during which a channel cannot accept another hit (in ns).
+	  * \param[in]  clockPeriod_ Period of the system clock used for event times (in seconds).
+	  */
+	RateMonitor(const double &decayTime_=10, const double &resolvingTime_=1000, const double &clockPeriod_=8E-9);
+
+	/** Start a new spill. The monitor is locked until EndSpill is called, so that it may
+	  * be printed or reset from another thread. A requested reset is applied here.
+	  * \return Nothing.
+	  */
+	void BeginSpill();
+
+	/** Add a hit to the rates. Must only be called between BeginSpill and EndSpill.
+	  * \param[in]  id_ Index of the channel (any unique number for each crate, module, and channel).
+	  * \param[in]  event_ Pointer to the channel event.
+	  * \return Nothing.
+	  */
+	void Hit(const unsigned int &id_, XiaData *event_);
+
+	/** Finish the current spill, check all channels for anomalies, and unlock the monitor.
+	  * Anomalies are printed when they first appear and when they go away.
+	  * \return The number of channels which are flagged.
+	  */
+	size_t EndSpill();
+
+	/// Return the number of channel indices in use.
+	size_t GetNumChannels() const { return channels.size(); }
+
+	/// Return the rate bookkeeping of a channel index, or NULL if the index is not in use.
+	const ChannelRate *GetChannel(const size_t &id_) const { return (id_ < channels.size() && channels[id_].numHits > 0 ? &channels[id_] : NULL); }
+
+	/// Return the decaying rate of a channel at the end of the most recent spill (in Hz).
+	double GetRate(const size_t &id_) const ;
+
+	/// Return the estimated fraction of the time that a channel was dead at the end of the most recent spill.
+	double GetDeadFraction(const size_t &id_) const ;
+
+	/// Return the lower edge of a bin of the time between hits histogram (log10 of the time in ns).
+	static double GetIntervalEdge(const int &bin_){ return (double)bin_/RATE_INTERVAL_BINS_PER_DECADE; }
+
+	/// Return the sum of the decaying rates of all channels at the end of the most recent spill (in Hz).
+	double GetTotalRate() const { return totalRate; }
+
+	/// Return the number of spills which have been checked.
+	unsigned long GetNumSpills() const { return numSpills; }
+
+	/// Return the decay time of the channel rates (in seconds).
+	double GetDecayTime() const { return decayTime; }
+
+	/// Return the resolving time used to estimate the dead time (in ns).
+	double GetResolvingTime() const { return resolvingTime*1E9; }
+
+	/// Return a short status string for the terminal status line.
+	std::string GetStatus();
+
+	/// Print the rate, dead time, and pileup of all channels.
+	void PrintStatus();
+
+	/// Reset all channels at the start of the next spill. May be called from any thread.
+	void Reset(){ reset_pending = true; }
+
+  private:
+	double decayTime; /// Decay time of the channel rates (in seconds).
+	double resolvingTime; /// Resolving time of each channel (in seconds).
+	double clockPeriod; /// Period of the system clock (in seconds).
+
+	std::vector<ChannelRate> channels; /// Rate bookkeeping of all channels.
+
+	double spillStart; /// Time of the earliest hit in the current spill (in system clock ticks).
+	double spillStop; /// Time of the latest hit in the current spill (in system clock ticks).
+	double endTime; /// Time of the latest hit in the most recent spill (in system clock ticks).
+
+	double totalRate; /// Sum of the decaying rates of all channels at the end of the most recent spill (in Hz).
+
+	unsigned long numSpills; /// Number of spills which have been checked.
+	size_t numHot; /// Number of hot channels in the most recent spill.
+	size_t numDead; /// Number of dead channels in the most recent spill.
+	size_t numDrop; /// Number of channels whose rate dropped in the most recent spill.
+
+	std::mutex monitor_mutex; /// Locked while a spill is added and while the channels are printed.
+	std::atomic<bool> reset_pending; /// Set when a reset has been requested.
+
+	/// Clear all channels.
+	void clear();
+
+	/// Return a label for a channel.
+	std::string label(const ChannelRate &chan_) const ;
+};
+
+#endif
@@ -0,0 +1,116 @@
+/** \file RawEventCache.hpp
+ * \brief Stores the raw events built by the Unpacker so that later scans may skip event building.
+ *
+ * The first scan of an input file writes every raw event built by the Unpacker to a
+ * cache file, followed by the channel counts of each spill. The channel events of each
+ * raw event are encoded as pixie16 (Rev. F) events, including their ADC traces. The cache
+ * is keyed on the input file and the event builder settings, so that a later scan using
+ * the same settings may replay the raw events without reading, decoding, time sorting,
+ * and building the spills of the input file again.
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#ifndef RAW_EVENT_CACHE_HPP
+#define RAW_EVENT_CACHE_HPP
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <deque>
+
+class XiaData;
+
+/// Record types returned by RawEventCache::Read.
+enum CacheRecord {CACHE_ERROR=-1, CACHE_RAW_EVENT=0, CACHE_END_SPILL=1, CACHE_END=2};
+
+class RawEventCache{
+  public:
+	/// Default constructor.
+	RawEventCache();
+
+	/// Destructor. An unfinished cache file is removed.
+	~RawEventCache();
+
+	/// Return true if a cache file is open for reading.
+	bool IsReading() const { return reading; }
+
+	/// Return true if a cache file is open for writing.
+	bool IsWriting() const { return writing; }
+
+	/// Return the name of the cache file.
+	std::string GetFilename() const { return filename; }
+
+	/// Return the number of raw events written to or read from the cache.
+	unsigned long GetNumRawEvents() const { return numRawEvents; }
+
+	/// Return the number of spills written to or read from the cache.
+	unsigned long GetNumSpills() const { return numSpills; }
+
+	/// Return the fraction of the cache file which has been read.
+	double GetProgress();
+
+	/** Open a cache file for reading. The cache is only opened if it was written
+	  * completely and its key matches.
+	  * \param[in]  fname_ Path to the cache file.
+	  * \param[in]  key_   Description of the input file and the event builder settings.
+	  * \return True if the cache file may be replayed and false otherwise.
+	  */
+	bool OpenRead(const std::string &fname_, const std::string &key_);
+
+	/** Open a new cache file for writing. The cache is written to a temporary file
+	  * which only replaces the cache file once the cache is complete.
+	  * \param[in]  fname_ Path to the cache file.
+	  * \param[in]  key_   Description of the input file and the event builder settings.
+	  * \return True upon success and false otherwise.
+	  */
+	bool OpenWrite(const std::string &fname_, const std::string &key_);
+
+	/** Write a raw event to the cache.
+	  * \param[in]  rawEvent_ List of all channel events in the raw event.
+	  * \param[in]  times_    Array of the start event time, raw event start time, and raw event stop time.
+	  * \return True upon success and false otherwise.
+	  */
+	bool WriteRawEvent(const std::deque<XiaData*> &rawEvent_, const double *times_);
+
+	/** Mark the end of a spill in the cache.
+	  * \param[in]  counts_ List of channel id and count pairs for all channel events in the spill.
+	  * \return True upon success and false otherwise.
+	  */
+	bool WriteEndSpill(const std::vector<unsigned int> &counts_);
+
+	/** Read the next record from the cache.
+	  * \param[out] data_   Pointer to the encoded channel events of a raw event, or to the channel id
+	  *                     and count pairs at the end of a spill. Valid until the next call.
+	  * \param[out] nWords_ Number of words pointed to by data_.
+	  * \param[out] times_  Array of the start event time, raw event start time, and raw event stop time.
+	  * \return The type of the record (see CacheRecord).
+	  */
+	CacheRecord Read(unsigned int *&data_, unsigned int &nWords_, double *times_);
+
+	/** Close the cache file.
+	  * \param[in]  complete_ Set to true if all raw events of the input file were written. A cache
+	  *                       which is being written is only kept if it is complete.
+	  * \return True if a complete cache was written and false otherwise.
+	  */
+	bool Close(const bool &complete_=false);
+
+  private:
+	std::string filename; /// Name of the cache file.
+	std::string tempFilename; /// Name of the temporary file used while writing the cache.
+
+	std::ifstream input; /// Cache file being replayed.
+	std::ofstream output; /// Cache file being written.
+	std::streampos length; /// Length of the cache file being replayed (in bytes).
+
+	bool reading; /// Set to true if a cache file is open for reading.
+	bool writing; /// Set to true if a cache file is open for writing.
+
+	unsigned long numRawEvents; /// Number of raw events written or read.
+	unsigned long numSpills; /// Number of spills written or read.
+
+	std::vector<unsigned int> record; /// Words of the current record.
+};
+
+#endif
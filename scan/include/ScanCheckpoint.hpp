@@ -0,0 +1,121 @@
+/** \file ScanCheckpoint.hpp
+ * \brief Stores the state of a scan so that it may be resumed after a crash.
+ *
+ * A checkpoint is a list of named values which is written to a small text file,
+ * one value per line. ScanInterface records the position of the input file and
+ * the Unpacker and derived classes add whatever they need to restore their state.
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#ifndef SCAN_CHECKPOINT_HPP
+#define SCAN_CHECKPOINT_HPP
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+
+class ScanCheckpoint{
+  public:
+	/// Default constructor.
+	ScanCheckpoint(){ }
+
+	/// Destructor.
+	~ScanCheckpoint(){ }
+
+	/// Return the number of values in the checkpoint.
+	size_t size() const { return values.size(); }
+
+	/// Return true if the checkpoint contains a value with the specified name.
+	bool Has(const std::string &name_) const { return (values.find(name_) != values.end()); }
+
+	/** Set a value. Any existing value with the same name is replaced.
+	  * \param[in]  name_  Name of the value. May not contain whitespace.
+	  * \param[in]  value_ The value to store.
+	  * \return Nothing.
+	  */
+	template <typename T>
+	void Set(const std::string &name_, const T &value_){
+		std::stringstream stream;
+		stream.precision(17);
+		stream << value_;
+		values[name_] = stream.str();
+	}
+
+	/** Set an array of values.
+	  * \param[in]  name_   Name of the array. May not contain whitespace.
+	  * \param[in]  values_ The values to store.
+	  * \return Nothing.
+	  */
+	template <typename T>
+	void SetArray(const std::string &name_, const std::vector<T> &values_){
+		std::stringstream stream;
+		stream.precision(17);
+		stream << values_.size();
+		for(typename std::vector<T>::const_iterator iter = values_.begin(); iter != values_.end(); ++iter)
+			stream << " " << *iter;
+		values[name_] = stream.str();
+	}
+
+	/** Get a value.
+	  * \param[in]  name_  Name of the value.
+	  * \param[out] value_ The stored value. Unchanged if the value is not found.
+	  * \return True if the value was found and could be converted and false otherwise.
+	  */
+	template <typename T>
+	bool Get(const std::string &name_, T &value_) const {
+		std::map<std::string, std::string>::const_iterator iter = values.find(name_);
+		if(iter == values.end()) return false;
+		std::stringstream stream(iter->second);
+		T value;
+		if(!(stream >> value)) return false;
+		value_ = value;
+		return true;
+	}
+
+	/** Get an array of values.
+	  * \param[in]  name_   Name of the array.
+	  * \param[out] values_ The stored values.
+	  * \return True if the array was found and all of its values could be converted and false otherwise.
+	  */
+	template <typename T>
+	bool GetArray(const std::string &name_, std::vector<T> &values_) const {
+		std::map<std::string, std::string>::const_iterator iter = values.find(name_);
+		if(iter == values.end()) return false;
+		std::stringstream stream(iter->second);
+		size_t length;
+		if(!(stream >> length)) return false;
+		values_.resize(length);
+		for(size_t i = 0; i < length; i++){
+			if(!(stream >> values_[i])) return false;
+		}
+		return true;
+	}
+
+	/// Remove all values.
+	void Clear(){ values.clear(); }
+
+	/** Write the checkpoint to a file. The checkpoint is written to a temporary file
+	  * which then replaces the existing file, so that a checkpoint file is never left
+	  * half written.
+	  * \param[in]  fname_ Path to the checkpoint file.
+	  * \return True upon success and false otherwise.
+	  */
+	bool Write(const std::string &fname_) const ;
+
+	/** Read a checkpoint file. Any existing values are removed.
+	  * \param[in]  fname_ Path to the checkpoint file.
+	  * \return True upon success and false if the file could not be read or is incomplete.
+	  */
+	bool Read(const std::string &fname_);
+
+  private:
+	std::map<std::string, std::string> values; /// All named values.
+};
+
+/// Specialization for strings, which may contain whitespace.
+template <>
+bool ScanCheckpoint::Get<std::string>(const std::string &name_, std::string &value_) const ;
+
+#endif
@@ -17,9 +17,12 @@
 #include <sstream>
 #include <vector>
 #include <deque>
+#include <mutex>
+#include <chrono>
 
 #include "optionHandler.hpp"
 #include "hribf_buffers.h"
+#include "cld_buffers.h"
 #include "XiaData.hpp"
 
 #define SCAN_VERSION "1.2.29"
@@ -28,6 +31,12 @@
 class Server;
 class Terminal;
 class Unpacker;
+class StreamMerger;
+class SpillReceiver;
+class SpillSampler;
+class RateMonitor;
+class RawEventCache;
+class ScanCheckpoint;
 
 class fileInformation{
   public:
@@ -80,6 +89,15 @@ class ScanInterface{
 	/// Return true if batch processing mode is enabled.
 	bool BatchMode(){ return batch_mode; }
 
+	/// Return true if multiple crate streams are being merged.
+	bool MergeMode(){ return (merger != NULL); }
+
+	/// Return true if the scan is to be resumed from the last checkpoint.
+	bool ResumeMode(){ return resume_mode; }
+
+	/// Return true if the last scan reached the end of the run without being interrupted.
+	bool GetScanComplete(){ return scan_complete; }
+
 	/** Return true if the scan is running and return false otherwise
 	  */ 
 	bool GetIsRunning() const { return is_running; }
@@ -98,6 +116,9 @@ class ScanInterface{
     
 	/// \return The name of the output file
 	std::string GetOutputFilename(){ return(output_filename); }
+
+	/// \return The name of the checkpoint file
+	std::string GetCheckpointFilename(){ return(checkpoint_filename); }
     
 	/// Return a pointer to a fileInformation object used to store file header info.
 	fileInformation *GetFileInfo(){ return &finfo; }
@@ -111,6 +132,24 @@ class ScanInterface{
 	/// Return an integer representing the input file format.
 	int GetFileFormat(){ return file_format; }
 
+	/// Return the number of input files waiting in the run queue.
+	size_t GetQueueSize();
+
+	/// Return a pointer to the multi-crate stream merger (NULL if not in merge mode).
+	StreamMerger *GetMerger(){ return merger; }
+
+	/// Return a pointer to the shared memory spill sampler (NULL if not in shm mode).
+	SpillSampler *GetSampler(){ return sampler; }
+
+	/// Return a pointer to the channel rate monitor (NULL if rates are not monitored).
+	RateMonitor *GetRateMonitor(){ return rates; }
+
+	/** Return the weight of the spill which is currently being processed. In shm mode, this is the
+	  * number of spills which the spill represents when processing cannot keep up and spills are
+	  * skipped. Histograms filled from the spill may be scaled by this weight.
+	  */
+	unsigned int GetSpillWeight();
+
 	/// Set the header string used to prefix output messages.
 	void SetProgramName(const std::string &head_){
 		progName = head_;
@@ -264,6 +303,26 @@ class ScanInterface{
 	  */
 	virtual Unpacker *GetCore();
 
+	/** Add the state of the derived class to a checkpoint. This method is called between
+	  * spills, so all output for the spills read so far should be flushed to disk.
+	  * \param[out] ckpt_ Pointer to the checkpoint. Not used by default.
+	  * \return True upon success and false if the checkpoint should not be written. Returns false by default.
+	  */
+	virtual bool SaveCheckpoint(ScanCheckpoint *ckpt_){ return false; }
+
+	/** Restore the state of the derived class from a checkpoint when a scan is resumed.
+	  * \param[in]  ckpt_ Pointer to the checkpoint. Not used by default.
+	  * \return True upon success and false otherwise. Returns false by default.
+	  */
+	virtual bool LoadCheckpoint(ScanCheckpoint *ckpt_){ return false; }
+
+	/** Set the name of the checkpoint file. Checkpoints are only written for derived classes
+	  * which set a checkpoint file during initialization.
+	  * \param[in]  fname_ Path to the checkpoint file.
+	  * \return Nothing.
+	  */
+	void SetCheckpointFilename(const std::string &fname_){ checkpoint_filename = fname_; }
+
 	/** Return a pointer to the Terminal object used for interfacing with the user.
 	  * \return Pointer to a Terminal object.
 	  */
@@ -281,10 +340,15 @@ class ScanInterface{
 	/// Start the scan.
 	void start_scan();
 
-  private:
-	unsigned int maxShmSizeL; /// Max size of shared memory buffer in pixie words (4050 + 2 header words)
-	unsigned int maxShmSize; /// Max size of shared memory buffer in bytes
+	/** Add input files to the run queue. The input may be a (quoted) glob pattern, a single
+	  * .ldf, .pld, or .cld file, or a text file containing a list of input filenames (one per line).
+	  * The headers of all files are read and validated before they are added to the queue.
+	  * \param[in]  input_ Glob pattern, input filename, or list filename.
+	  * \return The number of files which were added to the queue.
+	  */
+	int queue_input_files(const std::string &input_);
 
+  private:
 	std::string prefix; /// Input filename prefix (without extension).
 	std::string extension; /// Input file extension.
 	std::string workDir; /// Linux system current working directory.
@@ -294,7 +358,7 @@ class ScanInterface{
 	std::string output_filename; //!< Name of file to be used for output
 
 	int max_spill_size; /// Maximum size of a spill to read.
-	int file_format; /// Input file format to use (0=.ldf, 1=.pld).
+	int file_format; /// Input file format to use (0=.ldf, 1=.pld, 3=.cld).
 	
 	unsigned long num_spills_recvd; /// The total number of good spills received from either the input file or shared memory.
 	std::streampos file_start_offset; /// The first word in the file at which to start scanning.
@@ -315,10 +379,43 @@ class ScanInterface{
 	bool file_open; /// Set to true when an input binary file is successfully opened for reading.
 	bool automatic_start; /// Start the scan automatically upon loading the input file.
 
+	bool file_stop_reached; /// Set to true when the scan is stopped at the file stop point.
+	bool prefetch_done; /// Set to true when the next queued file has been prefetched.
+
+	std::deque<std::string> file_queue; /// List of validated input files waiting to be scanned.
+	std::mutex queue_mutex; /// Mutex protecting the run queue.
+	std::streampos prefetch_size; /// Number of bytes of the next queued file to prefetch.
+
+	double checkpoint_interval; /// Minimum time between scan checkpoints (in seconds). Checkpoints are disabled if not positive.
+	std::string checkpoint_filename; /// Name of the checkpoint file.
+	std::chrono::steady_clock::time_point last_checkpoint; /// Time at which the last checkpoint was written.
+	unsigned long num_checkpoints; /// Number of checkpoints written.
+	unsigned int file_number; /// Number of input files opened (including the current file).
+
+	bool resume_mode; /// Set to true if the scan is to be resumed from the last checkpoint.
+	bool resume_pending; /// Set to true until the input file is moved to the checkpoint position.
+	std::streampos resume_offset; /// Position of the input file (or ldf buffer) at which to resume.
+	unsigned int resume_word; /// Position in the ldf buffer at which to resume.
+	bool scan_complete; /// Set to true when the scan reaches the end of the run without being interrupted.
+
 	bool kill_all; /// Set to true when user has sent kill command.
 	bool run_ctrl_exit; /// Set to true when run control thread has exited.
 
 	Server *poll_server; /// Poll2 shared memory server.
+	SpillReceiver *receiver; /// Receiver thread used to read spill chunks from the poll2 server.
+	SpillSampler *sampler; /// Selects which shared memory spills to process when the scan cannot keep up.
+	unsigned int max_sampling; /// Maximum shared memory sampling factor (process at least one in every N spills).
+
+	RateMonitor *rates; /// Online estimate of the channel rates and dead time (NULL if rates are not monitored).
+	double rate_decay_time; /// Decay time of the channel rates (in seconds). Rates are not monitored if not positive.
+	double rate_resolving_time; /// Resolving time used to estimate the channel dead time (in ns).
+
+	std::string cache_dir; /// Directory in which raw event caches are stored.
+	RawEventCache *event_cache; /// Cache of the raw events built from the current input file (NULL if caching is disabled).
+	std::streampos file_data_start; /// Position of the first spill in the current input file.
+
+	StreamMerger *merger; /// Merger used to combine the data streams of multiple crates.
+	std::string merge_filename; /// Name of the merge list file.
 
 	std::ifstream input_file; /// Main input binary data file.
 	std::streampos file_length; /// Main input file length (in bytes).
@@ -327,18 +424,54 @@ class ScanInterface{
 
 	PLD_header pldHead; /// PLD style HEAD buffer handler.
 	PLD_data pldData; /// PLD style DATA buffer handler.
+
+	CLD_header cldHead; /// Compact list data file header handler.
+	CLD_data cldData; /// Compact list data spill handler.
+	CLD_index cldIndex; /// Spill index of the current compact list data file.
 	DIR_buffer dirbuff; /// HRIBF DIR buffer handler.
 	HEAD_buffer headbuff; /// HRIBF HEAD buffer handler.
 	DATA_buffer databuff; /// HRIBF DATA buffer handler.
 	EOF_buffer eofbuff; /// HRIBF EOF buffer handler.
 
+	SpillBufferPool spill_pool; /// Recycled spill buffers used by the run control thread.
+
 	Terminal *term; /// ncurses terminal used for displaying output and handling user input.
 	
 	/// Print a command line argument help dialogue.
 	void help(char *name_);
 	
 	/// Open a new binary input file for reading.
-	bool open_input_file(const std::string &fname_);
+	bool open_input_file(const std::string &fname_, const bool &queued_=false);
+
+	/// Read the header of an input file and return true if it is a valid .ldf, .pld, or .cld file.
+	bool validate_input_file(const std::string &fname_, std::string &summary_);
+
+	/// Ask the kernel to read ahead the start of the next file in the run queue.
+	void prefetch_next_file();
+
+	/// Open the next file in the run queue. Return false if the queue is empty.
+	bool open_next_file();
+
+	/// Open all crate input streams listed in a merge list file.
+	bool open_merge_streams(const std::string &fname_);
+
+	/// Write a checkpoint if the checkpoint interval has elapsed. Must only be called between spills.
+	void checkpoint_spill();
+
+	/// Write a checkpoint of the input position, the Unpacker, and the derived class.
+	bool write_checkpoint();
+
+	/// Restore the scan state from the checkpoint file and skip to the checkpoint input file.
+	bool resume_from_checkpoint();
+
+	/// Move the input file to the position stored in the checkpoint.
+	bool seek_checkpoint();
+
+	/// Open the raw event cache of the current input file. Return true if the cache is to be replayed instead of the file.
+	bool open_event_cache();
+
+	/// Close the raw event cache of the current input file. An incomplete cache is discarded.
+	void close_event_cache(const bool &complete_);
 };
 
 #endif
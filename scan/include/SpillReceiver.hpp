@@ -0,0 +1,195 @@
+/** \file SpillReceiver.hpp
+ * \brief Receive poll2 spill chunks from the network in a dedicated thread.
+ *
+ * Poll2 broadcasts each spill as a series of UDP datagrams (chunks). Every chunk
+ * begins with two words, the chunk number (starting at 1) and the total number
+ * of chunks in the spill, followed by up to 4050 words of spill data. Only the
+ * final chunk of a spill may be shorter than the maximum chunk size.
+ *
+ * The SpillReceiver reads chunks in batches (recvmmsg) and writes the data of
+ * chunk k directly to offset (k-1)*4050 of a pre-allocated spill slot, so that a
+ * complete spill is contiguous in memory and may be passed to the Unpacker
+ * without copying. Chunks which do not arrive in the expected order are moved
+ * to their proper position. Incomplete spills are dropped and counted.
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2016
+ */
+#ifndef SPILLRECEIVER_HPP
+#define SPILLRECEIVER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+class Server;
+
+struct mmsghdr;
+struct iovec;
+
+/// A single spill in the SpillReceiver ring.
+class SpillSlot{
+  public:
+	std::vector<unsigned int> data; /// Spill data. Chunk k is written starting at word (k-1)*chunkWords.
+	std::vector<unsigned int> chunkLength; /// Length of each chunk (in words).
+	std::vector<bool> haveChunk; /// Flags for each chunk which has been received.
+
+	unsigned int total; /// Total number of chunks in the spill.
+	unsigned int received; /// Number of chunks received.
+	unsigned int nWords; /// Length of the complete spill, including the end of spill marker (in words).
+
+	int state; /// The current state of the slot (see SpillReceiver::SlotStates).
+
+	/// Default constructor.
+	SpillSlot() : total(0), received(0), nWords(0), state(0) { }
+
+	/// Prepare the slot for a new spill with a given number of chunks.
+	void Reset(const unsigned int &total_, const unsigned int &chunkWords_);
+
+	/// Make sure the data array is large enough to hold a given chunk.
+	void Reserve(const unsigned int &chunk_, const unsigned int &chunkWords_);
+};
+
+class SpillReceiver{
+  public:
+	/// States of a spill slot.
+	enum SlotStates {FREE=0, FILLING, READY, BUSY};
+
+	/** Constructor.
+	  * \param[in]  server_ Pointer to an initialized poll2 Server.
+	  * \param[in]  numSlots_ Number of spill slots in the ring (at least 2).
+	  * \param[in]  batchSize_ Maximum number of datagrams to read with a single system call.
+	  */
+	SpillReceiver(Server *server_, const size_t &numSlots_=8, const unsigned int &batchSize_=64);
+
+	/// Destructor.
+	~SpillReceiver();
+
+	/** Set the kernel receive buffer size and start the receiver thread.
+	  * \return True if the thread was started and false otherwise.
+	  */
+	bool Start();
+
+	/** Stop the receiver thread. Spills which have not been released are discarded.
+	  * \return Nothing.
+	  */
+	void Stop();
+
+	/** Wait for a complete spill. The spill data is terminated with the end of
+	  * spill marker and remains valid until Release() is called for the slot.
+	  * \param[out] data_ Pointer to the spill data.
+	  * \param[out] nWords_ Length of the spill (in words).
+	  * \param[in]  timeout_ Maximum time to wait (in ms).
+	  * \return The index of the spill slot, or -1 if no spill was received.
+	  */
+	int GetSpill(unsigned int *&data_, unsigned int &nWords_, const int &timeout_);
+
+	/** Return a spill slot to the receiver so that it may be re-used.
+	  * \param[in]  slot_ Index of the slot returned by GetSpill().
+	  * \return Nothing.
+	  */
+	void Release(const int &slot_);
+
+	/// Return a short status string for the terminal status line.
+	std::string GetStatus();
+
+	/// Print the receiver statistics.
+	void PrintStatus();
+
+	/// Set the debug flag.
+	bool SetDebugMode(bool state_=true){ return (debug_mode = state_); }
+
+	/// Set the requested kernel receive buffer size (in bytes). Must be called before Start().
+	int SetRecvBufferSize(const int &size_){ return (recvBufferSize = size_); }
+
+	/// Set the time after which an incomplete spill is dropped (in ms).
+	int SetSpillTimeout(const int &timeout_){ return (spillTimeout = timeout_); }
+
+	/// Return the number of complete spills received.
+	unsigned long GetNumSpills(){ return numSpills; }
+
+	/// Return the number of incomplete spills which were dropped.
+	unsigned long GetNumDropped(){ return numDropped; }
+
+	/// Return the number of spills lost because every slot was in use.
+	unsigned long GetNumOverflow(){ return numOverflow; }
+
+	/// Return the number of complete spills waiting to be retrieved.
+	size_t GetNumReady();
+
+	/// Return the number of spill slots in the ring.
+	size_t GetNumSlots() const { return slots.size(); }
+
+  private:
+	Server *server; /// Pointer to the poll2 server.
+
+	std::vector<SpillSlot> slots; /// Ring of spill slots.
+
+	unsigned int batchSize; /// Maximum number of datagrams per system call.
+	unsigned int chunkWords; /// Maximum number of data words in a chunk (not including the two header words).
+	unsigned int maxChunks; /// Maximum number of chunks allowed in a single spill.
+	unsigned int reorderWindow; /// Chunks arriving more than this many chunks late are assumed to start a new spill.
+
+	int recvBufferSize; /// Requested kernel receive buffer size (in bytes).
+	int spillTimeout; /// Time after which an incomplete spill is dropped (in ms).
+
+	std::vector<unsigned int> headers; /// Chunk headers for the current batch (two words per datagram).
+	std::vector<unsigned int> stage; /// Staging area for chunks which cannot be written directly to a slot.
+	std::vector<int> predSlot; /// Slot into which each datagram of the current batch was received (-1 for the staging area).
+	std::vector<unsigned int> predChunk; /// Chunk number each datagram of the current batch was expected to be.
+
+	struct mmsghdr *msgs; /// Message headers for recvmmsg.
+	struct iovec *iovs; /// Scatter arrays for recvmmsg (two per datagram).
+
+	int fill; /// Index of the slot currently being filled (-1 if none).
+	int lastFill; /// Index of the most recently filled slot.
+	unsigned int lastChunk; /// Number of the most recently received chunk.
+
+	std::chrono::steady_clock::time_point lastTime; /// Time at which the most recent chunk was received.
+
+	std::deque<int> ready; /// Indices of complete spills, in order of arrival.
+
+	std::atomic<unsigned long> numChunks; /// Total number of chunks received.
+	std::atomic<unsigned long> numSpills; /// Number of complete spills received.
+	std::atomic<unsigned long> numDropped; /// Number of incomplete spills which were dropped.
+	std::atomic<unsigned long> numLostChunks; /// Number of chunks missing from dropped spills.
+	std::atomic<unsigned long> numReordered; /// Number of chunks which arrived out of order.
+	std::atomic<unsigned long> numOverflow; /// Number of spills lost because every slot was in use.
+	std::atomic<unsigned long> numSkipped; /// Number of chunks skipped while every slot was in use.
+	std::atomic<unsigned long> numBad; /// Number of malformed datagrams.
+	std::atomic<unsigned long> numCopied; /// Number of chunks which could not be received in place.
+
+	bool debug_mode; /// Set to true if the user wishes to display debug information.
+	std::atomic<bool> running; /// Set to true while the receiver thread is running.
+
+	std::mutex slot_mutex; /// Mutex protecting the slot states and the ready queue.
+	std::condition_variable spill_ready; /// Signalled when a complete spill is added to the ready queue.
+
+	std::thread worker; /// The receiver thread.
+
+	/// Main loop of the receiver thread.
+	void receive();
+
+	/// Predict the slot and chunk number of each datagram in the next batch and set up the scatter arrays.
+	void predict();
+
+	/// Handle a batch of received datagrams.
+	void process(const int &count_);
+
+	/// Store a single chunk in the current spill.
+	void store(const unsigned int &chunk_, const unsigned int &total_, const unsigned int &nWords_, const int &index_, const bool &staged_);
+
+	/// Mark the current spill as complete and pass it to the ready queue.
+	void complete();
+
+	/// Drop the current (incomplete) spill.
+	void drop();
+};
+
+#endif
@@ -0,0 +1,109 @@
+/** \file SpillSampler.hpp
+ * \brief Decide which shared memory spills to process when the scan cannot keep up.
+ *
+ * The SpillSampler compares the average time taken to process a spill with the
+ * average time between spills arriving from poll2. When processing takes longer
+ * than the time available (times a target load), only every k-th spill is
+ * processed, where k is the sampling factor. The selection depends only on the
+ * order in which spills arrive, so that the sampled spills are evenly spaced rather
+ * than being whichever spills happen to survive an overflowing socket. Every processed
+ * spill carries a weight equal to the sampling factor used when it was selected,
+ * so that histograms may be rescaled to the total number of spills.
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#ifndef SPILLSAMPLER_HPP
+#define SPILLSAMPLER_HPP
+
+#include <string>
+#include <chrono>
+
+class SpillSampler{
+  public:
+	/** Constructor.
+	  * \param[in]  maxFactor_ Maximum sampling factor. Sampling is disabled if less than 2.
+	  * \param[in]  targetLoad_ Fraction of the time between spills which may be spent processing.
+	  */
+	SpillSampler(const unsigned int &maxFactor_=64, const double &targetLoad_=0.9);
+
+	/** Mark the arrival of a new spill and decide whether it should be processed.
+	  * \param[in]  numArrived_ Total number of spills which have arrived from the network (including lost spills).
+	  * \param[in]  backlog_ Number of complete spills waiting to be processed.
+	  * \param[in]  capacity_ Maximum number of spills which may wait to be processed.
+	  * \return True if the spill should be processed and false if it should be skipped.
+	  */
+	bool Arrive(const unsigned long &numArrived_, const size_t &backlog_, const size_t &capacity_);
+
+	/** Record the time taken to process the most recently selected spill.
+	  * \param[in]  seconds_ Processing time (in seconds).
+	  * \return Nothing.
+	  */
+	void Processed(const double &seconds_);
+
+	/// Return the current sampling factor (1 if every spill is processed).
+	unsigned int GetFactor() const { return factor; }
+
+	/// Return the weight of the most recently selected spill.
+	unsigned int GetWeight() const { return weight; }
+
+	/// Return the maximum sampling factor.
+	unsigned int GetMaxFactor() const { return maxFactor; }
+
+	/// Return the number of spills which were processed.
+	unsigned long GetNumProcessed() const { return numProcessed; }
+
+	/// Return the number of spills which were processed while the sampling factor was greater than one.
+	unsigned long GetNumSampled() const { return numSampled; }
+
+	/// Return the number of spills which were skipped.
+	unsigned long GetNumSkipped() const { return numSkipped; }
+
+	/// Return the sum of the weights of all processed spills.
+	double GetTotalWeight() const { return totalWeight; }
+
+	/// Return the average time taken to process a spill (in seconds).
+	double GetProcessTime() const { return procTime; }
+
+	/// Return the average time between spills (in seconds).
+	double GetArrivalTime() const { return arrivalTime; }
+
+	/// Set the maximum sampling factor. Sampling is disabled if less than 2.
+	unsigned int SetMaxFactor(const unsigned int &maxFactor_);
+
+	/// Return a short status string for the terminal status line.
+	std::string GetStatus();
+
+	/// Print the sampling statistics.
+	void PrintStatus();
+
+	/// Reset the sampling factor and all counters.
+	void Reset();
+
+  private:
+	unsigned int maxFactor; /// Maximum sampling factor.
+	double targetLoad; /// Fraction of the time between spills which may be spent processing.
+
+	unsigned int factor; /// Current sampling factor.
+	unsigned int weight; /// Weight of the most recently selected spill.
+	unsigned int calm; /// Number of consecutive spills for which a smaller sampling factor would have been sufficient.
+
+	unsigned int countdown; /// Number of spills to skip before the next spill is processed.
+
+	unsigned long numProcessed; /// Number of spills which were processed.
+	unsigned long numSampled; /// Number of spills which were processed while sampling.
+	unsigned long numSkipped; /// Number of spills which were skipped.
+	double totalWeight; /// Sum of the weights of all processed spills.
+
+	double procTime; /// Running average of the spill processing time (in seconds).
+	double arrivalTime; /// Running average of the time between spills (in seconds).
+
+	unsigned long windowArrived; /// Number of spills which had arrived at the start of the rate window.
+	std::chrono::steady_clock::time_point windowStart; /// Start time of the rate window.
+
+	/// Compute the sampling factor required to keep up with the incoming spills.
+	unsigned int required(const size_t &backlog_, const size_t &capacity_);
+};
+
+#endif
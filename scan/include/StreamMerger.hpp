@@ -0,0 +1,198 @@
+/** \file StreamMerger.hpp
+ * \brief Merge the output of several pixie16 crates into a single time-ordered stream.
+ *
+ * Each crate writes its own .ldf or .pld file. The StreamMerger reads every file
+ * in a separate thread, decodes the spills into channel events, corrects their
+ * timestamps onto a common time base, and merges them in time order so they may
+ * be passed to Unpacker::ReadHits as if they were read from a single crate.
+ *
+ * Timestamps of crate c are corrected using
+ *  t' = t + offset_c + drift_c*1E-6*(t - t0_c) + delta_c(t)
+ * where offset_c (ticks) and drift_c (ppm) are static values taken from the merge
+ * file and delta_c(t) is a linear clock model which is continuously re-fitted to the
+ * difference between the (scaled) external timestamp and the internal pixie clock.
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2016
+ */
+#ifndef STREAMMERGER_HPP
+#define STREAMMERGER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "hribf_buffers.h"
+
+class XiaData;
+
+/// Linear clock model fitted to (external - internal) timestamp differences.
+class ClockModel{
+  public:
+	double forget; /// Forgetting factor applied to old samples (0 to 1).
+	double t0; /// Reference time for the fit (in pixie clock ticks).
+
+	unsigned long numSamples; /// Total number of samples added to the fit.
+
+	/// Default constructor.
+	ClockModel() : forget(0.999), t0(-1), numSamples(0), sw(0), sx(0), sy(0), sxx(0), sxy(0) { }
+
+	/// Add a new (time, residual) sample to the fit.
+	void Add(const double &time_, const double &residual_);
+
+	/// Return the fitted correction at a given time. Returns zero until enough samples are available.
+	double Evaluate(const double &time_) const ;
+
+	/// Return the fitted clock drift relative to the external clock (in ppm).
+	double GetDrift() const ;
+
+	/// Reset the fit.
+	void Reset();
+
+  private:
+	double sw, sx, sy, sxx, sxy; /// Weighted sums used for the least squares fit.
+};
+
+/// A single input stream (one crate) handled by the StreamMerger.
+class MergeStream{
+  public:
+	std::string fname; /// Input filename.
+	unsigned short crate; /// Crate number to use for all events in this stream.
+
+	double offset; /// Static timestamp offset (in pixie clock ticks).
+	double drift; /// Static clock drift (in ppm).
+	double t0; /// Raw time of the first decoded hit (in pixie clock ticks).
+
+	int format; /// Input file format (0 = ldf, 1 = pld).
+	unsigned int maxSpillSize; /// Maximum spill size (in words).
+
+	std::ifstream file; /// The input file.
+	std::streampos length; /// Length of the input file (in bytes).
+
+	PLD_header pldHead; /// PLD style HEAD buffer handler.
+	PLD_data pldData; /// PLD style DATA buffer handler.
+	DIR_buffer dirbuff; /// HRIBF DIR buffer handler.
+	HEAD_buffer headbuff; /// HRIBF HEAD buffer handler.
+	DATA_buffer databuff; /// HRIBF DATA buffer handler.
+
+	ClockModel model; /// External timestamp clock model.
+
+	std::deque<XiaData*> hits; /// Corrected hits waiting to be merged.
+	double lowWater; /// Earliest corrected time in the most recently decoded spill.
+	bool done; /// Set to true when the end of the input file has been reached.
+
+	std::atomic<unsigned long> numSpills; /// Number of spills read from file (updated by the reader thread).
+	std::atomic<unsigned long> numHits; /// Number of hits decoded from file (updated by the reader thread).
+	std::atomic<unsigned long> numBad; /// Number of corrupt spills or events which were skipped (updated by the reader thread).
+
+	std::thread worker; /// Thread used to read and decode the input file.
+
+	/// Default constructor.
+	MergeStream() : crate(0), offset(0), drift(0), t0(-1), format(-1), maxSpillSize(0), length(0), lowWater(0), done(false), numSpills(0), numHits(0), numBad(0) { }
+
+	/// Return the corrected time of a raw pixie timestamp.
+	double Correct(const double &time_) const ;
+};
+
+class StreamMerger{
+  public:
+	/// Default constructor.
+	StreamMerger();
+
+	/// Destructor.
+	~StreamMerger();
+
+	/** Read a merge list file. Each line of the file specifies one input stream as
+	  *  crate filename [offset] [drift]
+	  * where offset is in pixie clock ticks and drift is in ppm. Additional lines of the form
+	  *  ratio <value>
+	  *  forget <value>
+	  * set the number of pixie clock ticks per external timestamp tick (0 disables the
+	  * automatic clock alignment) and the forgetting factor of the clock model.
+	  * Blank lines and lines beginning with '#' are ignored.
+	  * \param[in]  fname_ Path to the merge list file.
+	  * \return True if at least one stream was defined and false otherwise.
+	  */
+	bool ReadConfig(const std::string &fname_);
+
+	/** Open all input files and read their headers.
+	  * \return True if all input files were opened successfully and false otherwise.
+	  */
+	bool Open();
+
+	/** Start the reader threads.
+	  * \return True if the threads were started and false otherwise.
+	  */
+	bool Start();
+
+	/** Stop all reader threads and delete any remaining hits.
+	  * \return Nothing.
+	  */
+	void Stop();
+
+	/** Get the next time-ordered batch of hits from all streams. This method will
+	  * block until every stream has either decoded data later than the merge
+	  * watermark or reached the end of its file. Ownership of the hits is passed
+	  * to the caller.
+	  * \param[out] output_ Deque to which time-ordered hits will be appended.
+	  * \return True if hits were retrieved and false if all streams are finished.
+	  */
+	bool GetNext(std::deque<XiaData*> &output_);
+
+	/// Return the number of input streams.
+	size_t GetNumStreams(){ return streams.size(); }
+
+	/// Return a pointer to one of the input streams.
+	MergeStream *GetStream(const size_t &index_){ return (index_ < streams.size() ? streams.at(index_) : NULL); }
+
+	/// Return the title of the first input file.
+	std::string GetRunTitle();
+
+	/// Return the run number of the first input file.
+	int GetRunNumber();
+
+	/// Return a short status string for the terminal status line.
+	std::string GetStatus();
+
+	/// Print information about the clock alignment of each stream.
+	void PrintStatus();
+
+	/// Set the debug flag.
+	bool SetDebugMode(bool state_=true){ return (debug_mode = state_); }
+
+	/// Set the maximum number of buffered hits per stream.
+	size_t SetMaxBuffered(const size_t &max_){ return (maxBuffered = max_); }
+
+  private:
+	std::vector<MergeStream*> streams; /// Vector of input streams.
+
+	double ratio; /// Number of pixie clock ticks per external timestamp tick.
+	double forget; /// Forgetting factor of the clock models.
+	double watermark; /// All hits earlier than the watermark have been merged.
+
+	size_t maxBuffered; /// Maximum number of buffered hits per stream.
+
+	unsigned long numMerged; /// Total number of merged hits.
+	unsigned long numLate; /// Number of hits which arrived earlier than the watermark.
+
+	bool debug_mode; /// Set to true if the user wishes to display debug information.
+	bool running; /// Set to true while the reader threads are running.
+
+	std::mutex merge_mutex; /// Mutex protecting the stream hit buffers.
+	std::condition_variable data_ready; /// Signalled when a reader thread has pushed new hits.
+	std::condition_variable space_ready; /// Signalled when the merger has removed hits.
+
+	/// Main loop of the reader thread for a single stream.
+	void read_stream(MergeStream *stream_);
+
+	/// Decode a single spill into a list of uncorrected hits.
+	bool decode_spill(MergeStream *stream_, unsigned int *data_, const unsigned int &nWords_, std::vector<XiaData*> &hits_);
+};
+
+#endif
@@ -23,10 +23,16 @@
 #ifndef MAX_PIXIE_CHAN
 #define MAX_PIXIE_CHAN 15
 #endif
+#ifndef MAX_PIXIE_CRATE
+#define MAX_PIXIE_CRATE 4
+#endif
 
 class XiaData;
 class ScanMain;
 class ScanInterface;
+class ScanCheckpoint;
+class RawEventCache;
+class RateMonitor;
 
 class Unpacker{
   public:
@@ -81,6 +87,15 @@ class Unpacker{
 	/// Return true if the scan is running and false otherwise.
 	bool IsRunning(){ return running; }
 
+	/// Return true if the raw event statistics vectors are in use.
+	bool GetUseRawEventStats(){ return useRawEventStats; }
+
+	/** Get a description of all settings which affect raw event building. Raw events
+	  * written to a cache may only be replayed if the description has not changed.
+	  * \return The description of the raw event builder settings.
+	  */
+	std::string GetBuilderSettings();
+
 	/// Toggle debug mode on / off.
 	bool SetDebugMode(bool state_=true){ return (debug_mode = state_); }
 
@@ -112,6 +127,15 @@ class Unpacker{
 	
 	/// Set the address of the scan interface used for file operations.
 	ScanInterface *SetInterface(ScanInterface *interface_){ return (interface = interface_); }
+
+	/// Set the cache to which all built raw events are written. Set to NULL to stop writing raw events.
+	RawEventCache *SetEventCache(RawEventCache *cache_){ return (eventCache = cache_); }
+
+	/// Set the monitor which is updated with all events of each spill. Set to NULL to stop monitoring rates.
+	RateMonitor *SetRateMonitor(RateMonitor *monitor_){ return (rateMonitor = monitor_); }
+
+	/// Return a pointer to the channel rate monitor (may be NULL).
+	RateMonitor *GetRateMonitor(){ return rateMonitor; }
 	
 	/** ReadSpill is responsible for constructing a list of pixie16 events from
 	  * a raw data spill. This method performs sanity checks on the spill and
@@ -123,6 +147,15 @@ class Unpacker{
 	  */	
 	bool ReadSpill(unsigned int *data, unsigned int nWords, bool is_verbose=true);
 	
+	/** ReadHits is responsible for building raw events from a list of already decoded
+	  * channel events (e.g. the time-ordered output of the StreamMerger). The Unpacker
+	  * takes ownership of all events in the list.
+	  * \param[in]  hits       Deque of pointers to decoded channel events. Emptied upon return.
+	  * \param[in]  is_verbose Toggle the verbosity flag on/off.
+	  * \return True if at least one event was added to the event list and false otherwise.
+	  */
+	bool ReadHits(std::deque<XiaData*> &hits, bool is_verbose=true);
+
 	/** ReadRawEvent assumes that the events in the incoming data are already grouped
 	  * into a raw event. This method performs sanity checks on the raw event and calls
 	  * ReadBuffer in order to construct the event list.
@@ -132,11 +165,33 @@ class Unpacker{
 	  * \return True if the spill was read successfully and false otherwise.
 	  */	
 	bool ReadRawEvent(unsigned int *data, unsigned int nWords, bool is_verbose=true);
+
+	/** ReplaySpill reads the raw events of a single spill from a raw event cache which was
+	  * written during a previous scan and passes them to ProcessRawEvent. Raw events are
+	  * not built again, so the event list is unused.
+	  * \param[in]  cache_     Pointer to a cache opened for reading.
+	  * \param[in]  is_verbose Toggle the verbosity flag on/off.
+	  * \return 1 if a spill was replayed, 0 at the end of the cache, and -1 upon failure.
+	  */
+	int ReplaySpill(RawEventCache *cache_, bool is_verbose=true);
 	
 	/** Write all recorded channel counts to a file.
 	  * \return Nothing.
 	  */
 	void Write();
+
+	/** Add the raw event counters and channel counts to a checkpoint. Must only be called
+	  * between spills, when the event list is empty.
+	  * \param[out] ckpt_ Pointer to the checkpoint.
+	  * \return Nothing.
+	  */
+	virtual void SaveState(ScanCheckpoint *ckpt_);
+
+	/** Restore the raw event counters and channel counts from a checkpoint.
+	  * \param[in]  ckpt_ Pointer to the checkpoint.
+	  * \return True if the checkpoint contains the unpacker state and false otherwise.
+	  */
+	virtual bool LoadState(ScanCheckpoint *ckpt_);
 	
 	/** Stop the scan. Unused by default.
 	  * \return Nothing.
@@ -185,6 +240,10 @@ class Unpacker{
 
 	ScanInterface *interface; /// Pointer to an object derived from ScanInterface.
 
+	RawEventCache *eventCache; /// Pointer to the cache to which built raw events are written (may be NULL).
+
+	RateMonitor *rateMonitor; /// Pointer to the monitor of the channel rates (may be NULL).
+
 	/** Return a pointer to a new XiaData channel event.
 	  * \return A pointer to a new XiaData.
 	  */
@@ -202,6 +261,13 @@ class Unpacker{
 	  * \return Nothing.
 	  */
 	virtual void RawStats(XiaData *event_, ScanInterface *addr_=NULL){  }
+
+	/** Called from ReadSpill after all raw events in a full spill have been built
+	  * and passed to ProcessRawEvent. Unused by default.
+	  * \param[in]  addr_ Pointer to a ScanInterface object. Unused by default.
+	  * \return Nothing.
+	  */
+	virtual void EndSpill(ScanInterface *addr_=NULL){  }
 	
 	/** Called form ReadSpill. Scan the current spill and construct a list of
 	  * events which fired by obtaining the module, channel, trace, etc. of the
@@ -227,11 +293,9 @@ class Unpacker{
 	bool IsInWhitelist(const int &mod, const int &chan);
 	
   private:
-	unsigned int TOTALREAD; /// Maximum number of data words to read.
-	unsigned int maxWords; /// Maximum number of data words for revision D.
 	unsigned int numRawEvt; /// The total count of raw events read from file.
 	
-	unsigned int channel_counts[MAX_PIXIE_MOD+1][MAX_PIXIE_CHAN+1]; /// Counters for each channel in each module.
+	unsigned int channel_counts[MAX_PIXIE_CRATE][MAX_PIXIE_MOD+1][MAX_PIXIE_CHAN+1]; /// Counters for each channel in each module of each crate.
 	
 	double firstTime; /// The first recorded event time.
 
@@ -258,6 +322,25 @@ class Unpacker{
 	  */
 	void TimeSort();
 
+	/** Sort the event list, build all raw events, and pass them to ProcessRawEvent.
+	  * The event list is cleared upon return.
+	  * \return Nothing.
+	  */
+	void ProcessEventList();
+
+	/** Get the index of an event in the event list. Modules of crate N are stored
+	  * after all modules of crates 0 to N-1.
+	  * \param[in]  event_ Pointer to the XiaData whose index will be returned.
+	  * \return The event list index or -1 if the crate or module number is invalid.
+	  */
+	int GetModuleIndex(XiaData *event_);
+
+	/** Increment the counter for the crate, module, and channel of an event.
+	  * \param[in]  event_ Pointer to the XiaData to count.
+	  * \return True if the event has a valid crate, module, and channel and false otherwise.
+	  */
+	bool CountEvent(XiaData *event_);
+
 	/** Scan the time sorted event list and package the events into a raw
 	  * event with a size governed by the event width.
 	  * \return True if the event list is not empty and false otherwise.
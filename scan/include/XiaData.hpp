@@ -26,6 +26,8 @@ class XiaData{
 	
 	size_t numQdcs; /// Number of QDCs onboard.
 	unsigned int *qdcValue; /// QDCs from onboard.
+
+	unsigned int energySums[4]; /// Raw onboard energy sums (trailing, leading, gap, baseline).
 	
 	unsigned short headerLength; /// Length of the pixie header in words.
 	unsigned short eventLength; /// Length of the total event in words.
@@ -80,7 +82,10 @@ class XiaData{
 	
 	/// Return one of the onboard qdc values.
 	unsigned int getQdcValue(const size_t &id){ return (id < 0 || id >= numQdcs ? -1 : qdcValue[id]); }
-	
+
+	/// Return the sum of the onboard qdc values in the range [start_, stop_].
+	double getQdcSum(const size_t &start_, const size_t &stop_);
+
 	/// Clear all variables.
 	void clear();
 	
@@ -144,6 +149,15 @@ class XiaData{
 	virtual int writeEvent(std::ofstream *file_, char *array_){ return -1; }
 };
 
+/** Trace quantities computed by a ChannelEvent. Quantities are computed when they are first
+  * requested and are not re-computed until the event is cleared.
+  */
+enum TraceQuantity { TRACE_BASELINE=0x1, ///< Baseline, baseline standard deviation, and pulse maximum.
+                     TRACE_QDC=0x2,      ///< Trace integral (qdc).
+                     TRACE_QDC2=0x4,     ///< Second trace integral (qdc2).
+                     TRACE_PHASE=0x8,    ///< Trace phase (CFD or fit).
+                     TRACE_ALL=0xF };
+
 class ChannelEvent : public XiaData {
   public:
 	bool valid_chan; /// True if the high resolution energy and time are valid.
@@ -166,6 +180,8 @@ class ChannelEvent : public XiaData {
 	double cfdPar[7]; /// Array of floats for storing cfd polynomial fits.
 
 	float *cfdvals; ///
+
+	unsigned short computed; ///< Bit mask of the trace quantities which have already been computed (see TraceQuantity).
 	
 	/// Default constructor.
 	ChannelEvent();
@@ -176,8 +192,26 @@ class ChannelEvent : public XiaData {
 	/// Destructor.
 	~ChannelEvent();
 	
-	/// Calculate the trace baseline, baseline standard deviation, and find the pulse maximum.
+	/// Calculate the trace baseline, baseline standard deviation, and find the pulse maximum. Only computed once.
 	float ComputeBaseline();
+
+	/// Return true if all of the specified trace quantities (see TraceQuantity) have been computed.
+	bool IsComputed(const unsigned short &quantities_) const { return ((computed & quantities_) == quantities_); }
+
+	/// Return the trace baseline, computing it if necessary.
+	float GetBaseline(){ ComputeBaseline(); return baseline; }
+
+	/// Return the standard deviation of the baseline, computing it if necessary.
+	float GetStddev(){ ComputeBaseline(); return stddev; }
+
+	/// Return the baseline corrected pulse maximum, computing it if necessary.
+	float GetMaximum(){ ComputeBaseline(); return maximum; }
+
+	/// Return the index of the maximum trace bin, computing it if necessary.
+	unsigned short GetMaxIndex(){ ComputeBaseline(); return max_index; }
+
+	/// Return the uncorrected maximum ADC value, computing it if necessary.
+	unsigned short GetMaxADC(){ ComputeBaseline(); return max_ADC; }
 	
 	/// Integrate the baseline corrected trace for QDC in the range [start_, stop_] and return the result.
 	float IntegratePulse(const size_t &start_=0, const size_t &stop_=0);
@@ -190,6 +224,19 @@ class ChannelEvent : public XiaData {
 	
 	/// Perform polynomial CFD analysis on the waveform.
 	float AnalyzePolyCFD(const float &F_=0.5);
+
+	/** Compute the phase from the onboard CFD time for a module with a given ADC clock period (2, 4, or 10 ns).
+	  * Returns the phase in ADC clock ticks, or -9999 if the onboard CFD failed to trigger.
+	  */
+	float AnalyzeOnboardCFD(const double &adcClockInSeconds_);
+
+	/** Compute the baseline, QDC, and QDC2 from onboard quantities. The baseline (per ADC sample) is
+	  * taken from the trailing energy sum using the energy filter length len_. If sumLengths_ is not
+	  * NULL, it is assumed to point to the lengths (in samples) of the 8 QDC sums and each sum will
+	  * be baseline corrected. The QDC and QDC2 are the sums of QDC ranges [start_, stop_] and
+	  * [start2_, stop2_] respectively. Returns the QDC, or -9999 if the onboard QDC sums are missing.
+	  */
+	float ComputeOnboard(const size_t &start_, const size_t &stop_, const int &start2_=-1, const int &stop2_=-1, const double &len_=0, const double *sumLengths_=NULL);
 	
 	/// Clear all variables and clear the trace vector and arrays.
 	void Clear();
@@ -0,0 +1,263 @@
+/** \file RateMonitor.cpp
+ * \brief Online estimate of channel rates, pileup, and dead time from the raw hit stream.
+ *
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "RateMonitor.hpp"
+#include "XiaData.hpp"
+
+#define RATE_HOT_FACTOR 10.0 // A channel is hot if its rate is this many times the median rate of all channels.
+#define RATE_DROP_FRACTION 0.5 // A channel is dropping if its rate is less than this fraction of its average rate.
+#define RATE_MIN_COUNTS 20 // Minimum (expected) number of hits in a spill before a channel may be flagged.
+
+/** Format a rate with an SI prefix.
+  * \param[in]  rate_ Rate (in Hz).
+  * \return The formatted rate.
+  */
+std::string formatRate(const double &rate_){
+	std::stringstream stream;
+	stream << std::setprecision(3);
+	if(rate_ >= 1E6) stream << rate_/1E6 << " MHz";
+	else if(rate_ >= 1E3) stream << rate_/1E3 << " kHz";
+	else stream << rate_ << " Hz";
+	return stream.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class ChannelRate
+///////////////////////////////////////////////////////////////////////////////
+
+ChannelRate::ChannelRate() : modNum(0), chanNum(0), intervals(RATE_INTERVAL_BINS, 0) {
+	Reset();
+}
+
+double ChannelRate::GetRate(const double &time_, const double &clockPeriod_, const double &decayTime_) const {
+	if(lastTime < 0) return 0;
+	double dt = (time_ - lastTime)*clockPeriod_;
+	return (dt > 0 ? rate*std::exp(-dt/decayTime_) : rate);
+}
+
+void ChannelRate::Reset(){
+	rate = 0;
+	lastTime = -1;
+	spillRate = 0;
+	meanRate = 0;
+	pileupFraction = 0;
+	numHits = 0;
+	numPileup = 0;
+	spillHits = 0;
+	spillPileup = 0;
+	flags = RateMonitor::RATE_OK;
+	std::fill(intervals.begin(), intervals.end(), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class RateMonitor
+///////////////////////////////////////////////////////////////////////////////
+
+RateMonitor::RateMonitor(const double &decayTime_/*=10*/, const double &resolvingTime_/*=1000*/, const double &clockPeriod_/*=8E-9*/) :
+  decayTime(decayTime_ > 0 ? decayTime_ : 10), resolvingTime(resolvingTime_ > 0 ? resolvingTime_*1E-9 : 0), clockPeriod(clockPeriod_), reset_pending(false) {
+	clear();
+}
+
+void RateMonitor::BeginSpill(){
+	monitor_mutex.lock();
+	if(reset_pending){
+		clear();
+		reset_pending = false;
+	}
+}
+
+void RateMonitor::Hit(const unsigned int &id_, XiaData *event_){
+	if(id_ >= channels.size()) channels.resize(id_+1);
+	ChannelRate &chan = channels[id_];
+
+	const double &time = event_->time;
+	if(chan.lastTime < 0){ // First hit of this channel.
+		chan.modNum = event_->modNum;
+		chan.chanNum = event_->chanNum;
+		chan.rate = 1/decayTime;
+		chan.lastTime = time;
+	}
+	else if(time >= chan.lastTime){ // Hits which are out of time order are counted, but do not change the rate.
+		double dt = (time - chan.lastTime)*clockPeriod;
+		chan.rate = chan.rate*std::exp(-dt/decayTime) + 1/decayTime;
+		chan.lastTime = time;
+
+		double ns = dt*1E9;
+		int bin = (ns > 1 ? (int)(std::log10(ns)*RATE_INTERVAL_BINS_PER_DECADE) : 0);
+		chan.intervals[bin < RATE_INTERVAL_BINS ? bin : RATE_INTERVAL_BINS-1]++;
+	}
+
+	chan.numHits++;
+	chan.spillHits++;
+	if(event_->pileupBit){
+		chan.numPileup++;
+		chan.spillPileup++;
+	}
+
+	if(time < spillStart) spillStart = time;
+	if(time > spillStop) spillStop = time;
+}
+
+size_t RateMonitor::EndSpill(){
+	std::lock_guard<std::mutex> lock(monitor_mutex, std::adopt_lock); // Locked by BeginSpill.
+	if(spillStop < spillStart) return 0; // No hits in this spill.
+
+	double duration = (spillStop - spillStart)*clockPeriod;
+	if(duration <= 0) duration = clockPeriod;
+
+	// Find the median spill rate of all channels which have ever had a hit.
+	std::vector<double> rates;
+	for(std::vector<ChannelRate>::iterator iter = channels.begin(); iter != channels.end(); ++iter){
+		if(iter->numHits == 0) continue;
+		iter->spillRate = iter->spillHits/duration;
+		rates.push_back(iter->spillRate);
+	}
+	double median = 0;
+	if(!rates.empty()){
+		std::nth_element(rates.begin(), rates.begin()+rates.size()/2, rates.end());
+		median = rates[rates.size()/2];
+	}
+
+	// Weight of this spill in the decaying averages.
+	double weight = 1 - std::exp(-duration/decayTime);
+
+	numHot = 0;
+	numDead = 0;
+	numDrop = 0;
+	totalRate = 0;
+	for(std::vector<ChannelRate>::iterator iter = channels.begin(); iter != channels.end(); ++iter){
+		if(iter->numHits == 0) continue;
+
+		bool firstSpill = (iter->numHits == iter->spillHits);
+		double expected = iter->meanRate*duration;
+
+		unsigned int flags = RATE_OK;
+		if(iter->spillHits >= RATE_MIN_COUNTS && median > 0 && iter->spillRate > RATE_HOT_FACTOR*median)
+			flags |= RATE_HOT;
+		if(!firstSpill && expected >= RATE_MIN_COUNTS){
+			if(iter->spillHits == 0) flags |= RATE_DEAD;
+			else if(iter->spillHits < RATE_DROP_FRACTION*expected) flags |= RATE_DROP;
+		}
+
+		// Only report changes, so that a problem is not repeated for every spill.
+		unsigned int raised = flags & ~iter->flags;
+		if(raised & RATE_HOT)
+			std::cout << "RateMonitor: Channel " << label(*iter) << " is HOT (" << formatRate(iter->spillRate) << ", median of " << formatRate(median) << ")\n";
+		if(raised & RATE_DEAD)
+			std::cout << "RateMonitor: Channel " << label(*iter) << " is DEAD (no hits, expected " << (unsigned long)expected << ")\n";
+		if(raised & RATE_DROP)
+			std::cout << "RateMonitor: Channel " << label(*iter) << " rate DROPPED to " << formatRate(iter->spillRate) << " (average of " << formatRate(iter->meanRate) << ")\n";
+		if(flags == RATE_OK && iter->flags != RATE_OK)
+			std::cout << "RateMonitor: Channel " << label(*iter) << " is no longer flagged (" << formatRate(iter->spillRate) << ")\n";
+		iter->flags = flags;
+
+		if(flags & RATE_HOT) numHot++;
+		if(flags & RATE_DEAD) numDead++;
+		if(flags & RATE_DROP) numDrop++;
+
+		// Update the decaying averages.
+		if(firstSpill){
+			iter->meanRate = iter->spillRate;
+			iter->pileupFraction = (double)iter->spillPileup/iter->spillHits;
+		}
+		else{
+			iter->meanRate += weight*(iter->spillRate - iter->meanRate);
+			if(iter->spillHits > 0)
+				iter->pileupFraction += weight*((double)iter->spillPileup/iter->spillHits - iter->pileupFraction);
+		}
+
+		totalRate += iter->GetRate(spillStop, clockPeriod, decayTime);
+
+		iter->spillHits = 0;
+		iter->spillPileup = 0;
+	}
+
+	endTime = spillStop;
+	spillStart = std::numeric_limits<double>::max();
+	spillStop = std::numeric_limits<double>::lowest();
+	numSpills++;
+
+	return (numHot + numDead + numDrop);
+}
+
+double RateMonitor::GetRate(const size_t &id_) const {
+	if(id_ >= channels.size()) return 0;
+	return channels[id_].GetRate(endTime, clockPeriod, decayTime);
+}
+
+double RateMonitor::GetDeadFraction(const size_t &id_) const {
+	// Non-paralyzable dead time, where the channel is dead for the resolving time after each recorded hit.
+	double fraction = GetRate(id_)*resolvingTime;
+	return (fraction < 1 ? fraction : 1);
+}
+
+std::string RateMonitor::GetStatus(){
+	std::lock_guard<std::mutex> lock(monitor_mutex);
+	std::stringstream stream;
+	stream << "rate " << formatRate(totalRate);
+
+	// Show the channel with the largest dead time.
+	size_t worst = channels.size();
+	double maxDead = 0;
+	for(size_t i = 0; i < channels.size(); i++){
+		double dead = GetDeadFraction(i);
+		if(dead > maxDead){
+			maxDead = dead;
+			worst = i;
+		}
+	}
+	if(worst < channels.size())
+		stream << ", dead " << std::setprecision(2) << 100*maxDead << "% (" << label(channels[worst]) << ")";
+
+	if(numHot > 0) stream << ", " << numHot << " hot";
+	if(numDead > 0) stream << ", " << numDead << " dead";
+	if(numDrop > 0) stream << ", " << numDrop << " dropping";
+	return stream.str();
+}
+
+void RateMonitor::PrintStatus(){
+	std::lock_guard<std::mutex> lock(monitor_mutex);
+	std::cout << " RateMonitor: Checked " << numSpills << " spills, total rate of " << formatRate(totalRate) << ".\n";
+	std::cout << "  Using a decay time of " << decayTime << " s and a resolving time of " << resolvingTime*1E9 << " ns.\n";
+	std::cout << "  mod\tchan\trate (Hz)\tspill (Hz)\tdead (%)\tpileup (%)\thits\tflags\n";
+	for(size_t i = 0; i < channels.size(); i++){
+		const ChannelRate &chan = channels[i];
+		if(chan.numHits == 0) continue;
+		std::cout << "  " << chan.modNum << "\t" << chan.chanNum << "\t" << GetRate(i) << "\t" << chan.spillRate << "\t";
+		std::cout << 100*GetDeadFraction(i) << "\t" << 100*chan.pileupFraction << "\t" << chan.numHits << "\t";
+		if(chan.flags & RATE_HOT) std::cout << "HOT ";
+		if(chan.flags & RATE_DEAD) std::cout << "DEAD ";
+		if(chan.flags & RATE_DROP) std::cout << "DROP ";
+		std::cout << std::endl;
+	}
+}
+
+void RateMonitor::clear(){
+	channels.clear();
+	spillStart = std::numeric_limits<double>::max();
+	spillStop = std::numeric_limits<double>::lowest();
+	endTime = 0;
+	totalRate = 0;
+	numSpills = 0;
+	numHot = 0;
+	numDead = 0;
+	numDrop = 0;
+}
+
+std::string RateMonitor::label(const ChannelRate &chan_) const {
+	std::stringstream stream;
+	stream << chan_.modNum << ":" << chan_.chanNum;
+	return stream.str();
+}
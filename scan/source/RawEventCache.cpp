@@ -0,0 +1,191 @@
+/** \file RawEventCache.cpp
+ * \brief Stores the raw events built by the Unpacker so that later scans may skip event building.
+ *
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "RawEventCache.hpp"
+#include "XiaData.hpp"
+
+#define CACHE_MAGIC "PIXCACHE"
+#define CACHE_VERSION 1
+
+// Each raw event record is the number of words of encoded channel events, followed by the three
+// raw event times and the channel events. Each spill record is a zero, followed by the number of
+// words of channel id and count pairs and the pairs themselves.
+#define CACHE_END_SPILL_WORD 0x00000000 // Record length marking the end of a spill.
+#define CACHE_END_WORD 0xFFFFFFFF // Record length marking the end of the cache.
+
+RawEventCache::RawEventCache() : length(0), reading(false), writing(false), numRawEvents(0), numSpills(0) {
+}
+
+RawEventCache::~RawEventCache(){
+	Close();
+}
+
+double RawEventCache::GetProgress(){
+	if(!reading || length <= 0) return 0;
+	return (double)input.tellg()/length;
+}
+
+bool RawEventCache::OpenRead(const std::string &fname_, const std::string &key_){
+	Close();
+
+	input.open(fname_.c_str(), std::ios::binary);
+	if(!input.good()){
+		input.close();
+		return false;
+	}
+
+	input.seekg(0, input.end);
+	length = input.tellg();
+	input.seekg(0, input.beg);
+
+	// Check the file identifier and the key.
+	char magic[8];
+	unsigned int version, keyLength;
+	input.read(magic, 8);
+	input.read((char *)&version, 4);
+	input.read((char *)&keyLength, 4);
+	if(!input.good() || memcmp(magic, CACHE_MAGIC, 8) != 0 || version != CACHE_VERSION || keyLength != key_.length()){
+		input.close();
+		return false;
+	}
+	std::string key(keyLength, ' ');
+	input.read(&key[0], keyLength);
+	if(!input.good() || key != key_){
+		input.close();
+		return false;
+	}
+
+	filename = fname_;
+	reading = true;
+	numRawEvents = 0;
+	numSpills = 0;
+
+	return true;
+}
+
+bool RawEventCache::OpenWrite(const std::string &fname_, const std::string &key_){
+	Close();
+
+	tempFilename = fname_ + ".tmp";
+	output.open(tempFilename.c_str(), std::ios::binary);
+	if(!output.good()){
+		output.close();
+		return false;
+	}
+
+	unsigned int version = CACHE_VERSION;
+	unsigned int keyLength = key_.length();
+	output.write(CACHE_MAGIC, 8);
+	output.write((char *)&version, 4);
+	output.write((char *)&keyLength, 4);
+	output.write(key_.c_str(), keyLength);
+
+	filename = fname_;
+	writing = true;
+	numRawEvents = 0;
+	numSpills = 0;
+
+	return output.good();
+}
+
+bool RawEventCache::WriteRawEvent(const std::deque<XiaData*> &rawEvent_, const double *times_){
+	if(!writing || rawEvent_.empty()) return false;
+
+	// Encode all channel events of the raw event.
+	size_t nWords = 0;
+	for(std::deque<XiaData*>::const_iterator iter = rawEvent_.begin(); iter != rawEvent_.end(); ++iter)
+		nWords += (*iter)->getEventLengthRevF();
+	if(record.size() < nWords)
+		record.resize(nWords);
+
+	size_t index = 0;
+	for(std::deque<XiaData*>::const_iterator iter = rawEvent_.begin(); iter != rawEvent_.end(); ++iter){
+		int numBytes = (*iter)->writeEventRevF(NULL, (char *)&record[index]);
+		if(numBytes <= 0) return false;
+		index += numBytes/4;
+	}
+
+	unsigned int recordLength = index;
+	output.write((char *)&recordLength, 4);
+	output.write((char *)times_, 3*sizeof(double));
+	output.write((char *)record.data(), 4*recordLength);
+	numRawEvents++;
+
+	return output.good();
+}
+
+bool RawEventCache::WriteEndSpill(const std::vector<unsigned int> &counts_){
+	if(!writing) return false;
+	unsigned int marker = CACHE_END_SPILL_WORD;
+	unsigned int numWords = counts_.size();
+	output.write((char *)&marker, 4);
+	output.write((char *)&numWords, 4);
+	output.write((char *)counts_.data(), 4*numWords);
+	numSpills++;
+	return output.good();
+}
+
+CacheRecord RawEventCache::Read(unsigned int *&data_, unsigned int &nWords_, double *times_){
+	data_ = NULL;
+	nWords_ = 0;
+	if(!reading) return CACHE_ERROR;
+
+	unsigned int recordLength;
+	input.read((char *)&recordLength, 4);
+	if(!input.good()) return CACHE_ERROR;
+
+	if(recordLength == CACHE_END_WORD) return CACHE_END;
+
+	CacheRecord retval = CACHE_RAW_EVENT;
+	if(recordLength == CACHE_END_SPILL_WORD){
+		input.read((char *)&recordLength, 4);
+		retval = CACHE_END_SPILL;
+	}
+	else input.read((char *)times_, 3*sizeof(double));
+
+	// Guard against reading garbage from a damaged cache.
+	if(!input.good() || (std::streamoff)input.tellg() + 4*(std::streamoff)recordLength > (std::streamoff)length) return CACHE_ERROR;
+
+	if(record.size() < recordLength)
+		record.resize(recordLength);
+	input.read((char *)record.data(), 4*recordLength);
+	if(!input.good()) return CACHE_ERROR;
+
+	data_ = record.data();
+	nWords_ = recordLength;
+	if(retval == CACHE_RAW_EVENT) numRawEvents++;
+	else numSpills++;
+
+	return retval;
+}
+
+bool RawEventCache::Close(const bool &complete_/*=false*/){
+	bool retval = false;
+	if(reading){
+		input.close();
+		reading = false;
+	}
+	if(writing){
+		if(complete_){
+			unsigned int marker = CACHE_END_WORD;
+			output.write((char *)&marker, 4);
+		}
+		output.close();
+		writing = false;
+
+		// Replace the previous cache, or remove the unfinished cache.
+		if(complete_ && !output.fail())
+			retval = (rename(tempFilename.c_str(), filename.c_str()) == 0);
+		else
+			remove(tempFilename.c_str());
+	}
+	return retval;
+}
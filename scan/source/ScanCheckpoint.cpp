@@ -0,0 +1,70 @@
+/** \file ScanCheckpoint.cpp
+ * \brief Stores the state of a scan so that it may be resumed after a crash.
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#include <fstream>
+#include <stdio.h>
+
+#include "ScanCheckpoint.hpp"
+
+#define CHECKPOINT_HEADER "# SimplePixieScan checkpoint"
+#define CHECKPOINT_FOOTER "# end"
+
+template <>
+bool ScanCheckpoint::Get<std::string>(const std::string &name_, std::string &value_) const {
+	std::map<std::string, std::string>::const_iterator iter = values.find(name_);
+	if(iter == values.end()) return false;
+	value_ = iter->second;
+	return true;
+}
+
+bool ScanCheckpoint::Write(const std::string &fname_) const {
+	std::string tempName = fname_ + ".tmp";
+
+	std::ofstream file(tempName.c_str());
+	if(!file.good()) return false;
+
+	file << CHECKPOINT_HEADER << std::endl;
+	for(std::map<std::string, std::string>::const_iterator iter = values.begin(); iter != values.end(); ++iter)
+		file << iter->first << " " << iter->second << std::endl;
+	file << CHECKPOINT_FOOTER << std::endl;
+
+	file.close();
+	if(file.fail()){
+		remove(tempName.c_str());
+		return false;
+	}
+
+	// Replace the previous checkpoint.
+	return (rename(tempName.c_str(), fname_.c_str()) == 0);
+}
+
+bool ScanCheckpoint::Read(const std::string &fname_){
+	values.clear();
+
+	std::ifstream file(fname_.c_str());
+	if(!file.good()) return false;
+
+	std::string line;
+	if(!std::getline(file, line) || line != CHECKPOINT_HEADER) return false;
+
+	// The footer is only written if the entire checkpoint was written.
+	bool complete = false;
+	while(std::getline(file, line)){
+		if(line == CHECKPOINT_FOOTER){
+			complete = true;
+			break;
+		}
+		if(line.empty() || line[0] == '#') continue;
+
+		size_t index = line.find(' ');
+		if(index == std::string::npos) values[line] = "";
+		else values[line.substr(0, index)] = line.substr(index+1);
+	}
+
+	if(!complete) values.clear();
+
+	return complete;
+}
@@ -19,11 +19,20 @@
 
 #include <unistd.h>
 #include <getopt.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "Unpacker.hpp"
 #include "poll2_socket.h"
 #include "CTerminal.h"
 #include "helperFunctions.h"
+#include "StreamMerger.hpp"
+#include "SpillReceiver.hpp"
+#include "SpillSampler.hpp"
+#include "RateMonitor.hpp"
+#include "ScanCheckpoint.hpp"
+#include "RawEventCache.hpp"
 
 #include "ScanInterface.hpp"
 
@@ -90,11 +99,11 @@ void fileInformation::clear(){
   * \return Nothing.
   */
 void ScanInterface::start_scan(){
-	if(!(file_open || shm_mode))
+	if(!(file_open || shm_mode || merger))
 		std::cout << " No input file loaded.\n";
-	else if(!input_file.good())
+	else if(!merger && !input_file.good())
 		std::cout << " Error reading from input file!\n";
-	else if(input_file.eof())
+	else if(!merger && input_file.eof())
 		std::cout << " Physical end-of-file reached.\n";
 	else if(is_running)
 		std::cout << " Already running.\n";
@@ -159,10 +168,26 @@ bool ScanInterface::rewind(const std::streampos &offset_/*=0*/){
 		std::cout << " Cannot change file position while scan is running!\n";
 		return false;
 	}
+	else if(event_cache && event_cache->IsReading()){
+		std::cout << " Cannot change file position while replaying the raw event cache!\n";
+		return false;
+	}
+
+	// Raw events which were already written to the cache would be written again.
+	if(event_cache && event_cache->IsWriting()){
+		std::cout << " Discarding incomplete raw event cache \"" << event_cache->GetFilename() << "\".\n";
+		close_event_cache(false);
+	}
+
+	// Move to the start of the spill containing the requested position.
+	std::streampos offset = offset_;
+	if(file_format == 3 && cldIndex.GetNumSpills() > 0)
+		offset = cldIndex.FindSpill(offset_);
 
 	// Move to the first word in the file.
-	std::cout << " Seeking to word no. " << offset_/4 << " in file\n";
-	input_file.seekg(offset_, input_file.beg);
+	std::cout << " Seeking to word no. " << offset/4 << " in file\n";
+	input_file.clear();
+	input_file.seekg(offset, input_file.beg);
 	std::cout << " Input file is now at " << input_file.tellg() << " bytes\n";
 
 	// Notify that the user has rewound to the start of the file.
@@ -192,11 +217,12 @@ bool ScanInterface::restart(const std::streampos &offset_/*=0*/){
 }
 
 /** Open a new binary input file for reading.
-  * \param[in]  fname_ Input filename to open for reading.
+  * \param[in]  fname_  Input filename to open for reading.
+  * \param[in]  queued_ Set to true if the file is being opened from the run queue while the scan is running.
   * \return True upon successfully opening the file and false otherwise.
   */
-bool ScanInterface::open_input_file(const std::string &fname_){
-	if(is_running){ 
+bool ScanInterface::open_input_file(const std::string &fname_, const bool &queued_/*=false*/){
+	if(is_running && !queued_){ 
 		std::cout << " ERROR! Unable to open input file while scan is running.\n"; 
 		return false;
 	}
@@ -217,20 +243,27 @@ bool ScanInterface::open_input_file(const std::string &fname_){
 	else if(extension == "pld"){ // Pixie list data file format
 		file_format = 1;
 	}
+	else if(extension == "cld"){ // Compact list data file format
+		file_format = 3;
+	}
 	else{
 		std::cout << " ERROR! Invalid file format '" << extension << "'\n";
 		std::cout << "  The current valid data formats are:\n";
 		std::cout << "   ldf - list data format (HRIBF)\n";
 		std::cout << "   pld - pixie list data format\n";
+		std::cout << "   cld - compact list data format\n";
 		return false;
 	}
 
 	// Close the previous file, if one is open.
 	if(file_open){
-		std::cout << " Note: Closing previously opened file.\n";
+		if(!queued_) std::cout << " Note: Closing previously opened file.\n";
 		input_file.close();
 	}
 
+	// Reset the prefetch flag for the next file in the queue.
+	prefetch_done = false;
+
 	file_open = true;
 
 	// Load the input file.
@@ -245,6 +278,8 @@ bool ScanInterface::open_input_file(const std::string &fname_){
  	file_length = input_file.tellg();
  	input_file.seekg(0, input_file.beg);
 
+	file_number++;
+
 	if(!shm_mode){
 		// Clear the file information container.
 		finfo.clear();
@@ -273,6 +308,9 @@ bool ScanInterface::open_input_file(const std::string &fname_){
 			pldHead.Read(&input_file);
 			
 			max_spill_size = pldHead.GetMaxSpillSize();
+			
+			// Size the spill buffers so that the largest spill in the file fits without re-allocation.
+			spill_pool.SetInitialSize(max_spill_size+2);
 
 			// Store the file information for later use.
 			finfo.push_back("Facility", pldHead.GetFacility());
@@ -287,8 +325,45 @@ bool ScanInterface::open_input_file(const std::string &fname_){
 			pldHead.Print();	
 			std::cout << std::endl;
 		}
+		else if(file_format == 3){
+			if(!cldHead.Read(&input_file, &pldHead)){
+				std::cout << " ERROR! Failed to read header of compact list data file '" << fname_ << "'!\n";
+				input_file.close();
+				file_open = false;
+				return false;
+			}
+
+			max_spill_size = pldHead.GetMaxSpillSize();
+
+			// Spills are stored with their end of spill marker.
+			spill_pool.SetInitialSize(max_spill_size);
+
+			// The index is used to seek to the start of a spill. The file may still be read without it.
+			if(!cldIndex.Read(&input_file)){
+				std::cout << " WARNING! Input file has no spill index. Was the file closed properly?\n";
+			}
+
+			// Store the file information for later use.
+			finfo.push_back("Facility", pldHead.GetFacility());
+			finfo.push_back("Format", pldHead.GetFormat());
+			finfo.push_back("Start", pldHead.GetStartDate());
+			finfo.push_back("Stop", pldHead.GetEndDate());
+			finfo.push_back("Title", pldHead.GetRunTitle());
+			finfo.push_back("Run number", pldHead.GetRunNumber());
+			finfo.push_back("Max spill", max_spill_size, "words");
+			finfo.push_back("ACQ time", pldHead.GetRunTime(), "seconds");
+			finfo.push_back("Spills", cldIndex.GetNumSpills());
+			finfo.push_back("Compression", cldHead.GetCompressionName());
+
+			pldHead.Print();
+			std::cout << "  Spills:     " << cldIndex.GetNumSpills() << " (" << cldIndex.GetTotalWords() << " words)\n";
+			std::cout << "  Compression: " << cldHead.GetCompressionName() << std::endl;
+			std::cout << std::endl;
+		}
 	}
 
+	file_data_start = input_file.tellg();
+
 	// Notify that the user has loaded a new file.
 	Notify("LOAD_FILE");
 
@@ -312,6 +387,210 @@ bool ScanInterface::open_input_file(const std::string &fname_){
 	return true;	
 }
 
+/** Read the header of an input file and check that it is a valid .ldf, .pld, or .cld file.
+  * \param[in]  fname_   Input filename to validate.
+  * \param[out] summary_ Short description of the file (run number and title).
+  * \return True if the file may be scanned and false otherwise.
+  */
+bool ScanInterface::validate_input_file(const std::string &fname_, std::string &summary_){
+	std::string filePrefix;
+	std::string fileExtension = get_extension(fname_, filePrefix);
+	if(fileExtension != "ldf" && fileExtension != "pld" && fileExtension != "cld"){
+		std::cout << msgHeader << "Invalid file format '" << fileExtension << "' for input file " << fname_ << ".\n";
+		return false;
+	}
+
+	std::ifstream file(fname_.c_str(), std::ios::binary);
+	if(!file.is_open() || !file.good()){
+		std::cout << msgHeader << "Failed to open input file " << fname_ << ".\n";
+		return false;
+	}
+	
+	std::stringstream stream;
+	if(fileExtension == "ldf"){
+		DIR_buffer dir;
+		HEAD_buffer head;
+		if(!dir.Read(&file) || !head.Read(&file)){
+			std::cout << msgHeader << "Failed to read ldf header of input file " << fname_ << ".\n";
+			return false;
+		}
+		stream << "run " << dir.GetRunNumber() << ", \"" << head.GetRunTitle() << "\"";
+	}
+	else if(fileExtension == "pld"){
+		PLD_header head;
+		if(!head.Read(&file)){
+			std::cout << msgHeader << "Failed to read pld header of input file " << fname_ << ".\n";
+			return false;
+		}
+		stream << "run " << head.GetRunNumber() << ", \"" << head.GetRunTitle() << "\", " << head.GetMaxSpillSize() << " word max spill";
+	}
+	else if(fileExtension == "cld"){
+		CLD_header cld;
+		PLD_header head;
+		if(!cld.Read(&file, &head)){
+			std::cout << msgHeader << "Failed to read cld header of input file " << fname_ << ".\n";
+			return false;
+		}
+		stream << "run " << head.GetRunNumber() << ", \"" << head.GetRunTitle() << "\", " << head.GetMaxSpillSize() << " word max spill";
+	}
+	summary_ = stream.str();
+	
+	return true;
+}
+
+/** Add input files to the run queue. The input may be a (quoted) glob pattern, a single
+  * .ldf, .pld, or .cld file, or a text file containing a list of input filenames (one per line).
+  * The headers of all files are read and validated before they are added to the queue.
+  * \param[in]  input_ Glob pattern, input filename, or list filename.
+  * \return The number of files which were added to the queue.
+  */
+int ScanInterface::queue_input_files(const std::string &input_){
+	std::vector<std::string> filenames;
+	
+	std::string listPrefix;
+	std::string listExtension = get_extension(input_, listPrefix);
+	if(input_.find_first_of("*?[") != std::string::npos){ // Glob pattern.
+		glob_t results;
+		if(glob(input_.c_str(), 0, NULL, &results) == 0){
+			for(size_t i = 0; i < results.gl_pathc; i++)
+				filenames.push_back(std::string(results.gl_pathv[i]));
+		}
+		globfree(&results);
+	}
+	else if(listExtension == "ldf" || listExtension == "pld" || listExtension == "cld"){ // Single input file.
+		filenames.push_back(input_);
+	}
+	else{ // List of input files.
+		std::ifstream listFile(input_.c_str());
+		if(!listFile.good()){
+			std::cout << msgHeader << "Failed to open input file list " << input_ << ".\n";
+			return 0;
+		}
+		std::string line;
+		while(std::getline(listFile, line)){
+			// Strip leading and trailing whitespace and skip comments.
+			size_t start = line.find_first_not_of(" \t");
+			if(start == std::string::npos || line[start] == '#') continue;
+			size_t stop = line.find_last_not_of(" \t\r");
+			filenames.push_back(line.substr(start, stop-start+1));
+		}
+	}
+	
+	if(filenames.empty()){
+		std::cout << msgHeader << "No input files found matching \"" << input_ << "\".\n";
+		return 0;
+	}
+
+	// Parse all file headers up front, so that bad files are rejected before the scan starts.
+	int numAdded = 0;
+	std::string summary;
+	for(std::vector<std::string>::iterator iter = filenames.begin(); iter != filenames.end(); ++iter){
+		if(!validate_input_file(*iter, summary)){
+			std::cout << msgHeader << "Skipping invalid input file " << *iter << ".\n";
+			continue;
+		}
+		queue_mutex.lock();
+		file_queue.push_back(*iter);
+		std::cout << msgHeader << "Queued file " << file_queue.size() << ": " << *iter << " (" << summary << ")\n";
+		queue_mutex.unlock();
+		numAdded++;
+	}
+	
+	return numAdded;
+}
+
+/** Ask the kernel to read ahead the start of the next file in the run queue, so that the
+  * first buffers of the file are already in memory when the current file is finished.
+  * \return Nothing.
+  */
+void ScanInterface::prefetch_next_file(){
+	if(prefetch_done) return;
+	prefetch_done = true;
+
+	std::string fname;
+	queue_mutex.lock();
+	if(!file_queue.empty()) fname = file_queue.front();
+	queue_mutex.unlock();
+	if(fname.empty()) return;
+
+	int fd = open(fname.c_str(), O_RDONLY);
+	if(fd < 0) return;
+	posix_fadvise(fd, 0, prefetch_size, POSIX_FADV_WILLNEED);
+	close(fd);
+	
+	if(debug_mode){ std::cout << "debug: Prefetching " << prefetch_size << " bytes of queued file " << fname << std::endl; }
+}
+
+/** Open the next file in the run queue. The file start and stop offsets only apply to the
+  * first file which is scanned, so they are reset here.
+  * \return True if the next file was opened and false if the queue is empty.
+  */
+bool ScanInterface::open_next_file(){
+	while(true){
+		std::string fname;
+		queue_mutex.lock();
+		if(!file_queue.empty()){
+			fname = file_queue.front();
+			file_queue.pop_front();
+		}
+		queue_mutex.unlock();
+		if(fname.empty()) return false;
+
+		file_start_offset = 0;
+		file_start_percent = -1;
+		file_stop_offset = 0;
+		file_stop_percent = -1;
+	
+		std::cout << msgHeader << "Continuing with queued file " << fname << ".\n";
+		if(open_input_file(fname, true)){
+			input_filename = fname;
+			return true;
+		}
+		std::cout << msgHeader << "Failed to open queued file " << fname << "!\n";
+	}
+	return false;
+}
+
+/** Open all crate input streams listed in a merge list file. The merged stream
+  * is treated as a single input file.
+  * \param[in]  fname_ Path to the merge list file.
+  * \return True if all streams were opened successfully and false otherwise.
+  */
+bool ScanInterface::open_merge_streams(const std::string &fname_){
+	if(shm_mode){
+		std::cout << " ERROR! Unable to merge input streams in shm mode.\n"; 
+		return false;
+	}
+
+	merger = new StreamMerger();
+	merger->SetDebugMode(debug_mode);
+	if(!merger->ReadConfig(fname_) || !merger->Open()){
+		delete merger;
+		merger = NULL;
+		return false;
+	}
+
+	// Store the file information for later use.
+	finfo.clear();
+	finfo.push_back("Title", merger->GetRunTitle());
+	finfo.push_back("Run number", merger->GetRunNumber());
+	finfo.push_back("Streams", (int)merger->GetNumStreams());
+	std::cout << std::endl;
+
+	// Notify that the user has loaded a new file.
+	Notify("LOAD_FILE");
+
+	return true;
+}
+
+/// Return the number of input files waiting in the run queue.
+size_t ScanInterface::GetQueueSize(){
+	queue_mutex.lock();
+	size_t retval = file_queue.size();
+	queue_mutex.unlock();
+	return retval;
+}
+
 /** Add a command line option to the option list.
   * \param[in]  opt_ The option to add to the list.
   * \return Nothing.
@@ -329,6 +608,189 @@ void ScanInterface::SyntaxStr(char *name_){
 	std::cout << " usage: " << name_ << " [options]\n";
 }
 
+/** Write a checkpoint if the checkpoint interval has elapsed since the last checkpoint.
+  * This method must only be called between spills, after the spill has been processed.
+  * \return Nothing.
+  */
+void ScanInterface::checkpoint_spill(){
+	if(checkpoint_interval <= 0 || checkpoint_filename.empty() || dry_run_mode){ return; }
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(std::chrono::duration<double>(now - last_checkpoint).count() < checkpoint_interval){ return; }
+	last_checkpoint = now;
+
+	if(!write_checkpoint())
+		std::cout << msgHeader << "Failed to write checkpoint file \"" << checkpoint_filename << "\"!\n";
+}
+
+/** Write a checkpoint containing the position of the next spill in the input file, the state of the
+  * Unpacker, and the state of the derived class. The previous checkpoint is replaced.
+  * \return True upon success and false otherwise.
+  */
+bool ScanInterface::write_checkpoint(){
+	// The ldf reader reads ahead, so the position is taken from the buffer reader.
+	std::streampos offset = input_file.tellg();
+	unsigned int word = 0;
+	if(file_format == 0 && !databuff.GetPosition(offset, word)){ return false; }
+	else if(offset < 0){ return false; }
+
+	ScanCheckpoint ckpt;
+	ckpt.Set("scan.format", file_format);
+	ckpt.Set("scan.file_number", file_number);
+	ckpt.Set("scan.file_name", input_filename);
+	ckpt.Set("scan.file_length", (std::streamoff)file_length);
+	ckpt.Set("scan.file_offset", (std::streamoff)offset);
+	ckpt.Set("scan.buffer_word", word);
+	ckpt.Set("scan.num_spills", num_spills_recvd);
+
+	core->SaveState(&ckpt);
+	if(!SaveCheckpoint(&ckpt) || !ckpt.Write(checkpoint_filename)){ return false; }
+
+	if(debug_mode){ std::cout << "debug: Wrote checkpoint at word number " << offset/4 << " of input file " << input_filename << std::endl; }
+	num_checkpoints++;
+
+	// Notify that the checkpoint is complete.
+	Notify("CHECKPOINT");
+
+	return true;
+}
+
+/** Open the raw event cache of the current input file. If a cache was written during a previous scan
+  * of the unmodified file using the same event builder settings, it is replayed instead of the file.
+  * Otherwise, a new cache is written while the file is scanned. Raw events are only cached when the
+  * entire input file is scanned.
+  * \return True if the cache is to be replayed and false otherwise.
+  */
+bool ScanInterface::open_event_cache(){
+	if(!event_cache || file_format == 2){ return false; }
+
+	// Raw event statistics include channel events which are not part of a raw event.
+	if(core->GetUseRawEventStats()){
+		std::cout << msgHeader << "Raw event caching is not supported when writing raw event statistics.\n";
+		return false;
+	}
+	else if(resume_pending || file_start_offset != 0 || file_stop_offset != 0 || input_file.tellg() > file_data_start){
+		std::cout << msgHeader << "Raw event cache is only used when scanning the entire input file.\n";
+		return false;
+	}
+
+	std::string fname = prefix + "." + extension;
+	size_t index = prefix.find_last_of('/');
+	std::string cache_filename = cache_dir + "/" + (index != std::string::npos ? fname.substr(index+1) : fname) + ".cache";
+
+	// The cache may only be replayed for the same unmodified input file and event builder settings.
+	struct stat info;
+	std::stringstream key;
+	key << fname << ";" << (std::streamoff)file_length << ";" << (stat(fname.c_str(), &info) == 0 ? info.st_mtime : 0);
+	key << ";" << core->GetBuilderSettings();
+
+	if(event_cache->OpenRead(cache_filename, key.str())){
+		std::cout << msgHeader << "Replaying raw events from cache \"" << cache_filename << "\".\n";
+		return true;
+	}
+
+	if(event_cache->OpenWrite(cache_filename, key.str())){
+		if(debug_mode){ std::cout << "debug: Writing raw events to cache " << cache_filename << std::endl; }
+		core->SetEventCache(event_cache);
+	}
+	else{ std::cout << msgHeader << "Failed to open raw event cache \"" << cache_filename << "\" for writing!\n"; }
+
+	return false;
+}
+
+/** Close the raw event cache of the current input file. A cache which is being written
+  * is only kept if the entire input file was scanned.
+  * \param[in]  complete_ Set to true if all spills of the input file were scanned.
+  * \return Nothing.
+  */
+void ScanInterface::close_event_cache(const bool &complete_){
+	if(!event_cache){ return; }
+
+	core->SetEventCache(NULL);
+
+	if(event_cache->IsWriting()){
+		unsigned long numRawEvents = event_cache->GetNumRawEvents();
+		unsigned long numSpills = event_cache->GetNumSpills();
+		if(event_cache->Close(complete_))
+			std::cout << msgHeader << "Wrote " << numRawEvents << " raw events (" << numSpills << " spills) to cache \"" << event_cache->GetFilename() << "\".\n";
+	}
+	else{ event_cache->Close(); }
+}
+
+/** Read the checkpoint file and restore the state of the Unpacker and the derived class. Input files
+  * in the run queue which were completely scanned before the checkpoint are opened and skipped. If
+  * no checkpoint exists, the scan starts from the beginning of the run.
+  * \return True upon success and false if the checkpoint does not match the current input files.
+  */
+bool ScanInterface::resume_from_checkpoint(){
+	ScanCheckpoint ckpt;
+	if(!ckpt.Read(checkpoint_filename)){
+		std::cout << msgHeader << "No checkpoint found at \"" << checkpoint_filename << "\", starting from the beginning of the run.\n";
+		return true;
+	}
+
+	int format;
+	unsigned int fileNumber;
+	std::string fileName;
+	std::streamoff fileLength;
+	std::streamoff fileOffset;
+	if(!ckpt.Get("scan.format", format) || !ckpt.Get("scan.file_number", fileNumber) || !ckpt.Get("scan.file_name", fileName) ||
+	   !ckpt.Get("scan.file_length", fileLength) || !ckpt.Get("scan.file_offset", fileOffset) || !ckpt.Get("scan.buffer_word", resume_word)){
+		std::cout << " ERROR! Checkpoint file does not contain the input file position!\n";
+		return false;
+	}
+
+	// Skip the input files which were scanned before the checkpoint was written.
+	while(file_number < fileNumber){
+		if(!open_next_file()){
+			std::cout << " ERROR! Checkpoint is in input file no. " << fileNumber << ", but only " << file_number << " files are in the run queue!\n";
+			return false;
+		}
+	}
+
+	if(file_format != format || input_filename != fileName || (std::streamoff)file_length != fileLength){
+		std::cout << " ERROR! Checkpoint input file \"" << fileName << "\" (" << fileLength << " bytes) does not match \"" << input_filename << "\" (" << file_length << " bytes)!\n";
+		return false;
+	}
+
+	if(!core->LoadState(&ckpt)){
+		std::cout << " ERROR! Failed to restore unpacker state from checkpoint!\n";
+		return false;
+	}
+	if(!LoadCheckpoint(&ckpt)){
+		std::cout << " ERROR! Failed to restore scan output from checkpoint!\n";
+		return false;
+	}
+	ckpt.Get("scan.num_spills", num_spills_recvd);
+
+	// The input file is moved to the checkpoint position when the scan starts.
+	resume_offset = fileOffset;
+	resume_pending = true;
+
+	std::cout << msgHeader << "Resuming scan of " << input_filename << " at word no. " << fileOffset/4 << " (" << 100.0*fileOffset/file_length << "%)\n";
+
+	return true;
+}
+
+/** Move the input file to the position stored in the checkpoint. Must be called after the
+  * buffer reader for the current file format has been reset.
+  * \return True upon success and false otherwise.
+  */
+bool ScanInterface::seek_checkpoint(){
+	resume_pending = false;
+	if(file_format == 0){ return databuff.SetPosition(&input_file, resume_offset, resume_word); }
+	input_file.clear();
+	input_file.seekg(resume_offset, input_file.beg);
+	return input_file.good();
+}
+
+/** Return the weight of the spill which is currently being processed.
+  * \return The sampling factor used when the spill was selected, or one if spills are not sampled.
+  */
+unsigned int ScanInterface::GetSpillWeight(){
+	return (sampler ? sampler->GetWeight() : 1);
+}
+
 /** Initialize the Unpacker object. 
   * Does nothing useful by default.
   * \param[in]  prefix_ String to append to the beginning of system output.
@@ -362,9 +824,6 @@ ScanInterface::ScanInterface(Unpacker *core_/*=NULL*/){
 	// Get the home directory.
 	homeDir = getenv("HOME");
 
-	maxShmSizeL = 4052;
-	maxShmSize  = maxShmSizeL * 4;
-
 	max_spill_size = 0;
 	file_format = -1;
 
@@ -389,10 +848,32 @@ ScanInterface::ScanInterface(Unpacker *core_/*=NULL*/){
 	file_open = false;
 	automatic_start = false;
 
+	file_stop_reached = false;
+	prefetch_done = false;
+	prefetch_size = 32*1024*1024; // 32 MB
+
+	checkpoint_interval = -1;
+	num_checkpoints = 0;
+	file_number = 0;
+	resume_mode = false;
+	resume_pending = false;
+	resume_offset = 0;
+	resume_word = 0;
+	scan_complete = false;
+
 	kill_all = false;
 	run_ctrl_exit = false;
 
 	poll_server = NULL;
+	receiver = NULL;
+	sampler = NULL;
+	max_sampling = 64;
+	rates = NULL;
+	rate_decay_time = -1;
+	rate_resolving_time = 1000;
+	merger = NULL;
+	event_cache = NULL;
+	file_data_start = 0;
 	term = NULL;
 	
 	// Set the Unpacker pointer, if one is specified.
@@ -407,11 +888,19 @@ ScanInterface::ScanInterface(Unpacker *core_/*=NULL*/){
 	baseOpts.push_back(optionExt("dry-run", no_argument, NULL, 0, "", "Extract spills from file, but do no processing"));
 	baseOpts.push_back(optionExt("fast-fwd", required_argument, NULL, 0, "<word>", "Skip ahead to a specified fraction (.xx) or word in the file (start of file at zero)"));
 	baseOpts.push_back(optionExt("stop-point", required_argument, NULL, 0, "<word>", "Stop scanning the input file when the specified fraction (.xx) or word is reached"));
+	baseOpts.push_back(optionExt("queue", required_argument, NULL, 0, "<list>", "Scan a list file or (quoted) glob pattern of input files as one continuous run"));
+	baseOpts.push_back(optionExt("merge", required_argument, NULL, 0, "<list>", "Merge the input files of multiple crates into one time-ordered stream"));
+	baseOpts.push_back(optionExt("checkpoint", required_argument, NULL, 0, "<sec>", "Write a checkpoint every <sec> seconds so that an interrupted scan may be resumed"));
+	baseOpts.push_back(optionExt("resume", no_argument, NULL, 0, "", "Resume the scan from the last checkpoint (or start a new scan if there is none)"));
+	baseOpts.push_back(optionExt("cache", required_argument, NULL, 0, "<dir>", "Cache built raw events in <dir> and replay them when a file is scanned again with the same event settings"));
 	baseOpts.push_back(optionExt("help", no_argument, NULL, 'h', "", "Display this dialogue"));
 	baseOpts.push_back(optionExt("input", required_argument, NULL, 'i', "<filename>", "Specifies the input file to analyze"));
 	baseOpts.push_back(optionExt("output", required_argument, NULL, 'o', "<filename>", "Specifies the name of the output file. Default is \"out\""));
 	baseOpts.push_back(optionExt("quiet", no_argument, NULL, 'q', "", "Toggle off verbosity flag"));
 	baseOpts.push_back(optionExt("shm", no_argument, NULL, 's', "", "Enable shared memory readout"));
+	baseOpts.push_back(optionExt("sampling", required_argument, NULL, 0, "<N>", "Process at least one in every N spills when shm processing cannot keep up (default=64, 1 processes every spill)"));
+	baseOpts.push_back(optionExt("rates", required_argument, NULL, 0, "<sec>", "Monitor channel rates with a decay time of <sec> seconds and report hot, dead, and dropping channels"));
+	baseOpts.push_back(optionExt("dead-time", required_argument, NULL, 0, "<ns>", "Set the channel resolving time used to estimate the dead time (default=1000 ns)"));
 	baseOpts.push_back(optionExt("version", no_argument, NULL, 'v', "", "Display version information"));
 	baseOpts.push_back(optionExt("auto-start", no_argument, NULL, 'A', "", "Automatically start scan upon loading input file"));
 
@@ -435,6 +924,7 @@ void ScanInterface::RunControl(){
 	if(debug_mode){
 		pldHead.SetDebugMode();
 		pldData.SetDebugMode();
+		cldData.SetDebugMode();
 		dirbuff.SetDebugMode();
 		headbuff.SetDebugMode();
 		databuff.SetDebugMode();
@@ -451,19 +941,9 @@ void ScanInterface::RunControl(){
 			usleep(0.1);
 			continue;
 		}
-		else if(shm_mode){
-			std::cout << std::endl;
-			unsigned int data[250000]; // Array for storing spill data. Larger than any RevF spill should be.
-			unsigned int *shm_data = new unsigned int[maxShmSizeL]; // Array to store the temporary shm data (~16 kB)
-			int dummy;
-			int previous_chunk;
-			int current_chunk;
-			int total_chunks;
-			int nWords;
-			unsigned int nTotalWords;
-	
-			bool full_spill = false;
-		
+		else if(!shm_mode && !merger && open_event_cache()){ // Otherwise, the cache is written while the file is scanned.
+			int retval = 0;
+
 			while(true){
 				if(kill_all == true){ 
 					break;
@@ -474,96 +954,154 @@ void ScanInterface::RunControl(){
 					continue;
 				}
 
-				int select_dummy;
-				previous_chunk = 0;
-				current_chunk = 0;
-				total_chunks = -1;
-				nTotalWords = 0;
-				full_spill = true;
+				// Cached raw events are passed directly to the Unpacker, so the input file is not read.
+				if((retval = core->ReplaySpill(event_cache, is_verbose)) <= 0){ break; }
+
+				std::stringstream status;
+				status << "\033[0;32m" << "[CACHE] " << "\033[0m" << event_cache->GetNumRawEvents() << " raw events (" << (int)(100*event_cache->GetProgress()) << "%)";
+				if(!batch_mode){ term->SetStatus(status.str()); }
+				else{ std::cout << "\r" << status.str(); }
+
+				IdleTask();
+				num_spills_recvd++;
+			}
+
+			// The cache is written again the next time the file is scanned.
+			if(retval < 0){
+				std::cout << " ERROR! Failed to replay raw event cache \"" << event_cache->GetFilename() << "\", removing it!\n";
+				event_cache->Close();
+				remove(event_cache->GetFilename().c_str());
+			}
+		
+			if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Finished replaying raw event cache."); }
+			else{ std::cout << std::endl << std::endl; }
+		}
+		else if(merger){
+			std::deque<XiaData*> hits;
+
+			// Start reading all crate streams.
+			merger->Start();
 
-				if(!poll_server->Select(dummy)){
-					if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Waiting for a spill..."); }
-					else{ std::cout << "\r\033[0;33m[IDLE]\033[0m Waiting for a spill..."; }
+			while(true){
+				if(kill_all == true){ 
+					break;
+				}
+				else if(!is_running){
 					IdleTask();
-					continue; 
+					usleep(100000); //0.1 seconds
+					continue;
 				}
-		
-				if(!poll_server->Select(select_dummy)){ continue; } // Server timeout
-		
-				// Get the spill
-				while(current_chunk != total_chunks){
-					if(!poll_server->Select(select_dummy)){ // Server timeout
-						std::cout << msgHeader << "Network timeout before recv full spill!\n";
-						full_spill = false;
-						break;
-					} 
 
-					nWords = poll_server->RecvMessage((char*)shm_data, maxShmSize) / 4; // Read from the socket
-					if(strcmp((char*)shm_data, "$CLOSE_FILE") == 0 || strcmp((char*)shm_data, "$OPEN_FILE") == 0 || strcmp((char*)shm_data, "$KILL_SOCKET") == 0){ continue; } // Poll2 network flags
-					// Did not read enough bytes
-					else if(nWords < 2){
-						continue;
-					}
+				// Retrieve the next time-ordered batch of hits from all crates.
+				if(!merger->GetNext(hits)){ break; }
 
-					if(debug_mode){ std::cout << "debug: Received " << nWords << " words from the network\n"; }
-					memcpy((char *)&current_chunk, &shm_data[0], 4);
-					memcpy((char *)&total_chunks, &shm_data[1], 4);
+				std::stringstream status;
+				status << "\033[0;32m" << "[MERGE] " << "\033[0m" << merger->GetStatus();
+				if(rates){ status << ", " << rates->GetStatus(); }
+				if(!batch_mode){ term->SetStatus(status.str()); }
+				else{ std::cout << "\r" << status.str(); }
 
-					if(previous_chunk == -1 && current_chunk != 1){ // Started reading in the middle of a spill, ignore the rest of it
-						if(debug_mode){ std::cout << "debug: Skipping chunk " << current_chunk << " of " << total_chunks << std::endl; }
-						continue;
-					}
-					else if(previous_chunk != current_chunk - 1){ // We missed a spill chunk somewhere
-						if(debug_mode){ std::cout << "debug: Found chunk " << current_chunk << " but expected chunk " << previous_chunk+1 << std::endl; }
-						break;
-					}
+				if(debug_mode){ std::cout << "debug: Retrieved " << hits.size() << " merged hits\n"; }
 
-					previous_chunk = current_chunk;
-		
-					// Copy the shm spill chunk into the data array
-					if(nTotalWords + 2 + nWords <= 250000){ // This spill chunk will fit into the data buffer
-						memcpy(&data[nTotalWords], &shm_data[2], (nWords - 2)*4);
-						nTotalWords += (nWords - 2);				
+				if(!dry_run_mode){
+					core->ReadHits(hits, is_verbose);
+					IdleTask();
+				}
+				else{
+					while(!hits.empty()){
+						delete hits.front();
+						hits.pop_front();
 					}
-					else{ 
-						if(debug_mode){ std::cout << "debug: Abnormally full spill buffer with " << nTotalWords + 2 + nWords << " words!\n"; }
-						break; 
+				}
+				num_spills_recvd++;
+			}
+
+			merger->Stop();
+
+			if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Finished merging input streams."); }
+			else{ std::cout << std::endl << std::endl; }
+
+			merger->PrintStatus();
+		}
+		else if(shm_mode){
+			std::cout << std::endl;
+			unsigned int *data; // Pointer to the spill data inside of the receiver ring.
+			unsigned int nWords;
+
+			receiver->SetDebugMode(debug_mode);
+			receiver->Start();
+			sampler->Reset();
+
+			while(true){
+				if(kill_all == true){ 
+					break;
+				}
+
+				// Wait for the receiver thread to assemble a full spill.
+				int slot = receiver->GetSpill(data, nWords, 1000);
+				if(slot < 0){
+					if(is_running){
+						if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Waiting for a spill..."); }
+						else{ std::cout << "\r\033[0;33m[IDLE]\033[0m Waiting for a spill..."; }
 					}
+					IdleTask();
+					continue; 
+				}
+				else if(!is_running){ // Keep draining the receiver so that the spill ring does not overflow.
+					receiver->Release(slot);
+					IdleTask();
+					continue;
+				}
+
+				// Skip spills at regular intervals when processing cannot keep up with the incoming spills.
+				unsigned long numArrived = receiver->GetNumSpills() + receiver->GetNumDropped() + receiver->GetNumOverflow();
+				if(!sampler->Arrive(numArrived, receiver->GetNumReady(), receiver->GetNumSlots())){
+					if(debug_mode){ std::cout << "debug: Skipped spill of " << nWords-2 << " words (sampling factor " << sampler->GetFactor() << ")\n"; }
+					receiver->Release(slot);
+					num_spills_recvd++;
+					continue;
 				}
 
 				std::stringstream status;
-				status << "\033[0;32m" << "[RECV] " << "\033[0m" << nTotalWords << " words";
+				status << "\033[0;32m" << "[RECV] " << "\033[0m" << nWords-2 << " words (" << receiver->GetStatus() << "), " << sampler->GetStatus();
+				if(rates){ status << ", " << rates->GetStatus(); }
 				if(!batch_mode){ term->SetStatus(status.str()); }
 				else{ std::cout << "\r" << status.str(); }
 		
-				if(debug_mode){ std::cout << "debug: Retrieved spill of " << nTotalWords << " words (" << nTotalWords*4 << " bytes)\n"; }
-				if(!dry_run_mode && full_spill){ 
-					int word1 = 2, word2 = 9999;
-					memcpy(&data[nTotalWords], (char *)&word1, 4);
-					memcpy(&data[nTotalWords+1], (char *)&word2, 4);
-					core->ReadSpill(data, nTotalWords + 2, is_verbose); 
+				if(debug_mode){ std::cout << "debug: Retrieved spill of " << nWords-2 << " words (" << (nWords-2)*4 << " bytes)\n"; }
+				if(!dry_run_mode){ 
+					std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+					core->ReadSpill(data, nWords, is_verbose); 
 					IdleTask();
+					sampler->Processed(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
 				}
-			
-				if(!full_spill){ std::cout << msgHeader << "Not processing spill fragment!\n"; }
-				else{ num_spills_recvd++; }
+				receiver->Release(slot);
+				num_spills_recvd++;
 			}
-		
-			delete[] shm_data;
+
+			receiver->Stop();
+			receiver->PrintStatus();
+			sampler->PrintStatus();
 		}
 		else if(file_format == 0){
+			SpillBuffer *buffer = spill_pool.Get();
 			unsigned int *data = NULL;
 			bool full_spill;
 			bool bad_spill;
 			unsigned int nBytes;
 		
-			if(!dry_run_mode){ data = new unsigned int[250000]; }
-		
 			// Reset the buffer reader to default values.
 			databuff.Reset();
+
+			// Move to the position of the resumed scan.
+			if(resume_pending && !seek_checkpoint()){
+				std::cout << " ERROR! Failed to move to checkpoint position in input file!\n";
+				kill_all = true;
+			}
 		
 			while(true){
 				if(is_running && (file_stop_offset != 0 && input_file.tellg() >= file_stop_offset)){
+					file_stop_reached = true;
 					if(batch_mode) break;
 					stop_scan();
 				}
@@ -577,7 +1115,7 @@ void ScanInterface::RunControl(){
 					continue;
 				}
 
-				if(!databuff.Read(&input_file, (char*)data, nBytes, 1000000, full_spill, bad_spill, dry_run_mode)){
+				if(!databuff.Read(&input_file, buffer, nBytes, full_spill, bad_spill, dry_run_mode)){
 					if(databuff.GetRetval() == 1){
 						if(debug_mode){ std::cout << "debug: Encountered single EOF buffer (end of run).\n"; }
 					}
@@ -598,12 +1136,21 @@ void ScanInterface::RunControl(){
 						if(debug_mode){ std::cout << "debug: Failed to read buffer from input file.\n"; }
 						break;
 					}
+					else if(databuff.GetRetval() == 7){
+						std::cout << " WARNING: Spill is larger than the maximum buffer size of " << buffer->GetLimit() << " words, skipping (at word " << input_file.tellg()/4 << " in file)!\n";
+					}
 					continue;
 				}
+				data = buffer->GetData();
+
+				// Prefetch the next queued file when the current file is nearly finished.
+				if(input_file.tellg() + prefetch_size >= file_length)
+					prefetch_next_file();
 
 				std::stringstream status;			
 				status << "\033[0;32m" << "[READ] " << "\033[0m" << nBytes/4 << " words (" << 100*input_file.tellg()/file_length << "%), ";
 				status << "GOOD = " << databuff.GetNumChunks() << ", LOST = " << databuff.GetNumMissing();
+				if(rates){ status << ", " << rates->GetStatus(); }
 				if(!batch_mode){ term->SetStatus(status.str()); }
 				else{ std::cout << "\r" << status.str(); }
 		
@@ -618,6 +1165,7 @@ void ScanInterface::RunControl(){
 							IdleTask();
 						}
 						else{ std::cout << " WARNING: Spill has been flagged as corrupt, skipping (at word " << input_file.tellg()/4 << " in file)!\n"; }
+						checkpoint_spill();
 					}
 				}
 				else if(debug_mode){ 
@@ -627,22 +1175,28 @@ void ScanInterface::RunControl(){
 				num_spills_recvd++;
 			}
 
-			if(!dry_run_mode){ delete[] data; }
+			spill_pool.Release(buffer);
 		
 			if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Finished scanning file."); }
 			else{ std::cout << std::endl << std::endl; }
 		}
 		else if(file_format == 1 || file_format == 2){
+			SpillBuffer *buffer = spill_pool.Get();
 			unsigned int *data = NULL;
 			unsigned int nBytes;
 		
-			if(!dry_run_mode){ data = new unsigned int[max_spill_size+2]; }
-		
 			// Reset the buffer reader to default values.
 			pldData.Reset();
+
+			// Move to the position of the resumed scan.
+			if(resume_pending && !seek_checkpoint()){
+				std::cout << " ERROR! Failed to move to checkpoint position in input file!\n";
+				kill_all = true;
+			}
 		
-			while(pldData.Read(&input_file, (char*)data, nBytes, 4*max_spill_size, dry_run_mode)){
+			while(pldData.Read(&input_file, buffer, nBytes, dry_run_mode)){
 				if(is_running && (file_stop_offset != 0 && input_file.tellg() >= file_stop_offset)){
+					file_stop_reached = true;
 					if(batch_mode) break;
 					stop_scan();
 				}
@@ -656,8 +1210,13 @@ void ScanInterface::RunControl(){
 					continue;
 				}
 
+				// Prefetch the next queued file when the current file is nearly finished.
+				if(input_file.tellg() + prefetch_size >= file_length)
+					prefetch_next_file();
+
 				std::stringstream status;
 				status << "\033[0;32m" << "[READ] " << "\033[0m" << nBytes/4 << " words (" << 100*input_file.tellg()/file_length << "%)";
+				if(rates){ status << ", " << rates->GetStatus(); }
 				if(!batch_mode){ term->SetStatus(status.str()); }
 				else{ std::cout << "\r" << status.str(); }
 		
@@ -668,15 +1227,20 @@ void ScanInterface::RunControl(){
 			
 				if(!dry_run_mode){ 
 					if(file_format == 1){
+						// Make room for the end of spill marker.
+						buffer->Reserve(nBytes/4 + 2);
+						data = buffer->GetData();
 						int word1 = 2, word2 = 9999;
 						memcpy(&data[(nBytes/4)], (char *)&word1, 4);
 						memcpy(&data[(nBytes/4)+1], (char *)&word2, 4);
 						core->ReadSpill(data, nBytes/4 + 2, is_verbose); 
 					}
 					else{
+						data = buffer->GetData();
 						core->ReadRawEvent(data, nBytes/4, is_verbose);
 					}
 					IdleTask();
+					checkpoint_spill();
 				}
 				num_spills_recvd++;
 			}
@@ -688,12 +1252,104 @@ void ScanInterface::RunControl(){
 				std::cout << msgHeader << "Failed to find end of file buffer!\n";
 			}
 		
-			if(!dry_run_mode){ delete[] data; }
+			spill_pool.Release(buffer);
+		
+			if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Finished scanning file."); }
+			else{ std::cout << std::endl << std::endl; }
+		}
+		else if(file_format == 3){
+			SpillBuffer *buffer = spill_pool.Get();
+			unsigned int nWords;
+		
+			// Reset the spill reader to default values.
+			cldData.Reset();
+
+			// Move to the position of the resumed scan.
+			if(resume_pending && !seek_checkpoint()){
+				std::cout << " ERROR! Failed to move to checkpoint position in input file!\n";
+				kill_all = true;
+			}
+		
+			while(true){
+				if(is_running && (file_stop_offset != 0 && input_file.tellg() >= file_stop_offset)){
+					file_stop_reached = true;
+					if(batch_mode) break;
+					stop_scan();
+				}
+ 
+				if(kill_all == true){ 
+					break;
+				}
+				else if(!is_running){
+					IdleTask();
+					usleep(100000); //0.1 seconds
+					continue;
+				}
+
+				if(!cldData.Read(&input_file, buffer, nWords, dry_run_mode)){
+					if(cldData.GetRetval() == 1){
+						if(debug_mode){ std::cout << "debug: Reached the spill index (end of file).\n"; }
+						break;
+					}
+					else if(cldData.GetRetval() == 2){
+						if(debug_mode){ std::cout << "debug: Failed to read spill from input file.\n"; }
+						break;
+					}
+					else if(cldData.GetRetval() == 3){
+						std::cout << " WARNING: Spill failed CRC check, skipping (at word " << input_file.tellg()/4 << " in file)!\n";
+					}
+					else if(cldData.GetRetval() == 4){
+						std::cout << " WARNING: Failed to decompress spill, skipping (at word " << input_file.tellg()/4 << " in file)!\n";
+					}
+					else if(cldData.GetRetval() == 5){
+						std::cout << " WARNING: Spill is larger than the maximum buffer size of " << buffer->GetLimit() << " words, skipping (at word " << input_file.tellg()/4 << " in file)!\n";
+					}
+					continue;
+				}
+
+				// Prefetch the next queued file when the current file is nearly finished.
+				if(input_file.tellg() + prefetch_size >= file_length)
+					prefetch_next_file();
+
+				std::stringstream status;
+				status << "\033[0;32m" << "[READ] " << "\033[0m" << nWords << " words (" << 100*input_file.tellg()/file_length << "%)";
+				if(cldData.GetNumCrcErrors() > 0) status << ", BAD = " << cldData.GetNumCrcErrors();
+				if(rates){ status << ", " << rates->GetStatus(); }
+				if(!batch_mode){ term->SetStatus(status.str()); }
+				else{ std::cout << "\r" << status.str(); }
+		
+				if(debug_mode){ 
+					std::cout << "debug: Retrieved spill of " << nWords << " words (" << nWords*4 << " bytes)\n"; 
+					std::cout << "debug: Read up to word number " << input_file.tellg()/4 << " in input file\n";
+				}
+
+				// Stored spills already contain the end of spill marker.
+				if(!dry_run_mode){ 
+					core->ReadSpill(buffer->GetData(), nWords, is_verbose); 
+					IdleTask();
+					checkpoint_spill();
+				}
+				num_spills_recvd++;
+			}
+
+			spill_pool.Release(buffer);
 		
 			if(!batch_mode){ term->SetStatus("\033[0;33m[IDLE]\033[0m Finished scanning file."); }
 			else{ std::cout << std::endl << std::endl; }
 		}
 
+		// The raw event cache is only kept if the whole input file was scanned.
+		close_event_cache(!kill_all && !file_stop_reached);
+
+		// Continue directly with the next file in the run queue.
+		if(!shm_mode && !merger && is_running && !kill_all && !file_stop_reached){
+			if(open_next_file()){ continue; }
+		}
+		file_stop_reached = false;
+
+		// An interrupted scan may still be resumed from the last checkpoint.
+		scan_complete = !kill_all;
+
 		// Notify that the scan has completed.
 		Notify("SCAN_COMPLETE");
 		
@@ -776,11 +1432,14 @@ void ScanInterface::CmdControl(){
 			std::cout << "   run                 - Start acquisition\n";
 			std::cout << "   stop [offset]       - Stop acquisition\n";
 			std::cout << "   file <filename>     - Load an input file\n";
+			std::cout << "   queue [files]       - Add files (list file or glob) to the run queue, or show the queue\n";
 			std::cout << "   rewind [offset]     - Rewind to the beginning of the file\n";
 			std::cout << "   sync                - Wait for the current run to finish\n";
 			std::cout << "   tell                - If stopped, display the current file position\n";
 			std::cout << "   restart [offset]    - Stop the scan and restart from the beginning of the file\n";
 			std::cout << "   event-width <width> - Set the width of raw events (in ns, default=500)\n";
+			if(shm_mode){ std::cout << "   sampling [N]        - Set the maximum shm sampling factor, or show the sampling status (default=64)\n"; }
+			if(rates){ std::cout << "   rates [reset]       - Show the rate, dead time, and pileup of all channels, or reset the channel rates\n"; }
 			CmdHelp("   ");
 		}
 		else if(cmd == "run"){ // Start acquisition.
@@ -828,6 +1487,19 @@ void ScanInterface::CmdControl(){
 				std::cout << msgHeader << " -SYNTAX- file <filename>\n";
 			}
 		}
+		else if(cmd == "queue"){ // Add files to the run queue or print the queue
+			if(p_args > 0){
+				for(std::vector<std::string>::iterator iter = arguments.begin(); iter != arguments.end(); ++iter)
+					queue_input_files(*iter);
+			}
+			else{
+				queue_mutex.lock();
+				if(file_queue.empty()){ std::cout << msgHeader << "Run queue is empty.\n"; }
+				for(size_t i = 0; i < file_queue.size(); i++)
+					std::cout << msgHeader << " " << i+1 << ": " << file_queue.at(i) << std::endl;
+				queue_mutex.unlock();
+			}
+		}
 		else if(cmd == "rewind"){ // Rewind the file to the start position
 			if(p_args > 0){ 
 				if(!isDecimal(arguments.at(0).c_str()))
@@ -877,6 +1549,21 @@ void ScanInterface::CmdControl(){
 			}
 			else std::cout << msgHeader << "Current raw event width is " << core->GetEventWidth()*8 << " ns (" << core->GetEventWidth() << " system clock ticks).\n";
 		}
+		else if(cmd == "sampling" && sampler){ // Set the maximum sampling factor for shm mode.
+			if(p_args > 0){
+				max_sampling = sampler->SetMaxFactor(strtoul(arguments.at(0).c_str(), NULL, 0));
+				if(max_sampling > 1) std::cout << msgHeader << "Processing at least one in every " << max_sampling << " spills when the scan cannot keep up.\n";
+				else std::cout << msgHeader << "Processing every spill.\n";
+			}
+			else sampler->PrintStatus();
+		}
+		else if(cmd == "rates" && rates){ // Show or reset the channel rates.
+			if(p_args > 0 && arguments.at(0) == "reset"){
+				rates->Reset();
+				std::cout << msgHeader << "Channel rates will be reset at the start of the next spill.\n";
+			}
+			else rates->PrintStatus();
+		}
 		else if(!ExtraCommands(cmd, arguments)){ // Unrecognized command. Send it to a derived object.
 			std::cout << msgHeader << "Unknown command '" << cmd << "'\n";
 		}
@@ -945,6 +1632,30 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 				else // Specified as percentage offset
 					file_stop_percent = strtod(optarg, NULL);
 			}
+			else if(strcmp("queue", longOpts[idx].name) == 0) {
+				queue_input_files(optarg);
+			}
+			else if(strcmp("merge", longOpts[idx].name) == 0) {
+				merge_filename = optarg;
+			}
+			else if(strcmp("checkpoint", longOpts[idx].name) == 0) {
+				checkpoint_interval = strtod(optarg, NULL);
+			}
+			else if(strcmp("resume", longOpts[idx].name) == 0) {
+				resume_mode = true;
+			}
+			else if(strcmp("cache", longOpts[idx].name) == 0) {
+				cache_dir = optarg;
+			}
+			else if(strcmp("sampling", longOpts[idx].name) == 0) {
+				max_sampling = strtoul(optarg, NULL, 0);
+			}
+			else if(strcmp("rates", longOpts[idx].name) == 0) {
+				rate_decay_time = strtod(optarg, NULL);
+			}
+			else if(strcmp("dead-time", longOpts[idx].name) == 0) {
+				rate_resolving_time = strtod(optarg, NULL);
+			}
 			else{
 				for(std::vector<optionExt>::iterator iter = userOpts.begin(); iter != userOpts.end(); iter++){
 					if(strcmp(iter->name, longOpts[idx].name) == 0){
@@ -1006,6 +1717,25 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 		}
 	}//while
 
+	// Checkpoints are only written when reading from input files.
+	if(shm_mode || !merge_filename.empty()){
+		if(checkpoint_interval > 0 || resume_mode)
+			std::cout << msgHeader << "Checkpoints are not supported in shared-memory or merge mode.\n";
+		checkpoint_interval = -1;
+		resume_mode = false;
+	}
+	else if(resume_mode && checkpoint_interval <= 0){ // Keep writing checkpoints, in case the resumed scan is also interrupted.
+		checkpoint_interval = 600;
+	}
+
+	// Raw events are only cached when reading from input files.
+	if(!cache_dir.empty()){
+		if(shm_mode || !merge_filename.empty() || dry_run_mode)
+			std::cout << msgHeader << "Raw event caching is not supported in shared-memory, merge, or dry-run mode.\n";
+		else
+			event_cache = new RawEventCache();
+	}
+
 	// If a pointer to an Unpacker derived class is not specified, call the
 	// extern function GetCore() to get a pointer to a new object.
 	if(!core)
@@ -1017,6 +1747,12 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 	if(debug_mode)
 		core->SetDebugMode();
 
+	// Monitor the rates of all channels as spills are unpacked.
+	if(rate_decay_time > 0){
+		rates = new RateMonitor(rate_decay_time, rate_resolving_time);
+		core->SetRateMonitor(rates);
+	}
+
 	// Parse for any extra arguments that are known to the derived class.
 	ExtraArguments();
 
@@ -1035,6 +1771,8 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 			std::cout << "\nCleaning up...\n";
 			return false;
 		}	
+		receiver = new SpillReceiver(poll_server);
+		sampler = new SpillSampler(max_sampling);
 		if(batch_mode){
 			std::cout << msgHeader << "Unable to enable batch mode for shared-memory mode!\n";
 			batch_mode = false;
@@ -1059,7 +1797,9 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 	if(shm_mode){ 
 		std::cout << msgHeader << "Using shared-memory mode.\n\n"; 
 		std::cout << msgHeader << "Listening on poll2 SHM port 5555\n\n";
+		if(max_sampling > 1){ std::cout << msgHeader << "Processing at least one in every " << max_sampling << " spills when the scan cannot keep up.\n\n"; }
 	}
+	if(rates){ std::cout << msgHeader << "Monitoring channel rates with a decay time of " << rates->GetDecayTime() << " s.\n\n"; }
 		
 	// Do any last minute initialization.
 	try {
@@ -1068,13 +1808,51 @@ bool ScanInterface::Setup(int argc, char *argv[]){
 	catch(...) {
 		std::cout << "\nFinal initialization failed!\n";
 	}
+
+	// The derived class sets the checkpoint file if it supports checkpoints.
+	if(checkpoint_interval > 0){
+		if(!checkpoint_filename.empty())
+			std::cout << msgHeader << "Writing checkpoint to \"" << checkpoint_filename << "\" every " << checkpoint_interval << " seconds.\n";
+		else{
+			std::cout << msgHeader << "Checkpoints are not supported by " << progName << ".\n";
+			checkpoint_interval = -1;
+			resume_mode = false;
+		}
+	}
+	last_checkpoint = std::chrono::steady_clock::now();
 		
 	scan_init = true;
 		
+	// Open all crate streams listed in the merge list.
+	if(!shm_mode && !merge_filename.empty()){
+		std::cout << msgHeader << "Using merge list " << merge_filename << ".\n";
+		if(open_merge_streams(merge_filename)){ // Start the scan automatically in batch mode.
+			if(batch_mode || automatic_start) 
+				start_scan();
+		}
+		else std::cout << msgHeader << "Failed to open merged input streams from \"" << merge_filename << "\"!\n";
+		return true;
+	}
+
+	// Take the first file from the run queue, if no input file was specified.
+	if(!shm_mode && input_filename.empty()){
+		queue_mutex.lock();
+		if(!file_queue.empty()){
+			input_filename = file_queue.front();
+			file_queue.pop_front();
+		}
+		queue_mutex.unlock();
+	}
+
 	// Load the input file, if the user has supplied a filename.
 	if(!shm_mode && !input_filename.empty()){
 		std::cout << msgHeader << "Using filename " << input_filename << ".\n";
 		if(open_input_file(input_filename)){ // Start the scan automatically in batch mode.
+			if(resume_mode && !resume_from_checkpoint()){
+				std::cout << " FATAL ERROR! Failed to resume scan from checkpoint \"" << checkpoint_filename << "\"!\n";
+				std::cout << "\nCleaning up...\n";
+				return false;
+			}
 			if(batch_mode || automatic_start) 
 				start_scan();
 		}
@@ -1134,6 +1912,9 @@ bool ScanInterface::Close(){
 	
 	std::cout << msgHeader << "Retrieved " << num_spills_recvd << " spills!\n";
 
+	if(num_checkpoints > 0)
+		std::cout << msgHeader << "Wrote " << num_checkpoints << " checkpoints.\n";
+
 	if(input_file.good()){
 		input_file.close();	
 	}
@@ -1145,10 +1926,23 @@ bool ScanInterface::Close(){
 	std::cout << msgHeader << "Read " << databuff.GetNumChunks() << " spill chunks.\n";
 	std::cout << msgHeader << "Lost at least " << databuff.GetNumMissing() << " spill chunks.\n";
 	
+	// Show the memory used to hold spill data.
+	spill_pool.Print(msgHeader);
+	
 	if(write_counts)
 		core->Write();
+
+	if(rates){
+		rates->PrintStatus();
+		core->SetRateMonitor(NULL);
+		delete rates;
+	}
 	
+	if(receiver){ delete receiver; }
+	if(sampler){ delete sampler; }
+	if(event_cache){ delete event_cache; }
 	if(poll_server){ delete poll_server; }
+	if(merger){ delete merger; }
 	if(term){ delete term; }
 	if(core){ delete core; }
 	
@@ -0,0 +1,390 @@
+/** \file SpillReceiver.cpp
+ * \brief Receive poll2 spill chunks from the network in a dedicated thread.
+ *
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2016
+ */
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "SpillReceiver.hpp"
+#include "poll2_socket.h"
+
+#define POLL2_CHUNK_WORDS 4050 // Maximum number of spill data words in a single poll2 chunk.
+#define MAX_SPILL_CHUNKS 4096 // Maximum number of chunks in a single spill (~66 MB).
+
+///////////////////////////////////////////////////////////////////////////////
+// class SpillSlot
+///////////////////////////////////////////////////////////////////////////////
+
+/// Prepare the slot for a new spill with a given number of chunks.
+void SpillSlot::Reset(const unsigned int &total_, const unsigned int &chunkWords_){
+	total = total_;
+	received = 0;
+	nWords = 0;
+	chunkLength.assign(total, 0);
+	haveChunk.assign(total, false);
+	Reserve(total, chunkWords_);
+}
+
+/// Make sure the data array is large enough to hold a given chunk.
+void SpillSlot::Reserve(const unsigned int &chunk_, const unsigned int &chunkWords_){
+	size_t required = chunk_*chunkWords_ + 2; // Leave room for the end of spill marker.
+	if(data.size() < required){ data.resize(required); }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class SpillReceiver
+///////////////////////////////////////////////////////////////////////////////
+
+SpillReceiver::SpillReceiver(Server *server_, const size_t &numSlots_/*=8*/, const unsigned int &batchSize_/*=64*/) : server(server_),
+  slots(numSlots_ > 2 ? numSlots_ : 2), batchSize(batchSize_ > 0 ? batchSize_ : 1), chunkWords(POLL2_CHUNK_WORDS), maxChunks(MAX_SPILL_CHUNKS),
+  reorderWindow(16), recvBufferSize(64*1024*1024), spillTimeout(1000), fill(-1), lastFill(-1), lastChunk(0), numChunks(0), numSpills(0),
+  numDropped(0), numLostChunks(0), numReordered(0), numOverflow(0), numSkipped(0), numBad(0), numCopied(0), debug_mode(false), running(false) {
+	headers.resize(2*batchSize);
+	stage.resize(batchSize*chunkWords);
+	predSlot.resize(batchSize);
+	predChunk.resize(batchSize);
+
+	msgs = new struct mmsghdr[batchSize];
+	iovs = new struct iovec[2*batchSize];
+
+	// Pre-allocate each slot with room for a typical spill.
+	for(std::vector<SpillSlot>::iterator iter = slots.begin(); iter != slots.end(); ++iter){
+		iter->Reserve(64, chunkWords);
+	}
+}
+
+SpillReceiver::~SpillReceiver(){
+	Stop();
+	delete[] msgs;
+	delete[] iovs;
+}
+
+/** Set the kernel receive buffer size and start the receiver thread.
+  * \return True if the thread was started and false otherwise.
+  */
+bool SpillReceiver::Start(){
+	if(running || !server){ return false; }
+
+	int actualSize = server->SetRecvBufferSize(recvBufferSize);
+	if(actualSize < 0){
+		std::cout << " SpillReceiver: Warning! Failed to set socket receive buffer size.\n";
+	}
+	else{
+		// Linux reports twice the usable size. Requests larger than net.core.rmem_max are silently clamped.
+		if(actualSize < recvBufferSize){
+			std::cout << " SpillReceiver: Warning! Socket receive buffer is only " << actualSize/1024 << " kB (requested " << recvBufferSize/1024 << " kB).\n";
+			std::cout << " SpillReceiver:  Increase net.core.rmem_max to allow a larger buffer.\n";
+		}
+		else if(debug_mode){ std::cout << "debug: Socket receive buffer is " << actualSize/1024 << " kB\n"; }
+	}
+
+	{ // Reset the ring.
+		std::lock_guard<std::mutex> lock(slot_mutex);
+		for(std::vector<SpillSlot>::iterator iter = slots.begin(); iter != slots.end(); ++iter){
+			iter->state = FREE;
+		}
+		ready.clear();
+	}
+
+	fill = -1;
+	lastFill = -1;
+	lastChunk = 0;
+	lastTime = std::chrono::steady_clock::now();
+
+	running = true;
+	worker = std::thread(&SpillReceiver::receive, this);
+
+	return true;
+}
+
+/** Stop the receiver thread. Spills which have not been released are discarded.
+  * \return Nothing.
+  */
+void SpillReceiver::Stop(){
+	if(!running){ return; }
+	running = false;
+	if(worker.joinable()){ worker.join(); }
+	spill_ready.notify_all();
+}
+
+/** Wait for a complete spill. The spill data is terminated with the end of
+  * spill marker and remains valid until Release() is called for the slot.
+  * \param[out] data_ Pointer to the spill data.
+  * \param[out] nWords_ Length of the spill (in words).
+  * \param[in]  timeout_ Maximum time to wait (in ms).
+  * \return The index of the spill slot, or -1 if no spill was received.
+  */
+int SpillReceiver::GetSpill(unsigned int *&data_, unsigned int &nWords_, const int &timeout_){
+	std::unique_lock<std::mutex> lock(slot_mutex);
+	if(ready.empty()){
+		spill_ready.wait_for(lock, std::chrono::milliseconds(timeout_), [this]{ return !ready.empty() || !running; });
+		if(ready.empty()){ return -1; }
+	}
+
+	int index = ready.front();
+	ready.pop_front();
+
+	SpillSlot &slot = slots[index];
+	slot.state = BUSY;
+	data_ = slot.data.data();
+	nWords_ = slot.nWords;
+
+	return index;
+}
+
+/** Return a spill slot to the receiver so that it may be re-used.
+  * \param[in]  slot_ Index of the slot returned by GetSpill().
+  * \return Nothing.
+  */
+void SpillReceiver::Release(const int &slot_){
+	if(slot_ < 0 || slot_ >= (int)slots.size()){ return; }
+	std::lock_guard<std::mutex> lock(slot_mutex);
+	slots[slot_].state = FREE;
+}
+
+/// Return a short status string for the terminal status line.
+std::string SpillReceiver::GetStatus(){
+	std::stringstream stream;
+	stream << numSpills << " spills, " << numDropped + numOverflow << " dropped, " << numReordered << " reordered";
+	return stream.str();
+}
+
+/// Return the number of complete spills waiting to be retrieved.
+size_t SpillReceiver::GetNumReady(){
+	std::lock_guard<std::mutex> lock(slot_mutex);
+	return ready.size();
+}
+
+/// Print the receiver statistics.
+void SpillReceiver::PrintStatus(){
+	std::cout << " SpillReceiver: Received " << numSpills << " spills (" << numChunks << " chunks).\n";
+	std::cout << "  Dropped " << numDropped << " incomplete spills (" << numLostChunks << " missing chunks).\n";
+	std::cout << "  Dropped " << numOverflow << " spills because the spill ring was full (" << numSkipped << " chunks skipped).\n";
+	std::cout << "  Found " << numReordered << " out of order chunks and " << numBad << " malformed datagrams.\n";
+	if(debug_mode){ std::cout << "debug: " << numCopied << " chunks could not be received in place\n"; }
+}
+
+/// Main loop of the receiver thread.
+void SpillReceiver::receive(){
+	while(running){
+		predict();
+
+		int count = server->RecvMessages(msgs, batchSize, 100);
+		if(count < 0){
+			if(debug_mode){ std::cout << "debug: Failed to receive from socket\n"; }
+			continue;
+		}
+		else if(count == 0){ // Socket timeout.
+			if(fill >= 0 && std::chrono::steady_clock::now() - lastTime > std::chrono::milliseconds(spillTimeout)){
+				std::cout << " SpillReceiver: Network timeout before recv full spill!\n";
+				drop();
+			}
+			continue;
+		}
+
+		process(count);
+	}
+}
+
+/// Predict the slot and chunk number of each datagram in the next batch and set up the scatter arrays.
+void SpillReceiver::predict(){
+	int slot = fill;
+	unsigned int chunk = (fill >= 0 ? lastChunk : 0);
+	unsigned int total = (fill >= 0 ? slots[fill].total : 0);
+	int previous = (fill >= 0 ? fill : lastFill);
+
+	std::unique_lock<std::mutex> lock(slot_mutex);
+	for(unsigned int i = 0; i < batchSize; i++){
+		if(slot < 0 || (total > 0 && chunk >= total)){ // The next chunk should start a new spill.
+			int candidate = (previous+1) % slots.size();
+			if(slots[candidate].state == FREE){
+				slot = candidate;
+				previous = candidate;
+			}
+			else{ slot = -1; }
+			chunk = 1;
+			total = 0;
+		}
+		else{ chunk++; }
+
+		if(slot >= 0 && chunk > maxChunks){ slot = -1; }
+
+		predSlot[i] = slot;
+		predChunk[i] = chunk;
+	}
+	lock.unlock();
+
+	// Resize the slots before taking any pointers into them.
+	for(unsigned int i = 0; i < batchSize; i++){
+		if(predSlot[i] >= 0){ slots[predSlot[i]].Reserve(predChunk[i], chunkWords); }
+	}
+
+	for(unsigned int i = 0; i < batchSize; i++){
+		iovs[2*i].iov_base = (void*)&headers[2*i];
+		iovs[2*i].iov_len = 8;
+		if(predSlot[i] >= 0){ iovs[2*i+1].iov_base = (void*)&slots[predSlot[i]].data[(predChunk[i]-1)*chunkWords]; }
+		else{ iovs[2*i+1].iov_base = (void*)&stage[i*chunkWords]; }
+		iovs[2*i+1].iov_len = chunkWords*4;
+
+		memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+		msgs[i].msg_hdr.msg_iov = &iovs[2*i];
+		msgs[i].msg_hdr.msg_iovlen = 2;
+		msgs[i].msg_len = 0;
+	}
+}
+
+/// Handle a batch of received datagrams.
+void SpillReceiver::process(const int &count_){
+	// Check that every datagram landed where it was expected.
+	bool regular = true;
+	for(int i = 0; i < count_; i++){
+		if(predSlot[i] < 0 || msgs[i].msg_len < 8 || headers[2*i] != predChunk[i]){
+			regular = false;
+			break;
+		}
+	}
+
+	// Datagrams will be moved to their proper position one at a time, so first move
+	// all of them out of the slots to avoid overwriting any which have not been handled.
+	if(!regular){
+		for(int i = 0; i < count_; i++){
+			if(predSlot[i] < 0 || msgs[i].msg_len <= 8){ continue; }
+			memcpy(&stage[i*chunkWords], &slots[predSlot[i]].data[(predChunk[i]-1)*chunkWords], msgs[i].msg_len-8);
+		}
+	}
+
+	for(int i = 0; i < count_; i++){
+		unsigned int nBytes = msgs[i].msg_len;
+		if(nBytes < 8){
+			numBad++;
+			continue;
+		}
+
+		// Check for poll2 network flags.
+		if(nBytes <= 16){
+			char flag[17];
+			memcpy(flag, &headers[2*i], 8);
+			if(nBytes > 8){ memcpy(&flag[8], (regular ? (char*)iovs[2*i+1].iov_base : (char*)&stage[i*chunkWords]), nBytes-8); }
+			flag[nBytes] = '\0';
+			if(strcmp(flag, "$CLOSE_FILE") == 0 || strcmp(flag, "$OPEN_FILE") == 0 || strcmp(flag, "$KILL_SOCKET") == 0){ continue; }
+		}
+
+		unsigned int chunk = headers[2*i];
+		unsigned int total = headers[2*i+1];
+		if((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) || (nBytes-8) % 4 != 0 || chunk == 0 || chunk > total || total > maxChunks){
+			if(debug_mode){ std::cout << "debug: Malformed chunk " << chunk << " of " << total << " (" << nBytes << " bytes)\n"; }
+			numBad++;
+			continue;
+		}
+
+		numChunks++;
+		store(chunk, total, (nBytes-8)/4, i, !regular || predSlot[i] < 0);
+	}
+}
+
+/// Store a single chunk in the current spill.
+void SpillReceiver::store(const unsigned int &chunk_, const unsigned int &total_, const unsigned int &nWords_, const int &index_, const bool &staged_){
+	if(fill >= 0){
+		SpillSlot &current = slots[fill];
+		if(total_ != current.total || current.haveChunk[chunk_-1] || chunk_ + reorderWindow < lastChunk || (chunk_ == 1 && lastChunk == current.total)){ // This chunk belongs to a new spill.
+			if(debug_mode){ std::cout << "debug: Found chunk " << chunk_ << " of " << total_ << " but expected chunk " << lastChunk+1 << " of " << current.total << std::endl; }
+			drop();
+		}
+		else if(chunk_ < lastChunk){ numReordered++; }
+	}
+
+	if(fill < 0){ // Start a new spill.
+		int candidate = (lastFill+1) % slots.size();
+		std::unique_lock<std::mutex> lock(slot_mutex);
+		if(slots[candidate].state != FREE){ // Every slot is in use.
+			if(chunk_ == 1){ numOverflow++; }
+			numSkipped++;
+			return;
+		}
+		slots[candidate].state = FILLING;
+		lock.unlock();
+
+		fill = candidate;
+		slots[fill].Reset(total_, chunkWords);
+	}
+
+	SpillSlot &current = slots[fill];
+	current.Reserve(chunk_, chunkWords);
+
+	// Move the chunk to its proper position if it was not received in place.
+	unsigned int *target = &current.data[(chunk_-1)*chunkWords];
+	unsigned int *source;
+	if(staged_){ source = &stage[index_*chunkWords]; }
+	else{ source = &slots[predSlot[index_]].data[(predChunk[index_]-1)*chunkWords]; }
+	if(source != target){
+		memmove(target, source, nWords_*4);
+		numCopied++;
+	}
+
+	current.haveChunk[chunk_-1] = true;
+	current.chunkLength[chunk_-1] = nWords_;
+	current.received++;
+
+	if(chunk_ > lastChunk){ lastChunk = chunk_; }
+	lastTime = std::chrono::steady_clock::now();
+
+	if(current.received == current.total){ complete(); }
+}
+
+/// Mark the current spill as complete and pass it to the ready queue.
+void SpillReceiver::complete(){
+	SpillSlot &current = slots[fill];
+
+	// Remove the gaps left by any short chunks before the final chunk.
+	unsigned int nWords = 0;
+	for(unsigned int i = 0; i < current.total; i++){
+		if(nWords != i*chunkWords){ memmove(&current.data[nWords], &current.data[i*chunkWords], current.chunkLength[i]*4); }
+		nWords += current.chunkLength[i];
+	}
+
+	// Append the end of spill marker.
+	current.data[nWords++] = 2;
+	current.data[nWords++] = 9999;
+	current.nWords = nWords;
+
+	if(debug_mode){ std::cout << "debug: Received spill of " << current.nWords << " words in " << current.total << " chunks\n"; }
+
+	{
+		std::lock_guard<std::mutex> lock(slot_mutex);
+		current.state = READY;
+		ready.push_back(fill);
+	}
+	spill_ready.notify_one();
+
+	numSpills++;
+	lastFill = fill;
+	fill = -1;
+	lastChunk = 0;
+}
+
+/// Drop the current (incomplete) spill.
+void SpillReceiver::drop(){
+	if(fill < 0){ return; }
+
+	SpillSlot &current = slots[fill];
+	numDropped++;
+	numLostChunks += current.total - current.received;
+
+	{
+		std::lock_guard<std::mutex> lock(slot_mutex);
+		current.state = FREE;
+	}
+
+	// Re-use the same slot for the next spill.
+	lastFill = (fill + slots.size() - 1) % slots.size();
+	fill = -1;
+	lastChunk = 0;
+}
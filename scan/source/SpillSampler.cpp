@@ -0,0 +1,124 @@
+/** \file SpillSampler.cpp
+ * \brief Decide which shared memory spills to process when the scan cannot keep up.
+ *
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2026
+ */
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+#include "SpillSampler.hpp"
+
+#define SAMPLER_SMOOTHING 0.2 // Weight of the newest measurement in the running averages.
+#define SAMPLER_WINDOW 1.0 // Minimum time over which the spill arrival rate is measured (in seconds).
+#define SAMPLER_CALM_SPILLS 32 // Number of spills to wait before the sampling factor is reduced.
+
+SpillSampler::SpillSampler(const unsigned int &maxFactor_/*=64*/, const double &targetLoad_/*=0.9*/) :
+  maxFactor(maxFactor_ > 0 ? maxFactor_ : 1), targetLoad(targetLoad_ > 0 ? targetLoad_ : 0.9) {
+	Reset();
+}
+
+bool SpillSampler::Arrive(const unsigned long &numArrived_, const size_t &backlog_, const size_t &capacity_){
+	// Measure the arrival rate over a window, since spills waiting in the receiver
+	// are retrieved immediately and do not reflect the time between spills.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - windowStart).count();
+	if(elapsed >= SAMPLER_WINDOW){
+		if(numArrived_ > windowArrived){
+			double interval = elapsed/(numArrived_ - windowArrived);
+			arrivalTime = (arrivalTime > 0 ? (1-SAMPLER_SMOOTHING)*arrivalTime + SAMPLER_SMOOTHING*interval : interval);
+		}
+		windowArrived = numArrived_;
+		windowStart = now;
+	}
+
+	if(maxFactor > 1){
+		// The backlog is only checked before processing a spill, since skipped spills are released immediately.
+		unsigned int newFactor = required((countdown == 0 ? backlog_ : 0), capacity_);
+		if(newFactor > factor){ // Fall behind as little as possible.
+			factor = newFactor;
+			calm = 0;
+		}
+		else if(newFactor < factor){ // Wait before processing more spills, so that the factor does not oscillate.
+			if(++calm >= SAMPLER_CALM_SPILLS){
+				factor = (factor/2 > newFactor ? factor/2 : newFactor);
+				calm = 0;
+			}
+		}
+		else{ calm = 0; }
+	}
+
+	// Process one spill, then skip the next (factor-1) spills.
+	if(countdown > 0){
+		countdown--;
+		numSkipped++;
+		return false;
+	}
+
+	countdown = factor-1;
+	weight = factor;
+	totalWeight += weight;
+	numProcessed++;
+	if(factor > 1){ numSampled++; }
+
+	return true;
+}
+
+void SpillSampler::Processed(const double &seconds_){
+	procTime = (procTime > 0 ? (1-SAMPLER_SMOOTHING)*procTime + SAMPLER_SMOOTHING*seconds_ : seconds_);
+}
+
+unsigned int SpillSampler::SetMaxFactor(const unsigned int &maxFactor_){
+	maxFactor = (maxFactor_ > 0 ? maxFactor_ : 1);
+	if(factor > maxFactor){ factor = maxFactor; }
+	return maxFactor;
+}
+
+std::string SpillSampler::GetStatus(){
+	std::stringstream stream;
+	stream << "processed " << numProcessed << ", sampled " << numSampled;
+	if(factor > 1){ stream << " (1/" << factor << ")"; }
+	stream << ", skipped " << numSkipped;
+	return stream.str();
+}
+
+void SpillSampler::PrintStatus(){
+	std::cout << " SpillSampler: Processed " << numProcessed << " spills (" << numSampled << " while sampling) and skipped " << numSkipped << " spills.\n";
+	std::cout << "  Average of " << procTime*1E3 << " ms to process a spill and " << arrivalTime*1E3 << " ms between spills.\n";
+	if(numSkipped > 0){ std::cout << "  Histograms should be scaled by " << totalWeight/numProcessed << " to account for skipped spills.\n"; }
+}
+
+void SpillSampler::Reset(){
+	factor = 1;
+	weight = 1;
+	calm = 0;
+	countdown = 0;
+	numProcessed = 0;
+	numSampled = 0;
+	numSkipped = 0;
+	totalWeight = 0;
+	procTime = 0;
+	arrivalTime = 0;
+	windowArrived = 0;
+	windowStart = std::chrono::steady_clock::now();
+}
+
+/** Compute the sampling factor required to keep up with the incoming spills.
+  * \param[in]  backlog_ Number of complete spills waiting to be processed.
+  * \param[in]  capacity_ Maximum number of spills which may wait to be processed.
+  * \return The sampling factor, between one and the maximum sampling factor.
+  */
+unsigned int SpillSampler::required(const size_t &backlog_, const size_t &capacity_){
+	double ratio = 1;
+	if(procTime > 0 && arrivalTime > 0){ ratio = std::ceil(procTime/(targetLoad*arrivalTime)); }
+
+	// Spills are piling up in the receiver, process fewer of them.
+	if(capacity_ > 0 && backlog_ > capacity_/2 && ratio <= factor){ ratio = factor+1; }
+
+	if(ratio < 1){ return 1; }
+	else if(ratio > maxFactor){ return maxFactor; }
+	return (unsigned int)ratio;
+}
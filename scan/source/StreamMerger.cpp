@@ -0,0 +1,517 @@
+/** \file StreamMerger.cpp
+ * \brief Merge the output of several pixie16 crates into a single time-ordered stream.
+ *
+ * CRT
+ *
+ * \author C. R. Thornsberry
+ * \date Oct. 19th, 2016
+ */
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdlib.h>
+
+#include "StreamMerger.hpp"
+#include "Unpacker.hpp"
+#include "XiaData.hpp"
+#include "helperFunctions.h"
+
+#define CLOCK_MODEL_SCALE 1E-9 // Scale factor applied to times before they are added to the fit.
+
+///////////////////////////////////////////////////////////////////////////////
+// class ClockModel
+///////////////////////////////////////////////////////////////////////////////
+
+/// Add a new (time, residual) sample to the fit.
+void ClockModel::Add(const double &time_, const double &residual_){
+	if(t0 < 0){ t0 = time_; }
+	double x = (time_ - t0)*CLOCK_MODEL_SCALE;
+
+	// Exponentially weighted least squares. Older samples are de-weighted by the
+	// forgetting factor so the fit follows slow changes in the clock drift.
+	sw = forget*sw + 1;
+	sx = forget*sx + x;
+	sy = forget*sy + residual_;
+	sxx = forget*sxx + x*x;
+	sxy = forget*sxy + x*residual_;
+	numSamples++;
+}
+
+/// Return the fitted correction at a given time. Returns zero until enough samples are available.
+double ClockModel::Evaluate(const double &time_) const {
+	if(numSamples == 0){ return 0.0; }
+
+	double det = sw*sxx - sx*sx;
+	if(numSamples < 2 || std::fabs(det) <= std::numeric_limits<double>::epsilon()*sw*sxx){ return sy/sw; }
+
+	double slope = (sw*sxy - sx*sy)/det;
+	double intercept = (sy - slope*sx)/sw;
+
+	return intercept + slope*(time_ - t0)*CLOCK_MODEL_SCALE;
+}
+
+/// Return the fitted clock drift relative to the external clock (in ppm).
+double ClockModel::GetDrift() const {
+	double det = sw*sxx - sx*sx;
+	if(numSamples < 2 || std::fabs(det) <= std::numeric_limits<double>::epsilon()*sw*sxx){ return 0.0; }
+	return ((sw*sxy - sx*sy)/det)*CLOCK_MODEL_SCALE*1E6;
+}
+
+/// Reset the fit.
+void ClockModel::Reset(){
+	t0 = -1;
+	numSamples = 0;
+	sw = 0; sx = 0; sy = 0; sxx = 0; sxy = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class MergeStream
+///////////////////////////////////////////////////////////////////////////////
+
+/// Return the corrected time of a raw pixie timestamp.
+double MergeStream::Correct(const double &time_) const {
+	return (time_ + offset + drift*1E-6*(time_ - t0) + model.Evaluate(time_));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class StreamMerger
+///////////////////////////////////////////////////////////////////////////////
+
+/// Default constructor.
+StreamMerger::StreamMerger() : ratio(0), forget(0.999), watermark(-1), maxBuffered(1000000), numMerged(0), numLate(0), debug_mode(false), running(false) { }
+
+/// Destructor.
+StreamMerger::~StreamMerger(){
+	Stop();
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		if((*iter)->file.is_open()){ (*iter)->file.close(); }
+		delete (*iter);
+	}
+	streams.clear();
+}
+
+/** Read a merge list file. Each line of the file specifies one input stream as
+  *  crate filename [offset] [drift]
+  * where offset is in pixie clock ticks and drift is in ppm. Additional lines of the form
+  *  ratio <value>
+  *  forget <value>
+  * set the number of pixie clock ticks per external timestamp tick (0 disables the
+  * automatic clock alignment) and the forgetting factor of the clock model.
+  * Blank lines and lines beginning with '#' are ignored.
+  * \param[in]  fname_ Path to the merge list file.
+  * \return True if at least one stream was defined and false otherwise.
+  */
+bool StreamMerger::ReadConfig(const std::string &fname_){
+	std::ifstream mergeFile(fname_.c_str());
+	if(!mergeFile.good()){
+		std::cout << " StreamMerger: ERROR! Failed to open merge list file '" << fname_ << "'.\n";
+		return false;
+	}
+
+	std::string line;
+	std::vector<std::string> args;
+	unsigned int lineNum = 0;
+	while(true){
+		std::getline(mergeFile, line);
+		if(mergeFile.eof()){ break; }
+		lineNum++;
+
+		// Split the line into whitespace separated arguments.
+		args.clear();
+		std::istringstream lineStream(line);
+		std::string arg;
+		while(lineStream >> arg){ args.push_back(arg); }
+		if(args.empty() || args.front()[0] == '#'){ continue; }
+
+		if(args.size() < 2){
+			std::cout << " StreamMerger: WARNING! Invalid merge list entry on line " << lineNum << ".\n";
+			continue;
+		}
+
+		if(args.at(0) == "ratio"){
+			ratio = strtod(args.at(1).c_str(), NULL);
+			continue;
+		}
+		else if(args.at(0) == "forget"){
+			forget = strtod(args.at(1).c_str(), NULL);
+			if(forget <= 0 || forget > 1){
+				std::cout << " StreamMerger: WARNING! Invalid forgetting factor (" << forget << "), using 0.999.\n";
+				forget = 0.999;
+			}
+			continue;
+		}
+
+		unsigned int crate = strtoul(args.at(0).c_str(), NULL, 0);
+		if(crate >= MAX_PIXIE_CRATE){ // The module numbers of the hits would be out of range.
+			std::cout << " StreamMerger: WARNING! Invalid crate number (" << crate << ") on line " << lineNum << ", must be less than " << MAX_PIXIE_CRATE << ".\n";
+			continue;
+		}
+
+		MergeStream *stream = new MergeStream();
+		stream->crate = crate;
+		stream->fname = args.at(1);
+		if(args.size() >= 3){ stream->offset = strtod(args.at(2).c_str(), NULL); }
+		if(args.size() >= 4){ stream->drift = strtod(args.at(3).c_str(), NULL); }
+
+		// Check for duplicate crate numbers.
+		for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+			if((*iter)->crate == stream->crate){
+				std::cout << " StreamMerger: WARNING! Crate " << stream->crate << " is defined more than once on line " << lineNum << ".\n";
+				break;
+			}
+		}
+
+		streams.push_back(stream);
+	}
+	mergeFile.close();
+
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		(*iter)->model.forget = forget;
+	}
+
+	return !streams.empty();
+}
+
+/** Open all input files and read their headers.
+  * \return True if all input files were opened successfully and false otherwise.
+  */
+bool StreamMerger::Open(){
+	if(streams.empty()){
+		std::cout << " StreamMerger: ERROR! No input streams defined.\n";
+		return false;
+	}
+
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		MergeStream *stream = (*iter);
+
+		std::string prefix;
+		std::string extension = get_extension(stream->fname, prefix);
+		if(extension == "ldf"){ stream->format = 0; }
+		else if(extension == "pld"){ stream->format = 1; }
+		else{
+			std::cout << " StreamMerger: ERROR! Invalid file format '" << extension << "' for crate " << stream->crate << ".\n";
+			return false;
+		}
+
+		stream->file.open(stream->fname.c_str(), std::ios::binary);
+		if(!stream->file.is_open() || !stream->file.good()){
+			std::cout << " StreamMerger: ERROR! Failed to open input file '" << stream->fname << "'! Check that the path is correct.\n";
+			return false;
+		}
+		stream->file.seekg(0, stream->file.end);
+		stream->length = stream->file.tellg();
+		stream->file.seekg(0, stream->file.beg);
+
+		if(debug_mode){
+			stream->pldHead.SetDebugMode();
+			stream->pldData.SetDebugMode();
+			stream->dirbuff.SetDebugMode();
+			stream->headbuff.SetDebugMode();
+			stream->databuff.SetDebugMode();
+		}
+
+		if(stream->format == 0){
+			if(!stream->dirbuff.Read(&stream->file) || !stream->headbuff.Read(&stream->file)){
+				std::cout << " StreamMerger: ERROR! Failed to read ldf header of '" << stream->fname << "'.\n";
+				return false;
+			}
+			stream->databuff.Reset();
+		}
+		else{
+			if(!stream->pldHead.Read(&stream->file)){
+				std::cout << " StreamMerger: ERROR! Failed to read pld header of '" << stream->fname << "'.\n";
+				return false;
+			}
+			stream->maxSpillSize = stream->pldHead.GetMaxSpillSize();
+			stream->pldData.Reset();
+		}
+
+		std::cout << " StreamMerger: Crate " << stream->crate << " <- " << stream->fname << " (offset = " << stream->offset << " ticks, drift = " << stream->drift << " ppm)\n";
+	}
+
+	if(ratio > 0){ std::cout << " StreamMerger: Aligning crate clocks to external timestamps (" << ratio << " ticks per external tick).\n"; }
+
+	return true;
+}
+
+/** Start the reader threads.
+  * \return True if the threads were started and false otherwise.
+  */
+bool StreamMerger::Start(){
+	if(running || streams.empty()){ return false; }
+
+	running = true;
+	watermark = -1;
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		(*iter)->worker = std::thread(&StreamMerger::read_stream, this, (*iter));
+	}
+
+	return true;
+}
+
+/** Stop all reader threads and delete any remaining hits.
+  * \return Nothing.
+  */
+void StreamMerger::Stop(){
+	{
+		std::lock_guard<std::mutex> lock(merge_mutex);
+		running = false;
+	}
+	space_ready.notify_all();
+	data_ready.notify_all();
+
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		if((*iter)->worker.joinable()){ (*iter)->worker.join(); }
+		while(!(*iter)->hits.empty()){
+			delete (*iter)->hits.front();
+			(*iter)->hits.pop_front();
+		}
+	}
+}
+
+/** Get the next time-ordered batch of hits from all streams. This method will
+  * block until every stream has either decoded data later than the merge
+  * watermark or reached the end of its file. Ownership of the hits is passed
+  * to the caller.
+  * \param[out] output_ Deque to which time-ordered hits will be appended.
+  * \return True if hits were retrieved and false if all streams are finished.
+  */
+bool StreamMerger::GetNext(std::deque<XiaData*> &output_){
+	std::unique_lock<std::mutex> lock(merge_mutex);
+
+	std::vector<XiaData*> batch;
+	while(batch.empty()){
+		bool allDone = true;
+		double horizon = std::numeric_limits<double>::max();
+
+		// Each stream promises that all hits it has yet to decode are later than the
+		// earliest hit of its most recent spill. Hits earlier than the minimum of
+		// these promises over all streams may be safely merged.
+		for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+			MergeStream *stream = (*iter);
+			if(stream->done){ continue; }
+			allDone = false;
+			double streamHorizon = (stream->numSpills > 0 ? stream->lowWater : -1);
+			if(streamHorizon < horizon){ horizon = streamHorizon; }
+		}
+
+		double limit = horizon;
+		if(allDone){ limit = std::numeric_limits<double>::max(); }
+		else if(horizon <= watermark){
+			// A stream is lagging behind the watermark. Wait for it to decode more data
+			// unless every lagging stream is blocked by a full buffer, in which case the
+			// buffered hits are released to force progress (at the expense of ordering).
+			bool mustWait = false;
+			limit = std::numeric_limits<double>::max();
+			for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+				MergeStream *stream = (*iter);
+				if(stream->done || (stream->numSpills > 0 && stream->lowWater > watermark)){ continue; }
+				if(stream->hits.size() < maxBuffered || stream->hits.empty()){
+					mustWait = true;
+					break;
+				}
+				double latest = std::nextafter(stream->hits.back()->time, std::numeric_limits<double>::max());
+				if(latest < limit){ limit = latest; }
+			}
+			if(mustWait){
+				if(!running){ return false; }
+				data_ready.wait(lock);
+				continue;
+			}
+		}
+
+		// Remove all hits earlier than the limit from each stream.
+		for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+			std::deque<XiaData*> &hits = (*iter)->hits;
+			std::deque<XiaData*> remaining;
+			for(std::deque<XiaData*>::iterator hit = hits.begin(); hit != hits.end(); ++hit){
+				if((*hit)->time < limit){ batch.push_back(*hit); }
+				else{ remaining.push_back(*hit); }
+			}
+			hits.swap(remaining);
+		}
+
+		if(limit > watermark){ watermark = limit; }
+		space_ready.notify_all();
+
+		if(batch.empty()){
+			if(allDone || !running){ return false; }
+			data_ready.wait(lock);
+		}
+	}
+	numMerged += batch.size();
+	lock.unlock();
+
+	// Sort the merged hits in time.
+	std::stable_sort(batch.begin(), batch.end(), &XiaData::compareTime);
+	for(std::vector<XiaData*>::iterator iter = batch.begin(); iter != batch.end(); ++iter){
+		output_.push_back(*iter);
+	}
+
+	if(debug_mode){ std::cout << "debug: Merged " << batch.size() << " hits up to time " << watermark << std::endl; }
+
+	return true;
+}
+
+/// Return the title of the first input file.
+std::string StreamMerger::GetRunTitle(){
+	if(streams.empty()){ return ""; }
+	if(streams.front()->format == 0){ return std::string(streams.front()->headbuff.GetRunTitle()); }
+	return std::string(streams.front()->pldHead.GetRunTitle());
+}
+
+/// Return the run number of the first input file.
+int StreamMerger::GetRunNumber(){
+	if(streams.empty()){ return -1; }
+	if(streams.front()->format == 0){ return streams.front()->dirbuff.GetRunNumber(); }
+	return streams.front()->pldHead.GetRunNumber();
+}
+
+/// Return a short status string for the terminal status line.
+std::string StreamMerger::GetStatus(){
+	std::lock_guard<std::mutex> lock(merge_mutex);
+	std::stringstream stream;
+	unsigned long numBuffered = 0;
+	unsigned int numDone = 0;
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		numBuffered += (*iter)->hits.size();
+		if((*iter)->done){ numDone++; }
+	}
+	stream << numMerged << " hits merged, " << numBuffered << " buffered, " << numLate << " late, " << numDone << "/" << streams.size() << " streams done";
+	return stream.str();
+}
+
+/// Print information about the clock alignment of each stream.
+void StreamMerger::PrintStatus(){
+	std::lock_guard<std::mutex> lock(merge_mutex);
+	std::cout << " StreamMerger: Merged " << numMerged << " hits (" << numLate << " late).\n";
+	for(std::vector<MergeStream*>::iterator iter = streams.begin(); iter != streams.end(); ++iter){
+		MergeStream *stream = (*iter);
+		std::cout << "  Crate " << stream->crate << ": " << stream->numSpills << " spills, " << stream->numHits << " hits, " << stream->numBad << " bad";
+		if(stream->model.numSamples > 0){
+			std::cout << ", " << stream->model.numSamples << " external timestamps, fitted drift = " << stream->model.GetDrift() << " ppm";
+		}
+		std::cout << std::endl;
+	}
+}
+
+/// Main loop of the reader thread for a single stream.
+void StreamMerger::read_stream(MergeStream *stream_){
+	// The buffer grows to fit the largest spill in the stream.
+	SpillBuffer buffer(stream_->format == 0 ? 0 : stream_->maxSpillSize);
+
+	unsigned int nBytes;
+	bool full_spill;
+	bool bad_spill;
+
+	std::vector<XiaData*> spillHits;
+	while(running){
+		if(stream_->format == 0){
+			if(!stream_->databuff.Read(&stream_->file, &buffer, nBytes, full_spill, bad_spill)){
+				int retval = stream_->databuff.GetRetval();
+				if(retval == 2 || retval == 6){ break; } // End of file or read failure.
+				continue;
+			}
+			if(!full_spill){ continue; }
+			if(bad_spill){
+				stream_->numBad++;
+				continue;
+			}
+		}
+		else if(!stream_->pldData.Read(&stream_->file, &buffer, nBytes)){ break; }
+
+		spillHits.clear();
+		if(!decode_spill(stream_, buffer.GetData(), nBytes/4, spillHits)){ stream_->numBad++; }
+		stream_->numSpills++;
+		if(spillHits.empty()){ continue; }
+
+		// Update the clock model using hits with external timestamps.
+		if(ratio > 0){
+			for(std::vector<XiaData*>::iterator iter = spillHits.begin(); iter != spillHits.end(); ++iter){
+				if(!(*iter)->hasExternalTimestamp){ continue; }
+				double staticTime = (*iter)->time + stream_->offset + stream_->drift*1E-6*((*iter)->time - stream_->t0);
+				stream_->model.Add((*iter)->time, (*iter)->externalTime*ratio - staticTime);
+			}
+		}
+
+		// Correct all timestamps onto the common time base.
+		for(std::vector<XiaData*>::iterator iter = spillHits.begin(); iter != spillHits.end(); ++iter){
+			(*iter)->time = stream_->Correct((*iter)->time);
+		}
+		std::sort(spillHits.begin(), spillHits.end(), &XiaData::compareTime);
+
+		// Push the corrected hits onto the merge buffer.
+		std::unique_lock<std::mutex> lock(merge_mutex);
+		while(running && stream_->hits.size() >= maxBuffered){ space_ready.wait(lock); }
+		if(!running){
+			lock.unlock();
+			for(std::vector<XiaData*>::iterator iter = spillHits.begin(); iter != spillHits.end(); ++iter){ delete (*iter); }
+			break;
+		}
+		for(std::vector<XiaData*>::iterator iter = spillHits.begin(); iter != spillHits.end(); ++iter){
+			if((*iter)->time < watermark){ numLate++; }
+			stream_->hits.push_back(*iter);
+		}
+		stream_->numHits += spillHits.size();
+		stream_->lowWater = spillHits.front()->time;
+		lock.unlock();
+		data_ready.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(merge_mutex);
+		stream_->done = true;
+	}
+	data_ready.notify_all();
+
+	if(debug_mode){ std::cout << "debug: Finished reading crate " << stream_->crate << " (" << stream_->numSpills << " spills, " << stream_->numHits << " hits)\n"; }
+}
+
+/// Decode a single spill into a list of uncorrected hits.
+bool StreamMerger::decode_spill(MergeStream *stream_, unsigned int *data_, const unsigned int &nWords_, std::vector<XiaData*> &hits_){
+	const unsigned int maxVsn = 14; // No more than 14 pixie modules per crate
+	unsigned int nWords_read = 0;
+
+	while(nWords_read + 1 < nWords_){
+		unsigned int lenRec = data_[nWords_read]; // Number of words in this record
+		unsigned int vsn = data_[nWords_read+1]; // Module number
+
+		if(vsn == 9999){ break; } // End spill vsn
+		else if(lenRec < 2 || nWords_read + lenRec > nWords_){
+			if(debug_mode){ std::cout << "debug: Invalid record length of " << lenRec << " words for crate " << stream_->crate << ", vsn " << vsn << std::endl; }
+			return false;
+		}
+		else if(vsn == 1000 || lenRec == 6){ // Wall clock time or empty channel.
+			nWords_read += lenRec;
+			continue;
+		}
+		else if(vsn >= maxVsn){
+			if(debug_mode){ std::cout << "debug: Unexpected vsn " << vsn << " for crate " << stream_->crate << std::endl; }
+			return false;
+		}
+
+		unsigned int *buf = &data_[nWords_read];
+		unsigned int bufIndex = 2;
+		while(bufIndex < lenRec){
+			XiaData *currentEvt = new XiaData();
+			if(!currentEvt->readEventRevF(buf, bufIndex, vsn)){
+				delete currentEvt;
+				stream_->numBad++;
+				continue;
+			}
+
+			// Assign the crate number of this stream.
+			currentEvt->crateNum = stream_->crate;
+			currentEvt->modNum = 100*stream_->crate + vsn;
+
+			if(stream_->t0 < 0){ stream_->t0 = currentEvt->time; }
+			hits_.push_back(currentEvt);
+		}
+
+		nWords_read += lenRec;
+	}
+
+	return true;
+}
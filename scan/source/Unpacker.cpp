@@ -21,6 +21,9 @@
 
 #include "Unpacker.hpp"
 #include "XiaData.hpp"
+#include "ScanCheckpoint.hpp"
+#include "RawEventCache.hpp"
+#include "RateMonitor.hpp"
 
 void clearDeque(std::deque<XiaData*> &list){
 	while(!list.empty()){
@@ -89,7 +92,7 @@ bool Unpacker::BuildRawEventA(){
 			mod = current_event->modNum;
 			chan = current_event->chanNum;
 	
-			if(mod > MAX_PIXIE_MOD || chan > MAX_PIXIE_CHAN){ // Skip this channel
+			if(GetModuleIndex(current_event) < 0 || chan > MAX_PIXIE_CHAN){ // Skip this channel
 				std::cout << "BuildRawEvent: Encountered non-physical Pixie ID (mod = " << mod << ", chan = " << chan << ")\n";
 				delete current_event;
 				iter->pop_front();
@@ -174,7 +177,10 @@ bool Unpacker::BuildRawEventB(){
 			// Loop over all time-sorted modules.
 			int whitelistModCount = 0;
 			for(std::vector<std::deque<XiaData*> >::iterator iter = eventList.begin(); iter != eventList.end(); iter++){
-				if(!IsInWhitelist(whitelistModCount++, -1) || iter->empty())
+				// Convert the event list index back to a crate-offset module number.
+				int whitelistMod = 100*(whitelistModCount/(MAX_PIXIE_MOD+1)) + whitelistModCount%(MAX_PIXIE_MOD+1);
+				whitelistModCount++;
+				if(!IsInWhitelist(whitelistMod, -1) || iter->empty())
 					continue;
 				
 				// Loop over the list of channels that fired in this module.
@@ -244,7 +250,7 @@ bool Unpacker::BuildRawEventB(){
 			mod = current_event->modNum;
 			chan = current_event->chanNum;
 	
-			if(mod > MAX_PIXIE_MOD || chan > MAX_PIXIE_CHAN){ // Skip this channel
+			if(GetModuleIndex(current_event) < 0 || chan > MAX_PIXIE_CHAN){ // Skip this channel
 				std::cout << "BuildRawEvent: Encountered non-physical Pixie ID (mod = " << mod << ", chan = " << chan << ")\n";
 				delete current_event;
 				iter->pop_front();
@@ -302,21 +308,42 @@ bool Unpacker::BuildRawEventB(){
   * \return True if the XiaData's module number is valid and false otherwise.
   */
 bool Unpacker::AddEvent(XiaData *event_){
-	if(event_->modNum > MAX_PIXIE_MOD){ return false; }
+	int index = GetModuleIndex(event_);
+	if(index < 0){ return false; }
 	
 	// Check for the need to add a new deque to the event list.
-	if(event_->modNum+1 > (unsigned short)eventList.size()){
-		while ((unsigned short)eventList.size() < event_->modNum + 1) {
-			eventList.push_back(std::deque<XiaData*>());
-		}
+	while ((int)eventList.size() < index + 1) {
+		eventList.push_back(std::deque<XiaData*>());
 	}
 
 	if(rawEventMode >= 2 && (event_->modNum == startMod && event_->chanNum == startChan)) startList.push_back(event_);
-	else eventList.at(event_->modNum).push_back(event_);
+	else eventList.at(index).push_back(event_);
 	
 	return true;
 }
 
+/** Get the index of an event in the event list. Modules of crate N are stored
+  * after all modules of crates 0 to N-1.
+  * \param[in]  event_ Pointer to the XiaData whose index will be returned.
+  * \return The event list index or -1 if the crate or module number is invalid.
+  */
+int Unpacker::GetModuleIndex(XiaData *event_){
+	unsigned int crate = event_->modNum / 100;
+	unsigned int mod = event_->modNum % 100;
+	if(crate >= MAX_PIXIE_CRATE || mod > MAX_PIXIE_MOD){ return -1; }
+	return (int)(crate*(MAX_PIXIE_MOD+1) + mod);
+}
+
+/** Increment the counter for the crate, module, and channel of an event.
+  * \param[in]  event_ Pointer to the XiaData to count.
+  * \return True if the event has a valid crate, module, and channel and false otherwise.
+  */
+bool Unpacker::CountEvent(XiaData *event_){
+	if(GetModuleIndex(event_) < 0 || event_->chanNum > MAX_PIXIE_CHAN){ return false; }
+	channel_counts[event_->modNum / 100][event_->modNum % 100][event_->chanNum]++;
+	return true;
+}
+
 /** Clear all events in the spill event list. WARNING! This method will delete all events in the
   * event list. This could cause seg faults if the events are used elsewhere.
   * \return Nothing.
@@ -418,11 +445,12 @@ int Unpacker::ReadSpillModule(unsigned int *buf){
 				continue;
 			}
 
-			// Does not handle multiple crates! CRT
-			channel_counts[currentEvt->modNum][currentEvt->chanNum]++;
-			
-			// Add the event to the event list.
-			AddEvent(currentEvt);
+			// Update the channel counter and add the event to the event list.
+			if(!CountEvent(currentEvt) || !AddEvent(currentEvt)){
+				std::cout << "ReadSpillModule: ERROR - Encountered non-physical Pixie ID (mod = " << currentEvt->modNum << ", chan = " << currentEvt->chanNum << ")\n";
+				delete currentEvt;
+				continue;
+			}
 			numEvents++;
 		}
 	} 
@@ -459,8 +487,8 @@ Unpacker::Unpacker() :
 	debug_mode(false),
 	running(true),
 	interface(NULL),
-	TOTALREAD(1000000), // Maximum number of data words to read.
-	maxWords(131072), // Maximum number of data words for revision D.	
+	eventCache(NULL),
+	rateMonitor(NULL),
 	numRawEvt(0), // Count of raw events read from file.
 	firstTime(0),
 	rawEventMode(2), // The raw event building method to use.
@@ -472,9 +500,11 @@ Unpacker::Unpacker() :
 	useRawEventStats(false),
 	untriggeredMode(false)
 {
-	for(unsigned int i = 0; i <= MAX_PIXIE_MOD; i++){
-		for(unsigned int j = 0; j <= MAX_PIXIE_CHAN; j++){
-			channel_counts[i][j] = 0;
+	for(unsigned int i = 0; i < MAX_PIXIE_CRATE; i++){
+		for(unsigned int j = 0; j <= MAX_PIXIE_MOD; j++){
+			for(unsigned int k = 0; k <= MAX_PIXIE_CHAN; k++){
+				channel_counts[i][j][k] = 0;
+			}
 		}
 	}
 }
@@ -555,13 +585,13 @@ bool Unpacker::ReadSpill(unsigned int *data, unsigned int nWords, bool is_verbos
 
 	// While the current location in the buffer has not gone beyond the end
 	// of the buffer (ignoring the last three delimiters, continue reading
-	while (nWords_read <= nWords){
+	while (nWords_read + 2 <= nWords){
 		// Retrieve the record length and the vsn number
 		lenRec = data[nWords_read]; // Number of words in this record
 		vsn = data[nWords_read+1]; // Module number
 	
-		// Check sanity of record length and vsn
-		if(lenRec > maxWords || (vsn > maxVsn && vsn != 9999 && vsn != 1000)){ 
+		// Check sanity of record length and vsn. The record must fit inside the remaining spill words.
+		if(lenRec < 2 || lenRec > nWords - nWords_read || (vsn > maxVsn && vsn != 9999 && vsn != 1000)){ 
 			if(is_verbose){
 				std::cout << "ReadSpill: SANITY CHECK FAILED: lenRec = " << lenRec << ", vsn = " << vsn << ", read " << nWords_read << " of " << nWords << std::endl;
 			}
@@ -635,11 +665,6 @@ bool Unpacker::ReadSpill(unsigned int *data, unsigned int nWords, bool is_verbos
 		}
 	} // while still have words
 
-	if(nWords > TOTALREAD || nWords_read > TOTALREAD){
-		std::cout << "ReadSpill: Values of nn - " << nWords << " nk - "<< nWords_read << " TOTALREAD - " << TOTALREAD << std::endl;
-		return false;
-	}
-
 	// If the vsn is 9999 this is the end of a spill, signal this buffer
 	// for processing and determine if the buffer is split between spills.
 	if(vsn == 9999 || vsn == 1000){
@@ -659,24 +684,8 @@ bool Unpacker::ReadSpill(unsigned int *data, unsigned int nWords, bool is_verbos
 			// Sort the vector of pointers eventlist according to time
 			//double lastTimestamp = (*(eventList.rbegin()))->time;
 
-			// Sort the event list in time
-			TimeSort();
-
-			// Once the vector of pointers eventlist is sorted based on time,
-			// begin the event processing in ScanList().
-			// ScanList will also clear the event list for us.
-			if(rawEventMode <= 1){
-				while(BuildRawEventA()){ // Build a new raw event and process it.
-					ProcessRawEvent(interface);
-				}
-			}
-			else{
-				while(BuildRawEventB()){ // Build a new raw event and process it.
-					ProcessRawEvent(interface);
-				}
-			}
-
-			ClearEventList();
+			// Sort the event list in time, build raw events, and process them.
+			ProcessEventList();
 			
 			// Once the eventlist has been scanned, reset the number 
 			// of events to zero and update the event counter
@@ -704,6 +713,101 @@ bool Unpacker::ReadSpill(unsigned int *data, unsigned int nWords, bool is_verbos
 	return true;		
 }
 
+/** Sort the event list, build all raw events, and pass them to ProcessRawEvent.
+  * The event list is cleared upon return.
+  * \return Nothing.
+  */
+void Unpacker::ProcessEventList(){
+	// Sort the event list in time
+	TimeSort();
+
+	// Update the channel rates with every event in the spill (including start events), since
+	// events which are not part of any raw event still take up the time of a channel.
+	if(rateMonitor){
+		rateMonitor->BeginSpill();
+		for(std::vector<std::deque<XiaData*> >::iterator iter = eventList.begin(); iter != eventList.end(); iter++){
+			for(std::deque<XiaData*>::iterator evt = iter->begin(); evt != iter->end(); evt++)
+				rateMonitor->Hit(GetModuleIndex(*evt)*(MAX_PIXIE_CHAN+1) + (*evt)->chanNum, *evt);
+		}
+		for(std::deque<XiaData*>::iterator evt = startList.begin(); evt != startList.end(); evt++)
+			rateMonitor->Hit(GetModuleIndex(*evt)*(MAX_PIXIE_CHAN+1) + (*evt)->chanNum, *evt);
+		rateMonitor->EndSpill();
+	}
+
+	// Count the events of every channel in the spill, since events which are not
+	// part of any raw event must also be counted when the cache is replayed.
+	// All events in the event list and the start list have already passed CountEvent.
+	std::vector<unsigned int> counts;
+	if(eventCache){
+		unsigned int spill_counts[MAX_PIXIE_CRATE][MAX_PIXIE_MOD+1][MAX_PIXIE_CHAN+1] = {};
+		for(std::vector<std::deque<XiaData*> >::iterator iter = eventList.begin(); iter != eventList.end(); iter++){
+			for(std::deque<XiaData*>::iterator evt = iter->begin(); evt != iter->end(); evt++)
+				spill_counts[(*evt)->modNum / 100][(*evt)->modNum % 100][(*evt)->chanNum]++;
+		}
+		for(std::deque<XiaData*>::iterator evt = startList.begin(); evt != startList.end(); evt++)
+			spill_counts[(*evt)->modNum / 100][(*evt)->modNum % 100][(*evt)->chanNum]++;
+		// Only store the channels which have counts, as (crate*100+mod)*16+chan and count pairs.
+		for(unsigned int i = 0; i < MAX_PIXIE_CRATE; i++){
+			for(unsigned int j = 0; j <= MAX_PIXIE_MOD; j++){
+				for(unsigned int k = 0; k <= MAX_PIXIE_CHAN; k++){
+					if(spill_counts[i][j][k] == 0) continue;
+					counts.push_back((100*i+j)*16+k);
+					counts.push_back(spill_counts[i][j][k]);
+				}
+			}
+		}
+	}
+
+	// Once the vector of pointers eventlist is sorted based on time,
+	// begin the event processing in ScanList().
+	// ScanList will also clear the event list for us.
+	double times[3];
+	while(rawEventMode <= 1 ? BuildRawEventA() : BuildRawEventB()){ // Build a new raw event and process it.
+		if(eventCache){
+			times[0] = startEventTime;
+			times[1] = rawEventStartTime;
+			times[2] = rawEventStopTime;
+			eventCache->WriteRawEvent(rawEvent, times);
+		}
+		ProcessRawEvent(interface);
+	}
+
+	// Notify derived classes that the spill has been fully processed.
+	if(eventCache) eventCache->WriteEndSpill(counts);
+	EndSpill(interface);
+
+	ClearEventList();
+}
+
+/** ReadHits is responsible for building raw events from a list of already decoded
+  * channel events (e.g. the time-ordered output of the StreamMerger). The Unpacker
+  * takes ownership of all events in the list.
+  * \param[in]  hits       Deque of pointers to decoded channel events. Emptied upon return.
+  * \param[in]  is_verbose Toggle the verbosity flag on/off.
+  * \return True if at least one event was added to the event list and false otherwise.
+  */
+bool Unpacker::ReadHits(std::deque<XiaData*> &hits, bool is_verbose/*=true*/){
+	unsigned long numEvents = 0;
+	while(!hits.empty()){
+		XiaData *currentEvt = hits.front();
+		hits.pop_front();
+		
+		// Update the channel counter and add the event to the event list.
+		if(!CountEvent(currentEvt) || !AddEvent(currentEvt)){
+			if(is_verbose){ std::cout << "ReadHits: Encountered non-physical Pixie ID (mod = " << currentEvt->modNum << ", chan = " << currentEvt->chanNum << ")\n"; }
+			delete currentEvt;
+			continue;
+		}
+		numEvents++;
+	}
+
+	if(numEvents == 0){ return false; }
+
+	ProcessEventList();
+
+	return true;
+}
+
 /** ReadRawEvent assumes that the events in the incoming data are already grouped
   * into a raw event. This method performs sanity checks on the raw event and calls
   * ReadBuffer in order to construct the event list.
@@ -742,8 +846,8 @@ bool Unpacker::ReadRawEvent(unsigned int *data, unsigned int nWords, bool is_ver
 		if(currentEvt->time > rawEventStopTime) 
 			rawEventStopTime = currentEvt->time;
 
-		// Does not handle multiple crates! CRT
-		channel_counts[currentEvt->modNum][currentEvt->chanNum]++;
+		// Update the channel counter.
+		CountEvent(currentEvt);
 
 		// Update raw stats output with the new event before adding it to the raw event.
 		RawStats(currentEvt);			
@@ -773,21 +877,161 @@ bool Unpacker::ReadRawEvent(unsigned int *data, unsigned int nWords, bool is_ver
 	return true;
 }
 
+/** ReplaySpill reads the raw events of a single spill from a raw event cache which was
+  * written during a previous scan and passes them to ProcessRawEvent. Raw events are
+  * not built again, so the event list is unused.
+  * \param[in]  cache_     Pointer to a cache opened for reading.
+  * \param[in]  is_verbose Toggle the verbosity flag on/off.
+  * \return 1 if a spill was replayed, 0 at the end of the cache, and -1 upon failure.
+  */
+int Unpacker::ReplaySpill(RawEventCache *cache_, bool is_verbose/*=true*/){
+	unsigned int *data;
+	unsigned int nWords;
+	double times[3];
+
+	while(true){
+		CacheRecord record = cache_->Read(data, nWords, times);
+
+		if(record == CACHE_END){
+			return 0;
+		}
+		else if(record == CACHE_ERROR){
+			if(is_verbose){ std::cout << "ReplaySpill: Failed to read raw event cache \"" << cache_->GetFilename() << "\"!\n"; }
+			return -1;
+		}
+		else if(record == CACHE_END_SPILL){
+			// Restore the channel counts of all events in the spill.
+			for(unsigned int i = 0; i+1 < nWords; i += 2){
+				unsigned int crate = data[i]/1600;
+				unsigned int mod = (data[i]/16) % 100;
+				unsigned int chan = data[i] % 16;
+				if(crate < MAX_PIXIE_CRATE && mod <= MAX_PIXIE_MOD)
+					channel_counts[crate][mod][chan] += data[i+1];
+			}
+
+			// Notify derived classes that the spill has been fully processed.
+			EndSpill(interface);
+
+			return 1;
+		}
+
+		if(!rawEvent.empty())
+			ClearRawEvent();
+
+		// Decode the channel events of the raw event. Module numbers were already
+		// offset by the crate number when the cache was written.
+		unsigned int bufIndex = 0;
+		while(bufIndex < nWords){
+			XiaData *currentEvt = GetNewEvent();
+			unsigned int startIndex = bufIndex;
+			if(!currentEvt->readEventRevF(data, bufIndex) || bufIndex <= startIndex || bufIndex > nWords){
+				if(is_verbose){ std::cout << "ReplaySpill: ERROR - Failed to decode cached raw event! numRawEvt=" << numRawEvt << ", bufIndex=" << bufIndex << ", nWords=" << nWords << std::endl; }
+				delete currentEvt;
+				ClearRawEvent();
+				return -1;
+			}
+			rawEvent.push_back(currentEvt);
+		}
+
+		startEventTime = times[0];
+		rawEventStartTime = times[1];
+		rawEventStopTime = times[2];
+
+		// Print the time of the very first raw event.
+		if(numRawEvt == 0){
+			firstTime = rawEventStartTime;
+			if(is_verbose){ std::cout << "ReplaySpill: First event time is " << firstTime << " clock ticks.\n"; }
+		}
+
+		// Process the event.
+		ProcessRawEvent(interface);
+
+		// Increment the number of raw events which have been read.
+		numRawEvt++;
+	}
+}
+
+/** Get a description of all settings which affect raw event building. Raw events
+  * written to a cache may only be replayed if the description has not changed.
+  * \return The description of the raw event builder settings.
+  */
+std::string Unpacker::GetBuilderSettings(){
+	std::stringstream stream;
+	stream << "width=" << eventWidth << ";delay=" << eventDelay << ";mode=" << rawEventMode;
+	stream << ";start=" << startMod << ":" << startChan << ";untriggered=" << untriggeredMode << ";whitelist=";
+	for(size_t mod = 0; mod < whitelist.size(); mod++){
+		for(std::vector<int>::iterator chan = whitelist[mod].begin(); chan != whitelist[mod].end(); chan++)
+			stream << mod << ":" << *chan << ",";
+	}
+	return stream.str();
+}
+
 /** Write all recorded channel counts to a file.
   * \return Nothing.
   */
 void Unpacker::Write(){
 	std::ofstream count_output("counts.dat");
 	if(count_output.good()){
-		for(unsigned int i = 0; i <= MAX_PIXIE_MOD; i++){
-			for(unsigned int j = 0; j <= MAX_PIXIE_CHAN; j++){
-				count_output << i << "\t" << j << "\t" << channel_counts[i][j] << std::endl;
+		for(unsigned int i = 0; i < MAX_PIXIE_CRATE; i++){
+			for(unsigned int j = 0; j <= MAX_PIXIE_MOD; j++){
+				// Skip empty modules of additional crates.
+				if(i > 0){
+					unsigned int total = 0;
+					for(unsigned int k = 0; k <= MAX_PIXIE_CHAN; k++){ total += channel_counts[i][j][k]; }
+					if(total == 0) continue;
+				}
+				for(unsigned int k = 0; k <= MAX_PIXIE_CHAN; k++){ // Module numbers are offset by 100 for each crate.
+					count_output << 100*i+j << "\t" << k << "\t" << channel_counts[i][j][k] << std::endl;
+				}
 			}
 		}
 		count_output.close();
 	}
 }
 
+/** Add the raw event counters and channel counts to a checkpoint. Must only be called
+  * between spills, when the event list is empty.
+  * \param[out] ckpt_ Pointer to the checkpoint.
+  * \return Nothing.
+  */
+void Unpacker::SaveState(ScanCheckpoint *ckpt_){
+	ckpt_->Set("unpacker.numRawEvt", numRawEvt);
+	ckpt_->Set("unpacker.firstTime", firstTime);
+
+	// Only store the channels which have counts, as (crate*100+mod)*16+chan and count pairs.
+	std::vector<unsigned int> counts;
+	for(unsigned int i = 0; i < MAX_PIXIE_CRATE; i++){
+		for(unsigned int j = 0; j <= MAX_PIXIE_MOD; j++){
+			for(unsigned int k = 0; k <= MAX_PIXIE_CHAN; k++){
+				if(channel_counts[i][j][k] == 0) continue;
+				counts.push_back((100*i+j)*16+k);
+				counts.push_back(channel_counts[i][j][k]);
+			}
+		}
+	}
+	ckpt_->SetArray("unpacker.counts", counts);
+}
+
+/** Restore the raw event counters and channel counts from a checkpoint.
+  * \param[in]  ckpt_ Pointer to the checkpoint.
+  * \return True if the checkpoint contains the unpacker state and false otherwise.
+  */
+bool Unpacker::LoadState(ScanCheckpoint *ckpt_){
+	std::vector<unsigned int> counts;
+	if(!ckpt_->Get("unpacker.numRawEvt", numRawEvt) || !ckpt_->Get("unpacker.firstTime", firstTime) ||
+	   !ckpt_->GetArray("unpacker.counts", counts) || counts.size() % 2 != 0) return false;
+
+	for(size_t i = 0; i < counts.size(); i += 2){
+		unsigned int crate = counts[i]/1600;
+		unsigned int mod = (counts[i]/16) % 100;
+		unsigned int chan = counts[i] % 16;
+		if(crate >= MAX_PIXIE_CRATE || mod > MAX_PIXIE_MOD) return false;
+		channel_counts[crate][mod][chan] = counts[i+1];
+	}
+
+	return true;
+}
+
 /** Clear event list and raw event.
   * \return Nothing.
   */
@@ -26,6 +26,8 @@ XiaData::XiaData(XiaData *other_){
 	energy = other_->energy; 
 	time = other_->time;
 
+	crateNum = other_->crateNum;
+	slotNum = other_->slotNum;
 	modNum = other_->modNum;
 	chanNum = other_->chanNum;
 	cfdTime = other_->cfdTime;
@@ -48,6 +50,9 @@ XiaData::XiaData(XiaData *other_){
 	hasRawQdcSums = other_->hasRawQdcSums;
 	hasExternalTimestamp = other_->hasExternalTimestamp;
 
+	for(size_t i = 0; i < 4; i++)
+		energySums[i] = other_->energySums[i];
+
 	// Copy the ADC trace, if enabled.
 	if(other_->traceLength > 0)
 		copyTrace((char *)other_->adcTrace, other_->traceLength);
@@ -88,6 +93,8 @@ void XiaData::clear(){
 	energy = 0.0; 
 	time = 0.0;
 	
+	crateNum = 0;
+	slotNum = 0;
 	modNum = 0;
 	chanNum = 0;
 	cfdTime = 0;
@@ -110,6 +117,9 @@ void XiaData::clear(){
 	hasRawQdcSums = false;
 	hasExternalTimestamp = false;
 
+	for(size_t i = 0; i < 4; i++)
+		energySums[i] = 0;
+
 	clearTrace();
 	clearQDCs();
 }
@@ -132,6 +142,14 @@ void XiaData::clearQDCs(){
 	qdcValue = NULL;
 }
 
+/// Return the sum of the onboard qdc values in the range [start_, stop_].
+double XiaData::getQdcSum(const size_t &start_, const size_t &stop_){
+	double sum = 0;
+	for(size_t i = start_; i <= stop_ && i < numQdcs; i++)
+		sum += qdcValue[i];
+	return sum;
+}
+
 /// Print event information to the screen.
 void XiaData::print(){
 	std::cout << " energy:	  " << this->energy << std::endl;
@@ -226,11 +244,13 @@ bool XiaData::readEventRevF(unsigned int *buf, unsigned int &bufferIndex, unsign
 		return false;
 	}
 
-	// Determine what information is contained in the header.
+	// Determine what information is contained in the header. Each optional
+	// block adds (words/2) to the header length bits i.e. 4 energy sums (2),
+	// 8 QDCs (4), and the 2 word external timestamp (1).
 	std::bitset<3> headerBits((headerLength-4)/2);
 
-	hasRawEnergySums = headerBits[2];
-	hasRawQdcSums = headerBits[1];
+	hasRawEnergySums = headerBits[1];
+	hasRawQdcSums = headerBits[2];
 	hasExternalTimestamp = headerBits[0];
 
 	// One last check on the event length.
@@ -248,8 +268,8 @@ bool XiaData::readEventRevF(unsigned int *buf, unsigned int &bufferIndex, unsign
 
 	// Handle the raw energy sums (4 words).
 	if(hasRawEnergySums){
-		// Skip the onboard partial sums for now 
 		// trailing, leading, gap, baseline
+		memcpy((char *)energySums, (char *)&buf[bufferIndex], 16);
 		bufferIndex += 4;
 	}
 
@@ -300,7 +320,9 @@ bool XiaData::readEventRevF(unsigned int *buf, unsigned int &bufferIndex, unsign
 /// Get the size of the XiaData event when written to disk by ::writeEventRevF (in 4-byte words).
 size_t XiaData::getEventLengthRevF(){
 	size_t eventLength = 4;
+	if(hasRawEnergySums) eventLength += 4; // Account for the onboard energy sums.
 	if(numQdcs > 0) eventLength += numQdcs; // Account for the onboard QDCs.
+	if(hasExternalTimestamp) eventLength += 2; // Account for the external timestamp.
 	if(traceLength > 0) eventLength += traceLength/2; // Account for the ADC trace.
 	return eventLength;
 }
@@ -316,7 +338,6 @@ size_t XiaData::getEventLengthRevF(){
 int XiaData::writeEventRevF(std::ofstream *file_, char *array_){
 	if((!file_ && !array_) || (file_ && !file_->good())) return -1;
 
-	unsigned int crateNum = 0x0; // Fixed value for now.
 	unsigned int chanIdentifier = 0xFFFFFFFF;
 	unsigned int eventTimeHiWord = 0xFFFFFFFF;
 	unsigned int eventEnergyWord = 0xFFFFFFFF;
@@ -326,7 +347,7 @@ int XiaData::writeEventRevF(std::ofstream *file_, char *array_){
 	
 	// Build up the channel identifier.
 	chanIdentifier &= ~(0x0000000F & (chanNum));	          // Pixie channel number
-	chanIdentifier &= ~(0x000000F0 & (modNum << 4));	      // Pixie module number (NOT the slot number)
+	chanIdentifier &= ~(0x000000F0 & ((modNum % 100) << 4));  // Pixie module number (NOT the slot number)
 	chanIdentifier &= ~(0x00000F00 & (crateNum << 8));	    // Crate number
 	chanIdentifier &= ~(0x0001F000 & (headLength << 12));	 // Header length
 	chanIdentifier &= ~(0x1FFE0000 & (eventLength << 17));	// Event length
@@ -363,6 +384,13 @@ int XiaData::writeEventRevF(std::ofstream *file_, char *array_){
 
 	int numBytes = 16;
 
+	// Write the onboard energy sums, if enabled.
+	if(hasRawEnergySums){
+		if(file_) file_->write((char *)energySums, 16);
+		if(array_) memcpy(&array_[numBytes], (char *)energySums, 16);
+		numBytes += 16;
+	}
+
 	// Write the onbard QDCs, if enabled.
 	if(numQdcs > 0){
 		if(file_) file_->write((char *)qdcValue, numQdcs*4);
@@ -370,6 +398,19 @@ int XiaData::writeEventRevF(std::ofstream *file_, char *array_){
 		numBytes += numQdcs*4;
 	}
 
+	// Write the external timestamp, if enabled.
+	if(hasExternalTimestamp){
+		if(file_){
+			file_->write((char *)&externalTimeLo, 4);
+			file_->write((char *)&externalTimeHi, 4);
+		}
+		if(array_){
+			memcpy(&array_[numBytes], (char *)&externalTimeLo, 4);
+			memcpy(&array_[numBytes+4], (char *)&externalTimeHi, 4);
+		}
+		numBytes += 8;
+	}
+
 	// Write the ADC trace, if enabled.
 	if(traceLength != 0){ // Write the trace.
 		if(file_) file_->write((char *)adcTrace, traceLength*2);
@@ -400,7 +441,7 @@ ChannelEvent::~ChannelEvent(){
 
 float ChannelEvent::ComputeBaseline(){
 	if(traceLength == 0){ return -9999; }
-	if(baseline > 0){ return baseline; }
+	if(computed & TRACE_BASELINE){ return baseline; }
 
 	// Find the baseline.
 	double tempbaseline = 0.0;
@@ -434,12 +475,14 @@ float ChannelEvent::ComputeBaseline(){
 	else // Favor the right side of the pulse.
 		maximum = calculateP3(max_index-1, &adcTrace[max_index-1], cfdPar) - baseline;
 
+	computed |= TRACE_BASELINE;
+
 	return baseline;
 }
 
 /// Integrate the baseline corrected trace for QDC in the range [start_, stop_] and return the result.
 float ChannelEvent::IntegratePulse(const size_t &start_/*=0*/, const size_t &stop_/*=0*/){
-	if(traceLength == 0 || baseline < 0.0){ return -9999; }
+	if(traceLength == 0 || ComputeBaseline() < 0.0){ return -9999; }
 	
 	size_t stop = (stop_ == 0?traceLength:stop_);
 
@@ -456,13 +499,14 @@ float ChannelEvent::IntegratePulse(const size_t &start_/*=0*/, const size_t &sto
 	for(size_t i = start_+1; i < stop; i++){ // Integrate using trapezoidal rule.
 		qdc += 0.5*(adcTrace[i-1] + adcTrace[i]) - baseline;
 	}
+	computed |= TRACE_QDC;
 
 	return qdc;
 }
 
 /// Integrate the baseline corrected trace for QDC2 in the range [start_, stop_] and return the result.
 float ChannelEvent::IntegratePulse2(const size_t &start_/*=0*/, const size_t &stop_/*=0*/){
-	if(traceLength == 0 || baseline < 0.0){ return -9999; }
+	if(traceLength == 0 || ComputeBaseline() < 0.0){ return -9999; }
 	
 	size_t stop = (stop_ == 0?traceLength:stop_);
 
@@ -477,13 +521,14 @@ float ChannelEvent::IntegratePulse2(const size_t &start_/*=0*/, const size_t &st
 	for(size_t i = start_+1; i < stop; i++){ // Integrate using trapezoidal rule.
 		qdc2 += 0.5*(adcTrace[i-1] + adcTrace[i]) - baseline;
 	}
+	computed |= TRACE_QDC2;
 
 	return qdc2;
 }
 
 /// Perform traditional CFD analysis on the waveform.
 float ChannelEvent::AnalyzeCFD(const float &F_/*=0.5*/, const size_t &D_/*=1*/, const size_t &L_/*=1*/){
-	if(traceLength == 0 || baseline < 0){ return -9999; }
+	if(traceLength == 0 || ComputeBaseline() < 0){ return -9999; }
 	if(!cfdvals)
 		cfdvals = new float[traceLength];
 	
@@ -508,20 +553,21 @@ float ChannelEvent::AnalyzeCFD(const float &F_/*=0.5*/, const size_t &D_/*=1*/,
 	// Find the zero-crossing.
 	if(cfdMinIndex > 0){
 		// Find the zero-crossing.
-		for(size_t cfdIndex = cfdMinIndex-1; cfdIndex >= 0; cfdIndex--){
-			if(cfdvals[cfdIndex] >= 0.0 && cfdvals[cfdIndex+1] < 0.0){
-				phase = cfdIndex - cfdvals[cfdIndex]/(cfdvals[cfdIndex+1]-cfdvals[cfdIndex]);
+		for(size_t cfdIndex = cfdMinIndex; cfdIndex > 0; cfdIndex--){
+			if(cfdvals[cfdIndex-1] >= 0.0 && cfdvals[cfdIndex] < 0.0){
+				phase = (cfdIndex-1) - cfdvals[cfdIndex-1]/(cfdvals[cfdIndex]-cfdvals[cfdIndex-1]);
 				break;
 			}
 		}
 	}
+	computed |= TRACE_PHASE;
 
 	return phase;
 }
 
 /// Perform polynomial CFD analysis on the waveform.
 float ChannelEvent::AnalyzePolyCFD(const float &F_/*=0.5*/){
-	if(traceLength == 0 || baseline < 0){ return -9999; }
+	if(traceLength == 0 || ComputeBaseline() < 0){ return -9999; }
 
 	double threshold = F_*maximum + baseline;
 
@@ -547,10 +593,68 @@ float ChannelEvent::AnalyzePolyCFD(const float &F_/*=0.5*/){
 			break;
 		}
 	}
+	computed |= TRACE_PHASE;
 
 	return phase;
 }
 
+/** Compute the phase from the onboard CFD time for a module with a given ADC clock period (2, 4, or 10 ns).
+  * Returns the phase in ADC clock ticks, or -9999 if the onboard CFD failed to trigger.
+  */
+float ChannelEvent::AnalyzeOnboardCFD(const double &adcClockInSeconds_){
+	phase = -9999;
+	if(adcClockInSeconds_ < 3E-9){ // 500 MHz module
+		unsigned short source = (cfdTime & 0xE000) >> 13;
+		if(source == 7){ return phase; } // Forced trigger.
+		phase = (source - 1) + (cfdTime & 0x1FFF)/8192.0;
+	}
+	else if(adcClockInSeconds_ < 8E-9){ // 250 MHz module
+		if(cfdTime & 0x8000){ return phase; } // Forced trigger.
+		phase = (cfdTime & 0x3FFF)/16384.0 - ((cfdTime & 0x4000) >> 14);
+	}
+	else{ // 100 MHz module
+		if(cfdTime & 0x8000){ return phase; } // Forced trigger.
+		phase = (cfdTime & 0x7FFF)/32768.0;
+	}
+	computed |= TRACE_PHASE;
+	return phase;
+}
+
+/** Compute the baseline, QDC, and QDC2 from onboard quantities. The baseline (per ADC sample) is
+  * taken from the trailing energy sum using the energy filter length len_. If sumLengths_ is not
+  * NULL, it is assumed to point to the lengths (in samples) of the 8 QDC sums and each sum will
+  * be baseline corrected. The QDC and QDC2 are the sums of QDC ranges [start_, stop_] and
+  * [start2_, stop2_] respectively. Returns the QDC, or -9999 if the onboard QDC sums are missing.
+  */
+float ChannelEvent::ComputeOnboard(const size_t &start_, const size_t &stop_, const int &start2_/*=-1*/, const int &stop2_/*=-1*/, const double &len_/*=0*/, const double *sumLengths_/*=NULL*/){
+	if(numQdcs == 0){ return -9999; }
+
+	// The trailing energy sum is taken over the len_ samples preceding the pulse.
+	if(hasRawEnergySums && len_ > 0)
+		baseline = energySums[0]/len_;
+	else
+		baseline = 0;
+	stddev = 0;
+
+	qdc = 0;
+	for(size_t i = start_; i <= stop_ && i < numQdcs; i++){
+		qdc += qdcValue[i];
+		if(sumLengths_) qdc -= baseline*sumLengths_[i];
+	}
+	computed |= TRACE_QDC;
+
+	if(start2_ >= 0 && stop2_ >= start2_){
+		qdc2 = 0;
+		for(size_t i = start2_; i <= (size_t)stop2_ && i < numQdcs; i++){
+			qdc2 += qdcValue[i];
+			if(sumLengths_) qdc2 -= baseline*sumLengths_[i];
+		}
+		computed |= TRACE_QDC2;
+	}
+
+	return qdc;
+}
+
 void ChannelEvent::Clear(){
 	hiresTime = 0.0;
 
@@ -568,6 +672,8 @@ void ChannelEvent::Clear(){
 	ignore = false;
 
 	cfdvals = NULL;
+
+	computed = 0;
 }
 
 /** Responsible for decoding ChannelEvents from a binary input file.
@@ -0,0 +1,79 @@
+#include "CompactHist.hpp"
+
+#include "TH1.h"
+#include "TH2F.h"
+
+CompactHist2d::CompactHist2d(const std::string &name_, const std::string &title_, const std::string &xtitle_, const std::string &xunits_,
+                             const int &xbins_, const double &xmin_, const double &xmax_, const std::string &ytitle_, const std::string &yunits_,
+                             const int &ybins_, const double &ymin_, const double &ymax_) :
+                             xbins(xbins_), ybins(ybins_),
+                             xmin(xmin_), xmax(xmax_),
+                             ymin(ymin_), ymax(ymax_),
+                             entries(0),
+                             name(name_), title(title_),
+                             xtitle(xtitle_), ytitle(ytitle_),
+                             xunits(xunits_), yunits(yunits_),
+                             rows(ybins_+2), hist(NULL)
+{
+}
+
+CompactHist2d::~CompactHist2d(){
+	delete hist;
+}
+
+size_t CompactHist2d::GetMemoryUsage() const {
+	size_t retval = 0;
+	for(std::vector<std::vector<unsigned int> >::const_iterator iter = rows.begin(); iter != rows.end(); iter++)
+		retval += iter->size()*sizeof(unsigned int);
+	return retval;
+}
+
+bool CompactHist2d::Add(const TH1 *hist_){
+	if(!hist_ || hist_->GetDimension() != 2 || hist_->GetNbinsX() != xbins || hist_->GetNbinsY() != ybins)
+		return false;
+	for(int j = 0; j <= ybins+1; j++){
+		for(int i = 0; i <= xbins+1; i++){
+			double content = hist_->GetBinContent(i, j);
+			if(content <= 0) continue;
+			if(rows[j].empty()) rows[j].assign(xbins+2, 0);
+			rows[j][i] += (unsigned int)(content+0.5);
+		}
+	}
+	entries += hist_->GetEntries();
+	return true;
+}
+
+bool CompactHist2d::CopyTo(TH1 *hist_) const {
+	if(!hist_ || hist_->GetDimension() != 2 || hist_->GetNbinsX() != xbins || hist_->GetNbinsY() != ybins)
+		return false;
+	hist_->Reset();
+
+	// Only rows which have been filled need to be copied.
+	for(int j = 0; j <= ybins+1; j++){
+		if(rows[j].empty()) continue;
+		for(int i = 0; i <= xbins+1; i++){
+			if(rows[j][i] > 0) hist_->SetBinContent(i, j, rows[j][i]);
+		}
+	}
+	hist_->SetEntries(entries);
+	return true;
+}
+
+void CompactHist2d::Zero(){
+	for(std::vector<std::vector<unsigned int> >::iterator iter = rows.begin(); iter != rows.end(); iter++)
+		std::vector<unsigned int>().swap(*iter);
+	entries = 0;
+}
+
+TH1 *CompactHist2d::GetHist(){
+	if(!hist){
+		hist = (TH1*)(new TH2F(name.c_str(), title.c_str(), xbins, xmin, xmax, ybins, ymin, ymax));
+		hist->SetDirectory(0);
+		hist->GetXaxis()->SetTitle((xunits.empty() ? xtitle : xtitle+" ("+xunits+")").c_str());
+		hist->GetYaxis()->SetTitle((yunits.empty() ? ytitle : ytitle+" ("+yunits+")").c_str());
+		hist->SetStats(0);
+	}
+	CopyTo(hist);
+
+	return hist;
+}
@@ -42,6 +42,9 @@ GenericBarProcessor::GenericBarProcessor(MapFile *map_) : Processor("GenericBar"
 	
 	// Set the detector type to a bar.
 	isSingleEnded = false;
+
+	// Only the short integral of each end of the bar is used.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
 }
 
 void GenericBarProcessor::GetHists(OnlineProcessor *online_){
@@ -33,6 +33,39 @@ bool GenericProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *ch
 	return true;
 }
 
+bool GenericProcessor::HandleBatch(){
+	const size_t nHits = batch.GetNumHits();
+
+	// Calculate the time difference between each event and the start of its raw event. The phases
+	// are only used when the event has a trace, or when the start has a trace (see HandleEvent).
+	for(size_t i = 0; i < nHits; i++){
+		float phase = (batch.hasTrace[i] ? batch.phase[i] : 0);
+		float startPhase = (batch.hasTrace[i] || batch.startHasTrace[i] ? batch.startPhase[i] : 0);
+		batch.tof[i] = (batch.time[i] - batch.startTime[i])*sysClock + (phase - startPhase)*adcClock;
+	}
+
+	if(histsEnabled){ // Fill all diagnostic histograms.
+		for(size_t i = 0; i < nHits; i++){
+			if(!batch.accepted[i]) continue;
+			tof_1d->Fill(batch.location[i], batch.tof[i]);
+			tqdc_1d->Fill(batch.location[i], batch.qdc[i]);
+			long_tof_2d->Fill2d(batch.location[i], batch.tof[i], batch.qdc[i]);
+			maxADC_tof_2d->Fill2d(batch.location[i], batch.tof[i], batch.maxADC[i]);
+			loc_1d->Fill(batch.location[i]);
+		}
+	}
+
+	return true;
+}
+
+bool GenericProcessor::FillBatchEvent(const size_t &event_){
+	// Fill the values into the root tree.
+	for(size_t i = batch.GetFirst(event_); i < batch.GetLast(event_); i++){
+		if(batch.accepted[i]) structure.Append(batch.tof[i], batch.qdc[i], batch.location[i]);
+	}
+	return true;
+}
+
 GenericProcessor::GenericProcessor(MapFile *map_) : Processor("Generic", "generic", map_){
 	root_structure = (Structure*)&structure;
 	root_waveform = &waveform;
@@ -40,6 +73,10 @@ GenericProcessor::GenericProcessor(MapFile *map_) : Processor("Generic", "generi
 	// Do not force the use of a trace. By setting this flag to false,
 	// this processor WILL NOT reject events which do not have an ADC trace.
 	use_trace = false;
+
+	// Generic detectors only use a single integration window.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
+	use_batch = true;
 }
 
 void GenericProcessor::GetHists(OnlineProcessor *online_){
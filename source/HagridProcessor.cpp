@@ -25,12 +25,45 @@ bool HagridProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chE
 	return true;
 }
 
+bool HagridProcessor::HandleBatch(){
+	const size_t nHits = batch.GetNumHits();
+
+	// Calculate the time difference between each event and the start of its raw event.
+	for(size_t i = 0; i < nHits; i++)
+		batch.tof[i] = (batch.time[i] - batch.startTime[i])*sysClock + (batch.phase[i] - batch.startPhase[i])*adcClock;
+
+	if(histsEnabled){ // Fill all diagnostic histograms.
+		for(size_t i = 0; i < nHits; i++){
+			if(!batch.accepted[i]) continue;
+			tof_1d->Fill(batch.location[i], batch.tof[i]);
+			tqdc_1d->Fill(batch.location[i], batch.qdc[i]);
+			filter_1d->Fill(batch.location[i], batch.energy[i]);
+			maxADC_1d->Fill(batch.location[i], batch.maxADC[i]);
+			loc_1d->Fill(batch.location[i]);
+		}
+	}
+
+	return true;
+}
+
+bool HagridProcessor::FillBatchEvent(const size_t &event_){
+	// Fill the values into the root tree.
+	for(size_t i = batch.GetFirst(event_); i < batch.GetLast(event_); i++){
+		if(batch.accepted[i]) structure.Append(batch.tof[i], batch.qdc[i], batch.energy[i], batch.maxADC[i], batch.location[i]);
+	}
+	return true;
+}
+
 HagridProcessor::HagridProcessor(MapFile *map_) : Processor("Hagrid", "hagrid", map_){
 	root_structure = (Structure*)&structure;
 	root_waveform = &waveform;
 
 	fitting_low = 8;
 	fitting_high = 21;
+
+	// The second integral is not used.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
+	use_batch = true;
 }
 
 void HagridProcessor::GetHists(OnlineProcessor *online_){
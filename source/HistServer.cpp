@@ -0,0 +1,334 @@
+#include <iostream>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Plotter.hpp"
+#include "HistServer.hpp"
+
+#include "TH1.h"
+#include "TAxis.h"
+#include "TArrayF.h"
+
+#define HIST_SERVER_POLL_TIMEOUT 50 // Time to wait for socket activity in the sender thread (in ms).
+
+// Return true if a string contains only decimal digits.
+static bool isPortNumber(const std::string &str_){
+	if(str_.empty()) return false;
+	for(std::string::const_iterator iter = str_.begin(); iter != str_.end(); iter++){
+		if(*iter < '0' || *iter > '9') return false;
+	}
+	return true;
+}
+
+// Build the definition of a ROOT histogram.
+static HistInfo getHistInfo(TH1 *hist_, const std::string &opt_, const int &location_){
+	HistInfo info;
+	info.name = hist_->GetName();
+	info.title = hist_->GetTitle();
+	info.xtitle = hist_->GetXaxis()->GetTitle();
+	info.ytitle = hist_->GetYaxis()->GetTitle();
+	info.opt = opt_;
+	info.location = location_;
+	info.dim = (hist_->GetDimension() >= 2 ? 2 : 1);
+	info.xbins = hist_->GetXaxis()->GetNbins();
+	info.xmin = hist_->GetXaxis()->GetXmin();
+	info.xmax = hist_->GetXaxis()->GetXmax();
+	if(info.dim == 2){
+		info.ybins = hist_->GetYaxis()->GetNbins();
+		info.ymin = hist_->GetYaxis()->GetXmin();
+		info.ymax = hist_->GetYaxis()->GetXmax();
+	}
+	return info;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class HistServer
+///////////////////////////////////////////////////////////////////////////////
+
+HistServer::HistServer() : hists(), curr(), prev(), havePrev(false), address(), listenfd(-1), localSocket(false),
+                           minInterval(500), maxQueued(8), lastPublish(), clients(), running(false), numClients(0),
+                           numKeyframes(0), numDeltas(0), numDropped(0), bytesSent(0) {
+}
+
+HistServer::~HistServer(){
+	Close();
+}
+
+bool HistServer::AddHist(Plotter *plot_){
+	if(!plot_ || running) return false;
+
+	// Add the main histogram.
+	TH1 *hist = plot_->GetHist();
+	hists.push_back(hist);
+	curr.Add(getHistInfo(hist, plot_->GetDrawOption(), -1));
+
+	// Add all per-detector sub-histograms.
+	int location;
+	for(size_t i = 0; i < plot_->GetNumHists(); i++){
+		hist = plot_->GetSubHist(i, location);
+		if(!hist) continue;
+		hists.push_back(hist);
+		curr.Add(getHistInfo(hist, (plot_->GetNdim() == 1 ? "" : plot_->GetDrawOption()), location));
+	}
+
+	return true;
+}
+
+bool HistServer::Open(const std::string &address_){
+	if(running) return false;
+
+	address = address_;
+	localSocket = !isPortNumber(address);
+
+	if(localSocket){ // Local (unix domain) socket.
+		struct sockaddr_un serv;
+		if(address.length() >= sizeof(serv.sun_path)) return false;
+
+		listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listenfd < 0) return false;
+
+		memset(&serv, 0, sizeof(serv));
+		serv.sun_family = AF_UNIX;
+		strcpy(serv.sun_path, address.c_str());
+
+		// Remove a stale socket left behind by a previous scan.
+		unlink(address.c_str());
+
+		if(bind(listenfd, (struct sockaddr *)&serv, sizeof(serv)) < 0){
+			close(listenfd);
+			listenfd = -1;
+			return false;
+		}
+	}
+	else{ // TCP socket.
+		listenfd = socket(AF_INET, SOCK_STREAM, 0);
+		if(listenfd < 0) return false;
+
+		int reuse = 1;
+		setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		struct sockaddr_in serv;
+		memset(&serv, 0, sizeof(serv));
+		serv.sin_family = AF_INET;
+		serv.sin_addr.s_addr = INADDR_ANY;
+		serv.sin_port = htons(strtol(address.c_str(), NULL, 10));
+
+		if(bind(listenfd, (struct sockaddr *)&serv, sizeof(serv)) < 0){
+			close(listenfd);
+			listenfd = -1;
+			return false;
+		}
+	}
+
+	if(listen(listenfd, 8) < 0){
+		Close();
+		return false;
+	}
+	fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+
+	prev = curr;
+	havePrev = false;
+
+	running = true;
+	worker = std::thread(&HistServer::Serve, this);
+
+	return true;
+}
+
+void HistServer::Close(){
+	if(running){
+		running = false;
+		worker.join();
+	}
+
+	for(std::vector<HistClient>::iterator iter = clients.begin(); iter != clients.end(); iter++){
+		close(iter->fd);
+	}
+	clients.clear();
+	numClients = 0;
+
+	if(listenfd >= 0){
+		close(listenfd);
+		listenfd = -1;
+		if(localSocket) unlink(address.c_str());
+	}
+}
+
+bool HistServer::Publish(const bool &force_/*=false*/){
+	if(!running || hists.empty()) return false;
+
+	// Nobody is listening. The next viewer will receive a keyframe.
+	if(numClients == 0){
+		havePrev = false;
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(!force_ && havePrev && std::chrono::duration_cast<std::chrono::milliseconds>(now - lastPublish).count() < minInterval)
+		return false;
+	lastPublish = now;
+
+	Snapshot();
+	curr.sequence = prev.sequence + 1;
+
+	// Check which types of frame are required.
+	bool needKeyframe = false;
+	bool needDelta = false;
+	{
+		std::lock_guard<std::mutex> lock(client_mutex);
+		for(std::vector<HistClient>::iterator iter = clients.begin(); iter != clients.end(); iter++){
+			if(iter->needKeyframe || !havePrev) needKeyframe = true;
+			else needDelta = true;
+		}
+	}
+
+	// Encode the frames without holding the lock.
+	std::shared_ptr<std::string> keyframe, delta;
+	if(needKeyframe){
+		keyframe.reset(new std::string());
+		curr.EncodeKeyframe(*keyframe);
+		numKeyframes++;
+	}
+	if(needDelta){
+		delta.reset(new std::string());
+		if(curr.EncodeDelta(prev, *delta) > 0) numDeltas++;
+		else delta.reset(); // Nothing has changed.
+	}
+
+	// Queue the frames for each viewer.
+	{
+		std::lock_guard<std::mutex> lock(client_mutex);
+		for(std::vector<HistClient>::iterator iter = clients.begin(); iter != clients.end(); iter++){
+			if(iter->needKeyframe || !havePrev){
+				if(!keyframe) continue; // Connected after the frames were encoded.
+
+				// A keyframe replaces any pending delta frames.
+				while(iter->queue.size() > (iter->offset > 0 ? 1 : 0)) iter->queue.pop_back();
+				iter->queue.push_back(keyframe);
+				iter->needKeyframe = false;
+			}
+			else if(delta){
+				if(iter->queue.size() >= maxQueued){ // The viewer is too slow. Re-synchronize it with a keyframe.
+					while(iter->queue.size() > (iter->offset > 0 ? 1 : 0)) iter->queue.pop_back();
+					iter->needKeyframe = true;
+					numDropped++;
+					continue;
+				}
+				iter->queue.push_back(delta);
+			}
+		}
+	}
+
+	curr.contents.swap(prev.contents);
+	curr.entries.swap(prev.entries);
+	prev.sequence = curr.sequence;
+	havePrev = true;
+
+	return true;
+}
+
+void HistServer::Print(const std::string &prefix_/*=""*/){
+	std::cout << prefix_ << "Histogram server sent " << numKeyframes << " keyframes and " << numDeltas << " delta frames (";
+	std::cout << bytesSent/1E6 << " MB) to " << numClients << " connected viewers.\n";
+	if(numDropped > 0)
+		std::cout << prefix_ << " Re-synchronized slow viewers " << numDropped << " times.\n";
+}
+
+void HistServer::Snapshot(){
+	for(size_t i = 0; i < hists.size(); i++){
+		std::vector<double> &contents = curr.contents[i];
+
+		// Copy the bin array directly when possible.
+		TArrayF *array = dynamic_cast<TArrayF*>(hists[i]);
+		if(array && (size_t)array->GetSize() == contents.size()){
+			const float *data = array->GetArray();
+			for(size_t j = 0; j < contents.size(); j++)
+				contents[j] = data[j];
+		}
+		else{
+			for(size_t j = 0; j < contents.size(); j++)
+				contents[j] = hists[i]->GetBinContent(j);
+		}
+
+		curr.entries[i] = hists[i]->GetEntries();
+	}
+}
+
+void HistServer::Serve(){
+	std::vector<struct pollfd> fds;
+	char dummy[256];
+
+	while(running){
+		// Build the list of sockets to watch.
+		fds.clear();
+		struct pollfd pfd;
+		pfd.fd = listenfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		fds.push_back(pfd);
+		{
+			std::lock_guard<std::mutex> lock(client_mutex);
+			for(std::vector<HistClient>::iterator iter = clients.begin(); iter != clients.end(); iter++){
+				pfd.fd = iter->fd;
+				pfd.events = POLLIN | (iter->queue.empty() ? 0 : POLLOUT);
+				fds.push_back(pfd);
+			}
+		}
+
+		if(poll(fds.data(), fds.size(), HIST_SERVER_POLL_TIMEOUT) <= 0) continue;
+
+		std::lock_guard<std::mutex> lock(client_mutex);
+
+		// Only this thread adds or removes viewers, so the indices of the viewers have not changed.
+		for(size_t i = fds.size()-1; i >= 1; i--){
+			HistClient &client = clients[i-1];
+			bool drop = (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+
+			// Viewers do not send anything, so a readable socket means that the viewer disconnected.
+			if(!drop && (fds[i].revents & POLLIN)){
+				ssize_t nBytes = recv(client.fd, dummy, sizeof(dummy), MSG_DONTWAIT);
+				if(nBytes == 0 || (nBytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) drop = true;
+			}
+
+			// Send as much of the queued data as possible.
+			while(!drop && (fds[i].revents & POLLOUT) && !client.queue.empty()){
+				const std::string &frame = *client.queue.front();
+				ssize_t nBytes = send(client.fd, frame.data()+client.offset, frame.length()-client.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if(nBytes < 0){
+					if(errno != EAGAIN && errno != EWOULDBLOCK) drop = true;
+					break;
+				}
+				bytesSent += nBytes;
+				client.offset += nBytes;
+				if(client.offset < frame.length()) break;
+				client.queue.pop_front();
+				client.offset = 0;
+			}
+
+			if(drop){
+				close(client.fd);
+				clients.erase(clients.begin()+(i-1));
+			}
+		}
+
+		// Accept new viewers.
+		if(fds[0].revents & POLLIN){
+			int fd;
+			while((fd = accept(listenfd, NULL, NULL)) >= 0){
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+				clients.push_back(HistClient(fd));
+			}
+		}
+
+		numClients = clients.size();
+	}
+}
@@ -9,12 +9,29 @@ bool LogicProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEv
 	return true;
 }
 
+/// Nothing to compute, only the trigger times are recorded.
+bool LogicProcessor::HandleBatch(){
+	return true;
+}
+
+bool LogicProcessor::FillBatchEvent(const size_t &event_){
+	// Fill the values into the root tree.
+	for(size_t i = batch.GetFirst(event_); i < batch.GetLast(event_); i++){
+		if(batch.accepted[i]) structure.Append(batch.time[i], batch.location[i]);
+	}
+	return true;
+}
+
 LogicProcessor::LogicProcessor(MapFile *map_) : Processor("Logic", "logic", map_){
 	root_structure = (Structure*)&structure;
 
 	// Do not force the use of a trace. By setting this flag to false,
 	// this processor WILL NOT reject events which do not have an ADC trace.
 	use_trace = false;
+
+	// Only the trigger time is used, no trace analysis is required.
+	traceQuantities = 0;
+	use_batch = true;
 }
 
 LogicProcessor::~LogicProcessor(){
@@ -205,7 +205,7 @@ void MapEntryValidator::PrintFailure(const int &failcode) const {
 ///////////////////////////////////////////////////////////////////////////////
 
 void MapFile::clearEntries(){
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			detectors[i][j].clear();
 		}
@@ -256,38 +256,46 @@ MapFile::MapFile(const char *filename_){
 	Load(filename_); 
 }
 
+int MapFile::GetModuleIndex(const int &mod_) const {
+	if(mod_ < 0 || mod_/100 >= max_crates || mod_%100 >= max_modules){ return -1; }
+	return (mod_/100)*max_modules + mod_%100;
+}
+
 MapEntry *MapFile::GetMapEntry(int mod_, int chan_){
-	if(mod_ >= max_modules || chan_ >= max_channels){ return NULL; }
-	return &detectors[mod_][chan_];
+	int index = GetModuleIndex(mod_);
+	if(index < 0 || chan_ < 0 || chan_ >= max_channels){ return NULL; }
+	return &detectors[index][chan_];
 }
 
 MapEntry *MapFile::GetMapEntry(XiaData *event_){
-	if(event_->modNum >= max_modules || event_->chanNum >= max_channels){ return NULL; }
-	return &detectors[event_->modNum][event_->chanNum];
+	return GetMapEntry(event_->modNum, event_->chanNum);
 }
 
 std::string MapFile::GetType(int mod_, int chan_) const {
-	if(mod_ >= max_modules || chan_ >= max_channels){ return ""; }
-	return detectors[mod_][chan_].type;
+	int index = GetModuleIndex(mod_);
+	if(index < 0 || chan_ < 0 || chan_ >= max_channels){ return ""; }
+	return detectors[index][chan_].type;
 }
 
 std::string MapFile::GetSubtype(int mod_, int chan_) const {
-	if(mod_ >= max_modules || chan_ >= max_channels){ return ""; }
-	return detectors[mod_][chan_].subtype;
+	int index = GetModuleIndex(mod_);
+	if(index < 0 || chan_ < 0 || chan_ >= max_channels){ return ""; }
+	return detectors[index][chan_].subtype;
 }
 
 std::string MapFile::GetTag(int mod_, int chan_) const {
-	if(mod_ >= max_modules || chan_ >= max_channels){ return ""; }
-	return detectors[mod_][chan_].tag;
+	int index = GetModuleIndex(mod_);
+	if(index < 0 || chan_ < 0 || chan_ >= max_channels){ return ""; }
+	return detectors[index][chan_].tag;
 }
 
 void MapFile::GetModChan(const int &location, int &mod, int &chan) const {
-	mod = location / max_channels;
+	mod = getModuleNumber(location / max_channels);
 	chan = location % max_channels;
 }
 
 void MapFile::GetListOfLocations(std::vector<int> &list, const MapEntryValidator &valid) const {
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			if(detectors[i][j].type == "ignore")
 				continue;
@@ -298,7 +306,7 @@ void MapFile::GetListOfLocations(std::vector<int> &list, const MapEntryValidator
 }
 
 int MapFile::GetFirstOccurance(const std::string &type_) const {
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			if(detectors[i][j].type == type_){ return (int)detectors[i][j].location; }
 		}
@@ -307,7 +315,7 @@ int MapFile::GetFirstOccurance(const std::string &type_) const {
 }
 
 int MapFile::GetLastOccurance(const std::string &type_) const {
-	for(int i = max_modules-1; i >= 0; i--){
+	for(int i = max_indices-1; i >= 0; i--){
 		for(int j = max_channels-1; j >= 0; j--){
 			if(detectors[i][j].type == type_){ return (int)detectors[i][j].location; }
 		}
@@ -317,7 +325,7 @@ int MapFile::GetLastOccurance(const std::string &type_) const {
 
 int MapFile::GetAllOccurances(const std::string &type_, std::vector<int> &locations, const bool &isSingleEnded/*=true*/) const {
 	int retval = 0;
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			if(!isSingleEnded && j % 2 != 0) continue; // Handle bar-type detectors
 			if(detectors[i][j].type == type_){
@@ -330,9 +338,12 @@ int MapFile::GetAllOccurances(const std::string &type_, std::vector<int> &locati
 }
 
 bool MapFile::GetFirstStart(int &mod, int &chan) const {
-	for(mod = 0; mod < max_modules; mod++){
+	for(int i = 0; i < max_indices; i++){
 		for(chan = 0; chan < max_channels; chan++){
-			if(detectors[mod][chan].hasTag("start")) return true;
+			if(detectors[i][chan].hasTag("start")){
+				mod = getModuleNumber(i);
+				return true;
+			}
 		}
 	}
 	return false;
@@ -350,7 +361,7 @@ bool MapFile::Load(const char *filename_){
 	init = true;
 
 	// Set the location of all possible detectors.
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			detectors[i][j].location = i*max_channels + j;
 		}
@@ -407,7 +418,8 @@ bool MapFile::Load(const char *filename_){
 
 		int mod, chan;
 		mod = (unsigned)atoi(values.at(0).c_str());
-		if(mod >= max_modules){
+		int index = GetModuleIndex(mod);
+		if(index < 0){
 			warnStr << "MapFile: WARNING! On line " << line_num << ", invalid module number (" << mod << "). Ignoring.\n";
 			continue;
 		}
@@ -458,20 +470,20 @@ bool MapFile::Load(const char *filename_){
 					break;
 				}
 				lowercaseString(values.at(2)); // Convert the string to lowercase
-				detectors[mod][*iter].set(values.at(2));
+				detectors[index][*iter].set(values.at(2));
 				for(size_t arg_index = 3; arg_index < values.size(); arg_index++){
-					detectors[mod][*iter].pushArg(strtod(values.at(arg_index).c_str(), NULL));
+					detectors[index][*iter].pushArg(strtod(values.at(arg_index).c_str(), NULL));
 				}
 				
 				bool in_list = false;
 				for(std::vector<std::string>::iterator iter2 = types.begin(); iter2 != types.end(); iter2++){
-					if(*iter2 == detectors[mod][*iter].type){
+					if(*iter2 == detectors[index][*iter].type){
 						in_list = true;
 						break;
 					}
 				}
 				if(!in_list){ 
-					types.push_back(detectors[mod][*iter].type); 
+					types.push_back(detectors[index][*iter].type); 
 				}
 			}
 		}
@@ -482,20 +494,20 @@ bool MapFile::Load(const char *filename_){
 				continue;
 			}
 			lowercaseString(values.at(2)); // Convert the string to lowercase
-			detectors[mod][chan].set(values.at(2));
+			detectors[index][chan].set(values.at(2));
 			for(size_t arg_index = 3; arg_index < values.size(); arg_index++){
-				detectors[mod][chan].pushArg(strtod(values.at(arg_index).c_str(), NULL));
+				detectors[index][chan].pushArg(strtod(values.at(arg_index).c_str(), NULL));
 			}
 			
 			bool in_list = false;
 			for(std::vector<std::string>::iterator iter = types.begin(); iter != types.end(); iter++){
-				if(*iter == detectors[mod][chan].type){
+				if(*iter == detectors[index][chan].type){
 					in_list = true;
 					break;
 				}
 			}
 			if(!in_list){ 
-				types.push_back(detectors[mod][chan].type); 
+				types.push_back(detectors[index][chan].type); 
 			}
 		}
 	}
@@ -504,7 +516,7 @@ bool MapFile::Load(const char *filename_){
 	
 	// Check for at least one start detector.
 	bool validStart = false;
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			if(detectors[i][j].hasTag("start")){
 				validStart = true;
@@ -521,10 +533,10 @@ bool MapFile::Load(const char *filename_){
 
 void MapFile::PrintAllEntries() const {
 	std::cout << "MapFile: List of defined detectors...\n";
-	for(int i = 0; i < max_modules; i++){
+	for(int i = 0; i < max_indices; i++){
 		for(int j = 0; j < max_channels; j++){
 			if(detectors[i][j].type == "ignore"){ continue; }
-			std::cout << " " << i << ", " << j << ", " << detectors[i][j].location << " " << detectors[i][j].print() << std::endl;
+			std::cout << " " << getModuleNumber(i) << ", " << j << ", " << detectors[i][j].location << " " << detectors[i][j].print() << std::endl;
 		}
 	}
 }
@@ -541,7 +553,7 @@ bool MapFile::Write(TFile *f_) const {
 		return false;
 		
 	// Add all map entries to the output root file.
-	const int num_mod = GetMaxModules();
+	const int num_mod = max_indices;
 	const int num_chan = GetMaxChannels();
 	const MapEntry *entryptr;
 
@@ -549,8 +561,9 @@ bool MapFile::Write(TFile *f_) const {
 	std::string *chan_names = new std::string[num_chan];
 	for(int i = 0; i < num_mod; i++){
 		std::stringstream stream;
-		if(i < 10){ stream << "0" << i; }
-		else{ stream << i; }
+		int mod = getModuleNumber(i);
+		if(mod < 10){ stream << "0" << mod; }
+		else{ stream << mod; }
 		dir_names[i] = "map/mod" + stream.str();
 	}
 	for(int i = 0; i < num_chan; i++){
@@ -572,7 +585,7 @@ bool MapFile::Write(TFile *f_) const {
 				first_good_channel = false;		
 			}
 			std::stringstream stream;
-			stream << i << " " << j << " " << entryptr->print();
+			stream << getModuleNumber(i) << " " << j << " " << entryptr->print();
 			TObjString str(stream.str().c_str());
 			str.Write();
 		}
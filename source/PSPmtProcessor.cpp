@@ -132,6 +132,9 @@ PSPmtProcessor::PSPmtProcessor(MapFile *map_) : Processor("PSPmt", "pspmt", map_
 	// Do not force the use of a trace. By setting this flag to false,
 	// this processor WILL NOT reject events which do not have an ADC trace.
 	use_trace = false;
+
+	// The second integral is computed by HandleEvent using its own integration window.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
 }
 
 void PSPmtProcessor::GetHists(OnlineProcessor *online_){
@@ -55,6 +55,17 @@ bool PhoswichProcessor::SetCfdParameters(ChanEvent *event_, MapEntry *entry_){
 	return true;
 }
 
+/// Set the fast and slow QDCs from the onboard QDC sums.
+bool PhoswichProcessor::SetOnboardParameters(ChanEvent *event_, MapEntry *entry_){
+	if(!event_ || !entry_){ return false; }
+
+	// The short and long QDC sums are used for the fast and slow components respectively.
+	fast_qdc = event_->qdc;
+	slow_qdc = event_->qdc2;
+
+	return true;
+}
+
 /// Process all individual events.
 bool PhoswichProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEvtR/*=NULL*/){
 	ChanEvent *current_event = chEvt->channelEvent;
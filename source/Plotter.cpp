@@ -71,6 +71,12 @@ TH1 *Plotter::GetHist(const int &location){
 	return NULL;
 }
 
+TH1 *Plotter::GetSubHist(const size_t &index, int &location){
+	if(index >= hists1d.size()) return NULL;
+	location = hists1d.at(index).second;
+	return hists1d.at(index).first;
+}
+
 void Plotter::GetXrange(double &xmin_, double &xmax_){
 	xmin_ = xmin;
 	xmax_ = xmax;
@@ -1,11 +1,14 @@
 #include <iostream>
+#include <sstream>
 #include <cmath>
+#include <stdio.h>
 #include <time.h>
 #include <algorithm>
 
 #include "Processor.hpp"
 #include "Structures.hpp"
 #include "MapFile.hpp"
+#include "ScanCheckpoint.hpp"
 
 #include "TTree.h"
 #include "TGraph.h"
@@ -16,6 +19,48 @@ Trace dummyTrace;
 const double pi = 3.1415926540;
 const double twoPi = 6.283185308;
 
+OnboardSettings::OnboardSettings() : start(0), stop(7), start2(-1), stop2(-1), baselineLength(0), useLengths(false) {
+	for(size_t i = 0; i < 8; i++) sumLengths[i] = 0;
+}
+
+bool OnboardSettings::Parse(const std::string &tags_){
+	bool retval = true;
+	std::stringstream stream(tags_);
+	std::string tag;
+	while(std::getline(stream, tag, ',')){
+		size_t index = tag.find('=');
+		if(index == std::string::npos) continue; // Not a key=value tag (e.g. "start").
+		std::string key = tag.substr(0, index);
+		std::string value = tag.substr(index+1);
+		if(key == "short" || key == "long"){
+			int low, high;
+			if(sscanf(value.c_str(), "%d-%d", &low, &high) != 2 || low < 0 || high < low || high > 7){
+				retval = false;
+				continue;
+			}
+			if(key == "short"){ start = low; stop = high; }
+			else{ start2 = low; stop2 = high; }
+		}
+		else if(key == "blen"){
+			baselineLength = strtod(value.c_str(), NULL);
+		}
+		else if(key == "qlen"){ // Either a single length for all sums or a '/' delimited list.
+			std::stringstream lengths(value);
+			std::string length;
+			size_t count = 0;
+			while(std::getline(lengths, length, '/') && count < 8)
+				sumLengths[count++] = strtod(length.c_str(), NULL);
+			if(count == 1){
+				for(size_t i = 1; i < 8; i++) sumLengths[i] = sumLengths[0];
+			}
+			else if(count != 8){ retval = false; }
+			useLengths = (count == 1 || count == 8);
+		}
+		else{ retval = false; }
+	}
+	return retval;
+}
+
 ChannelEventPair::ChannelEventPair(){
 	channelEvent = NULL;
 	entry = NULL;
@@ -30,6 +75,60 @@ ChannelEventPair::~ChannelEventPair(){
 	if(channelEvent){ delete channelEvent; } // Deleting the ChanEvent will also delete the underlying XiaData.
 }
 
+void HitBatch::AddEvent(const std::deque<ChannelEventPair*> &events_, ChannelEventPair *start_){
+	hits.insert(hits.end(), events_.begin(), events_.end());
+	eventStart.push_back(hits.size());
+	starts.push_back(start_);
+}
+
+void HitBatch::Fill(){
+	const size_t nHits = hits.size();
+	
+	location.resize(nHits);
+	time.resize(nHits);
+	phase.resize(nHits);
+	qdc.resize(nHits);
+	qdc2.resize(nHits);
+	maximum.resize(nHits);
+	energy.resize(nHits);
+	maxADC.resize(nHits);
+	hasTrace.resize(nHits);
+	valid.resize(nHits);
+	startTime.resize(nHits);
+	startPhase.resize(nHits);
+	startHasTrace.resize(nHits);
+	
+	tof.assign(nHits, 0);
+	accepted.resize(nHits);
+
+	for(size_t event = 0; event < starts.size(); event++){
+		ChanEvent *startEvent = starts[event]->channelEvent;
+		for(size_t i = eventStart[event]; i < eventStart[event+1]; i++){
+			ChanEvent *current_event = hits[i]->channelEvent;
+			location[i] = hits[i]->entry->location;
+			time[i] = current_event->time;
+			phase[i] = current_event->phase;
+			qdc[i] = current_event->qdc;
+			qdc2[i] = current_event->qdc2;
+			maximum[i] = current_event->maximum;
+			energy[i] = current_event->energy;
+			maxADC[i] = current_event->max_ADC;
+			hasTrace[i] = (current_event->traceLength != 0);
+			valid[i] = current_event->valid_chan;
+			accepted[i] = valid[i];
+			startTime[i] = startEvent->time;
+			startPhase[i] = startEvent->phase;
+			startHasTrace[i] = (startEvent->traceLength != 0);
+		}
+	}
+}
+
+void HitBatch::Clear(){
+	hits.clear();
+	eventStart.assign(1, 0);
+	starts.clear();
+}
+
 // Return a random number between low and high.
 double Processor::drand(const double &low_, const double &high_){
 	return low_+(double(rand())/RAND_MAX)*(high_-low_);
@@ -223,6 +322,32 @@ bool Processor::CfdPulse(ChanEvent *event_, MapEntry *entry_){
 	return (event_->phase > 0);
 }
 
+/// Compute the phase, baseline, and QDCs from onboard quantities (no trace is required).
+bool Processor::OnboardPulse(ChanEvent *event_, MapEntry *entry_, const unsigned short &quantities_/*=TRACE_ALL*/){
+	if(!event_ || !entry_){ return false; }
+
+	// Parse the channel settings once and store them for later use.
+	std::map<MapEntry*, OnboardSettings>::iterator settings = onboardSettings.find(entry_);
+	if(settings == onboardSettings.end()){
+		settings = onboardSettings.insert(std::make_pair(entry_, OnboardSettings())).first;
+		if(!settings->second.Parse(entry_->tag))
+			PrintMsg("Failed to parse onboard settings \""+entry_->tag+"\"!");
+	}
+
+	OnboardSettings *ptr = &settings->second;
+	if((quantities_ & (TRACE_BASELINE | TRACE_QDC | TRACE_QDC2)) &&
+	   event_->ComputeOnboard(ptr->start, ptr->stop, ptr->start2, ptr->stop2, ptr->baselineLength, (ptr->useLengths ? ptr->sumLengths : NULL)) == -9999){
+		preprocess_noOnboard++;
+		return false;
+	}
+
+	// A forced trigger has no CFD time, so the event is kept at the time of the trigger.
+	if((quantities_ & TRACE_PHASE) && event_->AnalyzeOnboardCFD(adcClockInSeconds) == -9999)
+		event_->phase = 0;
+
+	return SetOnboardParameters(event_, entry_);
+}
+
 Processor::Processor(std::string name_, std::string type_, MapFile *map_){
 	name = name_;
 	type = type_;
@@ -230,6 +355,8 @@ Processor::Processor(std::string name_, std::string type_, MapFile *map_){
 	write_waveform = false;
 	use_color_terminal = true;
 	use_trace = true;
+	use_batch = false;
+	traceQuantities = TRACE_ALL;
 	isSingleEnded = true;
 	histsEnabled = false;
 
@@ -246,6 +373,7 @@ Processor::Processor(std::string name_, std::string type_, MapFile *map_){
 	preprocess_badBaseline = 0;
 	preprocess_badFit = 0;
 	preprocess_badCfd = 0;
+	preprocess_noOnboard = 0;
 	
 	root_structure = &dummyStructure;
 	root_waveform = &dummyTrace;
@@ -280,10 +408,13 @@ Processor::~Processor(){
 }
 
 bool Processor::Initialize(TTree *tree_){
-	if(init || !tree_){ 
+	if(init){ 
 		PrintMsg("Root output is already initialized!");
 		return false; 
 	}
+
+	// Without an output tree, the processor only fills its online histograms.
+	if(!tree_) return (init = true);
 	
 	// Add a branch to the tree
 	PrintMsg("Adding branch to main TTree.");
@@ -333,6 +464,7 @@ float Processor::Status(unsigned long global_events_){
 		if(preprocess_badBaseline > 0) std::cout << "   [b] Bad Baseline:  " << preprocess_badBaseline << std::endl;
 		if(preprocess_badFit > 0)      std::cout << "   [c] Fit Failure:   " << preprocess_badFit << std::endl;
 		if(preprocess_badCfd > 0)      std::cout << "   [d] CFD Failure:   " << preprocess_badCfd << std::endl;
+		if(preprocess_noOnboard > 0)   std::cout << "   [e] No QDC Sums:   " << preprocess_noOnboard << std::endl;
 	}
 	if(handle_unpairedEvent > 0)                 std::cout << "  [2] Unpaired Event: " << handle_unpairedEvent << std::endl;
 	if(handle_notValid+handle_unpairedEvent > 0) std::cout << "  [3] Total Invalid:  " << handle_notValid+handle_unpairedEvent << std::endl;
@@ -340,71 +472,95 @@ float Processor::Status(unsigned long global_events_){
 	return time_taken;
 }
 
-void Processor::PreProcess(){
-	if(events.empty()) return;
-
-	// Start the timer.
-	StartProcess(); 
+/// Compute the trace quantities of a single event.
+void Processor::PreProcessEvent(ChannelEventPair *pair_){
+	ChanEvent *current_event = pair_->channelEvent;
 	
-	ChanEvent *current_event;
-
-	total_events += events.size();
-
-	// Iterate over the list of channel events.
-	for(std::deque<ChannelEventPair*>::iterator iter = events.begin(); iter != events.end(); iter++){
-		current_event = (*iter)->channelEvent;
-		
-		// Set the default values for high resolution energy and time.
-		current_event->hiresTime = current_event->time * sysClockInSeconds;
+	// The phase of a start event is used by every other processor.
+	unsigned short quantities = traceQuantities;
+	if(!(quantities & TRACE_PHASE) && pair_->entry->hasTag("start"))
+		quantities |= TRACE_PHASE;
 	
-		// Check for trace with zero size.
-		if(current_event->traceLength == 0){
-			if(use_trace){
-				// The trace is required by this processor, but does not exist.
-				preprocess_emptyTrace++;
-				continue; 
-			}				
-			// The trace is not required by the processor. Set the channel event to valid.
-			current_event->valid_chan = true;
+	// Set the default values for high resolution energy and time.
+	current_event->hiresTime = current_event->time * sysClockInSeconds;
+
+	// Use the onboard CFD and QDC sums instead of the trace, if any trace quantities are used.
+	if(analyzer == ONBOARD && quantities != 0){
+		if(!OnboardPulse(current_event, pair_->entry, quantities)){
+			current_event->valid_chan = false;
+			return;
 		}
-		else{ // The trace exists.
-			// Calculate the baseline.
-			if(current_event->ComputeBaseline() < 0){
-				preprocess_badBaseline++;
-				continue; 
-			}
-	
-			// Check for large SNR.
-			//if(current_event->stddev > 3.0){ continue; }
+		current_event->valid_chan = true;
+		current_event->hiresTime += current_event->phase * adcClockInSeconds;
+		return;
+	}
+
+	// Check for trace with zero size.
+	if(current_event->traceLength == 0){
+		if(use_trace){
+			// The trace is required by this processor, but does not exist.
+			preprocess_emptyTrace++;
+			return; 
+		}				
+		// The trace is not required by the processor. Set the channel event to valid.
+		current_event->valid_chan = true;
+	}
+	else if(quantities == 0){ // None of the trace quantities are used by this processor.
+		current_event->valid_chan = true;
+	}
+	else{ // The trace exists.
+		// Calculate the baseline.
+		if(current_event->ComputeBaseline() < 0){
+			preprocess_badBaseline++;
+			return; 
+		}
+
+		// Check for large SNR.
+		//if(current_event->stddev > 3.0){ return; }
 
-			// Compute the integral of the pulse within the integration window.
+		// Compute the integral of the pulse within the integration window.
+		if(quantities & TRACE_QDC)
 			current_event->IntegratePulse(current_event->max_index - fitting_low, current_event->max_index + fitting_high);
-			if(fitting_low2 != -9999 && fitting_high2 != -9999) 
-				current_event->IntegratePulse2(current_event->max_index - fitting_low2, current_event->max_index + fitting_high2);		
-	
-			// Set the channel event to valid.
-			current_event->valid_chan = true;
-	
-			if(analyzer == FIT){ // Do root fitting for high resolution timing (very slow).
-				if(!FitPulse(current_event, (*iter)->entry)){
-					// Set the channel event to invalid.
-					current_event->valid_chan = false;
-					preprocess_badFit++;
-					continue;
-				}
+		if((quantities & TRACE_QDC2) && fitting_low2 != -9999 && fitting_high2 != -9999) 
+			current_event->IntegratePulse2(current_event->max_index - fitting_low2, current_event->max_index + fitting_high2);		
+
+		// Set the channel event to valid.
+		current_event->valid_chan = true;
+
+		if(!(quantities & TRACE_PHASE)){ // The phase is not used by this processor.
+			return;
+		}
+		else if(analyzer == FIT){ // Do root fitting for high resolution timing (very slow).
+			if(!FitPulse(current_event, pair_->entry)){
+				// Set the channel event to invalid.
+				current_event->valid_chan = false;
+				preprocess_badFit++;
+				return;
 			}
-			else{ // Do a more simplified CFD analysis to save time.
-				if(!CfdPulse(current_event, (*iter)->entry)){
-					// Set the channel event to invalid.
-					current_event->valid_chan = false;
-					preprocess_badCfd++;
-					continue;
-				}
+		}
+		else{ // Do a more simplified CFD analysis to save time.
+			if(!CfdPulse(current_event, pair_->entry)){
+				// Set the channel event to invalid.
+				current_event->valid_chan = false;
+				preprocess_badCfd++;
+				return;
 			}
-		
-			// Add the phase of the trace to the high resolution time.
-			current_event->hiresTime += current_event->phase * adcClockInSeconds;
 		}
+	
+		// Add the phase of the trace to the high resolution time.
+		current_event->hiresTime += current_event->phase * adcClockInSeconds;
+	}
+}
+
+void Processor::PreProcess(){
+	if(events.empty()) return;
+
+	// Start the timer.
+	StartProcess(); 
+	
+	// Iterate over the list of channel events.
+	for(std::deque<ChannelEventPair*>::iterator iter = events.begin(); iter != events.end(); iter++){
+		PreProcessEvent(*iter);
 	}
 
 	// Stop the timer.
@@ -433,6 +589,83 @@ bool Processor::Process(ChannelEventPair *start_){
 	return retval;
 }
 
+/// Move the events of the current raw event into the batch.
+void Processor::QueueEvent(ChannelEventPair *start_){
+	batch.AddEvent(events, start_);
+	events.clear();
+}
+
+/// Compute the trace quantities of every hit in the batch.
+void Processor::PreProcessBatch(){
+	if(batch.GetNumHits() == 0) return;
+
+	// Start the timer.
+	StartProcess(); 
+
+	for(std::vector<ChannelEventPair*>::iterator iter = batch.hits.begin(); iter != batch.hits.end(); iter++){
+		PreProcessEvent(*iter);
+	}
+
+	// Stop the timer.
+	StopProcess(); 
+}
+
+/// Call HandleBatch for the entire batch (if supported).
+bool Processor::ProcessBatch(){
+	if(batch.GetNumHits() == 0) return false;
+	if(!use_batch) return true;
+	if(!init) return false;
+
+	// Start the timer.
+	StartProcess(); 
+
+	// Process the entire batch with a single call.
+	batch.Fill();
+	bool retval = HandleBatch();
+
+	// Update the event counters.
+	total_handled += batch.GetNumHits();
+	for(size_t i = 0; i < batch.GetNumHits(); i++){
+		if(!batch.valid[i]) handle_notValid++;
+		else if(batch.accepted[i]) good_events++;
+	}
+
+	// Stop the timer.
+	StopProcess(); 
+
+	return retval;
+}
+
+/// Process a single raw event of the batch.
+bool Processor::ProcessBatchEvent(const size_t &event_){
+	if(event_ >= batch.GetNumEvents() || batch.GetFirst(event_) == batch.GetLast(event_)) return false;
+
+	if(!use_batch){ // Use the per-event interface.
+		events.assign(batch.hits.begin()+batch.GetFirst(event_), batch.hits.begin()+batch.GetLast(event_));
+		return Process(batch.starts[event_]);
+	}
+	
+	if(!init) return false;
+
+	// Start the timer.
+	StartProcess(); 
+
+	// Copy the results into the root structure.
+	FillBatchEvent(event_);
+
+	// Copy the traces to the output file.
+	if(write_waveform){
+		for(size_t i = batch.GetFirst(event_); i < batch.GetLast(event_); i++){
+			if(batch.valid[i]) root_waveform->Append(batch.hits[i]->channelEvent->adcTrace, batch.hits[i]->channelEvent->traceLength);
+		}
+	}
+
+	// Stop the timer.
+	StopProcess(); 
+
+	return true;
+}
+
 /** WrapUp processing of events by clearing the event list. Calls to this method
   * must be done after processing is completed since other processor types may
   * rely upon events which are contained within this processor.
@@ -448,6 +681,32 @@ void Processor::Zero(){
 	root_waveform->Zero();
 }
 
+void Processor::SaveState(ScanCheckpoint *ckpt_, const std::string &prefix_){
+	ckpt_->Set(prefix_+"good_events", good_events);
+	ckpt_->Set(prefix_+"total_events", total_events);
+	ckpt_->Set(prefix_+"total_handled", total_handled);
+	ckpt_->Set(prefix_+"handle_notValid", handle_notValid);
+	ckpt_->Set(prefix_+"handle_unpairedEvent", handle_unpairedEvent);
+	ckpt_->Set(prefix_+"preprocess_emptyTrace", preprocess_emptyTrace);
+	ckpt_->Set(prefix_+"preprocess_badBaseline", preprocess_badBaseline);
+	ckpt_->Set(prefix_+"preprocess_badFit", preprocess_badFit);
+	ckpt_->Set(prefix_+"preprocess_badCfd", preprocess_badCfd);
+	ckpt_->Set(prefix_+"preprocess_noOnboard", preprocess_noOnboard);
+}
+
+bool Processor::LoadState(ScanCheckpoint *ckpt_, const std::string &prefix_){
+	return (ckpt_->Get(prefix_+"good_events", good_events) &&
+	        ckpt_->Get(prefix_+"total_events", total_events) &&
+	        ckpt_->Get(prefix_+"total_handled", total_handled) &&
+	        ckpt_->Get(prefix_+"handle_notValid", handle_notValid) &&
+	        ckpt_->Get(prefix_+"handle_unpairedEvent", handle_unpairedEvent) &&
+	        ckpt_->Get(prefix_+"preprocess_emptyTrace", preprocess_emptyTrace) &&
+	        ckpt_->Get(prefix_+"preprocess_badBaseline", preprocess_badBaseline) &&
+	        ckpt_->Get(prefix_+"preprocess_badFit", preprocess_badFit) &&
+	        ckpt_->Get(prefix_+"preprocess_badCfd", preprocess_badCfd) &&
+	        ckpt_->Get(prefix_+"preprocess_noOnboard", preprocess_noOnboard));
+}
+
 void Processor::RemoveByTag(const std::string &tag_, const bool &withTag_/*=true*/){
 	std::deque<ChannelEventPair*> tempList;
 	while(!events.empty()){
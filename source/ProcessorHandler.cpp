@@ -15,6 +15,7 @@
 #include "PSPmtProcessor.hpp"
 
 #include "MapFile.hpp"
+#include "ScanCheckpoint.hpp"
 
 const double MAX_SYSTEM_CLOCK = std::pow(2, 48); // Maximum of the 48-bit system clock. Roughly 26 days for 8 ns/tick system clock.
 
@@ -30,6 +31,7 @@ ProcessorHandler::ProcessorHandler(){
 	delta_event_time = 0.0;
 	untriggered = false;
 	untrigChannel = false;
+	batch_events = 0;
 }
 
 ProcessorHandler::~ProcessorHandler(){
@@ -138,11 +140,7 @@ bool ProcessorHandler::PreProcess(){
 	return true;
 }
 
-bool ProcessorHandler::Process(){
-	// Call all processor preprocess routines.
-	PreProcess();
-
-	// Return false if there are no start events.
+bool ProcessorHandler::SelectStart(){
 	if(starts.empty()){
 		if(untriggered) starts.push_back(&dummyStart);
 		else if(untrigChannel){
@@ -153,6 +151,16 @@ bool ProcessorHandler::Process(){
 		}
 		else return false;
 	}
+	return true;
+}
+
+bool ProcessorHandler::Process(){
+	// Return false if there are no start events. This is checked before preprocessing
+	// so that no trace analysis is performed for events which will be thrown away.
+	if(!SelectStart()) return false;
+
+	// Call all processor preprocess routines.
+	PreProcess();
 	
 	bool retval = false;
 	
@@ -176,6 +184,46 @@ double ProcessorHandler::GetDeltaEventTime(){
 	return delta_event_time*8E-9;
 }
 
+bool ProcessorHandler::QueueEvent(){
+	bool retval = SelectStart();
+	for(std::vector<ProcessorEntry>::iterator iter = procs.begin(); iter != procs.end(); iter++){
+		if(retval) iter->proc->QueueEvent(starts.front());
+		else iter->proc->WrapUp();
+	}
+	starts.clear();
+	if(retval) batch_events++;
+	return retval;
+}
+
+bool ProcessorHandler::ProcessBatch(){
+	// Preprocessing is done for all processors before any processor handles the batch,
+	// because the phase of each start is required by every processor.
+	for(std::vector<ProcessorEntry>::iterator iter = procs.begin(); iter != procs.end(); iter++){
+		iter->proc->PreProcessBatch();
+	}
+
+	bool retval = false;
+	for(std::vector<ProcessorEntry>::iterator iter = procs.begin(); iter != procs.end(); iter++){
+		if(iter->proc->ProcessBatch()){ retval = true; }
+	}
+	return retval;
+}
+
+bool ProcessorHandler::ProcessBatchEvent(const size_t &index_){
+	bool retval = false;
+	for(std::vector<ProcessorEntry>::iterator iter = procs.begin(); iter != procs.end(); iter++){
+		if(iter->proc->ProcessBatchEvent(index_)){ retval = true; }
+	}
+	return retval;
+}
+
+void ProcessorHandler::ClearBatch(){
+	for(std::vector<ProcessorEntry>::iterator iter = procs.begin(); iter != procs.end(); iter++){
+		iter->proc->ClearBatch();
+	}
+	batch_events = 0;
+}
+
 void ProcessorHandler::ZeroAll(){
 	// Remove all pointers from the start vector.
 	starts.clear();
@@ -191,3 +239,31 @@ void ProcessorHandler::ZeroAll(){
 
 	untrigChannel = false;
 }
+
+void ProcessorHandler::SaveState(ScanCheckpoint *ckpt_){
+	ckpt_->Set("handler.total_events", total_events);
+	ckpt_->Set("handler.start_events", start_events);
+	ckpt_->Set("handler.first_event_time", first_event_time);
+	ckpt_->Set("handler.delta_event_time", delta_event_time);
+	ckpt_->Set("handler.procs", procs.size());
+	for(size_t i = 0; i < procs.size(); i++){
+		std::stringstream prefix; prefix << "proc" << i << ".";
+		ckpt_->Set(prefix.str()+"type", procs.at(i).type);
+		procs.at(i).proc->SaveState(ckpt_, prefix.str());
+	}
+}
+
+bool ProcessorHandler::LoadState(ScanCheckpoint *ckpt_){
+	size_t numProcs;
+	if(!ckpt_->Get("handler.procs", numProcs) || numProcs != procs.size()) return false;
+	for(size_t i = 0; i < procs.size(); i++){
+		std::stringstream prefix; prefix << "proc" << i << ".";
+		std::string type;
+		if(!ckpt_->Get(prefix.str()+"type", type) || type != procs.at(i).type) return false;
+		if(!procs.at(i).proc->LoadState(ckpt_, prefix.str())) return false;
+	}
+	return (ckpt_->Get("handler.total_events", total_events) &&
+	        ckpt_->Get("handler.start_events", start_events) &&
+	        ckpt_->Get("handler.first_event_time", first_event_time) &&
+	        ckpt_->Get("handler.delta_event_time", delta_event_time));
+}
@@ -1,13 +1,22 @@
 #include <iostream>
+#include <algorithm>
+
+#include <stdio.h>
+#include <unistd.h>
 
 // Local files
 #include "Scanner.hpp"
+#include "ScanCheckpoint.hpp"
+#include "SpillSampler.hpp"
+#include "RateMonitor.hpp"
 #include "MapFile.hpp"
 #include "ConfigFile.hpp"
 #include "Processor.hpp"
 #include "ProcessorHandler.hpp"
 #include "OnlineProcessor.hpp"
+#include "HistServer.hpp"
 #include "Plotter.hpp"
+#include "CompactHist.hpp"
 #include "ColorTerm.hpp"
 
 #ifdef USE_HRIBF
@@ -20,6 +29,7 @@
 #include "TNamed.h"
 #include "TCanvas.h"
 #include "TSystem.h"
+#include "TROOT.h"
 
 // Define the name of the program.
 #if not defined(PROG_NAME)
@@ -39,6 +49,37 @@ void writeTNamed(const char *label_, const T &val_, const int &precision_=-1){
 	named.Write();
 }
 
+/** Return the name of the output file directory used to store the histograms of a checkpoint.
+  * @param id_ Number of the checkpoint.
+  * @return The directory name.
+  */
+std::string getCheckpointDirectory(const int &id_){
+	std::stringstream stream; 
+	stream << "checkpoint" << id_;
+	return stream.str();
+}
+
+/** Copy the first entries of a tree in the output file of an interrupted scan to an output tree.
+  * @param file_ Pointer to the output file of the interrupted scan.
+  * @param tree_ Pointer to the output tree.
+  * @param entries_ Number of entries to copy.
+  * @return True if the tree has at least the specified number of entries and false otherwise.
+  */
+bool copyTreeEntries(TFile *file_, TTree *tree_, const Long64_t &entries_){
+	TTree *prevTree = (TTree*)file_->Get(tree_->GetName());
+	if(!prevTree || prevTree->GetEntries() < entries_) return false;
+
+	// Read the previous entries directly into the branches of the output tree.
+	tree_->CopyAddresses(prevTree);
+	for(Long64_t i = 0; i < entries_; i++){
+		prevTree->GetEntry(i);
+		tree_->Fill();
+	}
+	prevTree->ResetBranchAddresses();
+
+	return true;
+}
+
 void writeFileInfo(std::ofstream &file_, const std::string &str_){
 	unsigned short dummy1 = ((unsigned short)str_.size() + 2) + (str_.size() + 2) % 4;
 	unsigned short dummy2 = (str_.size() + 2) % 4;
@@ -145,6 +186,14 @@ void simpleUnpacker::ProcessRawEvent(ScanInterface *addr_/*=NULL*/){
 	addr_->ProcessEvents();
 }
 
+void simpleUnpacker::EndSpill(ScanInterface *addr_/*=NULL*/){
+	// Process the batch of raw events from this spill.
+	if(addr_){
+		((simpleScanner*)addr_)->FlushBatch();
+		((simpleScanner*)addr_)->UpdateRates();
+	}
+}
+
 extTree *simpleUnpacker::InitTree(){
 	// Setup the stats tree for data output.
 	stat_tree = new extTree("stats", "Low-level statistics tree");
@@ -172,28 +221,60 @@ simpleScanner::simpleScanner() : ScanInterface() {
 	untriggered_mode = false;
 	force_overwrite = false;
 	online_mode = false;
+	headless_mode = false;
 	use_root_fitting = false;
 	use_traditional_cfd = false;
+	use_onboard_sums = false;
 	write_traces = false;
 	write_raw = false;
 	write_stats = false;
+	hist_only = false;
 	init = false;
 	mapfile = NULL;
 	configfile = NULL;
 	handler = NULL;
 	online = NULL;
+	histServer = NULL;
+	root_tree = NULL;
+	chanCounts = NULL;
+	chanMaxADC = NULL;
+	chanEnergy = NULL;
+	compCounts = NULL;
+	compMaxADC = NULL;
+	compEnergy = NULL;
+	chanRate = NULL;
+	chanDeadTime = NULL;
+	chanPileup = NULL;
+	chanInterval = NULL;
 	spillThreshold = 10000;
 	currSpillLength = 0;
 	maxSpillLength = 0;
+	spill_weight = 1;
 	events_since_last_update = 0;
 	events_between_updates = 5000;
 	loaded_files = 0;
 	defaultCFDparameter = -1;
+	batch_size = -1;
+	checkpoint_id = 0;
 }
 
 simpleScanner::~simpleScanner(){
 	if(init){
-		std::cout << msgHeader << "Found " << chanCounts->GetHist()->GetEntries() << " total events.\n";
+		// Process any raw events remaining in the batch.
+		FlushBatch();
+
+		double totalEvents = (compCounts ? compCounts->GetEntries() : chanCounts->GetHist()->GetEntries());
+		std::cout << msgHeader << "Found " << totalEvents << " total events.\n";
+
+		// Bring the online debug histograms up to date before they are published and written.
+		CopyCompactHists();
+
+		// Stop publishing histograms before they are written to file.
+		if(histServer){
+			histServer->Publish(true);
+			histServer->Print(msgHeader);
+			histServer->Close();
+		}
 
 		// If the root file is open, write the tree and histograms.
 		if(online_mode) // Write all online diagnostic histograms to the output root file.
@@ -208,38 +289,60 @@ simpleScanner::~simpleScanner(){
 
 		root_file->cd();
 
-		// Write root trees to output file.
-		std::cout << msgHeader << "Writing " << root_tree->GetEntries() << " processed data entries to root file.\n";
-		root_tree->Write();			
+		// The histograms of the last checkpoint are only kept if the scan may still be resumed.
+		std::string checkpointDir = getCheckpointDirectory(checkpoint_id);
+		if(GetScanComplete() && root_file->GetKey(checkpointDir.c_str()))
+			root_file->Delete((checkpointDir+";*").c_str());
+
+		// Write root trees to output file. Trees saved by a checkpoint are replaced.
+		if(!hist_only){
+			std::cout << msgHeader << "Writing " << root_tree->GetEntries() << " processed data entries to root file.\n";
+			root_tree->Write("", TObject::kOverwrite);
+		}
 		
 		if(write_raw){
 			std::cout << msgHeader << "Writing " << raw_tree->GetEntries() << " raw data entries to root file.\n";
-			raw_tree->Write();
+			raw_tree->Write("", TObject::kOverwrite);
 		}
 		
 		if(write_traces){
 			std::cout << msgHeader << "Writing " << trace_tree->GetEntries() << " raw ADC traces to root file.\n";
-			trace_tree->Write();
+			trace_tree->Write("", TObject::kOverwrite);
 		}
 		
 		if(write_stats){
 			std::cout << msgHeader << "Writing " << stat_tree->GetEntries() << " raw event stats entries to root file.\n";
-			stat_tree->Write();
+			stat_tree->Write("", TObject::kOverwrite);
 		}
 		
 		// Write debug histograms.
-		chanCounts->GetHist()->Write();
-		chanMaxADC->GetHist()->Write();
-		chanEnergy->GetHist()->Write();
+		if(compCounts){
+			std::vector<CompactHist2d*> compactHists;
+			GetCompactHists(compactHists);
+			for(std::vector<CompactHist2d*>::iterator iter = compactHists.begin(); iter != compactHists.end(); ++iter)
+				(*iter)->GetHist()->Write();
+		}
+		else{
+			chanCounts->GetHist()->Write();
+			chanMaxADC->GetHist()->Write();
+			chanEnergy->GetHist()->Write();
+		}
 
 		// Write processor count statistics.
 		root_file->mkdir("counts");
 		root_file->cd("counts");
 
-		writeTNamed("Global", chanCounts->GetHist()->GetEntries());
+		writeTNamed("Global", totalEvents);
 		writeTNamed("Handled", handler->GetTotalEvents());
 		writeTNamed("Starts", handler->GetStartEvents());
 
+		// Histograms should be scaled by the total spill weight over the number of processed spills. Each
+		// entry of the data tree should instead be weighted by its own "weight" branch.
+		if(GetSampler()){
+			writeTNamed("Spills", GetSampler()->GetNumProcessed());
+			writeTNamed("Spill weight", GetSampler()->GetTotalWeight());
+		}
+
 		for(size_t i = 0; i < handler->GetNumProcessors(); i++){
 			ProcessorEntry *ptr = handler->GetProcessor(i);
 			std::stringstream stream; stream << "counts/" << ptr->type;
@@ -253,6 +356,12 @@ simpleScanner::~simpleScanner(){
 		// Close the root file.
 		root_file->Close();
 		delete root_file;
+
+		// The checkpoint is no longer needed once the entire run has been scanned.
+		if(GetScanComplete()){
+			remove(GetCheckpointFilename().c_str());
+			remove(partialFilename.c_str());
+		}
 		
 		std::cout << msgHeader << "Processed " << loaded_files << " files.\n";
 		std::cout << msgHeader << "Found " << handler->GetTotalEvents() << " events.\n";
@@ -262,8 +371,13 @@ simpleScanner::~simpleScanner(){
 		delete mapfile;
 		delete configfile;
 		delete handler;
+		delete histServer;
 		delete online;
 	}
+
+	delete compCounts;
+	delete compMaxADC;
+	delete compEnergy;
 }
 
 bool simpleScanner::ExtraCommands(const std::string &cmd_, std::vector<std::string> &args_){
@@ -277,7 +391,10 @@ bool simpleScanner::ExtraCommands(const std::string &cmd_, std::vector<std::stri
 				}
 				else{ std::cout << msgHeader << "Failed to set canvas update frequency to " << frequency << " events!\n"; }
 			}
-			else{ online->Refresh(); }
+			else{
+				CopyCompactHists();
+				online->Refresh();
+			}
 		}
 		else if(cmd_ == "list"){
 			online->PrintHists();
@@ -440,11 +557,13 @@ bool simpleScanner::ExtraCommands(const std::string &cmd_, std::vector<std::stri
 				if(args_.size() >= 2)
 					std::cout << " " << args_.at(0) << "->Draw(\"" << args_.at(1) << "\", \"" << gateStr << "\", \"" << optStr << "\")\n";
 				if(args_.at(0) == "data"){
-					if(args_.size() >= 2)
+					if(hist_only)
+						std::cout << msgHeader << "The \"data\" tree is not available in histogram-only mode!\n";
+					else if(args_.size() >= 2)
 						root_tree->SafeDraw(args_.at(1), gateStr, optStr);
 					else
 						root_tree->SafeDraw();
-					if(!GetIsRunning()) // Manually update the histogram
+					if(!hist_only && !GetIsRunning()) // Manually update the histogram
 						root_tree->SafeFill(false);
 				}
 				else if(args_.at(0) == "raw"){
@@ -489,12 +608,14 @@ bool simpleScanner::ExtraCommands(const std::string &cmd_, std::vector<std::stri
 			}
 			if(args_.size() >= 1){
 				int index1 = strtol(args_.at(0).c_str(), NULL, 10);
+				ZeroCompactHist(index1);
 				if(online->Zero(index1)){ std::cout << msgHeader << "Zeroed histogram '" << args_.at(0) << "'.\n"; }
 				else{ std::cout << msgHeader << "Failed to zero histogram '" << args_.at(0) << "'!\n"; }
 			}
 			else{
 				// Zero all histograms
 				for(unsigned int i = 0; i < online->GetNumHistograms(); i++){
+					ZeroCompactHist(i);
 					online->Zero(i);
 					std::cout << msgHeader << " Zeroed histogram '" << i << "'.\n";
 				}
@@ -559,6 +680,37 @@ void simpleScanner::ExtraArguments(){
 		if(outputFilenamePrefix.back() != '/') outputFilenamePrefix += '/';
 		std::cout << msgHeader << "Using output filename prefix \"" << outputFilenamePrefix << "\".\n";
 	}
+	if(userOpts.at(12).active){ // Onboard QDC sums and CFD.
+		std::cout << msgHeader << "Using onboard CFD and QDC sums (no trace analysis).\n";
+		use_onboard_sums = true;
+	}
+	if(userOpts.at(13).active){ // Batch processing.
+		batch_size = strtol(userOpts.at(13).argument.c_str(), NULL, 0);
+		if(batch_size < 0) batch_size = 0;
+		if(batch_size > 0) std::cout << msgHeader << "Processing events in batches of " << batch_size << " raw events.\n";
+		else std::cout << msgHeader << "Processing events in batches of one spill.\n";
+	}
+	if(userOpts.at(14).active){ // Histogram snapshot server.
+		histServerAddress = userOpts.at(14).argument;
+		std::cout << msgHeader << "Publishing online histograms on \"" << histServerAddress << "\".\n";
+		online_mode = true;
+	}
+	if(userOpts.at(15).active){ // Headless online mode.
+		std::cout << msgHeader << "Using headless mode (no root graphics).\n";
+		headless_mode = true;
+		online_mode = true;
+		gROOT->SetBatch(true);
+	}
+	if(userOpts.at(16).active){ // Histogram-only mode.
+		std::cout << msgHeader << "Using histogram-only mode (no output trees).\n";
+		hist_only = true;
+		if(write_traces || write_raw || write_stats){
+			warnStr << msgHeader << "Warning! Trace, raw, and stats output are disabled in histogram-only mode.\n";
+			write_traces = false;
+			write_raw = false;
+			write_stats = false;
+		}
+	}
 }
 
 void simpleScanner::CmdHelp(const std::string &prefix_/*=""*/){
@@ -593,6 +745,11 @@ void simpleScanner::ArgHelp(){
 	AddOption(optionExt("parameters", required_argument, NULL, 0, "<list>", "Set default fitting/CFD parameters by supplying comma-delimited string"));
 	AddOption(optionExt("force-traces", no_argument, NULL, 0, "", "Change all entries in map file to type 'trace' to do trace analysis"));
 	AddOption(optionExt("output-prefix", required_argument, NULL, 0, "<prefix>", "Set the output file prefix (default is ./)"));
+	AddOption(optionExt("onboard", no_argument, NULL, 0, "", "Use onboard CFD and QDC sums for timing and energy instead of the ADC trace"));
+	AddOption(optionExt("batch", required_argument, NULL, 0, "<N>", "Process events in batches of N raw events (0 for one batch per spill)"));
+	AddOption(optionExt("hist-server", required_argument, NULL, 0, "<port|path>", "Publish online histograms to remote viewers on a TCP port or local socket"));
+	AddOption(optionExt("headless", no_argument, NULL, 0, "", "Fill online histograms without opening a root canvas"));
+	AddOption(optionExt("hist-only", no_argument, NULL, 0, "", "Only write histograms to the output file (no output trees)"));
 }
 
 void simpleScanner::SyntaxStr(char *name_){ 
@@ -600,22 +757,15 @@ void simpleScanner::SyntaxStr(char *name_){
 }
 
 void simpleScanner::IdleTask(){
-	if(online_mode)
+	if(histServer)
+		histServer->Publish();
+	if(online_mode && !headless_mode)
 		gSystem->ProcessEvents();
 }
 
 bool simpleScanner::Initialize(std::string prefix_){
 	if(init){ return false; }
 
-	// Setup a 2d histogram for tracking all channel counts.
-	chanCounts = new Plotter("chanCounts", "Recorded Counts for Module vs. Channel", "COLZ", "Channel", "", 16, 0, 16, "Module", "", 6, 0, 6);
-
-	// Setup a 2d histogram for tracking channel energies.
-	chanMaxADC = new Plotter("chanMaxADC", "Channel vs. Max ADC", "COLZ", "Max ADC Channel", "", 16384, 0, 16384, "Channel", "", 96, 0, 96);
-
-	// Setup a 2d histogram for tracking channel energies.
-	chanEnergy = new Plotter("chanEnergy", "Channel vs. Filter Energy", "COLZ", "Filter Energy", "a.u.", 32768, 0, 32768, "Channel", "", 96, 0, 96);
-
 	std::string setupDirectory = this->GetSetupFilename();
 	if(setupDirectory.empty()) setupDirectory = "./setup/";
 	else if(setupDirectory.back() != '/') setupDirectory += '/';
@@ -631,6 +781,27 @@ bool simpleScanner::Initialize(std::string prefix_){
 		return false;
 	}
 
+	// The debug histograms are indexed by the module index and channel location of the map, so that
+	// the modules of every crate are included. At least 6 modules are always shown.
+	int numModules = std::max(6, mapfile->GetNumModuleIndices());
+	int numChannels = 16*numModules;
+
+	if(hist_only){ // Fill integer counters which are only converted when written (or when the online histograms are refreshed).
+		compCounts = new CompactHist2d("chanCounts", "Recorded Counts for Module vs. Channel", "Channel", "", 16, 0, 16, "Module", "", numModules, 0, numModules);
+		compMaxADC = new CompactHist2d("chanMaxADC", "Channel vs. Max ADC", "Max ADC Channel", "", 16384, 0, 16384, "Channel", "", numChannels, 0, numChannels);
+		compEnergy = new CompactHist2d("chanEnergy", "Channel vs. Filter Energy", "Filter Energy", "a.u.", 32768, 0, 32768, "Channel", "", numChannels, 0, numChannels);
+	}
+	if(!hist_only || online_mode){
+		// Setup a 2d histogram for tracking all channel counts.
+		chanCounts = new Plotter("chanCounts", "Recorded Counts for Module vs. Channel", "COLZ", "Channel", "", 16, 0, 16, "Module", "", numModules, 0, numModules);
+
+		// Setup a 2d histogram for tracking channel energies.
+		chanMaxADC = new Plotter("chanMaxADC", "Channel vs. Max ADC", "COLZ", "Max ADC Channel", "", 16384, 0, 16384, "Channel", "", numChannels, 0, numChannels);
+
+		// Setup a 2d histogram for tracking channel energies.
+		chanEnergy = new Plotter("chanEnergy", "Channel vs. Filter Energy", "COLZ", "Filter Energy", "a.u.", 32768, 0, 32768, "Channel", "", numChannels, 0, numChannels);
+	}
+
 	if(online_mode){
 		// Initialize the online data processor.
 		online = new OnlineProcessor();
@@ -643,7 +814,7 @@ bool simpleScanner::Initialize(std::string prefix_){
 			return false;
 		}
 
-		online->SetDisplayMode();
+		if(!headless_mode) online->SetDisplayMode();
 		online->SetMapFile(mapfile);
 	
 		// Add the raw histograms to the online processor.
@@ -655,6 +826,21 @@ bool simpleScanner::Initialize(std::string prefix_){
 		online->ChangeHist(0, 0);
 		online->ChangeHist(1, 1);
 		online->ChangeHist(2, 2);
+
+		// Add the channel rate histograms, which are updated at the end of every spill.
+		if(GetRateMonitor()){
+			chanRate = new Plotter("chanRate", "Channel Rate", "", "Channel", "", numChannels, 0, numChannels);
+			chanDeadTime = new Plotter("chanDeadTime", "Channel Dead Time", "", "Channel", "", numChannels, 0, numChannels);
+			chanPileup = new Plotter("chanPileup", "Channel Pileup Fraction", "", "Channel", "", numChannels, 0, numChannels);
+			chanInterval = new Plotter("chanInterval", "Channel vs. Time Between Hits", "COLZ", "log10(Time Between Hits)", "ns", RATE_INTERVAL_BINS, 0, RATE_INTERVAL_DECADES, "Channel", "", numChannels, 0, numChannels);
+			chanRate->GetHist()->GetYaxis()->SetTitle("Rate (Hz)");
+			chanDeadTime->GetHist()->GetYaxis()->SetTitle("Dead Time (%)");
+			chanPileup->GetHist()->GetYaxis()->SetTitle("Pileup (%)");
+			online->AddHist(chanRate);
+			online->AddHist(chanDeadTime);
+			online->AddHist(chanPileup);
+			online->AddHist(chanInterval);
+		}
 		online->Refresh();
 	}
 
@@ -773,9 +959,37 @@ bool simpleScanner::Initialize(std::string prefix_){
 		std::cout << prefix_ << "No output filename given, using \"" << ofname << "\".\n";
 	}
 
-	// Initialize the root output file.
+	// Checkpoints are written next to the output file.
+	SetCheckpointFilename(ofname + ".ckpt");
+	partialFilename = ofname + ".partial";
+
+	// Keep the output of an interrupted scan until a new checkpoint is written. If the output file
+	// does not contain the histograms of the last checkpoint, the output of the interrupted scan
+	// was already moved by an earlier attempt to resume the scan.
+	bool resumingOutput = false;
+	if(ResumeMode()){
+		ScanCheckpoint ckpt;
+		if(ckpt.Read(GetCheckpointFilename()) && ckpt.Get("scanner.checkpoint", checkpoint_id)){
+			bool outputHasCheckpoint = false;
+			if(access(ofname.c_str(), F_OK) == 0){
+				TFile prevFile(ofname.c_str(), "READ");
+				outputHasCheckpoint = (prevFile.IsOpen() && prevFile.GetKey(getCheckpointDirectory(checkpoint_id).c_str()));
+				prevFile.Close();
+			}
+			if(outputHasCheckpoint && rename(ofname.c_str(), partialFilename.c_str()) != 0){
+				errStr << prefix_ << "Failed to move output of interrupted scan to '" << partialFilename << "'!\n";
+				return false;
+			}
+			resumingOutput = (access(partialFilename.c_str(), F_OK) == 0);
+			if(resumingOutput)
+				std::cout << prefix_ << "Resuming from output of interrupted scan \"" << partialFilename << "\".\n";
+		}
+	}
+
+	// Initialize the root output file. The output file is only replaced without --force when the
+	// output of an interrupted scan has been kept, since it is rebuilt from the checkpoint.
 	std::cout << prefix_ << "Initializing root output.\n";
-	if(force_overwrite){ root_file = new TFile(ofname.c_str(), "RECREATE"); }
+	if(force_overwrite || resumingOutput){ root_file = new TFile(ofname.c_str(), "RECREATE"); }
 	else{ root_file = new TFile(ofname.c_str(), "CREATE"); }
 
 	// Check that the root file is open.
@@ -788,7 +1002,12 @@ bool simpleScanner::Initialize(std::string prefix_){
 	}
 	
 	// Setup the root tree for data output.
-	root_tree = new extTree("data", "Pixie data");
+	if(!hist_only){
+		root_tree = new extTree("data", "Pixie data");
+
+		// Only a sample of the spills is processed in shm mode, so record how many spills each entry represents.
+		if(ShmMode()) root_tree->Branch("weight", &spill_weight);
+	}
 
 	// Setup the raw data tree for output.
 	if(write_raw){
@@ -804,7 +1023,7 @@ bool simpleScanner::Initialize(std::string prefix_){
 	if(write_stats)
 		stat_tree = ((simpleUnpacker*)GetCore())->InitTree();
 
-	// Add branches to the output tree.
+	// Add branches to the output tree. In histogram-only mode, the processors only fill their online histograms.
 	handler->InitRootOutput(root_tree);		
 
 	// Set processor options.
@@ -814,7 +1033,8 @@ bool simpleScanner::Initialize(std::string prefix_){
 	}
 
 	// Set trace analysis processor.
-	if(use_root_fitting) handler->SetTimingAnalyzer(FIT);
+	if(use_onboard_sums) handler->SetTimingAnalyzer(ONBOARD);
+	else if(use_root_fitting) handler->SetTimingAnalyzer(FIT);
 	else if(use_traditional_cfd) handler->SetTimingAnalyzer(CFD);
 	else handler->SetTimingAnalyzer(POLY);
 
@@ -834,12 +1054,31 @@ void simpleScanner::FinalInitialization(){
 	// Add map and config file entries to the file.	
 	mapfile->Write(root_file);
 	configfile->Write(root_file);
+
+	// Start publishing the online histograms.
+	if(online_mode && !histServerAddress.empty()){
+		histServer = new HistServer();
+		for(unsigned int i = 0; i < online->GetNumHistograms(); i++)
+			histServer->AddHist(online->GetHistogram(i));
+		if(histServer->Open(histServerAddress))
+			std::cout << msgHeader << "Publishing " << histServer->GetNumHists() << " histograms on \"" << histServerAddress << "\".\n";
+		else{
+			errStr << msgHeader << "Failed to open histogram server on \"" << histServerAddress << "\"!\n";
+			delete histServer;
+			histServer = NULL;
+		}
+	}
 }
 
 void simpleScanner::Notify(const std::string &code_/*=""*/){
 	if(code_ == "START_SCAN"){  }
 	else if(code_ == "STOP_SCAN"){  }
-	else if(code_ == "SCAN_COMPLETE"){ std::cout << msgHeader << "Scan complete.\n"; }
+	else if(code_ == "SCAN_COMPLETE"){ 
+		FlushBatch();
+		CopyCompactHists();
+		if(histServer) histServer->Publish(true);
+		std::cout << msgHeader << "Scan complete.\n"; 
+	}
 	else if(code_ == "LOAD_FILE"){
 		std::cout << msgHeader << "File loaded.\n";
 		fileInformation *finfo = GetFileInfo();
@@ -861,6 +1100,15 @@ void simpleScanner::Notify(const std::string &code_/*=""*/){
 		}
 		else{ std::cout << msgHeader << "Failed to fetch input file info!\n"; }
 	}
+	else if(code_ == "CHECKPOINT"){
+		// The previous checkpoint is no longer needed.
+		std::string prevDir = getCheckpointDirectory(checkpoint_id-1);
+		if(root_file->GetKey(prevDir.c_str())){
+			root_file->Delete((prevDir+";*").c_str());
+			root_file->SaveSelf(kTRUE);
+		}
+		remove(partialFilename.c_str());
+	}
 	else if(code_ == "REWIND_FILE"){  }
 	else if(code_ == "RESTART"){  }
 	else{ std::cout << msgHeader << "Unknown notification code '" << code_ << "'!\n"; }
@@ -876,20 +1124,30 @@ bool simpleScanner::AddEvent(XiaData *event_){
 
 	if(firstEvent) firstEvent = false; // This is the first event to be processed.
 
+	// Find the map entry of this channel. Channels which are not in the map are filled in the underflow bins.
+	MapEntry *mapentry = mapfile->GetMapEntry(event_);
+	int location = (mapentry ? (int)mapentry->location : -1);
+	int module = (mapentry ? location/16 : -1);
+
 	// Fill the output histograms.
-	chanCounts->Fill2d(event_->chanNum, event_->modNum);
-	chanEnergy->Fill2d(event_->energy, 16*event_->modNum + event_->chanNum);
+	if(compCounts){
+		compCounts->Fill(event_->chanNum, module);
+		compEnergy->Fill(event_->energy, location);
+	}
+	else{
+		chanCounts->Fill2d(event_->chanNum, module);
+		chanEnergy->Fill2d(event_->energy, location);
+	}
 
 	// Raw event information. Dump raw event information to root file.
 	if(write_raw){
-		xia_data_location = 16*event_->modNum + event_->chanNum;
+		xia_data_location = (mapentry ? location : 16*event_->modNum + event_->chanNum);
 		xia_data_energy = event_->energy;
 		xia_data_time = event_->time*8E-9;
 		raw_tree->SafeFill();
 	}
 
 	// Check that this channel is defined in the map.
-	MapEntry *mapentry = mapfile->GetMapEntry(event_);
 	if(!mapentry || mapentry->type == "ignore"){
 		delete event_;
 		return false;
@@ -907,11 +1165,6 @@ bool simpleScanner::AddEvent(XiaData *event_){
 	ChannelEventPair *pair_;
 	pair_ = new ChannelEventPair(current_event, mapentry);
 
-	// Correct the baseline before using the trace.
-	if(pair_->channelEvent->traceLength != 0 && pair_->channelEvent->ComputeBaseline() >= 0.0){
-		chanMaxADC->Fill2d(pair_->channelEvent->maximum, pair_->entry->location);
-	}
-	
 	// Pass this event to the correct processor
 	if(!handler->AddEvent(pair_)){ // Invalid detector type. Delete it
 		delete pair_;
@@ -938,6 +1191,20 @@ bool simpleScanner::AddEvent(XiaData *event_){
 bool simpleScanner::ProcessEvents(){
 	bool retval = true;
 
+	if(batch_size >= 0){ // Add the raw event to the batch.
+		if(nonStartEvents || recordAllStarts) retval = handler->QueueEvent();
+		else handler->ZeroAll();
+		nonStartEvents = false;
+
+		// Process the batch once it is full.
+		if(batch_size > 0 && handler->GetBatchSize() >= (size_t)batch_size)
+			FlushBatch();
+
+		UpdateOnline();
+
+		return retval;
+	}
+
 	// Check that at least one of the events in the event list is not a
 	// start event. This is done to avoid writing a lot of useless data
 	// to the output file in the event of a high trigger rate.
@@ -945,7 +1212,8 @@ bool simpleScanner::ProcessEvents(){
 		// Call each processor to do the processing.
 		if(handler->Process()){ // This event had at least one valid signal
 			// Fill the root tree with processed data.
-			root_tree->SafeFill();
+			spill_weight = GetSpillWeight();
+			if(!hist_only) root_tree->SafeFill();
 
 			// Fill the ADC trace tree with raw traces.		
 			if(write_traces){ trace_tree->SafeFill(); }
@@ -958,21 +1226,82 @@ bool simpleScanner::ProcessEvents(){
 	handler->ZeroAll();
 
 	// Clear all events from the channel event list.
+	ClearEventList();
+
+	UpdateOnline();
+	
+	return retval;
+}
+
+void simpleScanner::FlushBatch(){
+	if(!init || batch_size < 0) return;
+
+	if(handler->GetBatchSize() > 0){
+		// Analyze all hits in the batch.
+		handler->ProcessBatch();
+
+		// Fill the output trees one raw event at a time.
+		spill_weight = GetSpillWeight();
+		for(size_t i = 0; i < handler->GetBatchSize(); i++){
+			if(handler->ProcessBatchEvent(i) && !hist_only){ // This event had at least one valid signal
+				root_tree->SafeFill();
+				if(write_traces){ trace_tree->SafeFill(); }
+			}
+			handler->ZeroAll();
+		}
+		handler->ClearBatch();
+	}
+
+	// Delete all events in the batch.
+	ClearEventList();
+}
+
+void simpleScanner::ClearEventList(){
 	while(!chanEventList.empty()){
+		// Only histogram the maximum of traces which were analyzed by a processor.
+		if(chanEventList.front()->channelEvent->IsComputed(TRACE_BASELINE)){
+			if(compMaxADC) compMaxADC->Fill(chanEventList.front()->channelEvent->maximum, chanEventList.front()->entry->location);
+			else chanMaxADC->Fill2d(chanEventList.front()->channelEvent->maximum, chanEventList.front()->entry->location);
+		}
 		delete chanEventList.front();
 		chanEventList.pop_front(); // Remove this event from the raw event deque.
 	}
+}
 
+void simpleScanner::UpdateRates(){
+	RateMonitor *monitor = GetRateMonitor();
+	if(!monitor || !chanRate) return;
+
+	TH1 *rateHist = chanRate->GetHist();
+	TH1 *deadHist = chanDeadTime->GetHist();
+	TH1 *pileupHist = chanPileup->GetHist();
+	TH1 *intervalHist = chanInterval->GetHist();
+	for(size_t id = 0; id < monitor->GetNumChannels(); id++){
+		const ChannelRate *chan = monitor->GetChannel(id);
+		if(!chan) continue;
+		MapEntry *entry = mapfile->GetMapEntry(chan->modNum, chan->chanNum);
+		if(!entry) continue;
+		int bin = entry->location + 1;
+		if(bin > rateHist->GetNbinsX()) continue;
+		rateHist->SetBinContent(bin, monitor->GetRate(id));
+		deadHist->SetBinContent(bin, 100*monitor->GetDeadFraction(id));
+		pileupHist->SetBinContent(bin, 100*chan->pileupFraction);
+		for(int i = 0; i < RATE_INTERVAL_BINS; i++)
+			intervalHist->SetBinContent(i+1, bin, chan->intervals[i]);
+	}
+}
+
+void simpleScanner::UpdateOnline(){
 	// Check for the need to update the online canvas.
 	if(online_mode){
 		if(events_since_last_update >= events_between_updates){
+			CopyCompactHists();
 			online->Refresh();
+			if(histServer) histServer->Publish();
 			events_since_last_update = 0;
 		}
 		else{ events_since_last_update++; }
 	}
-	
-	return retval;
 }
 
 int main(int argc, char *argv[]){
@@ -993,3 +1322,169 @@ int main(int argc, char *argv[]){
 
 	return retval;
 }
+
+bool simpleScanner::SaveCheckpoint(ScanCheckpoint *ckpt_){
+	if(!init) return false;
+
+	// Process any raw events remaining in the batch.
+	FlushBatch();
+
+	// Flush the output trees so that their entries may be recovered.
+	root_file->cd();
+	if(!hist_only){
+		ckpt_->Set("scanner.data", root_tree->GetEntries());
+		root_tree->AutoSave("SaveSelf");
+	}
+	if(write_raw){
+		ckpt_->Set("scanner.raw", raw_tree->GetEntries());
+		raw_tree->AutoSave("SaveSelf");
+	}
+	if(write_traces){
+		ckpt_->Set("scanner.trace", trace_tree->GetEntries());
+		trace_tree->AutoSave("SaveSelf");
+	}
+	if(write_stats){
+		ckpt_->Set("scanner.stats", stat_tree->GetEntries());
+		stat_tree->AutoSave("SaveSelf");
+	}
+
+	// Write the histograms to a new directory, so that the previous checkpoint is
+	// still valid if the scan is interrupted before the checkpoint file is written.
+	std::string checkpointDir = getCheckpointDirectory(++checkpoint_id);
+	TDirectory *dir = root_file->mkdir(checkpointDir.c_str());
+	if(!dir) return false;
+	dir->cd();
+
+	std::vector<TH1*> hists;
+	std::vector<CompactHist2d*> compactHists;
+	GetCheckpointHists(hists);
+	GetCompactHists(compactHists);
+	for(std::vector<TH1*>::iterator iter = hists.begin(); iter != hists.end(); ++iter)
+		(*iter)->Write();
+	for(std::vector<CompactHist2d*>::iterator iter = compactHists.begin(); iter != compactHists.end(); ++iter)
+		(*iter)->GetHist()->Write();
+	dir->SaveSelf(kTRUE);
+	root_file->cd();
+	root_file->SaveSelf(kTRUE);
+
+	ckpt_->Set("scanner.checkpoint", checkpoint_id);
+	ckpt_->Set("scanner.hists", hists.size()+compactHists.size());
+	handler->SaveState(ckpt_);
+
+	return true;
+}
+
+bool simpleScanner::LoadCheckpoint(ScanCheckpoint *ckpt_){
+	if(!init) return false;
+
+	if(!handler->LoadState(ckpt_)){
+		errStr << msgHeader << "Checkpoint was written with a different set of processors!\n";
+		return false;
+	}
+
+	size_t numHists;
+	Long64_t dataEntries = 0, rawEntries = 0, traceEntries = 0, statsEntries = 0;
+	if(!ckpt_->Get("scanner.checkpoint", checkpoint_id) || !ckpt_->Get("scanner.hists", numHists) || (!hist_only && !ckpt_->Get("scanner.data", dataEntries)) ||
+	   (write_raw && !ckpt_->Get("scanner.raw", rawEntries)) || (write_traces && !ckpt_->Get("scanner.trace", traceEntries)) ||
+	   (write_stats && !ckpt_->Get("scanner.stats", statsEntries))){
+		errStr << msgHeader << "Checkpoint was written with different output options!\n";
+		return false;
+	}
+
+	std::vector<TH1*> hists;
+	std::vector<CompactHist2d*> compactHists;
+	GetCheckpointHists(hists);
+	GetCompactHists(compactHists);
+	if(hists.size()+compactHists.size() != numHists){
+		errStr << msgHeader << "Checkpoint was written with a different set of histograms!\n";
+		return false;
+	}
+
+	// Open the output of the interrupted scan. The file is recovered if it was not closed.
+	TFile *prevFile = new TFile(partialFilename.c_str(), "READ");
+	std::string checkpointDir = getCheckpointDirectory(checkpoint_id);
+	if(!prevFile->IsOpen() || !prevFile->GetKey(checkpointDir.c_str())){
+		errStr << msgHeader << "Failed to read checkpoint from output of interrupted scan '" << partialFilename << "'!\n";
+		delete prevFile;
+		root_file->cd();
+		return false;
+	}
+
+	// Copy the entries which were written before the checkpoint.
+	bool retval = (hist_only || copyTreeEntries(prevFile, root_tree, dataEntries));
+	if(retval && write_raw) retval = copyTreeEntries(prevFile, raw_tree, rawEntries);
+	if(retval && write_traces) retval = copyTreeEntries(prevFile, trace_tree, traceEntries);
+	if(retval && write_stats) retval = copyTreeEntries(prevFile, stat_tree, statsEntries);
+	if(!retval) errStr << msgHeader << "Output of interrupted scan contains fewer entries than the checkpoint!\n";
+	else if(!hist_only) std::cout << msgHeader << "Copied " << dataEntries << " processed data entries from output of interrupted scan.\n";
+
+	// Add the histograms of the interrupted scan.
+	for(std::vector<TH1*>::iterator iter = hists.begin(); retval && iter != hists.end(); ++iter){
+		TH1 *prevHist = (TH1*)prevFile->Get((checkpointDir+"/"+(*iter)->GetName()).c_str());
+		if(!prevHist){
+			errStr << msgHeader << "Histogram '" << (*iter)->GetName() << "' not found in checkpoint!\n";
+			retval = false;
+			break;
+		}
+		(*iter)->Add(prevHist);
+	}
+	for(std::vector<CompactHist2d*>::iterator iter = compactHists.begin(); retval && iter != compactHists.end(); ++iter){
+		TH1 *prevHist = (TH1*)prevFile->Get((checkpointDir+"/"+(*iter)->GetName()).c_str());
+		if(!prevHist || !(*iter)->Add(prevHist)){
+			errStr << msgHeader << "Histogram '" << (*iter)->GetName() << "' not found in checkpoint!\n";
+			retval = false;
+		}
+	}
+
+	prevFile->Close();
+	delete prevFile;
+	root_file->cd();
+
+	return retval;
+}
+
+void simpleScanner::GetCheckpointHists(std::vector<TH1*> &hists_){
+	hists_.clear();
+	if(!compCounts){
+		hists_.push_back(chanCounts->GetHist());
+		hists_.push_back(chanMaxADC->GetHist());
+		hists_.push_back(chanEnergy->GetHist());
+	}
+	if(!online) return;
+	for(unsigned int i = 0; i < online->GetNumHistograms(); i++){
+		Plotter *plotter = online->GetHistogram(i);
+		if(compCounts && (plotter == chanCounts || plotter == chanMaxADC || plotter == chanEnergy))
+			continue; // Stored by the compact histograms.
+		if(std::find(hists_.begin(), hists_.end(), plotter->GetHist()) == hists_.end())
+			hists_.push_back(plotter->GetHist());
+		int location;
+		for(size_t j = 0; j < plotter->GetNumHists(); j++){
+			TH1 *hist = plotter->GetSubHist(j, location);
+			if(hist && std::find(hists_.begin(), hists_.end(), hist) == hists_.end())
+				hists_.push_back(hist);
+		}
+	}
+}
+
+void simpleScanner::GetCompactHists(std::vector<CompactHist2d*> &hists_){
+	hists_.clear();
+	if(!compCounts) return;
+	hists_.push_back(compCounts);
+	hists_.push_back(compMaxADC);
+	hists_.push_back(compEnergy);
+}
+
+void simpleScanner::CopyCompactHists(){
+	if(!compCounts || !chanCounts) return;
+	compCounts->CopyTo(chanCounts->GetHist());
+	compMaxADC->CopyTo(chanMaxADC->GetHist());
+	compEnergy->CopyTo(chanEnergy->GetHist());
+}
+
+void simpleScanner::ZeroCompactHist(const unsigned int &index_){
+	if(!compCounts || index_ >= online->GetNumHistograms()) return;
+	Plotter *plotter = online->GetHistogram(index_);
+	if(plotter == chanCounts) compCounts->Zero();
+	else if(plotter == chanMaxADC) compMaxADC->Zero();
+	else if(plotter == chanEnergy) compEnergy->Zero();
+}
@@ -37,6 +37,9 @@ bool TraceProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *chEv
 TraceProcessor::TraceProcessor(MapFile *map_) : Processor("Trace", "trace", map_){
 	root_structure = (Structure*)&structure;
 	root_waveform = &waveform;
+
+	// Everything except the second integral is histogrammed.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
 }
 
 void TraceProcessor::GetHists(OnlineProcessor *online_){
@@ -20,12 +20,36 @@ bool TriggerProcessor::HandleEvent(ChannelEventPair *chEvt, ChannelEventPair *ch
 	return true;
 }
 
+bool TriggerProcessor::HandleBatch(){
+	if(histsEnabled){ // Fill all diagnostic histograms.
+		for(size_t i = 0; i < batch.GetNumHits(); i++){
+			if(!batch.accepted[i]) continue;
+			energy_1d->Fill(batch.location[i], batch.qdc[i]);
+			phase_1d->Fill(batch.location[i], batch.phase[i]);
+		}
+	}
+
+	return true;
+}
+
+bool TriggerProcessor::FillBatchEvent(const size_t &event_){
+	// Fill the values into the root tree.
+	for(size_t i = batch.GetFirst(event_); i < batch.GetLast(event_); i++){
+		if(batch.accepted[i]) structure.Append(batch.time[i], batch.phase[i], batch.qdc[i]);
+	}
+	return true;
+}
+
 TriggerProcessor::TriggerProcessor(MapFile *map_) : Processor("Trigger", "trigger", map_){
 	root_structure = (Structure*)&structure;
 	root_waveform = &waveform;
 
 	energy_1d = NULL;
 	phase_1d = NULL;
+
+	// Only the QDC and the phase of the trigger are recorded.
+	traceQuantities = TRACE_BASELINE | TRACE_QDC | TRACE_PHASE;
+	use_batch = true;
 }
 
 void TriggerProcessor::GetHists(OnlineProcessor *online_){
@@ -0,0 +1,160 @@
+#ifndef ACCEPTANCEMC_HPP
+#define ACCEPTANCEMC_HPP
+
+#include <vector>
+#include <atomic>
+
+class CalibFile;
+class PositionCal;
+class kinematicsTable;
+
+// Counter-based random number generator. Each value depends only on the key and the counter, so any
+// number of threads may draw from the same stream without sharing state.
+class CounterRNG{
+  public:
+	CounterRNG(const unsigned long long &key_=0) : key(Hash(key_)) { }
+
+	// SplitMix64 finalizer.
+	static unsigned long long Hash(unsigned long long x_){
+		x_ = (x_ ^ (x_ >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x_ = (x_ ^ (x_ >> 27)) * 0x94D049BB133111EBULL;
+		return x_ ^ (x_ >> 31);
+	}
+
+	// Return the random integer for a counter.
+	unsigned long long Get(const unsigned long long &counter_) const { return Hash(key + (counter_+1)*0x9E3779B97F4A7C15ULL); }
+
+	// Return the uniform random number in [0, 1) for a counter.
+	double Uniform(const unsigned long long &counter_) const { return (Get(counter_) >> 11) * (1.0/9007199254740992.0); }
+
+  private:
+	unsigned long long key;
+};
+
+// Angular bins used by AcceptanceMC.
+class AcceptanceBins{
+  public:
+	AcceptanceBins() : uniform(true), low(0), high(0), invWidth(0) { }
+
+	void Set(const int &nBins_, const double &low_, const double &high_);
+
+	void Set(const std::vector<double> &edges_);
+
+	size_t size() const { return (edges.empty() ? 0 : edges.size()-1); }
+
+	const std::vector<double> &GetEdges() const { return edges; }
+
+	// Return the bin containing an angle, or -1 if the angle is outside of the bins.
+	int Find(const double &angle_) const ;
+
+  private:
+	std::vector<double> edges;
+
+	bool uniform;
+	double low, high;
+	double invWidth;
+};
+
+// Detector volume sampled by AcceptanceMC. The width, height, and length of the detector are along the
+// x, y, and z axes of its frame, which is rotated into the lab frame by the PositionCal rotation matrix.
+class AcceptanceDetector{
+  public:
+	int loc;
+
+	double position[3]; // Center of the detector in the lab frame (m).
+	double rotation[9]; // Row-major rotation matrix of the detector.
+	double halfSize[3]; // Half of the width, height, and length of the detector (m).
+
+	double normal[3]; // Axis of the detector which is most nearly facing the origin.
+	double depth; // Thickness of the detector along the facing axis (m).
+	double faceArea; // Area of the face perpendicular to the facing axis (m^2).
+
+	double minAngle; // Minimum lab angle of all samples (deg).
+	double maxAngle; // Maximum lab angle of all samples (deg).
+	double solidAngle; // Solid angle subtended at the origin (sr).
+
+	AcceptanceDetector() : loc(-1), depth(0), faceArea(0), minAngle(180), maxAngle(0), solidAngle(0) { }
+
+	AcceptanceDetector(const int &loc_, PositionCal *pos_, const double &width_, const double &height_, const double &length_);
+};
+
+// Multithreaded Monte-Carlo estimate of the angular acceptance of a detector array. Interaction points
+// are sampled uniformly over the volume of each detector. The acceptance histograms hold the number of
+// samples in each angular bin divided by the number of samples per detector, summed over all detectors
+// (in units of detectors), and the solid angle histograms hold the solid angle (sr) subtended at the
+// origin. The solid angle of a sample is that of its share of the detector face which is most nearly
+// facing the origin. The samples, and the sums of each task, are the same for any number of threads.
+class AcceptanceMC{
+  public:
+	AcceptanceMC();
+
+	void SetSeed(const unsigned long long &seed_){ seed = seed_; }
+
+	void SetThreads(const unsigned int &threads_){ numThreads = threads_; }
+
+	void SetLabBins(const int &nBins_, const double &low_, const double &high_){ labBins.Set(nBins_, low_, high_); }
+
+	void SetLabBins(const std::vector<double> &edges_){ labBins.Set(edges_); }
+
+	void SetComBins(const int &nBins_, const double &low_, const double &high_){ comBins.Set(nBins_, low_, high_); }
+
+	void SetComBins(const std::vector<double> &edges_){ comBins.Set(edges_); }
+
+	// Set the lab to CoM table used to fill the CoM histograms. No CoM histograms are filled if NULL.
+	void SetKinematics(const kinematicsTable *table_){ kinematics = table_; }
+
+	// Add a detector with dimensions in m.
+	bool AddDetector(const int &loc_, PositionCal *pos_, const double &width_, const double &height_, const double &length_);
+
+	// Add all detectors with a position calibration. The dimensions of each bar are taken from its bar
+	// calibration (if loaded) or from the default dimensions (m). Returns the number of detectors added.
+	size_t AddDetectors(CalibFile &calib_, const double &width_, const double &height_, const double &length_, const bool &evenOnly_=true);
+
+	size_t GetNumDetectors() const { return detectors.size(); }
+
+	const AcceptanceDetector &GetDetector(const size_t &index_) const { return detectors.at(index_); }
+
+	const AcceptanceBins &GetLabBins() const { return labBins; }
+
+	const AcceptanceBins &GetComBins() const { return comBins; }
+
+	const std::vector<double> &GetLabAcceptance() const { return labAcceptance; }
+
+	const std::vector<double> &GetLabSolidAngle() const { return labSolidAngle; }
+
+	const std::vector<double> &GetComAcceptance() const { return comAcceptance; }
+
+	const std::vector<double> &GetComSolidAngle() const { return comSolidAngle; }
+
+	// Return the number of samples processed per second by the last run.
+	double GetRate() const { return rate; }
+
+	// Sample numSamples_ interaction points in each detector and fill the histograms.
+	bool Run(const unsigned long long &numSamples_);
+
+  private:
+	class Task;
+	class TaskSum;
+	class Result;
+
+	unsigned long long seed;
+	unsigned int numThreads;
+
+	AcceptanceBins labBins;
+	AcceptanceBins comBins;
+
+	const kinematicsTable *kinematics;
+
+	std::vector<AcceptanceDetector> detectors;
+
+	std::vector<double> labAcceptance;
+	std::vector<double> labSolidAngle;
+	std::vector<double> comAcceptance;
+	std::vector<double> comSolidAngle;
+
+	double rate;
+
+	void process(const std::vector<Task> *tasks_, std::atomic<size_t> *next_, std::vector<TaskSum> *sums_, Result *result_, const unsigned long long &numSamples_) const ;
+};
+
+#endif
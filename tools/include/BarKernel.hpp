@@ -0,0 +1,98 @@
+#ifndef BARKERNEL_HPP
+#define BARKERNEL_HPP
+
+#include <vector>
+
+class CalibFile;
+
+// Columns of detector hits which are calibrated together by BarKernel.
+class BarColumns{
+  public:
+	// Input columns.
+	std::vector<unsigned short> loc;
+	std::vector<double> tdiff_L, tdiff_R;
+	std::vector<float> tqdc_L, tqdc_R;
+	std::vector<double> xdet, ydet; // Transverse position of the hit inside the detector (m).
+
+	// Output columns.
+	std::vector<char> valid;
+	std::vector<double> ybar; // Position of the hit along the bar (m).
+	std::vector<double> tdiff, lbal, tof, ctof, tqdc, ctqdc;
+	std::vector<double> x, y, z, r, theta, phi;
+	std::vector<double> energy, centerE;
+
+	size_t size() const { return loc.size(); }
+
+	bool empty() const { return loc.empty(); }
+
+	void clear();
+
+	void push_back(const unsigned short &loc_, const double &tdiff_L_, const double &tdiff_R_, const float &tqdc_L_, const float &tqdc_R_, const double &xdet_=0, const double &ydet_=0);
+};
+
+// Calibrate columns of bar (or single-ended) detector hits using flattened per-location calibration arrays.
+class BarKernel{
+  public:
+	BarKernel();
+
+	// Build the per-location arrays from the loaded calibration. With averageTimeOffsets_ set, the mean of the
+	// left and right time offsets is subtracted from the tof (pspmt). Otherwise, the left time offset is only
+	// subtracted from the corrected tof (barifier). A positive energyOffset_ (MeV) shifts the tof of all hits.
+	bool Build(CalibFile &calib_, const bool &singleEnded_, const bool &useTime_, const bool &useEnergy_, const bool &usePosition_,
+	           const bool &lightBalance_, const bool &averageTimeOffsets_=false, const double &energyOffset_=0);
+
+	// Return true if a hit at location loc_ has a valid TQDC and all required calibration entries.
+	bool Check(const unsigned short &loc_, const float &tqdc_L_, const float &tqdc_R_) const {
+		return (loc_ < numLoc && usable[loc_] && tqdc_L_ > 0 && (singleEnded || tqdc_R_ > 0));
+	}
+
+	// Return half of the width of the bar at location loc_ (m).
+	double GetHalfWidth(const unsigned short &loc_) const { return (loc_ < numLoc ? halfWidth[loc_] : 0); }
+
+	// Return half of the height of the bar at location loc_ (m).
+	double GetHalfHeight(const unsigned short &loc_) const { return (loc_ < numLoc ? halfHeight[loc_] : 0); }
+
+	// Return the time difference offset of the bar at location loc_ (ns).
+	double GetBarOffset(const unsigned short &loc_) const { return (loc_ < numLoc ? barT0[loc_] : 0); }
+
+	// Return the distance from the origin to a point (m) in the frame of the detector at location loc_.
+	double GetDistance(const unsigned short &loc_, const double &x_, const double &y_, const double &z_) const ;
+
+	// Calibrate all hits in the input columns and fill the output columns. The energy at the central axis
+	// of the bar is only computed if centerEnergy_ is set. Returns the number of valid hits.
+	size_t Process(BarColumns &cols_, const bool &centerEnergy_=false);
+
+  private:
+	enum EnergyMode {ECAL_NONE=0, ECAL_SINGLE=1, ECAL_PAIR=2, ECAL_INDIVIDUAL=3};
+
+	size_t numLoc; // Number of locations. All arrays have one extra (zeroed) entry used for invalid hits.
+
+	bool singleEnded;
+	bool useEnergy;
+	bool usePosition;
+	bool lightBalance;
+
+	std::vector<char> usable; // Set if all calibration entries required for a location are loaded.
+
+	std::vector<double> barT0; // Bar time difference (or light balance) offset.
+	std::vector<double> yScale; // Conversion from time difference (or light balance) to position along the bar.
+	std::vector<double> halfWidth;
+	std::vector<double> halfHeight;
+
+	std::vector<double> tofOffset; // Subtracted from the tof.
+	std::vector<double> ctofShift; // Added to the tof to get the corrected tof.
+
+	std::vector<double> position; // Position of the detector (3 per location).
+	std::vector<double> rotation; // Row-major rotation matrix of the detector (9 per location).
+
+	std::vector<int> ecalMode;
+	std::vector<unsigned int> ecalLeft, ecalRight; // Index of the first polynomial coefficient.
+	std::vector<unsigned int> ecalLeftSize, ecalRightSize; // Number of polynomial coefficients.
+	std::vector<double> coefficients;
+
+	std::vector<unsigned short> slot; // Location used for each hit, or numLoc for invalid hits.
+
+	double calEnergy(const unsigned int &start_, const unsigned int &size_, const double &adc_) const ;
+};
+
+#endif
@@ -98,6 +98,8 @@ class EnergyCal : public CalType {
 	
 	double GetCalEnergy(const double &adc_);
 
+	const std::vector<double> &GetCoefficients() const { return vals; }
+
 	virtual std::string Print(bool fancy=true);
 
 	virtual unsigned int ReadPars(const std::vector<std::string> &pars_);
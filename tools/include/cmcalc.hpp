@@ -1,6 +1,9 @@
 #ifndef CMCALC_HPP
 #define CMCALC_HPP
 
+#include <string>
+#include <vector>
+
 extern const double c, cSquare, pi, twoPi;
 extern const double proton_RME, neutron_RME;
 extern const double mev2amu, mev2kg;
@@ -31,6 +34,50 @@ class particle{
 	std::string print(bool bothSolutions=true);
 };
 
+class kinematicsTable{
+  public:
+	kinematicsTable() : Vcm(0.0), partVcm(0.0), mass(0.0), inverseKin(false), maxAngle(0.0), step(0.0), invStep(0.0), numCells(0), numExact(0) { }
+
+	// Tabulate the CoM angle and energy of the first solution as a function of lab angle. Cells for which
+	// linear interpolation misses the exact solution at the cell center by more than angleTol_ (deg) or
+	// energyTol_ (relative) are computed exactly when evaluated.
+	bool Build(const double &Vcm_, const double &partVcm_, const double &mass_, const bool &inverseKin_, const double &angleTol_=1E-3, const double &energyTol_=1E-5);
+
+	void Clear();
+
+	bool Empty() const { return (numCells == 0); }
+
+	size_t GetNumCells() const { return numCells; }
+
+	size_t GetNumExactCells() const { return numExact; }
+
+	double GetMaxAngle() const { return maxAngle; }
+
+	// Return the CoM angle (deg) and energy (MeV) for a lab angle (deg). Returns false if there is no solution.
+	bool Evaluate(const double &thetaLab_, double &thetaCom_, double &energy_) const ;
+
+	// Evaluate an array of N_ lab angles. The energy array may be NULL. Angles without a solution are set
+	// to -1. Returns the number of lab angles with a solution.
+	size_t Evaluate(const double *thetaLab_, double *thetaCom_, double *energy_, const size_t &N_) const ;
+
+  private:
+	double Vcm, partVcm, mass;
+	bool inverseKin;
+
+	double maxAngle; // Maximum lab angle in the table (deg).
+	double step, invStep;
+	size_t numCells;
+	size_t numExact;
+
+	std::vector<double> comAngle; // CoM angle at each node (numCells+1).
+	std::vector<double> energy; // Energy at each node (numCells+1).
+	std::vector<char> exact; // Set for cells which are computed exactly (numCells).
+
+	bool calculate(const double &thetaLab_, double &thetaCom_, double &energy_) const ;
+
+	void fill(const size_t &N_);
+};
+
 class reaction{
   private:
 	double Mbeam, Mtarg, Mrecoil, Meject;
@@ -46,6 +93,9 @@ class reaction{
 	
 	particle recoilPart;
 	particle ejectPart;
+
+	kinematicsTable recoilTable;
+	kinematicsTable ejectTable;
 	
 	void Calculate();
 	
@@ -109,6 +159,19 @@ class reaction{
 	void SetLabAngle(const double &thetaLab_);
 	
 	void SetComAngle(const double &thetaCom_);
+
+	// Build lab to CoM lookup tables for the recoil and ejectile. Must be called again if the reaction changes.
+	bool BuildTables(const double &angleTol_=1E-3, const double &energyTol_=1E-5);
+
+	const kinematicsTable *GetRecoilTable(){ return &recoilTable; }
+
+	const kinematicsTable *GetEjectileTable(){ return &ejectTable; }
+
+	// Return the CoM angle and energy of the first ejectile solution for a lab angle, using the lookup table if it was built.
+	bool LabToCom(const double &thetaLab_, double &thetaCom_, double &energy_, const bool &recoil_=false);
+
+	// Return the CoM angles (and energies, if energy_ is not NULL) for an array of N_ lab angles.
+	size_t LabToCom(const double *thetaLab_, double *thetaCom_, double *energy_, const size_t &N_, const bool &recoil_=false);
 	
 	void Print();
 };
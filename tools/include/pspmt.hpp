@@ -6,6 +6,7 @@
 #include <deque>
 
 #include "CalibFile.hpp"
+#include "BarKernel.hpp"
 #include "simpleTool.hpp"
 #include "PSPmtMap.hpp"
 
@@ -227,6 +228,9 @@ class pspmtHandler : public simpleTool {
 
 	CalibFile calib;
 
+	BarKernel kernel;
+	BarColumns columns;
+
 	pspmtMap map;
 	pspmtBarMap barmap;
 	
@@ -6,6 +6,7 @@
 // These need to be global.
 extern size_t Nelements;
 extern double *xval, *yval;
+extern interpolator theoryCurve;
 
 double comp(double *x, double *p);
 
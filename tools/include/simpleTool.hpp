@@ -4,6 +4,9 @@
 #include <vector>
 #include <deque>
 #include <string>
+#include <map>
+#include <atomic>
+#include <ostream>
 #include <getopt.h>
 
 #include "ScanInterface.hpp"
@@ -48,23 +51,52 @@ bool splitByColon(const std::string &str, int &left, int &right, const char &del
 // Split a filename into path and extension.
 bool splitFilename(const std::string &str, std::string &left, std::string &right, const char &delim='.');
 
+/** Piecewise linear interpolation of a tabulated distribution. Points are sorted by x when loaded.
+  * Evenly spaced points are looked up directly, otherwise a binary search is used which first checks
+  * the interval found by the previous lookup (and its neighbor), since successive lookups are usually close.
+  */
 class interpolator{
   public:
 	interpolator();
 
 	interpolator(const char *fname_);
 
+	interpolator(const double *x_, const double *y_, const size_t &N_);
+
 	bool load(const char *fname_);
 
+	bool setPoints(const double *x_, const double *y_, const size_t &N_);
+
 	bool interpolate(const double &x_, double &y);
 
 	double interpolate(const double &x_);
 
+	/** Interpolate an array of values.
+	  * \param[in]  x_ Array of values to interpolate.
+	  * \param[out] y Array of interpolated values. Values outside the range of the points are set to defaultVal_.
+	  * \param[in]  N_ Length of the arrays.
+	  * \param[in]  defaultVal_ Value used for points which are out of range.
+	  * \return The number of values which were in range.
+	  */
+	size_t interpolate(const double *x_, double *y, const size_t &N_, const double &defaultVal_=-9999);
+
 	bool empty(){ return xvals.empty(); }
 
+	bool uniform(){ return isUniform; }
+
+	size_t size(){ return xvals.size(); }
+
   private:
 	std::vector<double> xvals;
 	std::vector<double> yvals;
+
+	bool isUniform; ///< Set if the points are evenly spaced in x.
+	double xstep; ///< Spacing between points (if evenly spaced).
+	size_t lastIndex; ///< Upper index of the interval found by the previous lookup.
+
+	void prepare();
+
+	bool findInterval(const double &x_, size_t &index);
 };
 
 class progressBar{
@@ -82,6 +114,41 @@ class progressBar{
 	void check(const long long &entry_);
 
 	void finalize();
+
+	void update(const long long &entry_);
+};
+
+/** Per-entry analysis of a simpleTool which is run by a single thread of simpleTool::processParallel.
+  * Each worker reads its own copy of the input tree, writes to its own output buffers, and fills
+  * its own histograms. The histograms are added to those of the tool by merge().
+  */
+class simpleToolWorker{
+  public:
+	virtual ~simpleToolWorker(){ }
+
+	/** Set the addresses of all branches read from the input tree. Called whenever the worker opens an input file.
+	  * \param[in]  intree_ Pointer to the input tree.
+	  * \param[in]  fileIndex_ Index of the input file, in the order in which the input files were specified.
+	  * \return True if all required branches were found and false otherwise.
+	  */
+	virtual bool setInputBranches(TTree *intree_, const size_t &fileIndex_) = 0;
+
+	/** Add the output branches of this worker to a tree. Only called if the tool has an output tree.
+	  * \param[in]  outtree_ Pointer to the tree.
+	  * \return Nothing.
+	  */
+	virtual void setOutputBranches(TTree *outtree_){ }
+
+	/** Process the current entry of the input tree.
+	  * \return True if the output buffers should be written to the output tree and false otherwise.
+	  */
+	virtual bool processEntry() = 0;
+
+	/** Add the histograms filled by this worker to those of the tool. Called from the main thread,
+	  * in worker order, once all entries have been processed.
+	  * \return Nothing.
+	  */
+	virtual void merge(){ }
 };
 
 class simpleTool{
@@ -125,6 +192,8 @@ class simpleTool{
 	long long max_entries_to_process;
 	long long current_entry;
 
+	unsigned int num_threads; /// Number of threads used by processParallel.
+
 	progressBar pbar;
 
 	virtual void addOptions(){ }
@@ -142,6 +211,20 @@ class simpleTool{
 	  */
 	virtual bool getNextEntry();
 
+	/** Return a new worker for processParallel. Tools which support parallel processing must override this method.
+	  * \return Pointer to a new worker, which is owned by the caller, or NULL if parallel processing is not supported.
+	  */
+	virtual simpleToolWorker *createWorker(){ return NULL; }
+
+	/** Process all entries of all input files using a pool of threads. The entries of each file are split
+	  * along the cluster boundaries of the input tree and processed by the workers returned by createWorker().
+	  * Output entries are copied to the output tree (if there is one) in input order, and the histograms of
+	  * all workers are merged once all entries have been processed. If the output tree has no branches, the
+	  * output branches of a worker are added to it. Consumes the list of input files.
+	  * \return True if all input files were processed and false otherwise.
+	  */
+	bool processParallel();
+
 	/** Get the full pathname from an input string.
 	  * \param[in]  path_ The user specified filename. May be relative or absolute.
 	  * \return String containing the full path to the input file.
@@ -199,6 +282,16 @@ class simpleHistoFitter : public simpleTool {
 
 	bool useProjX;
 
+	bool batchMode; /// Fit all projections without user input using a pool of threads.
+
+	std::string seed_filename; /// Results of a previous run used to seed batch fits.
+
+	std::map<std::string, std::vector<std::vector<double> > > seeds; /// Previous results for each projection label.
+
+	std::string cache_dir; /// Directory containing cached 2d histograms.
+
+	std::vector<std::string> fill_exprs; /// Expressions for the x and y axes of the 2d histogram.
+
 	bool getProjectionX(TH1 *h1_, TH2 *h2_, const int &binY_);
 	
 	bool getProjectionY(TH1 *h1_, TH2 *h2_, const int &binX_);	
@@ -215,6 +308,58 @@ class simpleHistoFitter : public simpleTool {
 
 	double getMaximum(TH1 *h1_, const double &lowVal_, const double &highVal_, double &mean);
 
+	/** Extract all projections of a 2d histogram in a single pass over its bins.
+	  * \param[in]  h2_ Pointer to the 2d histogram.
+	  * \param[out] hists_ Projection histograms, indexed by bin-1. Empty projections and projections outside
+	  *                    of the user range are NULL. The histograms are owned by the caller.
+	  * \return The number of non-empty projections.
+	  */
+	int getAllProjections(TH2 *h2_, std::vector<TH1D*> &hists_);
+
+	/** Return a new worker which fills a copy of the 2d histogram from the draw and expression strings.
+	  */
+	virtual simpleToolWorker *createWorker();
+
+	/** Fill the 2d histogram from the draw and expression strings using all entries of all input files.
+	  * The binning is taken from a histogram drawn from the first input file, then the entries of all
+	  * input files are processed in parallel. Consumes the list of input files.
+	  * \return True upon success and false otherwise.
+	  */
+	bool fillFromTrees();
+
+	/** Get the key describing the input files and expressions used to fill the 2d histogram.
+	  */
+	std::string getCacheKey();
+
+	/** Get the results of a previous run for a projection, as read from the seed file.
+	  * \param[in]  label_ Label of the projection (the low edge of its bin).
+	  * \return Pointer to the rows of results for the projection, or NULL if there are none.
+	  */
+	const std::vector<std::vector<double> > *getSeeds(const std::string &label_);
+
+	/** Fit a single projection in batch mode. Called concurrently by several threads, so implementations
+	  * must only use their own fit objects and must not draw anything.
+	  * \param[in]  h1_ Projection histogram.
+	  * \param[in]  label_ Label of the projection (the low edge of its bin).
+	  * \param[out] log_ Console output for the projection.
+	  * \param[out] results_ Lines to write to the fit results file.
+	  * \param[out] calib_ Lines to write to the calibration file.
+	  * \return True if the fit succeeded and false otherwise.
+	  */
+	virtual bool fitProjection(TH1D *h1_, const std::string &label_, std::ostream &log_, std::ostream &results_, std::ostream &calib_){ return false; }
+
+	/** Fit all projections concurrently using fitProjection(). The results are written in projection order once
+	  * all fits are done, and all fitted projections are written to fitresults.root for review.
+	  * \param[in]  resultsHeader_ Header of the fit results file (fitresults.dat).
+	  * \param[in]  calFilename_ Name of the calibration file (not written if empty).
+	  * \param[in]  calHeader_ Header of the calibration file.
+	  * \return True if at least one projection was fitted and false otherwise.
+	  */
+	bool processBatch(const std::string &resultsHeader_, const std::string &calFilename_="", const std::string &calHeader_="");
+
+	void fitProjections(const std::vector<TH1D*> *hists_, std::atomic<size_t> *nextProj_, std::vector<std::string> *logs_,
+	                    std::vector<std::string> *results_, std::vector<std::string> *calibs_, std::vector<char> *success_);
+
 	void addOptions();
 	
 	bool processArgs();
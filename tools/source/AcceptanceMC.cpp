@@ -0,0 +1,327 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "AcceptanceMC.hpp"
+#include "CalibFile.hpp"
+#include "cmcalc.hpp"
+
+#define ACCEPTANCE_TASK_SAMPLES 65536 // Number of samples processed by a thread at once.
+#define ACCEPTANCE_BATCH_SAMPLES 4096 // Number of samples converted to angles at once.
+
+const double rad2deg = 57.29577951308232;
+
+///////////////////////////////////////////////////////////////////////////////
+// class AcceptanceBins
+///////////////////////////////////////////////////////////////////////////////
+
+void AcceptanceBins::Set(const int &nBins_, const double &low_, const double &high_){
+	edges.clear();
+	if(nBins_ <= 0 || high_ <= low_) return;
+	for(int i = 0; i <= nBins_; i++)
+		edges.push_back(low_ + i*(high_-low_)/nBins_);
+	uniform = true;
+	low = low_;
+	high = high_;
+	invWidth = nBins_/(high_-low_);
+}
+
+void AcceptanceBins::Set(const std::vector<double> &edges_){
+	edges = edges_;
+	std::sort(edges.begin(), edges.end());
+	if(edges.size() < 2){
+		edges.clear();
+		return;
+	}
+	uniform = false;
+	low = edges.front();
+	high = edges.back();
+	invWidth = 0;
+}
+
+int AcceptanceBins::Find(const double &angle_) const {
+	if(!(angle_ >= low) || angle_ >= high) return -1;
+	if(uniform){
+		int bin = (int)((angle_-low)*invWidth);
+		return (bin < (int)edges.size()-1 ? bin : (int)edges.size()-2);
+	}
+	return (int)(std::upper_bound(edges.begin(), edges.end(), angle_) - edges.begin()) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class AcceptanceDetector
+///////////////////////////////////////////////////////////////////////////////
+
+AcceptanceDetector::AcceptanceDetector(const int &loc_, PositionCal *pos_, const double &width_, const double &height_, const double &length_) :
+	loc(loc_), minAngle(180), maxAngle(0), solidAngle(0) {
+	halfSize[0] = width_/2;
+	halfSize[1] = height_/2;
+	halfSize[2] = length_/2;
+
+	for(int i = 0; i < 3; i++){
+		position[i] = pos_->position.axis[i];
+		for(int j = 0; j < 3; j++)
+			rotation[3*i+j] = pos_->rotMatrix.components[i][j];
+	}
+
+	// Find the axis of the detector which is most nearly parallel to the direction of the origin.
+	double r = std::sqrt(position[0]*position[0] + position[1]*position[1] + position[2]*position[2]);
+	int facing = 0;
+	double maxCosine = -1;
+	for(int j = 0; j < 3; j++){
+		double cosine = (r > 0 ? std::fabs(rotation[j]*position[0] + rotation[3+j]*position[1] + rotation[6+j]*position[2])/r : 0);
+		if(cosine > maxCosine){
+			maxCosine = cosine;
+			facing = j;
+		}
+	}
+
+	for(int i = 0; i < 3; i++)
+		normal[i] = rotation[3*i+facing];
+	depth = 2*halfSize[facing];
+	faceArea = 8*halfSize[0]*halfSize[1]*halfSize[2]/depth;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class AcceptanceMC
+///////////////////////////////////////////////////////////////////////////////
+
+/// Range of samples of a single detector.
+class AcceptanceMC::Task{
+  public:
+	size_t detector;
+	unsigned long long first;
+	unsigned long long last;
+
+	Task(const size_t &detector_, const unsigned long long &first_, const unsigned long long &last_) : detector(detector_), first(first_), last(last_) { }
+};
+
+/// Solid angle sums of a single task over the range of bins which it filled.
+class AcceptanceMC::TaskSum{
+  public:
+	size_t labFirst;
+	size_t comFirst;
+	std::vector<double> lab;
+	std::vector<double> com;
+
+	double solidAngle;
+
+	TaskSum() : labFirst(0), comFirst(0), solidAngle(0) { }
+};
+
+/// Histograms and detector results filled by a single thread.
+class AcceptanceMC::Result{
+  public:
+	std::vector<unsigned long long> labCounts;
+	std::vector<unsigned long long> comCounts;
+	std::vector<double> labSolidAngle; // Solid angle sums of the current task.
+	std::vector<double> comSolidAngle; // Solid angle sums of the current task.
+
+	std::vector<double> minAngle;
+	std::vector<double> maxAngle;
+
+	Result(const size_t &numLab_, const size_t &numCom_, const size_t &numDet_) : labCounts(numLab_, 0), comCounts(numCom_, 0), labSolidAngle(numLab_, 0), comSolidAngle(numCom_, 0),
+	                                                                           minAngle(numDet_, 180), maxAngle(numDet_, 0) { }
+};
+
+/// Move the sums in bins [low_, high_] of the current task into the sums of the task and zero them.
+static void moveSums(std::vector<double> &current_, const int &low_, const int &high_, size_t &first_, std::vector<double> &sums_){
+	first_ = (low_ <= high_ ? low_ : 0);
+	sums_.clear();
+	for(int i = low_; i <= high_; i++){
+		sums_.push_back(current_[i]);
+		current_[i] = 0;
+	}
+}
+
+AcceptanceMC::AcceptanceMC() : seed(0), numThreads(1), kinematics(NULL), rate(0) {
+	labBins.Set(180, 0, 180);
+	comBins.Set(180, 0, 180);
+}
+
+bool AcceptanceMC::AddDetector(const int &loc_, PositionCal *pos_, const double &width_, const double &height_, const double &length_){
+	if(!pos_ || width_ <= 0 || height_ <= 0 || length_ <= 0) return false;
+	detectors.push_back(AcceptanceDetector(loc_, pos_, width_, height_, length_));
+	return true;
+}
+
+size_t AcceptanceMC::AddDetectors(CalibFile &calib_, const double &width_, const double &height_, const double &length_, const bool &evenOnly_/*=true*/){
+	size_t count = 0;
+	for(size_t loc = 0; loc < calib_.GetMaxPosition(); loc++){
+		// Bar detectors must be even.
+		if(evenOnly_ && loc % 2 != 0) continue;
+
+		PositionCal *pos = calib_.GetPositionCal(loc);
+		if(!pos || pos->defaultVals) continue;
+
+		// Bar dimensions are in cm.
+		BarCal *bar = calib_.GetBarCal(loc);
+		if(bar && !bar->defaultVals){
+			if(AddDetector(loc, pos, bar->width/100, bar->height/100, bar->length/100)) count++;
+		}
+		else if(AddDetector(loc, pos, width_, height_, length_)) count++;
+	}
+	return count;
+}
+
+bool AcceptanceMC::Run(const unsigned long long &numSamples_){
+	if(detectors.empty() || numSamples_ == 0 || labBins.size() == 0) return false;
+
+	// Split the samples of each detector into tasks.
+	std::vector<Task> tasks;
+	for(size_t i = 0; i < detectors.size(); i++){
+		for(unsigned long long first = 0; first < numSamples_; first += ACCEPTANCE_TASK_SAMPLES)
+			tasks.push_back(Task(i, first, std::min(first+ACCEPTANCE_TASK_SAMPLES, numSamples_)));
+	}
+
+	unsigned int nThreads = (numThreads < tasks.size() ? numThreads : tasks.size());
+	if(nThreads == 0) nThreads = 1;
+
+	size_t numCom = (kinematics ? comBins.size() : 0);
+	std::vector<Result*> results;
+	for(unsigned int i = 0; i < nThreads; i++)
+		results.push_back(new Result(labBins.size(), numCom, detectors.size()));
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::atomic<size_t> next(0);
+	std::vector<TaskSum> sums(tasks.size());
+	std::vector<std::thread> threads;
+	for(unsigned int i = 0; i < nThreads; i++)
+		threads.push_back(std::thread(&AcceptanceMC::process, this, &tasks, &next, &sums, results[i], numSamples_));
+	for(std::vector<std::thread>::iterator iter = threads.begin(); iter != threads.end(); iter++)
+		iter->join();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	rate = (elapsed > 0 ? numSamples_*detectors.size()/elapsed : 0);
+
+	// Merge the results of all threads. Counts are integers, so the acceptance does not depend on the number of threads.
+	std::vector<unsigned long long> labCounts(labBins.size(), 0);
+	std::vector<unsigned long long> comCounts(numCom, 0);
+	for(size_t i = 0; i < detectors.size(); i++){
+		detectors[i].minAngle = 180;
+		detectors[i].maxAngle = 0;
+		detectors[i].solidAngle = 0;
+	}
+	for(std::vector<Result*>::iterator iter = results.begin(); iter != results.end(); iter++){
+		for(size_t i = 0; i < labCounts.size(); i++)
+			labCounts[i] += (*iter)->labCounts[i];
+		for(size_t i = 0; i < comCounts.size(); i++)
+			comCounts[i] += (*iter)->comCounts[i];
+		for(size_t i = 0; i < detectors.size(); i++){
+			detectors[i].minAngle = std::min(detectors[i].minAngle, (*iter)->minAngle[i]);
+			detectors[i].maxAngle = std::max(detectors[i].maxAngle, (*iter)->maxAngle[i]);
+		}
+		delete (*iter);
+	}
+
+	// Add the solid angle sums in task order, so that they do not depend on the number of threads.
+	labSolidAngle.assign(labBins.size(), 0);
+	comSolidAngle.assign(numCom, 0);
+	for(size_t i = 0; i < tasks.size(); i++){
+		const TaskSum &sum = sums[i];
+		for(size_t j = 0; j < sum.lab.size(); j++)
+			labSolidAngle[sum.labFirst+j] += sum.lab[j];
+		for(size_t j = 0; j < sum.com.size(); j++)
+			comSolidAngle[sum.comFirst+j] += sum.com[j];
+		detectors[tasks[i].detector].solidAngle += sum.solidAngle;
+	}
+
+	labAcceptance.resize(labCounts.size());
+	for(size_t i = 0; i < labCounts.size(); i++)
+		labAcceptance[i] = (double)labCounts[i]/numSamples_;
+	comAcceptance.resize(comCounts.size());
+	for(size_t i = 0; i < comCounts.size(); i++)
+		comAcceptance[i] = (double)comCounts[i]/numSamples_;
+
+	return true;
+}
+
+void AcceptanceMC::process(const std::vector<Task> *tasks_, std::atomic<size_t> *next_, std::vector<TaskSum> *sums_, Result *result_, const unsigned long long &numSamples_) const {
+	double x[ACCEPTANCE_BATCH_SAMPLES];
+	double y[ACCEPTANCE_BATCH_SAMPLES];
+	double z[ACCEPTANCE_BATCH_SAMPLES];
+	double theta[ACCEPTANCE_BATCH_SAMPLES];
+	double weight[ACCEPTANCE_BATCH_SAMPLES];
+	double com[ACCEPTANCE_BATCH_SAMPLES];
+
+	while(true){
+		size_t index = (*next_)++;
+		if(index >= tasks_->size()) break;
+
+		const Task &task = (*tasks_)[index];
+		const AcceptanceDetector &det = detectors[task.detector];
+		const double *rot = det.rotation;
+		const double *pos = det.position;
+		const double *half = det.halfSize;
+
+		// Each detector has its own stream, and each sample uses three counters of the stream.
+		CounterRNG rng(seed ^ CounterRNG::Hash(det.loc+1));
+		double sampleArea = det.faceArea/numSamples_;
+
+		double &minAngle = result_->minAngle[task.detector];
+		double &maxAngle = result_->maxAngle[task.detector];
+
+		// Range of bins filled by this task.
+		int labLow = (int)labBins.size(), labHigh = -1;
+		int comLow = (int)comBins.size(), comHigh = -1;
+
+		TaskSum &sum = (*sums_)[index];
+		double &solidAngle = sum.solidAngle;
+
+		for(unsigned long long first = task.first; first < task.last; first += ACCEPTANCE_BATCH_SAMPLES){
+			size_t n = (size_t)std::min((unsigned long long)ACCEPTANCE_BATCH_SAMPLES, task.last-first);
+
+			// Sample points in the frame of the detector and rotate them to the lab frame.
+			for(size_t i = 0; i < n; i++){
+				unsigned long long counter = 3*(first+i);
+				double u = (2*rng.Uniform(counter)-1)*half[0];
+				double v = (2*rng.Uniform(counter+1)-1)*half[1];
+				double w = (2*rng.Uniform(counter+2)-1)*half[2];
+				x[i] = pos[0] + rot[0]*u + rot[1]*v + rot[2]*w;
+				y[i] = pos[1] + rot[3]*u + rot[4]*v + rot[5]*w;
+				z[i] = pos[2] + rot[6]*u + rot[7]*v + rot[8]*w;
+			}
+
+			// Compute the lab angle and the solid angle of each sample.
+			for(size_t i = 0; i < n; i++){
+				double r2 = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+				double r = std::sqrt(r2);
+				theta[i] = std::acos(z[i]/r)*rad2deg;
+				weight[i] = sampleArea*std::fabs(x[i]*det.normal[0] + y[i]*det.normal[1] + z[i]*det.normal[2])/(r2*r);
+			}
+
+			for(size_t i = 0; i < n; i++){
+				int bin = labBins.Find(theta[i]);
+				if(bin >= 0){
+					result_->labCounts[bin]++;
+					result_->labSolidAngle[bin] += weight[i];
+					if(bin < labLow) labLow = bin;
+					if(bin > labHigh) labHigh = bin;
+				}
+				if(theta[i] < minAngle) minAngle = theta[i];
+				if(theta[i] > maxAngle) maxAngle = theta[i];
+				solidAngle += weight[i];
+			}
+
+			if(!kinematics) continue;
+
+			kinematics->Evaluate(theta, com, NULL, n);
+			for(size_t i = 0; i < n; i++){
+				if(!(com[i] >= 0)) continue;
+				int bin = comBins.Find(com[i]);
+				if(bin >= 0){
+					result_->comCounts[bin]++;
+					result_->comSolidAngle[bin] += weight[i];
+					if(bin < comLow) comLow = bin;
+					if(bin > comHigh) comHigh = bin;
+				}
+			}
+		}
+
+		moveSums(result_->labSolidAngle, labLow, labHigh, sum.labFirst, sum.lab);
+		moveSums(result_->comSolidAngle, comLow, comHigh, sum.comFirst, sum.com);
+	}
+}
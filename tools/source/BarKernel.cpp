@@ -0,0 +1,307 @@
+#include <cmath>
+
+#include "BarKernel.hpp"
+#include "CalibFile.hpp"
+#include "Vector3.hpp"
+#include "simpleTool.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// class BarColumns
+///////////////////////////////////////////////////////////////////////////////
+
+void BarColumns::clear(){
+	loc.clear();
+	tdiff_L.clear();
+	tdiff_R.clear();
+	tqdc_L.clear();
+	tqdc_R.clear();
+	xdet.clear();
+	ydet.clear();
+}
+
+void BarColumns::push_back(const unsigned short &loc_, const double &tdiff_L_, const double &tdiff_R_, const float &tqdc_L_, const float &tqdc_R_, const double &xdet_/*=0*/, const double &ydet_/*=0*/){
+	loc.push_back(loc_);
+	tdiff_L.push_back(tdiff_L_);
+	tdiff_R.push_back(tdiff_R_);
+	tqdc_L.push_back(tqdc_L_);
+	tqdc_R.push_back(tqdc_R_);
+	xdet.push_back(xdet_);
+	ydet.push_back(ydet_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class BarKernel
+///////////////////////////////////////////////////////////////////////////////
+
+BarKernel::BarKernel() : numLoc(0), singleEnded(false), useEnergy(false), usePosition(false), lightBalance(false) { }
+
+bool BarKernel::Build(CalibFile &calib_, const bool &singleEnded_, const bool &useTime_, const bool &useEnergy_, const bool &usePosition_,
+                      const bool &lightBalance_, const bool &averageTimeOffsets_/*=false*/, const double &energyOffset_/*=0*/){
+	singleEnded = singleEnded_;
+	useEnergy = useEnergy_;
+	usePosition = usePosition_;
+	lightBalance = lightBalance_;
+
+	numLoc = calib_.GetMaxTime();
+	if(calib_.GetMaxEnergy() > numLoc) numLoc = calib_.GetMaxEnergy();
+	if(calib_.GetMaxPosition() > numLoc) numLoc = calib_.GetMaxPosition();
+	if(calib_.GetMaxBar() > numLoc) numLoc = calib_.GetMaxBar();
+	if(numLoc > 0xFFFF) numLoc = 0xFFFF; // Locations are stored as unsigned shorts.
+
+	// The extra entry at the end of each array is used for invalid hits.
+	const size_t size = numLoc+1;
+	usable.assign(size, 0);
+	barT0.assign(size, 0);
+	yScale.assign(size, 0);
+	halfWidth.assign(size, 0);
+	halfHeight.assign(size, 0);
+	tofOffset.assign(size, 0);
+	ctofShift.assign(size, 0);
+	position.assign(3*size, 0);
+	rotation.assign(9*size, 0);
+	ecalMode.assign(size, ECAL_NONE);
+	ecalLeft.assign(size, 0);
+	ecalRight.assign(size, 0);
+	ecalLeftSize.assign(size, 0);
+	ecalRightSize.assign(size, 0);
+	coefficients.clear();
+
+	size_t numUsable = 0;
+	for(size_t loc = 0; loc < numLoc; loc++){
+		BarCal *bar = (!singleEnded ? calib_.GetBarCal(loc) : NULL);
+		TimeCal *time = (useTime_ ? calib_.GetTimeCal(loc) : NULL);
+		PositionCal *pos = (usePosition ? calib_.GetPositionCal(loc) : NULL);
+
+		if((!singleEnded && !bar) || (useTime_ && !time) || (usePosition && !pos)) continue;
+
+		usable[loc] = 1;
+		numUsable++;
+
+		if(bar){
+			barT0[loc] = bar->t0;
+			yScale[loc] = (lightBalance ? (bar->length/100)/bar->beta : bar->cbar/200);
+			halfWidth[loc] = bar->width/200;
+			halfHeight[loc] = bar->height/200;
+		}
+
+		// Correct the gamma-flash offset for distance from source.
+		double flightTime = (pos ? 100*pos->r0/cvac : 0);
+		if(pos){
+			for(int i = 0; i < 3; i++){
+				position[3*loc+i] = pos->position.axis[i];
+				for(int j = 0; j < 3; j++)
+					rotation[9*loc+3*i+j] = pos->rotMatrix.components[i][j];
+			}
+		}
+
+		double t0_L = (time ? time->t0 : 0);
+		if(averageTimeOffsets_){
+			if(!singleEnded){
+				TimeCal *time_R = (useTime_ ? calib_.GetTimeCal(loc+1) : NULL);
+				tofOffset[loc] = (t0_L + (time_R ? time_R->t0 : 0))/2;
+			}
+			ctofShift[loc] = flightTime;
+		}
+		else // Correct timing offset. This should place the gamma-flash at t=0 ns.
+			ctofShift[loc] = flightTime - t0_L;
+
+		if(energyOffset_ > 0 && pos)
+			tofOffset[loc] -= energy2tof(energyOffset_, pos->r0) - flightTime;
+
+		if(!useEnergy) continue;
+
+		EnergyCal *ecal_L = calib_.GetEnergyCal(loc);
+		if(!singleEnded){
+			EnergyCal *ecal_R = calib_.GetEnergyCal(loc+1);
+			if(!ecal_L || ecal_L->defaultVals) continue;
+			if(!ecal_R || ecal_R->defaultVals) // Use pairwise calibration.
+				ecalMode[loc] = ECAL_PAIR;
+			else{ // Use individual channel calibration.
+				ecalMode[loc] = ECAL_INDIVIDUAL;
+				ecalRight[loc] = coefficients.size();
+				ecalRightSize[loc] = ecal_R->GetCoefficients().size();
+				coefficients.insert(coefficients.end(), ecal_R->GetCoefficients().begin(), ecal_R->GetCoefficients().end());
+			}
+		}
+		else if(ecal_L)
+			ecalMode[loc] = ECAL_SINGLE;
+		else continue;
+
+		ecalLeft[loc] = coefficients.size();
+		ecalLeftSize[loc] = ecal_L->GetCoefficients().size();
+		coefficients.insert(coefficients.end(), ecal_L->GetCoefficients().begin(), ecal_L->GetCoefficients().end());
+	}
+
+	return (numUsable > 0);
+}
+
+double BarKernel::GetDistance(const unsigned short &loc_, const double &x_, const double &y_, const double &z_) const {
+	const size_t s = (loc_ < numLoc ? loc_ : numLoc);
+	const double *rot = &rotation[9*s];
+	const double *pos = &position[3*s];
+	double px = pos[0] + rot[0]*x_ + rot[1]*y_ + rot[2]*z_;
+	double py = pos[1] + rot[3]*x_ + rot[4]*y_ + rot[5]*z_;
+	double pz = pos[2] + rot[6]*x_ + rot[7]*y_ + rot[8]*z_;
+	return std::sqrt(px*px + py*py + pz*pz);
+}
+
+size_t BarKernel::Process(BarColumns &cols_, const bool &centerEnergy_/*=false*/){
+	const size_t n = cols_.size();
+
+	cols_.valid.resize(n);
+	cols_.ybar.resize(n);
+	cols_.tdiff.resize(n);
+	cols_.lbal.resize(n);
+	cols_.tof.resize(n);
+	cols_.ctof.resize(n);
+	cols_.tqdc.resize(n);
+	cols_.ctqdc.resize(n);
+	cols_.x.resize(n);
+	cols_.y.resize(n);
+	cols_.z.resize(n);
+	cols_.r.resize(n);
+	cols_.theta.resize(n);
+	cols_.phi.resize(n);
+	cols_.energy.resize(n);
+	cols_.centerE.resize(n);
+	slot.resize(n);
+
+	// Invalid hits are redirected to the zeroed entry at the end of the arrays.
+	size_t numValid = 0;
+	for(size_t i = 0; i < n; i++){
+		bool valid = Check(cols_.loc[i], cols_.tqdc_L[i], cols_.tqdc_R[i]);
+		cols_.valid[i] = valid;
+		slot[i] = (valid ? cols_.loc[i] : numLoc);
+		numValid += valid;
+	}
+
+	const unsigned short *s = slot.data();
+	const double *tL = cols_.tdiff_L.data();
+	const double *tR = cols_.tdiff_R.data();
+	const float *qL = cols_.tqdc_L.data();
+	const float *qR = cols_.tqdc_R.data();
+	double *ybar = cols_.ybar.data();
+	double *tdiff = cols_.tdiff.data();
+	double *lbal = cols_.lbal.data();
+	double *tof = cols_.tof.data();
+	double *ctof = cols_.ctof.data();
+	double *tqdc = cols_.tqdc.data();
+	double *ctqdc = cols_.ctqdc.data();
+
+	// Compute the position along the bar, the tof, and the TQDC.
+	if(!singleEnded){
+		for(size_t i = 0; i < n; i++){
+			tdiff[i] = tR[i] - tL[i];
+			lbal[i] = (qL[i]-qR[i])/(qL[i]+qR[i]);
+			tof[i] = (tR[i] + tL[i])/2 - tofOffset[s[i]];
+			tqdc[i] = std::sqrt(qR[i]*qL[i]);
+		}
+		if(lightBalance){
+			for(size_t i = 0; i < n; i++){
+				lbal[i] = lbal[i] - barT0[s[i]];
+				ybar[i] = lbal[i]*yScale[s[i]];
+			}
+		}
+		else{
+			for(size_t i = 0; i < n; i++)
+				ybar[i] = (tdiff[i] - barT0[s[i]])*yScale[s[i]];
+		}
+	}
+	else{
+		for(size_t i = 0; i < n; i++){
+			tdiff[i] = 0;
+			lbal[i] = 0;
+			ybar[i] = 0;
+			tof[i] = tL[i] - tofOffset[s[i]];
+			tqdc[i] = qL[i];
+		}
+	}
+
+	// Calculate the corrected TOF.
+	for(size_t i = 0; i < n; i++)
+		ctof[i] = tof[i] + ctofShift[s[i]];
+
+	// Calibrate the TQDC.
+	if(useEnergy){
+		for(size_t i = 0; i < n; i++){
+			const unsigned short l = s[i];
+			if(ecalMode[l] == ECAL_SINGLE || ecalMode[l] == ECAL_PAIR)
+				ctqdc[i] = calEnergy(ecalLeft[l], ecalLeftSize[l], tqdc[i]);
+			else if(ecalMode[l] == ECAL_INDIVIDUAL){
+				float cqL = calEnergy(ecalLeft[l], ecalLeftSize[l], qL[i]);
+				float cqR = calEnergy(ecalRight[l], ecalRightSize[l], qR[i]);
+				ctqdc[i] = std::sqrt(cqR*cqL);
+			}
+			else
+				ctqdc[i] = tqdc[i];
+		}
+	}
+	else{
+		for(size_t i = 0; i < n; i++)
+			ctqdc[i] = tqdc[i];
+	}
+
+	double *x = cols_.x.data();
+	double *y = cols_.y.data();
+	double *z = cols_.z.data();
+	double *r = cols_.r.data();
+	double *energy = cols_.energy.data();
+	double *centerE = cols_.centerE.data();
+
+	if(!usePosition){
+		for(size_t i = 0; i < n; i++){
+			x[i] = 0;
+			y[i] = ybar[i];
+			z[i] = 0;
+			r[i] = 0;
+			cols_.theta[i] = 0;
+			cols_.phi[i] = 0;
+			energy[i] = 0;
+			centerE[i] = 0;
+		}
+		return numValid;
+	}
+
+	// Rotate the interaction point to the frame of the bar and add the position of the bar.
+	const double *xdet = cols_.xdet.data();
+	const double *ydet = cols_.ydet.data();
+	for(size_t i = 0; i < n; i++){
+		const double *rot = &rotation[9*s[i]];
+		const double *pos = &position[3*s[i]];
+		x[i] = pos[0] + rot[0]*xdet[i] + rot[1]*ydet[i] + rot[2]*ybar[i];
+		y[i] = pos[1] + rot[3]*xdet[i] + rot[4]*ydet[i] + rot[5]*ybar[i];
+		z[i] = pos[2] + rot[6]*xdet[i] + rot[7]*ydet[i] + rot[8]*ybar[i];
+	}
+
+	// Convert the event vectors to spherical.
+	for(size_t i = 0; i < n; i++)
+		Cart2Sphere(x[i], y[i], z[i], r[i], cols_.theta[i], cols_.phi[i]);
+
+	// Calculate the neutron energy.
+	for(size_t i = 0; i < n; i++)
+		energy[i] = 0.5*Mn*r[i]*r[i]/(ctof[i]*ctof[i]);
+
+	// Compute the energy at the central axis. The point on the axis is found from the position along
+	// the bar (ybar) in the detector frame, not from the lab y coordinate.
+	if(centerEnergy_){
+		for(size_t i = 0; i < n; i++){
+			const double *rot = &rotation[9*s[i]];
+			const double *pos = &position[3*s[i]];
+			double cx = pos[0] + rot[2]*ybar[i];
+			double cy = pos[1] + rot[5]*ybar[i];
+			double cz = pos[2] + rot[8]*ybar[i];
+			centerE[i] = 0.5*Mn*(cx*cx + cy*cy + cz*cz)/(ctof[i]*ctof[i]);
+		}
+	}
+
+	return numValid;
+}
+
+double BarKernel::calEnergy(const unsigned int &start_, const unsigned int &size_, const double &adc_) const {
+	if(size_ == 0) return adc_;
+	const double *vals = &coefficients[start_];
+	double output = vals[size_-1];
+	for(unsigned int i = size_-1; i > 0; i--)
+		output = output*adc_ + vals[i-1];
+	return output;
+}
@@ -3,25 +3,41 @@
 #include <time.h>
 #include <cmath>
 
-#include "TH1F.h"
+#include "TH1D.h"
+#include "TFile.h"
 #include "TCanvas.h"
 
 #include "CTerminal.h"
 
 #include "simpleTool.hpp"
 #include "CalibFile.hpp"
+#include "AcceptanceMC.hpp"
+#include "cmcalc.hpp"
 
 class angleAnalyzer : public simpleTool {
   private:
 	size_t maxEntry;	
 
 	double detectorWidth;
+	double detectorHeight;
 	double detectorLength;
+	double userEnergy;
+
+	unsigned long long numSamples;
+	unsigned long long seed;
+
+	std::string barFilename;
+	std::string configFilename;
+	std::string saveFilename;
 
 	CalibFile calib;
 
+	reaction rxn;
+
+	TH1D *makeHistogram(const char *name_, const char *title_, const char *xtitle_, const char *ytitle_, const std::vector<double> &edges_, const std::vector<double> &contents_, const size_t &firstBin_=0);
+
   public:
-	angleAnalyzer() : simpleTool(), maxEntry(0), detectorWidth(3), detectorLength(60), calib() { }
+	angleAnalyzer() : simpleTool(), maxEntry(0), detectorWidth(3), detectorHeight(-1), detectorLength(60), userEnergy(-1), numSamples(1000000), seed(0), calib() { }
 
 	~angleAnalyzer();
 	
@@ -38,6 +54,13 @@ angleAnalyzer::~angleAnalyzer(){
 void angleAnalyzer::addOptions(){
 	addOption(optionExt("length", required_argument, NULL, 0, "<length>", "Specify the length of the detectors (in cm, default = 60)."), userOpts, optstr);
 	addOption(optionExt("width", required_argument, NULL, 0, "<width>", "Specify the width of the detectors (in cm, default = 3)."), userOpts, optstr);
+	addOption(optionExt("height", required_argument, NULL, 0, "<height>", "Specify the height of the detectors (in cm, default = width)."), userOpts, optstr);
+	addOption(optionExt("samples", required_argument, NULL, 0, "<N>", "Specify the number of Monte-Carlo samples per detector (default = 1E6)."), userOpts, optstr);
+	addOption(optionExt("seed", required_argument, NULL, 0, "<seed>", "Specify the seed of the random number streams (default = 0)."), userOpts, optstr);
+	addOption(optionExt("bars", required_argument, NULL, 0, "<fname>", "Read the dimensions of each bar from a bar calibration file."), userOpts, optstr);
+	addOption(optionExt("config", required_argument, NULL, 'c', "<fname>", "Read reaction information from an input file and compute the CM acceptance."), userOpts, optstr);
+	addOption(optionExt("energy", required_argument, NULL, 'E', "<energy>", "Specify the beam energy in MeV."), userOpts, optstr);
+	addOption(optionExt("save", required_argument, NULL, 0, "<fname>", "Write the acceptance histograms to a root file."), userOpts, optstr);
 }
 
 bool angleAnalyzer::processArgs(){
@@ -45,10 +68,46 @@ bool angleAnalyzer::processArgs(){
 		detectorLength = strtod(userOpts.at(0).argument.c_str(), NULL);
 	if(userOpts.at(1).active)
 		detectorWidth = strtod(userOpts.at(1).argument.c_str(), NULL);
+	if(userOpts.at(2).active)
+		detectorHeight = strtod(userOpts.at(2).argument.c_str(), NULL);
+	if(userOpts.at(3).active){
+		numSamples = strtoull(userOpts.at(3).argument.c_str(), NULL, 0);
+		if(numSamples == 0){
+			std::cout << " Error: Invalid number of samples (" << userOpts.at(3).argument << ")!\n";
+			return false;
+		}
+	}
+	if(userOpts.at(4).active)
+		seed = strtoull(userOpts.at(4).argument.c_str(), NULL, 0);
+	if(userOpts.at(5).active)
+		barFilename = userOpts.at(5).argument;
+	if(userOpts.at(6).active)
+		configFilename = userOpts.at(6).argument;
+	if(userOpts.at(7).active)
+		userEnergy = strtod(userOpts.at(7).argument.c_str(), NULL);
+	if(userOpts.at(8).active)
+		saveFilename = userOpts.at(8).argument;
+
+	if(detectorHeight <= 0)
+		detectorHeight = detectorWidth;
 
 	return true;
 }
 
+/** Copy the contents of a range of Monte-Carlo bins into a new histogram.
+  * \param[in]  edges_    Bin edges of the histogram.
+  * \param[in]  contents_ Contents of the Monte-Carlo bins.
+  * \param[in]  firstBin_ Index of the Monte-Carlo bin corresponding to the first bin of the histogram.
+  */
+TH1D *angleAnalyzer::makeHistogram(const char *name_, const char *title_, const char *xtitle_, const char *ytitle_, const std::vector<double> &edges_, const std::vector<double> &contents_, const size_t &firstBin_/*=0*/){
+	TH1D *h = new TH1D(name_, title_, edges_.size()-1, edges_.data());
+	for(int i = 1; i <= h->GetNbinsX(); i++)
+		h->SetBinContent(i, contents_.at(firstBin_+i-1));
+	h->GetXaxis()->SetTitle(xtitle_);
+	h->GetYaxis()->SetTitle(ytitle_);
+	return h;
+}
+
 int angleAnalyzer::execute(int argc, char *argv[]){
 	if(!setup(argc, argv))
 		return 0;
@@ -69,82 +128,84 @@ int angleAnalyzer::execute(int argc, char *argv[]){
 	}
 
 	if(!calib.LoadPositionCal(input_filename.c_str())) return 3;
+	if(!barFilename.empty() && !calib.LoadBarCal(barFilename.c_str())) return 3;
+
+	if(!configFilename.empty()){
+		if(!rxn.Read(configFilename.c_str())){
+			std::cout << " Error: Failed to setup reaction parameters!\n";
+			return 4;
+		}
+		if(userEnergy > 0) rxn.SetEbeam(userEnergy);
+		rxn.Print();
+		if(!rxn.IsAboveThreshold()){
+			std::cout << " Error: Energy is below reaction threshold by " << (rxn.GetThresholdEnergy() - rxn.GetBeamEnergy()) << " MeV.\n";
+			return 4;
+		}
+		rxn.BuildTables();
+	}
 
 	std::cout << "Using detector length of " << detectorLength << " cm.\n";
 	std::cout << "Using detector width of " << detectorWidth << " cm.\n";
+	std::cout << "Using detector height of " << detectorHeight << " cm.\n";
+
+	// Sample the volume of each bar.
+	AcceptanceMC mc;
+	mc.SetLabBins(1800, 0, 180);
+	mc.SetSeed(seed);
+	mc.SetThreads(num_threads);
+	if(!configFilename.empty())
+		mc.SetKinematics(rxn.GetEjectileTable());
+	if(mc.AddDetectors(calib, detectorWidth/100, detectorHeight/100, detectorLength/100) == 0){
+		std::cout << " Error: Failed to find any detectors in \"" << input_filename << "\".\n";
+		return 5;
+	}
 
-	double thetaCyl, theta, x, z, r;
-	double rprime, alpha;
-
-	ofile << "loc\tthetaLow\tthetaHigh\n";
-
-	double dW[3] = {-detectorWidth/200, 0, detectorWidth/200};
-	double dY[3] = {-detectorLength/200, 0, detectorLength/200};
+	std::cout << " Sampling " << numSamples << " points in each of " << mc.GetNumDetectors() << " detectors using " << num_threads << " threads...\n";
+	mc.Run(numSamples);
+	std::cout << " Processed " << mc.GetRate() << " samples per second.\n";
 
-	std::vector<double> minima;
-	std::vector<double> maxima;
+	ofile << "loc\tthetaLow\tthetaHigh\tsolidAngle\n";
 
 	double overallMin = 180;
 	double overallMax = 0;
+	for(size_t i = 0; i < mc.GetNumDetectors(); i++){
+		const AcceptanceDetector &det = mc.GetDetector(i);
+		ofile << det.loc << "\t" << det.minAngle << "\t" << det.maxAngle << "\t" << det.solidAngle << std::endl;
 
-	maxEntry = calib.GetMaxPosition();
-	for(size_t i = 0; i < maxEntry; i++){
-		// Bar detectors must be even.
-		if(i % 2 != 0) continue;
-
-		PositionCal *pos = NULL;
-		if(!(pos = calib.GetPositionCal(i)) || pos->defaultVals) continue;	
-
-		double minAngle = 180;
-		double maxAngle = 0;
-		for(int j = 0; j < 3; j++){ // Over dW
-			// Calculate the cylindrical angle.
-			thetaCyl = pos->theta;
-			rprime = std::sqrt(pos->r0*pos->r0 + dW[j]*dW[j]);
-			alpha = std::atan2(dW[j], pos->r0);
-			addAngles(thetaCyl, alpha);
-
-			// Calculate the X and Z axis components.
-			x = rprime*std::sin(thetaCyl); // m
-			z = rprime*std::cos(thetaCyl); // m
-
-			for(int k = 0; k < 3; k++){ // Over dY
-				r = std::sqrt(x*x + dY[k]*dY[k] + z*z);
-				theta = std::acos(z/r)*180/pi;
-	
-				if(theta < minAngle) minAngle = theta;
-				if(theta > maxAngle) maxAngle = theta;
-			}
-		}
-
-		ofile << i << "\t" << minAngle << "\t" << maxAngle << std::endl;
-
-		if(minAngle < overallMin) overallMin = minAngle;
-		if(maxAngle > overallMax) overallMax = maxAngle;
-
-		minima.push_back(minAngle);
-		maxima.push_back(maxAngle);
+		if(det.minAngle < overallMin) overallMin = det.minAngle;
+		if(det.maxAngle > overallMax) overallMax = det.maxAngle;
 	}		
 
 	ofile.close();
 
 	int nBins = (ceil(overallMax)-floor(overallMin))*10;
-	TH1F *h = new TH1F("h", "h", nBins, floor(overallMin), ceil(overallMax));
 
 	std::cout << " nBins=" << nBins << std::endl;
 
 	std::cout << " Min Angle: " << floor(overallMin) << std::endl;
 	std::cout << " Max Angle: " << ceil(overallMax) << std::endl;
 
-	int count;
-	double binCenter;
-	for(int i = 1; i <= nBins; i++){
-		count = 0;
-		binCenter = h->GetBinCenter(i);
-		for(size_t j = 0; j < minima.size(); j++){
-			if(binCenter >= minima.at(j) && binCenter < maxima.at(j)) count++;
+	// Only keep the 0.1 degree bins in the angular range of all detectors.
+	size_t firstBin = (size_t)floor(overallMin)*10;
+	std::vector<double> edges(mc.GetLabBins().GetEdges().begin()+firstBin, mc.GetLabBins().GetEdges().begin()+firstBin+nBins+1);
+
+	TH1D *h = makeHistogram("hLabAcc", "Acceptance vs. Lab Angle", "Lab Angle (deg)", "Detectors", edges, mc.GetLabAcceptance(), firstBin);
+	TH1D *hsa = makeHistogram("hLabSA", "Solid Angle vs. Lab Angle", "Lab Angle (deg)", "Solid Angle (sr)", edges, mc.GetLabSolidAngle(), firstBin);
+
+	if(!saveFilename.empty()){
+		TFile *file = new TFile(saveFilename.c_str(), "RECREATE");
+		if(file->IsOpen()){
+			h->Write();
+			hsa->Write();
+			if(!configFilename.empty()){
+				makeHistogram("hComAcc", "Acceptance vs. CM Angle", "CM Angle (deg)", "Detectors", mc.GetComBins().GetEdges(), mc.GetComAcceptance())->Write();
+				makeHistogram("hComSA", "Solid Angle vs. CM Angle", "CM Angle (deg)", "Solid Angle (sr)", mc.GetComBins().GetEdges(), mc.GetComSolidAngle())->Write();
+			}
+			file->Close();
+			std::cout << " Wrote acceptance histograms to file \"" << saveFilename << "\".\n";
 		}
-		h->SetBinContent(i, count);
+		else std::cout << " Error: Failed to open output file \"" << saveFilename << "\".\n";
+		delete file;
 	}
 
 	openCanvas1();
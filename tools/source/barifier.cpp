@@ -11,8 +11,11 @@
 
 #include "simpleTool.hpp"
 #include "CalibFile.hpp"
+#include "BarKernel.hpp"
 #include "Structures.hpp"
 
+#define BARIFIER_BATCH_SIZE 4096 // Number of detector events to buffer before calibrating them.
+
 template <typename T>
 void writeTNamed(const char *label_, const T &val_, const int &precision_=-1){
 	std::stringstream stream; 
@@ -34,6 +37,10 @@ class barHandler : public simpleTool {
 
 	CalibFile calib;
 
+	BarKernel kernel;
+	BarColumns columns;
+	std::vector<double> shortIntegrals;
+
 	GenericBarStructure *gbptr;
 	GenericStructure *gptr;
 	LiquidBarStructure *lbptr;
@@ -65,6 +72,8 @@ class barHandler : public simpleTool {
 
 	void handleEvents();
 
+	void flushEvents();
+
   public:
 	barHandler() : simpleTool(), setupDir("./setup/"), index(0), calib(), gbptr(NULL), gptr(NULL), lbptr(NULL), lptr(NULL), hptr(NULL), detectorType(0), singleEndedMode(false), liquidDetMode(false), noTimeMode(false), noEnergyMode(false), noPositionMode(false), useLightBalance(false), countsString(""), totalCounts(0), totalDataTime(0) { }
 
@@ -124,133 +133,64 @@ bool barHandler::getNextEvent(){
 void barHandler::handleEvents(){
 	index = 0;
 	while(getNextEvent()){
-		// Check for invalid TQDC.
-		if(tqdc_L <= 0 || (!singleEndedMode && tqdc_R <= 0)) continue;
-
-		BarCal *bar = NULL;
-		if(!singleEndedMode && !(bar = calib.GetBarCal(location))) continue;
+		// Check for invalid TQDC and missing calibration.
+		if(!kernel.Check(location, tqdc_L, tqdc_R)) continue;
 
-		TimeCal *time = NULL;
-		if(!noTimeMode && !(time = calib.GetTimeCal(location))) continue;
-
-		PositionCal *pos = NULL;
+		// Take the width and thickness of the bar into consideration.
+		// Select a random point inside the bar.
+		double xdetRan = 0, ydetRan = 0;
 		if(!noPositionMode){
-			if(!(pos = calib.GetPositionCal(location))) continue;
+			xdetRan = frand(-kernel.GetHalfWidth(location), kernel.GetHalfWidth(location));
+			ydetRan = frand(-kernel.GetHalfHeight(location), kernel.GetHalfHeight(location));
 		}
 
-		// Compute the corrected time difference
-		if(!singleEndedMode){
-			if(!useLightBalance){
-				double ctdiff = tdiff_R - tdiff_L - bar->t0;
-				y = bar->cbar*ctdiff/200; // m
-			}
-			else{
-				// Calculate the light balance.
-				lbal = (tqdc_L-tqdc_R)/(tqdc_L+tqdc_R) - bar->t0;
-
-				// Use light balance to compute position in detector.
-				y = lbal*((bar->length/100)/bar->beta);
-			}
-		}
-		else y = 0; // m
-		
-		if(!noPositionMode){
-			// Take the width and thickness of the bar into consideration.
-			// Select a random point inside the bar.
-			double xdetRan = frand(-bar->width/200, bar->width/200);
-			double ydetRan = frand(-bar->height/200, bar->height/200);
-
-			// Vector from the center to the interaction point.
-			Vector3 p(xdetRan, ydetRan, y);
-	
-			// Rotate to the frame of the bar.
-			pos->Transform(p);
-	
-			// Calculate the vector from the origin of the lab frame.
-			Vector3 rEvent = (*pos->GetPosition()) + p;
-			x = rEvent.axis[0]; // m
-			y = rEvent.axis[1]; // m
-			z = rEvent.axis[2]; // m		
-			
-			// Convert the event vector to spherical.
-			Cart2Sphere(rEvent, r, theta, phi);	
-		}
-		else{
-			r = 0;
-			theta = 0;
-			phi = 0;
-			x = 0;
-			z = 0;
-		}
-
-		if(!singleEndedMode){
-			tdiff = (tdiff_R - tdiff_L);
-			tof = (tdiff_R + tdiff_L)/2;
-
-			// Calculate the TQDC.
-			tqdc = std::sqrt(tqdc_R*tqdc_L);
-		}
-		else{
-			tof = tdiff_L;
-		
-			// Calculate the TQDC.
-			tqdc = tqdc_L;
-		}
-		
-		// Calculate the corrected TOF.
-		ctof = tof;
-		if(!noTimeMode) // Correct timing offset. This should place the gamma-flash at t=0 ns.
-			ctof = ctof - time->t0;
-		if(!noPositionMode) // Correct the gamma-flash offset for distance from source.
-			ctof += 100*pos->r0/cvac;
+		columns.push_back(location, tdiff_L, (!singleEndedMode ? tdiff_R : 0), tqdc_L, (!singleEndedMode ? tqdc_R : 0), xdetRan, ydetRan);
 
 		if(liquidDetMode){ // Calculate the short integral for PSD.
 			if(!singleEndedMode)
-				stqdc = std::sqrt(stqdc_R*stqdc_L);
+				shortIntegrals.push_back(std::sqrt(stqdc_R*stqdc_L));
 			else
-				stqdc = stqdc_L;
+				shortIntegrals.push_back(stqdc_L);
 		}
+	}
 
-		if(!noEnergyMode){ // Calibrate the TQDC.
-			if(!singleEndedMode){
-				EnergyCal *ecalLeft = calib.GetEnergyCal(location);
-				EnergyCal *ecalRight = calib.GetEnergyCal(location+1);
-				if(ecalLeft && !ecalLeft->defaultVals){
-					if(!ecalRight || ecalRight->defaultVals){ // Use pairwise calibration.
-						ctqdc = ecalLeft->GetCalEnergy(std::sqrt(tqdc_R*tqdc_L));
-					}
-					else{ // Use individual channel calibration.
-						tqdc_L = ecalLeft->GetCalEnergy(tqdc_L);
-						tqdc_R = ecalRight->GetCalEnergy(tqdc_R);
-						ctqdc = std::sqrt(tqdc_R*tqdc_L);
-					}
-				}
-			}
-			else{
-				EnergyCal *ecal = calib.GetEnergyCal(location);
-				if(ecal) ctqdc = ecal->GetCalEnergy(tqdc);
-			}
-		}
+	if(columns.size() >= BARIFIER_BATCH_SIZE)
+		flushEvents();
+}
 
-		// Calculate the neutron energy.
-		if(!noPositionMode){
-			energy = tof2energy(ctof, r);
-			if(debug){ // Compute the energy at the central axis.
-				// Vector from the center to the interaction point.
-				Vector3 p(0, 0, y);
-	
-				// Rotate to the frame of the bar.
-				pos->Transform(p);
-	
-				// Calculate the vector from the origin of the lab frame.
-				Vector3 rEvent = (*pos->GetPosition()) + p;
-				centerE = tof2energy(ctof, rEvent.Length());
-			}
-		}
+void barHandler::flushEvents(){
+	if(columns.empty()) return;
+
+	// Calibrate all buffered events at once.
+	kernel.Process(columns, debug);
+
+	for(size_t i = 0; i < columns.size(); i++){
+		if(!columns.valid[i]) continue;
+
+		location = columns.loc[i];
+		tdiff = columns.tdiff[i];
+		lbal = columns.lbal[i];
+		tof = columns.tof[i];
+		ctof = columns.ctof[i];
+		tqdc = columns.tqdc[i];
+		ctqdc = columns.ctqdc[i];
+		x = columns.x[i];
+		y = columns.y[i];
+		z = columns.z[i];
+		r = columns.r[i];
+		theta = columns.theta[i];
+		phi = columns.phi[i];
+		energy = columns.energy[i];
+		centerE = columns.centerE[i];
+		if(liquidDetMode)
+			stqdc = shortIntegrals[i];
 
 		// Fill the tree with the event.
 		outtree->Fill();
 	}
+
+	columns.clear();
+	shortIntegrals.clear();
 }
 
 barHandler::~barHandler(){
@@ -341,6 +281,10 @@ int barHandler::execute(int argc, char *argv[]){
 	if(!noEnergyMode && !calib.LoadEnergyCal((setupDir+"energy.cal").c_str())) return 4;
 	if(!singleEndedMode && !calib.LoadBarCal((setupDir+"bars.cal").c_str())) return 5;
 
+	// Flatten the calibration for batch processing.
+	if(!kernel.Build(calib, singleEndedMode, !noTimeMode, !noEnergyMode, !noPositionMode, useLightBalance))
+		std::cout << " Warning: No detector locations have all required calibration entries!\n";
+
 	if(output_filename.empty()){
 		std::cout << " Error: Output filename not specified!\n";
 		return 6;
@@ -445,6 +389,9 @@ int barHandler::execute(int argc, char *argv[]){
 			handleEvents();
 	}
 
+	// Handle any remaining events.
+	flushEvents();
+
 	// Write output tree to file.
 	outfile->cd();
 	outtree->Write();
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cmath>
 
 #include "TApplication.h"
 #include "TCanvas.h"
@@ -12,18 +13,130 @@
 #include "TH1D.h"
 #include "TMarker.h"
 #include "TMath.h"
+#include "TSpectrum.h"
 
 #include "simpleTool.hpp"
 
+/** 1d gaussian, equivalent to the root "gaus" function, which is safe to use in several threads.
+  * \param[in] x: x[0] = ADC channel
+  * \param[in] p:
+  *  p[0] = Amplitude
+  *  p[1] = Mean
+  *  p[2] = Sigma
+  */
+double gaussian(double *x, double *p){
+	double arg = (x[0]-p[1])/p[2];
+	return p[0]*std::exp(-0.5*arg*arg);
+}
+
 class calibrator : public simpleHistoFitter {
+  private:
+	int batchPeaks; /// Number of photo peaks to fit in batch mode.
+	double fitRangeMult; /// Range of batch fits in multiples of sigma.
+
+	bool fitProjection(TH1D *h1_, const std::string &label_, std::ostream &log_, std::ostream &results_, std::ostream &calib_);
+
   public:
-	calibrator() : simpleHistoFitter() { }
+	calibrator() : simpleHistoFitter(), batchPeaks(1), fitRangeMult(2) { }
+
+	void addChildOptions();
+
+	bool processChildArgs();
 
 	bool process();
 };
 
+void calibrator::addChildOptions(){
+	addOption(optionExt("peaks", required_argument, NULL, 0, "<Npeaks>", "Specify the number of photo peaks to fit in batch mode (default = 1)."), userOpts, optstr);
+	addOption(optionExt("fit-range", required_argument, NULL, 0, "<multiplier>", "Specify sigma multiplier for range of batch fits (default = 2)."), userOpts, optstr);
+}
+
+bool calibrator::processChildArgs(){
+	if(userOpts.at(firstChildOption).active){
+		batchPeaks = strtol(userOpts.at(firstChildOption).argument.c_str(), NULL, 0);
+		if(batchPeaks <= 0){
+			std::cout << " Error: Invalid number of peaks (" << batchPeaks << "). Must be non-zero.\n";
+			return false;
+		}
+	}
+	if(userOpts.at(firstChildOption+1).active)
+		fitRangeMult = strtod(userOpts.at(firstChildOption+1).argument.c_str(), NULL);
+
+	return true;
+}
+
+bool calibrator::fitProjection(TH1D *h1_, const std::string &label_, std::ostream &log_, std::ostream &results_, std::ostream &calib_){
+	std::vector<double> amplitudes, means, sigmas;
+
+	const std::vector<std::vector<double> > *prev = getSeeds(label_);
+	if(prev){ // Use the peaks found by the previous run.
+		for(size_t j = 0; j < prev->size() && (int)j < batchPeaks; j++){
+			if(prev->at(j).size() < 3) continue;
+			amplitudes.push_back(prev->at(j).at(0));
+			means.push_back(prev->at(j).at(1));
+			sigmas.push_back(std::fabs(prev->at(j).at(2)));
+		}
+	}
+	else{ // Search for peaks.
+		TSpectrum spec(batchPeaks);
+		spec.Search(h1_, 2, "goff");
+
+		// Estimate the width of each peak from its half maximum crossings.
+		for(int j = 0; j < spec.GetNPeaks(); j++){
+			double mean = spec.GetPositionX()[j];
+			int peakBin = h1_->FindBin(mean);
+			double halfMax = h1_->GetBinContent(peakBin)/2;
+			int lowBin = peakBin, highBin = peakBin;
+			while(lowBin > 1 && h1_->GetBinContent(lowBin) > halfMax) lowBin--;
+			while(highBin < h1_->GetNbinsX() && h1_->GetBinContent(highBin) > halfMax) highBin++;
+			double sigma = (h1_->GetBinCenter(highBin)-h1_->GetBinCenter(lowBin))/2.35;
+			if(sigma <= 0) sigma = h1_->GetBinWidth(peakBin);
+			amplitudes.push_back(2*halfMax);
+			means.push_back(mean);
+			sigmas.push_back(sigma);
+		}
+	}
+
+	if(means.empty()){
+		log_ << "  No peaks found!\n";
+		return false;
+	}
+
+	// Each thread uses its own fit function.
+	std::string fname = "f1_" + label_;
+	TF1 f1(fname.c_str(), gaussian, 0, 1, 3);
+
+	int numConverged = 0;
+	for(size_t j = 0; j < means.size(); j++){
+		double x1 = means[j] - fitRangeMult*sigmas[j];
+		double x2 = means[j] + fitRangeMult*sigmas[j];
+		log_ << "  Range: " << x1 << ", " << x2 << std::endl;
+
+		f1.SetRange(x1, x2);
+		f1.SetParameters(amplitudes[j], means[j], sigmas[j]);
+		int fitStatus = h1_->Fit(&f1, "QR0+");
+
+		if(fitStatus != 0 || f1.GetNDF() <= 0){
+			log_ << "  Fit failed!\n";
+			continue;
+		}
+		numConverged++;
+
+		// Output the fit results.
+		log_ << "  Fit: chi^2 = " << f1.GetChisquare()/f1.GetNDF() << ", mean = " << f1.GetParameter(1) << "\n";
+		results_ << label_ << "\t" << f1.GetParameter(0) << "\t" << f1.GetParameter(1) << "\t" << f1.GetParameter(2) << "\t" << f1.GetChisquare()/f1.GetNDF() << std::endl;
+	}
+
+	return (numConverged > 0);
+}
+
 bool calibrator::process(){
-	if(!h2d || !can2) return false;
+	if(!h2d || (!batchMode && !can2)) return false;
+
+	if(batchMode){ // Compton edge fitting requires user input.
+		std::cout << "Using gaussian photo peak fitting of " << batchPeaks << " peaks.\n";
+		return processBatch("id\tA\tmean\tsigma\tchi2\n");
+	}
 
 	int fitMode = -1;
 	std::string userInput = "";
@@ -0,0 +1,263 @@
+/** \file cldConvert.cpp
+  * \brief Repack .ldf and .pld files into the compact list data (.cld) format.
+  *
+  * Every complete spill in the input file is written as a single contiguous
+  * block with a spill header containing its length, CRC, and timestamp range.
+  * The spills may optionally be compressed. A spill index is written at the
+  * end of the output file. The program may also be used to print the header
+  * and spill index of an existing .cld file, or to verify all of its spills.
+  */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hribf_buffers.h"
+#include "cld_buffers.h"
+#include "helperFunctions.h"
+#include "optionHandler.hpp"
+
+/** Make sure that a spill ends with the end of spill marker (2, 9999).
+  * @param buffer_ Pointer to the spill buffer.
+  * @param nWords_ Length of the spill (in words). Updated if the marker is appended.
+  * @return True if the spill ends with the marker and false if the buffer could not be enlarged.
+  */
+bool appendEndMarker(SpillBuffer *buffer_, unsigned int &nWords_){
+	unsigned int *data = buffer_->GetData();
+	if(nWords_ >= 2 && data[nWords_-2] == 2 && data[nWords_-1] == 9999)
+		return true;
+	if(!buffer_->Reserve(nWords_+2))
+		return false;
+	data = buffer_->GetData();
+	data[nWords_] = 2;
+	data[nWords_+1] = 9999;
+	nWords_ += 2;
+	return true;
+}
+
+/** Print the header and spill index of a .cld file, and optionally read every spill.
+  * @param filename_ Path to the .cld file.
+  * @param verify_ If set to true, every spill is read and its CRC is checked.
+  * @param verbose_ If set to true, the index entry of every spill is printed.
+  * @return True if the file is valid and false otherwise.
+  */
+bool printInfo(const std::string &filename_, const bool &verify_, const bool &verbose_){
+	std::ifstream file(filename_.c_str(), std::ios::binary);
+	if(!file.good()){
+		std::cout << " ERROR: Failed to open input file \"" << filename_ << "\"!\n";
+		return false;
+	}
+
+	CLD_header cldHead;
+	PLD_header pldHead;
+	if(!cldHead.Read(&file, &pldHead)){
+		std::cout << " ERROR: Failed to read .cld header from input file!\n";
+		return false;
+	}
+	pldHead.Print();
+	std::cout << "  Version:     " << cldHead.GetVersion() << std::endl;
+	std::cout << "  Compression: " << cldHead.GetCompressionName() << std::endl;
+
+	CLD_index index;
+	if(index.Read(&file)){
+		std::cout << "  Spills:      " << index.GetNumSpills() << " (" << index.GetTotalWords() << " words)\n";
+		if(index.GetNumSpills() > 0){
+			std::cout << "  First time:  " << index.GetEntry(0).firstTime << std::endl;
+			std::cout << "  Last time:   " << index.GetEntry(index.GetNumSpills()-1).lastTime << std::endl;
+		}
+		if(verbose_){
+			for(size_t i = 0; i < index.GetNumSpills(); i++){
+				const CLD_index_entry &entry = index.GetEntry(i);
+				std::cout << "   " << i << "\toffset=" << entry.offset << "\twords=" << entry.nWords << "\tbytes=" << entry.nBytes;
+				std::cout << "\ttime=[" << entry.firstTime << ", " << entry.lastTime << "]\n";
+			}
+		}
+	}
+	else std::cout << "  WARNING: File has no valid spill index!\n";
+
+	if(!verify_) return true;
+
+	CLD_data cldData;
+	SpillBuffer buffer(pldHead.GetMaxSpillSize());
+	unsigned int nWords;
+	unsigned long numGood = 0;
+	unsigned long numBad = 0;
+	while(true){
+		if(cldData.Read(&file, &buffer, nWords)){
+			numGood++;
+			continue;
+		}
+		if(cldData.GetRetval() == 1 || cldData.GetRetval() == 2) break;
+		numBad++;
+	}
+	std::cout << "  Verified:    " << numGood << " good spills, " << numBad << " bad spills";
+	if(cldData.GetNumResync() > 0) std::cout << ", " << cldData.GetNumResync() << " damaged spill headers";
+	std::cout << std::endl;
+
+	return (numBad == 0 && cldData.GetNumResync() == 0 && numGood == index.GetNumSpills());
+}
+
+int main(int argc, char *argv[]){
+	optionHandler handler;
+	handler.add(optionExt("input", required_argument, NULL, 'i', "<filename>", "Specify the input .ldf or .pld file (or .cld file with --info)"));
+	handler.add(optionExt("output", required_argument, NULL, 'o', "<filename>", "Specify the output .cld file"));
+	handler.add(optionExt("compress", no_argument, NULL, 'c', "", "Compress spills using the LZ4 block format"));
+	handler.add(optionExt("info", no_argument, NULL, 0, "", "Print the header and spill index of a .cld file"));
+	handler.add(optionExt("verify", no_argument, NULL, 0, "", "Read every spill of a .cld file and check its CRC (implies --info)"));
+	handler.add(optionExt("verbose", no_argument, NULL, 'v', "", "Print information about each spill"));
+
+	if(!handler.setup(argc, argv))
+		return 1;
+
+	if(!handler.getOption(0)->active){
+		std::cout << " ERROR: No input filename specified!\n";
+		return 1;
+	}
+	std::string filename = handler.getOption(0)->argument;
+
+	bool compress = handler.getOption(2)->active;
+	bool verify = handler.getOption(4)->active;
+	bool info = handler.getOption(3)->active || verify;
+	bool verbose = handler.getOption(5)->active;
+
+	if(info)
+		return (printInfo(filename, verify, verbose) ? 0 : 1);
+
+	std::string prefix;
+	std::string extension = get_extension(filename, prefix);
+	if(extension != "ldf" && extension != "pld"){
+		std::cout << " ERROR: Invalid input file format '" << extension << "'!\n";
+		return 1;
+	}
+
+	std::string outputFilename = prefix + ".cld";
+	if(handler.getOption(1)->active)
+		outputFilename = handler.getOption(1)->argument;
+
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if(!file.good()){
+		std::cout << " ERROR: Failed to open input file \"" << filename << "\"!\n";
+		return 1;
+	}
+
+	// Copy the run information to the output header.
+	PLD_header pldHead;
+	DIR_buffer dirbuff;
+	HEAD_buffer headbuff;
+	if(extension == "ldf"){
+		if(!dirbuff.Read(&file) || !headbuff.Read(&file)){
+			std::cout << " ERROR: Failed to read .ldf header from input file!\n";
+			return 1;
+		}
+		pldHead.SetRunNumber(dirbuff.GetRunNumber());
+		pldHead.SetFacility(headbuff.GetFacility());
+		pldHead.SetTitle(headbuff.GetRunTitle());
+		pldHead.SetStartDateTime(headbuff.GetDate());
+	}
+	else if(!pldHead.Read(&file)){
+		std::cout << " ERROR: Failed to read .pld header from input file!\n";
+		return 1;
+	}
+	pldHead.SetFormat("PIXIE LIST DATA ");
+
+	std::ofstream output(outputFilename.c_str(), std::ios::binary);
+	if(!output.good()){
+		std::cout << " ERROR: Failed to open output file \"" << outputFilename << "\"!\n";
+		return 1;
+	}
+
+	CLD_header cldHead;
+	cldHead.SetCompression(compress ? CLD_LZ4 : CLD_NONE);
+	if(!cldHead.Write(&output, &pldHead)){
+		std::cout << " ERROR: Failed to write header to output file!\n";
+		return 1;
+	}
+
+	std::cout << " Repacking \"" << filename << "\" (run " << pldHead.GetRunNumber() << ") to \"" << outputFilename << "\"\n";
+
+	// The buffer grows to fit spills larger than the maximum size in the header.
+	SpillBuffer buffer(pldHead.GetMaxSpillSize()+2);
+	CLD_data cldData;
+	DATA_buffer databuff;
+	PLD_data pldData;
+
+	unsigned long numSpills = 0;
+	unsigned long numBad = 0;
+	unsigned int maxSpillSize = 0;
+	double inputBytes = 0;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	unsigned int nBytes;
+	bool full_spill, bad_spill;
+	while(true){
+		if(extension == "ldf"){
+			if(!databuff.Read(&file, &buffer, nBytes, full_spill, bad_spill)){
+				if(databuff.GetRetval() == 2 || databuff.GetRetval() == 6) break; // End of file.
+				if(databuff.GetRetval() == 7){
+					std::cout << " WARNING: Spill is larger than the maximum buffer size of " << buffer.GetLimit() << " words, skipping!\n";
+					numBad++;
+				}
+				continue;
+			}
+			if(!full_spill) continue;
+			if(bad_spill){
+				if(verbose) std::cout << "  Skipping corrupt spill at word " << file.tellg()/4 << " in input file\n";
+				numBad++;
+				continue;
+			}
+		}
+		else if(!pldData.Read(&file, &buffer, nBytes)){
+			break;
+		}
+
+		unsigned int nWords = nBytes/4;
+		if(nWords == 0) continue;
+		if(!appendEndMarker(&buffer, nWords)){
+			std::cout << " WARNING: Failed to append end of spill marker, skipping spill!\n";
+			numBad++;
+			continue;
+		}
+
+		if(!cldData.Write(&output, buffer.GetData(), nWords, cldHead.GetCompression())){
+			std::cout << " ERROR: Failed to write spill " << numSpills << " to output file!\n";
+			return 1;
+		}
+
+		if(verbose){
+			const CLD_index_entry &entry = cldData.GetIndex()->GetEntry(numSpills);
+			std::cout << "  Spill " << numSpills << ": " << nWords << " words (" << entry.nBytes << " bytes stored)\n";
+		}
+
+		if(nWords-2 > maxSpillSize) maxSpillSize = nWords-2;
+		inputBytes += nBytes;
+		numSpills++;
+	}
+
+	if(!cldData.GetIndex()->Write(&output)){
+		std::cout << " ERROR: Failed to write spill index to output file!\n";
+		return 1;
+	}
+
+	// The maximum spill size of an ldf file is not known until all spills are read.
+	if(maxSpillSize > pldHead.GetMaxSpillSize()){
+		pldHead.SetMaxSpillSize(maxSpillSize);
+		cldHead.OverwriteValues(&output, &pldHead);
+	}
+
+	double outputBytes = output.tellp();
+	output.close();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << " Wrote " << numSpills << " spills (" << inputBytes/1E6 << " MB of spill data) to " << outputBytes/1E6 << " MB";
+	if(inputBytes > 0)
+		std::cout << " (" << 100*outputBytes/inputBytes << "%)";
+	std::cout << " in " << elapsed << " s\n";
+	if(numBad > 0)
+		std::cout << " Skipped " << numBad << " bad spills.\n";
+
+	return 0;
+}
@@ -7,6 +7,7 @@
 #include "TTree.h"
 #include "TBranch.h"
 #include "TCanvas.h"
+#include "TH1D.h"
 #include "TH2.h"
 #include "TCutG.h"
 #include "TNamed.h"
@@ -14,6 +15,7 @@
 #include "cmcalc.hpp"
 #include "simpleTool.hpp"
 #include "CalibFile.hpp"
+#include "AcceptanceMC.hpp"
 #include "Structures.hpp"
 
 // E_ in MeV, return TQDC in keVee.
@@ -188,6 +190,8 @@ class simpleComCalculator : public simpleTool {
 	double widthMultiplier;
 	int nBins;
 
+	unsigned long long numSamples;
+
 	bool mcarlo;
 	bool vandmc;
 	bool printMode;
@@ -203,6 +207,8 @@ class simpleComCalculator : public simpleTool {
 	std::string thresholdFilename;
 	std::string binWidthFilename;
 	std::string tqdcGateFilename;
+	std::string acceptanceFilename;
+	std::string barFilename;
 
 	int restrictLocation;
 
@@ -218,14 +224,16 @@ class simpleComCalculator : public simpleTool {
 
 	threshCal *getThreshCal(const unsigned int &id_);
 
+	TH1D *makeAcceptanceHist(const char *name_, const char *title_, const char *xtitle_, const char *ytitle_, const std::vector<double> &edges_, const std::vector<double> &contents_);
+
   public:
 	simpleComCalculator() : simpleTool(), startAngle(0), stopAngle(180), binWidth(1), 
 	                        threshold(-1), radius(0.5), userEnergy(-1), maxAxialPosition(-1), 
-	                        timeOffset(0), widthMultiplier(1), nBins(180), 
+	                        timeOffset(0), widthMultiplier(1), nBins(180), numSamples(1000000),
 	                        mcarlo(false), vandmc(false), printMode(false), defaultMode(false), 
 	                        treeMode(false), reactionMode(true), thresholdFile(false), tqdcGateFile(false),
 	                        tqdcGate(NULL), configFilename(""), thresholdFilename(""), binWidthFilename(""),
-	                        tqdcGateFilename(""), restrictLocation(-1) { }
+	                        tqdcGateFilename(""), acceptanceFilename(""), barFilename(""), restrictLocation(-1) { }
 
 	~simpleComCalculator();
 	
@@ -266,6 +274,12 @@ bool simpleComCalculator::setupReaction(){
 		return false;
 	}
 
+	// Tabulate the kinematics so that they do not need to be solved for every event.
+	if(rxn.BuildTables()){
+		const kinematicsTable *table = rxn.GetEjectileTable();
+		std::cout << " Built ejectile kinematics table with " << table->GetNumCells() << " cells up to " << table->GetMaxAngle() << " deg (" << table->GetNumExactCells() << " computed exactly).\n";
+	}
+
 	return true;
 }
 
@@ -318,6 +332,15 @@ threshCal *simpleComCalculator::getThreshCal(const unsigned int &id_){
 	return &detThresh.at(id_);
 }
 
+TH1D *simpleComCalculator::makeAcceptanceHist(const char *name_, const char *title_, const char *xtitle_, const char *ytitle_, const std::vector<double> &edges_, const std::vector<double> &contents_){
+	TH1D *h = new TH1D(name_, title_, edges_.size()-1, edges_.data());
+	for(size_t i = 0; i < contents_.size(); i++)
+		h->SetBinContent(i+1, contents_[i]);
+	h->GetXaxis()->SetTitle(xtitle_);
+	h->GetYaxis()->SetTitle(ytitle_);
+	return h;
+}
+
 simpleComCalculator::~simpleComCalculator(){
 	if(tqdcGate) delete tqdcGate;
 }
@@ -339,6 +362,9 @@ void simpleComCalculator::addOptions(){
 	addOption(optionExt("xbins", required_argument, NULL, 0x0, "<filename>", "Read lab angle bin widths from a file."), userOpts, optstr);
 	addOption(optionExt("location", required_argument, NULL, 0x0, "<location>", "Only process events from a particular pixie ID."), userOpts, optstr);
 	addOption(optionExt("tqdc-gate", required_argument, NULL, 0x0, "<filename>", "Use a TQDC gate on the input data."), userOpts, optstr);
+	addOption(optionExt("acceptance", required_argument, NULL, 0x0, "<filename>", "Compute the angular acceptance of the detectors in a position calibration file (not used with --mcarlo)."), userOpts, optstr);
+	addOption(optionExt("bars", required_argument, NULL, 0x0, "<filename>", "Read the dimensions of each bar from a bar calibration file (default=3x3x60 cm)."), userOpts, optstr);
+	addOption(optionExt("samples", required_argument, NULL, 0x0, "<N>", "Specify the number of acceptance samples per detector (default=1E6)."), userOpts, optstr);
 }
 
 bool simpleComCalculator::processArgs(){
@@ -390,6 +416,17 @@ bool simpleComCalculator::processArgs(){
 		tqdcGateFilename = userOpts.at(15).argument;
 		tqdcGateFile = true;
 	}
+	if(userOpts.at(16).active)
+		acceptanceFilename = userOpts.at(16).argument;
+	if(userOpts.at(17).active)
+		barFilename = userOpts.at(17).argument;
+	if(userOpts.at(18).active){
+		numSamples = strtoull(userOpts.at(18).argument.c_str(), NULL, 0);
+		if(numSamples == 0){
+			std::cout << " Error: Invalid number of acceptance samples (" << userOpts.at(18).argument << ").\n";
+			return false;
+		}
+	}
 
 	return true;
 }
@@ -468,6 +505,7 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 		TH2F *h2dloc = NULL;
 		TH2F *hEtqdc = NULL;
 		TH2F *h2dtqdc = NULL;
+		std::vector<TH1D*> acceptanceHists;
 		if(!mcarlo){
 			std::cout << std::endl;
 
@@ -617,6 +655,38 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 			h2dtqdc = new TH2F("h2dtqdc", "Trace QDC vs. Corrected TOF", tofBins.size()-1, tofBins.data(), tqdcBins.size()-1, tqdcBins.data());
 			h2dtqdc->GetXaxis()->SetTitle("Neutron TOF (ns)");
 			h2dtqdc->GetYaxis()->SetTitle("Trace QDC (keVee)");
+
+			// Compute the acceptance of the detectors using the same angular bins.
+			if(!acceptanceFilename.empty()){
+				CalibFile calib;
+				if(!calib.LoadPositionCal(acceptanceFilename.c_str()) || (!barFilename.empty() && !calib.LoadBarCal(barFilename.c_str()))){
+					std::cout << " Error: Failed to load detector calibration for acceptance calculation!\n";
+					return 8;
+				}
+
+				AcceptanceMC mc;
+				mc.SetThreads(num_threads);
+				mc.SetLabBins(xbinsLowLab);
+				if(reactionMode){
+					mc.SetComBins(xbinsLow);
+					mc.SetKinematics(rxn.GetEjectileTable());
+				}
+				if(mc.AddDetectors(calib, 0.03, 0.03, 0.6) == 0){
+					std::cout << " Error: Failed to find any detectors in \"" << acceptanceFilename << "\".\n";
+					return 8;
+				}
+
+				std::cout << " Sampling " << numSamples << " points in each of " << mc.GetNumDetectors() << " detectors...\n";
+				mc.Run(numSamples);
+				std::cout << " Processed " << mc.GetRate() << " samples per second.\n";
+
+				acceptanceHists.push_back(makeAcceptanceHist("hLabAcc", "Acceptance vs. Lab Angle", "Lab Angle (deg)", "Detectors", mc.GetLabBins().GetEdges(), mc.GetLabAcceptance()));
+				acceptanceHists.push_back(makeAcceptanceHist("hLabSA", "Solid Angle vs. Lab Angle", "Lab Angle (deg)", "Solid Angle (sr)", mc.GetLabBins().GetEdges(), mc.GetLabSolidAngle()));
+				if(reactionMode){
+					acceptanceHists.push_back(makeAcceptanceHist("hComAcc", "Acceptance vs. COM Angle", "COM Angle (deg)", "Detectors", mc.GetComBins().GetEdges(), mc.GetComAcceptance()));
+					acceptanceHists.push_back(makeAcceptanceHist("hComSA", "Solid Angle vs. COM Angle", "COM Angle (deg)", "Solid Angle (sr)", mc.GetComBins().GetEdges(), mc.GetComSolidAngle()));
+				}
+			}
 		}
 
 		int file_counter = 1;
@@ -630,6 +700,7 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 
 			branchHolder branches;
 			std::vector<double> hitTheta;
+			std::vector<double> hitThetaCOM;
 			std::vector<int> detLocation;
 			
 			// VANDMC data types
@@ -704,18 +775,17 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 						if(!det || tqdc < det->thresh) continue;
 					}
 
-					rxn.SetLabAngle(theta);
-					if(treeMode){
-						angleCOM = rxn.GetEjectile()->comAngle[0];
+					double energyCOM;
+					rxn.LabToCom(theta, angleCOM, energyCOM);
+					if(treeMode)
 						outtree->Fill();
-					}
 					hElab->Fill(theta, energy);
 					h2dlab->Fill(theta, ctof);
 					hEloc->Fill(location, energy);
 					h2dloc->Fill(location, ctof);
 					if(reactionMode){
-						hEcom->Fill(rxn.GetEjectile()->comAngle[0], energy);
-						h2dcom->Fill(rxn.GetEjectile()->comAngle[0], ctof);
+						hEcom->Fill(angleCOM, energy);
+						h2dcom->Fill(angleCOM, ctof);
 					}
 					if(hasCorTqdcBranch){
 						hEtqdc->Fill(energy, ctqdc);
@@ -723,10 +793,11 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 					}
 				}
 				else{
+					hitThetaCOM.resize(hitTheta.size());
+					rxn.LabToCom(hitTheta.data(), hitThetaCOM.data(), NULL, hitTheta.size());
 					for(unsigned int j = 0; j < hitTheta.size(); j++){
 						theta = hitTheta.at(j);
-						rxn.SetLabAngle(theta);
-						angleCOM = rxn.GetEjectile()->comAngle[0];
+						angleCOM = hitThetaCOM.at(j);
 						location = detLocation.at(j);
 					
 						outtree->Fill();
@@ -750,6 +821,8 @@ int simpleComCalculator::execute(int argc, char *argv[]){
 			}
 			hEtqdc->Write();
 			h2dtqdc->Write();
+			for(std::vector<TH1D*>::iterator iter = acceptanceHists.begin(); iter != acceptanceHists.end(); iter++)
+				(*iter)->Write();
 		}
 
 		if(treeMode || mcarlo) std::cout << "\n\n Done! Wrote " << outtree->GetEntries() << " entries to '" << output_filename << "'.\n";
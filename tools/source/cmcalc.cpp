@@ -114,6 +114,129 @@ std::string particle::print(bool bothSolutions/*=true*/){
 	return stream.str();
 }
 
+bool kinematicsTable::Build(const double &Vcm_, const double &partVcm_, const double &mass_, const bool &inverseKin_, const double &angleTol_/*=1E-3*/, const double &energyTol_/*=1E-5*/){
+	Clear();
+
+	Vcm = Vcm_;
+	partVcm = partVcm_;
+	mass = mass_;
+	inverseKin = inverseKin_;
+
+	if(!(Vcm >= 0.0) || !(partVcm > 0.0)) return false;
+
+	maxAngle = (partVcm < Vcm) ? std::asin(partVcm/Vcm)*180/pi : 180.0;
+
+	// Refine the table until few cells need to be computed exactly.
+	for(size_t N = 512; ; N *= 2){
+		fill(N);
+
+		numExact = 0;
+		for(size_t i = 0; i < numCells; i++){
+			if(!exact[i]){
+				double com, E;
+				if(!calculate((i+0.5)*step, com, E) || dabs(0.5*(comAngle[i]+comAngle[i+1]) - com) > angleTol_ || dabs(0.5*(energy[i]+energy[i+1]) - E) > energyTol_*E)
+					exact[i] = 1;
+			}
+			if(exact[i]) numExact++;
+		}
+
+		if(numExact*100 <= numCells || N >= 65536) break;
+	}
+
+	return true;
+}
+
+void kinematicsTable::Clear(){
+	maxAngle = 0.0;
+	step = 0.0;
+	invStep = 0.0;
+	numCells = 0;
+	numExact = 0;
+	comAngle.clear();
+	energy.clear();
+	exact.clear();
+}
+
+bool kinematicsTable::Evaluate(const double &thetaLab_, double &thetaCom_, double &energy_) const {
+	if(numCells == 0 || !(thetaLab_ >= 0.0) || thetaLab_ > maxAngle) return calculate(thetaLab_, thetaCom_, energy_);
+
+	size_t i = (size_t)(thetaLab_*invStep);
+	if(i >= numCells) i = numCells-1;
+	if(exact[i]) return calculate(thetaLab_, thetaCom_, energy_);
+
+	double frac = thetaLab_*invStep - i;
+	thetaCom_ = comAngle[i] + frac*(comAngle[i+1]-comAngle[i]);
+	energy_ = energy[i] + frac*(energy[i+1]-energy[i]);
+
+	return true;
+}
+
+size_t kinematicsTable::Evaluate(const double *thetaLab_, double *thetaCom_, double *energy_, const size_t &N_) const {
+	if(numCells == 0){
+		size_t count = 0;
+		double E;
+		for(size_t j = 0; j < N_; j++){
+			if(calculate(thetaLab_[j], thetaCom_[j], (energy_ ? energy_[j] : E))) count++;
+		}
+		return count;
+	}
+
+	// Interpolate all angles first, clamping the cell index so that the loop has no branches.
+	const double *com = comAngle.data();
+	const double *en = energy.data();
+	const double maxIndex = numCells - 1;
+	for(size_t j = 0; j < N_; j++){
+		double x = thetaLab_[j]*invStep;
+		double cell = (x > 0.0 ? (x < maxIndex ? x : maxIndex) : 0.0);
+		size_t i = (size_t)cell;
+		double frac = x - i;
+		thetaCom_[j] = com[i] + frac*(com[i+1]-com[i]);
+		if(energy_) energy_[j] = en[i] + frac*(en[i+1]-en[i]);
+	}
+
+	// Compute angles outside of the table and in cells which are not well approximated exactly.
+	size_t count = 0;
+	double E;
+	for(size_t j = 0; j < N_; j++){
+		const double &theta = thetaLab_[j];
+		if(!(theta >= 0.0) || theta > maxAngle || exact[(size_t)getMin(theta*invStep, maxIndex)]){
+			if(!calculate(theta, thetaCom_[j], (energy_ ? energy_[j] : E))) continue;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+bool kinematicsTable::calculate(const double &thetaLab_, double &thetaCom_, double &energy_) const {
+	particle part;
+	part.inverseKin = inverseKin;
+	bool retval = part.calculate(thetaLab_, Vcm, partVcm, mass);
+	thetaCom_ = part.comAngle[0];
+	energy_ = part.E[0];
+	return retval;
+}
+
+void kinematicsTable::fill(const size_t &N_){
+	numCells = N_;
+	step = maxAngle/numCells;
+	invStep = numCells/maxAngle;
+
+	comAngle.resize(numCells+1);
+	energy.resize(numCells+1);
+	exact.assign(numCells, 0);
+
+	// Cells touching a node without a (finite) solution are always computed exactly.
+	for(size_t i = 0; i <= numCells; i++){
+		if(!calculate(i*step, comAngle[i], energy[i]) || !std::isfinite(comAngle[i]) || !std::isfinite(energy[i])){
+			comAngle[i] = 0.0;
+			energy[i] = 0.0;
+			if(i > 0) exact[i-1] = 1;
+			if(i < numCells) exact[i] = 1;
+		}
+	}
+}
+
 void reaction::Calculate(){
 	// Must calculate these first. Other formulas rely on their values.
 	Ecm = (Mtarg / (Mbeam + Mtarg))*Ebeam;
@@ -127,6 +250,10 @@ void reaction::Calculate(){
 	
 	recoilMaxAngle = recoilVcm > Vcm ? 180.0 : std::asin(recoilVcm/Vcm)*180/pi;
 	ejectMaxAngle = ejectVcm > Vcm ? 180.0 : std::asin(ejectVcm/Vcm)*180/pi;
+
+	// Lookup tables are no longer valid.
+	recoilTable.Clear();
+	ejectTable.Clear();
 }
 
 bool reaction::Read(const char *fname_/*=NULL*/){
@@ -232,6 +359,34 @@ void reaction::SetComAngle(const double &thetaCom_){
 	ejectPart.calculateCOM(thetaCom_, Vcm, ejectVcm, Meject);
 }
 
+bool reaction::BuildTables(const double &angleTol_/*=1E-3*/, const double &energyTol_/*=1E-5*/){
+	return (recoilTable.Build(Vcm, recoilVcm, Mrecoil, recoilPart.inverseKin, angleTol_, energyTol_) &&
+	        ejectTable.Build(Vcm, ejectVcm, Meject, ejectPart.inverseKin, angleTol_, energyTol_));
+}
+
+bool reaction::LabToCom(const double &thetaLab_, double &thetaCom_, double &energy_, const bool &recoil_/*=false*/){
+	kinematicsTable &table = (recoil_ ? recoilTable : ejectTable);
+	if(!table.Empty()) return table.Evaluate(thetaLab_, thetaCom_, energy_);
+
+	particle &part = (recoil_ ? recoilPart : ejectPart);
+	bool retval = part.calculate(thetaLab_, Vcm, (recoil_ ? recoilVcm : ejectVcm), (recoil_ ? Mrecoil : Meject));
+	thetaCom_ = part.comAngle[0];
+	energy_ = part.E[0];
+	return retval;
+}
+
+size_t reaction::LabToCom(const double *thetaLab_, double *thetaCom_, double *energy_, const size_t &N_, const bool &recoil_/*=false*/){
+	kinematicsTable &table = (recoil_ ? recoilTable : ejectTable);
+	if(!table.Empty()) return table.Evaluate(thetaLab_, thetaCom_, energy_, N_);
+
+	size_t count = 0;
+	double E;
+	for(size_t j = 0; j < N_; j++){
+		if(LabToCom(thetaLab_[j], thetaCom_[j], (energy_ ? energy_[j] : E), recoil_)) count++;
+	}
+	return count;
+}
+
 void reaction::Print(){
 	particle tempParticle1;
 	particle tempParticle2;
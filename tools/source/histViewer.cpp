@@ -0,0 +1,339 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "TApplication.h"
+#include "TSystem.h"
+#include "TCanvas.h"
+#include "TH1F.h"
+#include "TH2F.h"
+#include "TVirtualPad.h"
+
+#include "CTerminal.h"
+#include "hist_snapshot.h"
+
+#include "simpleTool.hpp"
+
+#define VIEWER_POLL_TIMEOUT 10 // Time to wait for new frames between processing root events (in ms).
+#define VIEWER_RECV_SIZE 65536 // Number of bytes to read with a single call to recv().
+
+class histViewer : public simpleTool {
+  private:
+	std::string address; /// TCP address (host:port or port) or local socket path of the histogram server.
+	std::string histNames; /// Comma-delimited list of histograms to display.
+
+	unsigned int cols; /// Number of canvas columns.
+	unsigned int rows; /// Number of canvas rows.
+
+	bool listMode; /// Print the list of published histograms and exit.
+	bool logy; /// Use a logarithmic scale for 1d histograms.
+	bool logz; /// Use a logarithmic scale for 2d histograms.
+
+	int sock; /// Socket connected to the histogram server.
+
+	std::string buffer; /// Data received from the server which has not been decoded.
+
+	HistSnapshot snapshot; /// Current state of all published histograms.
+
+	std::vector<int> display; /// Index of the snapshot histogram drawn on each pad (-1 for none).
+	std::vector<TH1*> hists; /// Root histograms drawn on each pad.
+
+	unsigned long numFrames; /// Number of frames received.
+
+	bool connectServer();
+
+	/** Decode all complete frames in the receive buffer.
+	  * \param[out] changed Flags for each snapshot histogram which has changed.
+	  * \param[out] keyframe Set to true if one of the frames was a keyframe.
+	  * \return The number of decoded frames, or -1 if a frame is corrupt.
+	  */
+	int decodeFrames(std::vector<bool> &changed, bool &keyframe);
+
+	/// Select the histograms to display after a keyframe.
+	void selectHists();
+
+	/// Copy the contents of the displayed histograms which have changed and redraw the canvas.
+	void updateHists(const std::vector<bool> &changed, const bool &keyframe);
+
+	/// Print the list of published histograms.
+	void printHists();
+
+  public:
+	histViewer() : simpleTool(), address("5556"), histNames(), cols(2), rows(2), listMode(false), logy(false), logz(false),
+	               sock(-1), buffer(), snapshot(), display(), hists(), numFrames(0) { }
+
+	~histViewer();
+
+	void addOptions();
+
+	bool processArgs();
+
+	int execute(int argc, char *argv[]);
+};
+
+histViewer::~histViewer(){
+	for(std::vector<TH1*>::iterator iter = hists.begin(); iter != hists.end(); iter++)
+		if(*iter) delete (*iter);
+	if(sock >= 0) close(sock);
+}
+
+void histViewer::addOptions(){
+	addOption(optionExt("address", required_argument, NULL, 'a', "<address>", "Specify the server address as host:port, port, or a local socket path (default=5556)."), userOpts, optstr);
+	addOption(optionExt("hists", required_argument, NULL, 'H', "<list>", "Specify a comma-delimited list of histogram names to display."), userOpts, optstr);
+	addOption(optionExt("cols", required_argument, NULL, 0, "<N>", "Specify the number of canvas columns (default=2)."), userOpts, optstr);
+	addOption(optionExt("rows", required_argument, NULL, 0, "<N>", "Specify the number of canvas rows (default=2)."), userOpts, optstr);
+	addOption(optionExt("list", no_argument, NULL, 'l', "", "Print the list of published histograms and exit."), userOpts, optstr);
+	addOption(optionExt("logy", no_argument, NULL, 0, "", "Use logarithmic y-axis scale for 1d histograms."), userOpts, optstr);
+	addOption(optionExt("logz", no_argument, NULL, 0, "", "Use logarithmic z-axis scale for 2d histograms."), userOpts, optstr);
+}
+
+bool histViewer::processArgs(){
+	if(userOpts.at(0).active)
+		address = userOpts.at(0).argument;
+	if(userOpts.at(1).active)
+		histNames = userOpts.at(1).argument;
+	if(userOpts.at(2).active)
+		cols = strtoul(userOpts.at(2).argument.c_str(), NULL, 0);
+	if(userOpts.at(3).active)
+		rows = strtoul(userOpts.at(3).argument.c_str(), NULL, 0);
+	listMode = userOpts.at(4).active;
+	logy = userOpts.at(5).active;
+	logz = userOpts.at(6).active;
+
+	if(cols == 0 || rows == 0){
+		std::cout << " Error: Invalid canvas size (" << cols << "x" << rows << ")!\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool histViewer::connectServer(){
+	std::string host = "localhost";
+	std::string port = address;
+
+	size_t index = address.find_last_of(':');
+	if(index != std::string::npos){
+		host = address.substr(0, index);
+		port = address.substr(index+1);
+	}
+
+	if(port.find_first_not_of("0123456789") != std::string::npos){ // Local (unix domain) socket.
+		struct sockaddr_un serv;
+		if(address.length() >= sizeof(serv.sun_path)) return false;
+		memset(&serv, 0, sizeof(serv));
+		serv.sun_family = AF_UNIX;
+		strcpy(serv.sun_path, address.c_str());
+
+		sock = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(sock < 0) return false;
+		return (connect(sock, (struct sockaddr *)&serv, sizeof(serv)) == 0);
+	}
+
+	// TCP socket.
+	struct addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) return false;
+
+	sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	bool retval = (sock >= 0 && connect(sock, result->ai_addr, result->ai_addrlen) == 0);
+	freeaddrinfo(result);
+
+	return retval;
+}
+
+int histViewer::decodeFrames(std::vector<bool> &changed, bool &keyframe){
+	int count = 0;
+	size_t offset = 0;
+	std::vector<bool> frameChanged;
+	HistFrameHeader header;
+	while(buffer.length() - offset >= HistFrameHeader::GetSize()){
+		if(!header.Read(&buffer[offset])){
+			std::cout << " Error: Received an invalid frame header (version " << header.version << ")!\n";
+			return -1;
+		}
+		if(buffer.length() - offset < HistFrameHeader::GetSize() + header.length) break; // Incomplete frame.
+
+		if(!snapshot.Decode(header, &buffer[offset+HistFrameHeader::GetSize()], frameChanged)){
+			std::cout << " Error: Failed to decode frame " << header.sequence << "!\n";
+			return -1;
+		}
+		offset += HistFrameHeader::GetSize() + header.length;
+
+		if(header.type == HIST_KEYFRAME){
+			changed.assign(frameChanged.size(), true);
+			keyframe = true;
+		}
+		else{
+			changed.resize(frameChanged.size(), false);
+			for(size_t i = 0; i < frameChanged.size(); i++)
+				if(frameChanged[i]) changed[i] = true;
+		}
+
+		numFrames++;
+		count++;
+	}
+	buffer.erase(0, offset);
+	return count;
+}
+
+void histViewer::selectHists(){
+	display.assign(cols*rows, -1);
+
+	if(!histNames.empty()){ // Display the requested histograms.
+		std::vector<std::string> names;
+		split_str(histNames, names, ',');
+		for(size_t i = 0; i < names.size() && i < display.size(); i++){
+			display[i] = snapshot.Find(names[i]);
+			if(display[i] < 0)
+				std::cout << " Warning: Histogram \"" << names[i] << "\" is not published by the server.\n";
+		}
+	}
+	else{ // Display the first main histograms.
+		size_t pad = 0;
+		for(size_t i = 0; i < snapshot.GetNumHists() && pad < display.size(); i++){
+			if(snapshot.info[i].location < 0) display[pad++] = i;
+		}
+	}
+}
+
+void histViewer::updateHists(const std::vector<bool> &changed, const bool &keyframe){
+	if(keyframe){ // Rebuild all root histograms.
+		for(std::vector<TH1*>::iterator iter = hists.begin(); iter != hists.end(); iter++)
+			if(*iter) delete (*iter);
+		hists.assign(display.size(), NULL);
+
+		for(size_t pad = 0; pad < display.size(); pad++){
+			if(display[pad] < 0) continue;
+			const HistInfo &info = snapshot.info[display[pad]];
+			if(info.dim == 1)
+				hists[pad] = new TH1F(info.name.c_str(), info.title.c_str(), info.xbins, info.xmin, info.xmax);
+			else
+				hists[pad] = new TH2F(info.name.c_str(), info.title.c_str(), info.xbins, info.xmin, info.xmax, info.ybins, info.ymin, info.ymax);
+			hists[pad]->SetDirectory(0);
+			hists[pad]->GetXaxis()->SetTitle(info.xtitle.c_str());
+			hists[pad]->GetYaxis()->SetTitle(info.ytitle.c_str());
+		}
+	}
+
+	bool redraw = keyframe;
+	for(size_t pad = 0; pad < display.size(); pad++){
+		if(display[pad] < 0 || !(keyframe || changed[display[pad]])) continue;
+		const std::vector<double> &contents = snapshot.contents[display[pad]];
+		for(size_t cell = 0; cell < contents.size(); cell++)
+			hists[pad]->SetBinContent(cell, contents[cell]);
+		hists[pad]->SetEntries(snapshot.entries[display[pad]]);
+		can1->cd(pad+1)->Modified();
+		redraw = true;
+	}
+
+	if(keyframe){
+		for(size_t pad = 0; pad < display.size(); pad++){
+			if(display[pad] < 0) continue;
+			can1->cd(pad+1);
+			if(snapshot.info[display[pad]].dim == 1 && logy) gPad->SetLogy();
+			if(snapshot.info[display[pad]].dim == 2 && logz) gPad->SetLogz();
+			hists[pad]->Draw(snapshot.info[display[pad]].opt.c_str());
+		}
+	}
+
+	if(redraw) can1->Update();
+}
+
+void histViewer::printHists(){
+	std::cout << " Server publishes " << snapshot.GetNumHists() << " histograms.\n";
+	for(size_t i = 0; i < snapshot.GetNumHists(); i++){
+		const HistInfo &info = snapshot.info[i];
+		std::cout << "  " << info.name << "\t" << info.dim << "d\t" << info.title;
+		if(info.location >= 0) std::cout << " (det=" << info.location << ")";
+		std::cout << std::endl;
+	}
+}
+
+int histViewer::execute(int argc, char *argv[]){
+	if(!setup(argc, argv))
+		return 0;
+
+	if(!connectServer()){
+		std::cout << " Error: Failed to connect to histogram server \"" << address << "\"!\n";
+		return 1;
+	}
+	std::cout << " Connected to histogram server \"" << address << "\".\n";
+
+	if(!listMode){
+		openCanvas1("Online Histograms");
+		can1->Divide(cols, rows);
+	}
+
+	setup_signal_handlers();
+
+	std::vector<char> data(VIEWER_RECV_SIZE);
+	std::vector<bool> changed;
+	bool haveKeyframe = false;
+	int retval = 0;
+	while(true){
+		int signalReturn = check_signals();
+		if(signalReturn == SIGSEGV || signalReturn == SIGINT || signalReturn == SIGTSTP)
+			break;
+
+		struct pollfd pfd;
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if(poll(&pfd, 1, VIEWER_POLL_TIMEOUT) > 0){
+			ssize_t nBytes = recv(sock, data.data(), data.size(), 0);
+			if(nBytes <= 0){
+				std::cout << " Histogram server closed the connection.\n";
+				break;
+			}
+			buffer.append(data.data(), nBytes);
+
+			// Decode all complete frames before updating the display.
+			changed.clear();
+			bool keyframe = false;
+			int nFrames = decodeFrames(changed, keyframe);
+			if(nFrames < 0){
+				retval = 2;
+				break;
+			}
+
+			// A keyframe is received on connection, and whenever this viewer falls behind.
+			if(nFrames > 0 && (keyframe || haveKeyframe)){
+				if(listMode){
+					printHists();
+					break;
+				}
+				if(keyframe) selectHists();
+				haveKeyframe = true;
+				updateHists(changed, keyframe);
+			}
+		}
+
+		if(!listMode) gSystem->ProcessEvents();
+	}
+
+	unset_signal_handlers();
+
+	std::cout << " Received " << numFrames << " frames.\n";
+
+	return retval;
+}
+
+int main(int argc, char *argv[]){
+	histViewer obj;
+
+	return obj.execute(argc, argv);
+}
@@ -8,6 +8,82 @@
 #include "simpleTool.hpp"
 #include "Structures.hpp"
 
+class phaseWorker : public simpleToolWorker {
+  public:
+	phaseWorker(const int &startID_, const int &stopID_, const float &threshold_, const int &firstRun_) : 
+	  startID(startID_), stopID(stopID_), threshold(threshold_), firstRun(firstRun_), ptr(NULL) { }
+
+	~phaseWorker(){ delete ptr; }
+
+	bool setInputBranches(TTree *intree_, const size_t &fileIndex_);
+
+	void setOutputBranches(TTree *outtree_);
+
+	bool processEntry();
+
+  private:
+	int startID;
+	int stopID;
+	float threshold;
+	int firstRun;
+
+	int run;
+	float p1, p2;
+	float max1, max2;
+	double tdiff;
+
+	TraceStructure *ptr;
+};
+
+bool phaseWorker::setInputBranches(TTree *intree_, const size_t &fileIndex_){
+	TBranch *branch = NULL;
+	intree_->SetBranchAddress("trace", &ptr, &branch);
+
+	if(!branch){
+		std::cout << " Error: Failed to load branch \"trace\" from input TTree.\n";
+		return false;
+	}
+
+	run = firstRun + fileIndex_;
+
+	return true;
+}
+
+void phaseWorker::setOutputBranches(TTree *outtree_){
+	outtree_->Branch("tdiff", &tdiff);
+	outtree_->Branch("p1", &p1);
+	outtree_->Branch("p2", &p2);
+	outtree_->Branch("max1", &max1);
+	outtree_->Branch("max2", &max2);
+	outtree_->Branch("run", &run);
+}
+
+bool phaseWorker::processEntry(){
+	if(ptr->mult == 0)
+		return false;
+	p1 = -1;
+	p2 = -1;
+	for(unsigned int j = 0; j < ptr->mult; j++){
+		if(ptr->loc[j] == startID){
+			max1 = ptr->maximum[j];
+
+			// Check the threshold.
+			if(max1 >= threshold)
+				p1 = ptr->phase[j]*4;
+		}
+		else if(ptr->loc[j] == stopID){
+			max2 = ptr->maximum[j];
+
+			// Check the threshold.
+			if(max2 >= threshold){
+				p2 = ptr->phase[j]*4;
+				tdiff = ptr->tdiff[j];
+			}
+		}
+	}
+	return (p1 > 0 && p2 > 0);
+}
+
 class phasePhase : public simpleTool {
   private:
 	int startID;
@@ -19,19 +95,16 @@ class phasePhase : public simpleTool {
 
 	float threshold;
 
-	int run;
-	float p1, p2;
-	float max1, max2;
-	double tdiff;
+	int firstRun;
 
 	std::string input_prefix;
 
 	void setFilename(int run);
 
-	bool process();
+	simpleToolWorker *createWorker();
 	
   public:
-	phasePhase() : simpleTool(), startID(0), stopID(1), padding(3), startFile(1), stopFile(1), threshold(0.0), input_prefix("") { }
+	phasePhase() : simpleTool(), startID(0), stopID(1), padding(3), startFile(1), stopFile(1), threshold(0.0), firstRun(0), input_prefix("") { }
 	
 	void addOptions();
 	
@@ -50,55 +123,8 @@ void phasePhase::setFilename(int run){
 	input_filename += stream.str() + ".root";
 }
 
-bool phasePhase::process(){
-	if(!outtree) return false;
-
-	std::cout << " Processing " << input_filename << ".\n";
-	if(!openInputFile()) return false;
-
-	if(!loadInputTree()){
-		std::cout << "  Failed to load input tree!\n";
-		return false;
-	}
-
-	TBranch *branch = NULL;
-	TraceStructure *ptr = NULL;
-
-	intree->SetBranchAddress("trace", &ptr, &branch);
-
-	if(!branch){
-		std::cout << " Error: Failed to load branch \"trace\" from input TTree.\n";
-		return false;
-	}
-
-	while(getNextEntry()){
-		if(ptr->mult == 0)
-			continue;
-		p1 = -1;
-		p2 = -1;
-		for(unsigned int j = 0; j < ptr->mult; j++){
-			if(ptr->loc[j] == startID){
-				max1 = ptr->maximum[j];
-
-				// Check the threshold.
-				if(max1 >= threshold)
-					p1 = ptr->phase[j]*4;
-			}
-			else if(ptr->loc[j] == stopID){
-				max2 = ptr->maximum[j];
-
-				// Check the threshold.
-				if(max2 >= threshold){
-					p2 = ptr->phase[j]*4;
-					tdiff = ptr->tdiff[j];
-				}
-			}
-		}
-		if(p1 > 0 && p2 > 0)
-			outtree->Fill();
-	}
-
-	return true;
+simpleToolWorker *phasePhase::createWorker(){
+	return new phaseWorker(startID, stopID, threshold, firstRun);
 }
 
 void phasePhase::addOptions(){
@@ -195,24 +221,23 @@ int phasePhase::execute(int argc, char *argv[]){
 		return 3;
 	}
 	
+	// The output branches are added by processParallel.
 	outtree = new TTree("t", "tree");
-	outtree->Branch("tdiff", &tdiff);
-	outtree->Branch("p1", &p1);
-	outtree->Branch("p2", &p2);
-	outtree->Branch("max1", &max1);
-	outtree->Branch("max2", &max2);
-	outtree->Branch("run", &run);
-
-	// Specifying a full filename takes precedence over filename prefix.
-	if(!input_filename.empty()){
-		process();
-	}
-	else{
-		for(run = startFile; run <= stopFile; run++){
+
+	// Specifying a full filename takes precedence over filename prefix. The run
+	// number is the index of the input file unless files are specified by run number.
+	if(input_filename.empty()){
+		firstRun = startFile;
+		for(int run = startFile; run <= stopFile; run++){
 			setFilename(run);
-			process();
+			filename_list.push_back(input_filename);
 		}
 	}
+
+	if(!processParallel()){
+		std::cout << " Error: Failed to process input files.\n";
+		return 4;
+	}
 	
 	outfile->cd();
 	outtree->Write();
@@ -544,48 +544,14 @@ void pspmtBarMap::buildEventList(std::vector<fullBarEvent*>& vec_){
 ///////////////////////////////////////////////////////////////////////////////
 
 void pspmtHandler::process(){
-	// Check for invalid TQDC.
-	if(tqdc_L <= 0 || (!singleEndedMode && tqdc_R <= 0)) return;
-
-	BarCal *bar = NULL;
-	if(!singleEndedMode && !(bar = calib.GetBarCal(location))) return;
-
-	TimeCal *time = NULL;
-	double tDiffOffset_L = 0;
-	double tDiffOffset_R = 0;
-	if(!noTimeMode){
-		if(!(time = calib.GetTimeCal(location))) return;
-		tDiffOffset_L = time->t0;
-	}
-	if(!singleEndedMode){
-		TimeCal *time_R = calib.GetTimeCal(location+1);
-		if(time_R) tDiffOffset_R = time_R->t0;
-	}
-
-	PositionCal *pos = NULL;
-	pspmtPosCal *pspmtpos = NULL;
-	if(!noPositionMode){
-		if(!(pos = calib.GetPositionCal(location)) || location >= pspmtcal.size()) return;
-		pspmtpos = &pspmtcal.at(location);
-	}
-
-	// Compute the corrected time difference
-	if(!singleEndedMode){
-		tdiff = (tdiff_R - tdiff_L);
-		lbal = (tqdc_L-tqdc_R)/(tqdc_L+tqdc_R);
-		if(!useLightBalance){
-			tdiff = tdiff - bar->t0;
-			y = bar->cbar*tdiff/200; // m
-		}
-		else{ // Use light balance to compute position in detector.
-			lbal = lbal - bar->t0;
-			y = lbal*((bar->length/100)/bar->beta);
-		}
-	}
-	else y = 0; // m
+	// Check for invalid TQDC and missing calibration.
+	if(!kernel.Check(location, tqdc_L, tqdc_R)) return;
 
 	// Compute the 3d position of the detection event
 	if(!noPositionMode){
+		if(location >= pspmtcal.size()) return;
+		pspmtPosCal *pspmtpos = &pspmtcal.at(location);
+
 		// Get the calibrated X and Y positions.
 		if(!singleEndedMode)
 			pspmtpos->calibrate((xdetL+xdetR)/2, (ydetL+ydetR)/2, cxdet, cydet);
@@ -595,65 +561,29 @@ void pspmtHandler::process(){
 		// Get the X and Y pixel hit locations.
 		xcell = getXcell(cxdet);
 		ycell = getYcell(cydet);
-
-		// Vector from the center to the interaction point.
-		Vector3 p(cxdet, cydet, y); 
-	
-		// Rotate to the frame of the bar.
-		pos->Transform(p);
-	
-		// Calculate the vector from the origin of the lab frame.
-		Vector3 r0 = (*pos->GetPosition()) + p;
-		x = r0.axis[0]; // m
-		y = r0.axis[1]; // m
-		z = r0.axis[2]; // m
-
-		// Convert the event vector to spherical.
-		Cart2Sphere(r0, r, theta, phi);
 	}
-	else{
-		r = 0;
-		theta = 0;
-		phi = 0;
-		x = 0;
-		z = 0;
-	}
-
-	if(!singleEndedMode)
-		tof = (tdiff_R - tDiffOffset_R + tdiff_L - tDiffOffset_L)/2;
-	else
-		tof = tdiff_L;
 
-	if(userEnergyOffset > 0)
-		tof += energy2tof(userEnergyOffset, pos->r0) - 100*pos->r0/cvac;
+	// Compute the position along the bar, the TOF, the energy, and the lab frame position.
+	columns.clear();
+	columns.push_back(location, tdiff_L, (!singleEndedMode ? tdiff_R : 0), tqdc_L, (!singleEndedMode ? tqdc_R : 0), (!noPositionMode ? cxdet : 0), (!noPositionMode ? cydet : 0));
+	kernel.Process(columns, debug);
 
-	// Calculate the corrected TOF.
-	ctof = tof;
-	//if(!noTimeMode) // Correct timing offset. This should place the gamma-flash at t=0 ns.
-	//	ctof = ctof - time->t0;
-	if(!noPositionMode) // Correct the gamma-flash offset for distance from source.
-		ctof += 100*pos->r0/cvac;
-
-	if(!noEnergyMode){// Calibrate the TQDC.
-		if(!singleEndedMode){
-			EnergyCal *ecalLeft = calib.GetEnergyCal(location);
-			EnergyCal *ecalRight = calib.GetEnergyCal(location+1);
-			if(ecalLeft && !ecalLeft->defaultVals){
-				if(!ecalRight || ecalRight->defaultVals){ // Use pairwise calibration.
-					ctqdc = ecalLeft->GetCalEnergy(std::sqrt(tqdc_R*tqdc_L));
-				}
-				else{ // Use individual channel calibration.
-					tqdc_L = ecalLeft->GetCalEnergy(tqdc_L);
-					tqdc_R = ecalRight->GetCalEnergy(tqdc_R);
-					ctqdc = std::sqrt(tqdc_R*tqdc_L);
-				}
-			}
-		}
-		else{
-			EnergyCal *ecal = calib.GetEnergyCal(location);
-			if(ecal) ctqdc = ecal->GetCalEnergy(tqdc);
-		}
-	}
+	if(!singleEndedMode){
+		tdiff = columns.tdiff[0];
+		lbal = columns.lbal[0];
+		if(!useLightBalance)
+			tdiff = tdiff - kernel.GetBarOffset(location);
+	}
+	tof = columns.tof[0];
+	ctof = columns.ctof[0];
+	if(!noEnergyMode)
+		ctqdc = columns.ctqdc[0];
+	x = columns.x[0];
+	y = columns.y[0];
+	z = columns.z[0];
+	r = columns.r[0];
+	theta = columns.theta[0];
+	phi = columns.phi[0];
 
 	// Get the TQDC from the start detector.
 	if(sptr && sptr->mult > 0)
@@ -663,27 +593,18 @@ void pspmtHandler::process(){
 
 	// Calculate the neutron energy.
 	if(!noPositionMode){
-		energy = tof2energy(ctof, r);
+		energy = columns.energy[0];
 		
 		// Compute the energy to the center of the bar (i.e. no segmentation, equivalent to barifier).
 		if(debug){ 
 			// Select a random point inside the bar.
-			double xdetRan = frand(-bar->width/200, bar->width/200);
-			double ydetRan = frand(-bar->height/200, bar->height/200);
+			double xdetRan = frand(-kernel.GetHalfWidth(location), kernel.GetHalfWidth(location));
+			double ydetRan = frand(-kernel.GetHalfHeight(location), kernel.GetHalfHeight(location));
 
-			// Compute the "non-segmented" random position in the bar.			
-			Vector3 p(xdetRan, ydetRan, y);
-			pos->Transform(p);
-			Vector3 r0 = (*pos->GetPosition()) + p;
+			// Compute the energy at the "non-segmented" random position in the bar (ybar is along the bar).
+			barifierE = tof2energy(ctof, kernel.GetDistance(location, xdetRan, ydetRan, columns.ybar[0]));
 			
-			// Compute the energy.
-			barifierE = tof2energy(ctof, r0.Length());
-			
-			p = Vector3(0, 0, y);
-			pos->Transform(p);
-			r0 = (*pos->GetPosition()) + p;
-			
-			centerE = tof2energy(ctof, r0.Length());
+			centerE = columns.centerE[0];
 		}
 	}
 	
@@ -1082,6 +1003,10 @@ int pspmtHandler::execute(int argc, char *argv[]){
 		if(!noEnergyMode && !calib.LoadEnergyCal((setupDir+"energy.cal").c_str())) return 5;
 		if(!singleEndedMode && !calib.LoadBarCal((setupDir+"bars.cal").c_str())) return 6;
 
+		// Flatten the calibration for processing.
+		if(!kernel.Build(calib, singleEndedMode, !noTimeMode, !noEnergyMode, !noPositionMode, useLightBalance, true, userEnergyOffset))
+			std::cout << " Warning: No detector locations have all required calibration entries!\n";
+
 		if(output_filename.empty()){
 			std::cout << " Error: Output filename not specified!\n";
 			return 7;
@@ -0,0 +1,516 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "ScanInterface.hpp"
+#include "Unpacker.hpp"
+#include "XiaData.hpp"
+#include "hribf_buffers.h"
+#include "helperFunctions.h"
+
+#include "MapFile.hpp"
+#include "ConfigFile.hpp"
+#include "ColorTerm.hpp"
+
+// Define the name of the program.
+#if not defined(PROG_NAME)
+#define PROG_NAME "rawSkimmer"
+#endif
+
+/** Parse a comma-delimited list of pixie channel IDs (mod*16+chan). Individual entries may
+  * also be specified as a range with the format "start:stop".
+  * \param[in]  input_ The comma-delimited list of channel IDs.
+  * \param[out] ids    Vector of all channel IDs read from the input list.
+  * \return True if the list was parsed successfully and false otherwise.
+  */
+bool parseChannelList(const std::string &input_, std::vector<int> &ids){
+	std::string entry;
+	for(size_t i = 0; i <= input_.size(); i++){
+		if(i < input_.size() && input_[i] != ','){
+			entry += input_[i];
+			continue;
+		}
+		if(entry.empty()) continue;
+		size_t index = entry.find(':');
+		if(index == std::string::npos){
+			ids.push_back(strtol(entry.c_str(), NULL, 0));
+		}
+		else{
+			int start = strtol(entry.substr(0, index).c_str(), NULL, 0);
+			int stop = strtol(entry.substr(index+1).c_str(), NULL, 0);
+			if(stop < start) return false;
+			for(int id = start; id <= stop; id++)
+				ids.push_back(id);
+		}
+		entry = "";
+	}
+	return !ids.empty();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class skimUnpacker
+///////////////////////////////////////////////////////////////////////////////
+
+class skimUnpacker : public Unpacker {
+  public:
+	/** Default constructor
+	  */
+	skimUnpacker();
+
+	/** Destructor
+	  */
+	~skimUnpacker(){  }
+
+	/** Set the output file to which selected events will be written
+	  */
+	void SetOutputFile(PollOutputFile *output_){ output = output_; }
+
+	/** Add a pixie channel ID (mod*16+chan) to the list of channels to write to the output file
+	  */
+	void AddChannel(const int &id);
+
+	/** Set the time window (in pixie clock ticks relative to the first event) of events to write to the output file
+	  */
+	void SetTimeWindow(const double &low_, const double &high_){ windowLow = low_; windowHigh = high_; useWindow = true; }
+
+	/** Only write raw events containing a start signal and at least one other selected channel
+	  */
+	void SetCoincidence(const int &startID_){ startID = startID_; useCoincidence = true; }
+
+	/** Get the total number of channel events written to the output file
+	  */
+	unsigned long GetNumEventsWritten() const { return numEventsWritten; }
+
+	/** Get the total number of channel events which have been read from the input file
+	  */
+	unsigned long GetNumEventsRead() const { return numEventsRead; }
+
+	/** Get the total number of spills written to the output file
+	  */
+	unsigned long GetNumSpillsWritten() const { return numSpillsWritten; }
+
+	/** Reset the first event time, used when a new input file is loaded
+	  */
+	void ResetFirstTime(){ firstEventTime = -1; }
+
+  private:
+	PollOutputFile *output; ///< Pointer to the output .pld or .ldf file
+
+	std::vector<bool> selected; ///< Flags for each selected pixie channel ID (empty if all channels are selected)
+	std::vector<std::vector<unsigned int> > moduleData; ///< Re-encoded data words for each pixie module in the current spill
+	std::vector<char> eventData; ///< Temporary array for encoding individual channel events
+
+	double firstEventTime; ///< The time of the first event read from the input file (in pixie clock ticks)
+	double windowLow; ///< The low edge of the time window (in pixie clock ticks relative to the first event)
+	double windowHigh; ///< The high edge of the time window (in pixie clock ticks relative to the first event)
+
+	int startID; ///< The pixie ID of the start detector used for coincidence selection
+
+	bool useWindow; ///< Flag indicating that only events inside of the time window will be written
+	bool useCoincidence; ///< Flag indicating that only raw events containing a start signal will be written
+
+	unsigned long numEventsRead; ///< Total number of channel events read from the input
+	unsigned long numEventsWritten; ///< Total number of channel events written to the output
+	unsigned long numSpillsWritten; ///< Total number of spills written to the output
+
+	/** Return true if the specified channel event passes the channel and time window selection
+	  */
+	bool isSelected(XiaData *event_);
+
+	/** Re-encode a channel event and append it to the data buffer of its module
+	  */
+	void writeEvent(XiaData *event_);
+
+	/** Select events from the raw event and append them to the current output spill.
+	  * @param addr_ Pointer to a ScanInterface object.
+	  * @return Nothing.
+	  */
+	virtual void ProcessRawEvent(ScanInterface *addr_=NULL);
+
+	/** Write all selected events in the current spill to the output file.
+	  * @param addr_ Pointer to a ScanInterface object.
+	  * @return Nothing.
+	  */
+	virtual void EndSpill(ScanInterface *addr_=NULL);
+};
+
+skimUnpacker::skimUnpacker() : Unpacker(), output(NULL), firstEventTime(-1), windowLow(0), windowHigh(0), startID(-1),
+                               useWindow(false), useCoincidence(false), numEventsRead(0), numEventsWritten(0), numSpillsWritten(0) {
+}
+
+void skimUnpacker::AddChannel(const int &id){
+	if(id < 0) return;
+	if((int)selected.size() < id+1)
+		selected.resize(id+1, false);
+	selected[id] = true;
+}
+
+bool skimUnpacker::isSelected(XiaData *event_){
+	if(!selected.empty()){
+		int id = (event_->modNum % 100)*16 + event_->chanNum;
+		if(id >= (int)selected.size() || !selected[id]) return false;
+	}
+	if(useWindow){
+		double dt = event_->time - firstEventTime;
+		if(dt < windowLow || dt > windowHigh) return false;
+	}
+	return true;
+}
+
+void skimUnpacker::writeEvent(XiaData *event_){
+	unsigned int vsn = event_->modNum % 100;
+	if(vsn+1 > moduleData.size())
+		moduleData.resize(vsn+1);
+
+	size_t numWords = event_->getEventLengthRevF();
+	if(eventData.size() < 4*numWords)
+		eventData.resize(4*numWords);
+
+	int numBytes = event_->writeEventRevF(NULL, eventData.data());
+	if(numBytes <= 0) return;
+
+	std::vector<unsigned int> &buffer = moduleData.at(vsn);
+	size_t offset = buffer.size();
+	buffer.resize(offset + numBytes/4);
+	memcpy((char *)&buffer[offset], eventData.data(), numBytes);
+
+	numEventsWritten++;
+}
+
+void skimUnpacker::ProcessRawEvent(ScanInterface *addr_/*=NULL*/){
+	if(firstEventTime < 0 && !rawEvent.empty())
+		firstEventTime = rawEvent.front()->time;
+
+	numEventsRead += rawEvent.size();
+
+	if(useCoincidence){
+		// Check that the raw event contains a start and at least one other selected event.
+		XiaData *start = NULL;
+		bool foundOther = false;
+		for(std::deque<XiaData*>::iterator iter = rawEvent.begin(); iter != rawEvent.end(); ++iter){
+			if((*iter)->getID() == startID){
+				if(!start) start = (*iter);
+			}
+			else if(isSelected(*iter)){
+				foundOther = true;
+			}
+		}
+		if(start && foundOther){
+			for(std::deque<XiaData*>::iterator iter = rawEvent.begin(); iter != rawEvent.end(); ++iter){
+				if((*iter) == start || ((*iter)->getID() != startID && isSelected(*iter)))
+					writeEvent(*iter);
+			}
+		}
+	}
+	else{
+		for(std::deque<XiaData*>::iterator iter = rawEvent.begin(); iter != rawEvent.end(); ++iter){
+			if(isSelected(*iter))
+				writeEvent(*iter);
+		}
+	}
+
+	// Delete all events in the raw event.
+	Unpacker::ProcessRawEvent(addr_);
+}
+
+void skimUnpacker::EndSpill(ScanInterface *addr_/*=NULL*/){
+	bool hasData = false;
+	size_t totalWords = 0;
+	for(std::vector<std::vector<unsigned int> >::iterator iter = moduleData.begin(); iter != moduleData.end(); ++iter){
+		if(!iter->empty()) hasData = true;
+		totalWords += iter->size() + 2;
+	}
+
+	// Do not write empty spills to the output file.
+	if(!hasData || !output || !output->IsOpen()){
+		moduleData.clear();
+		return;
+	}
+
+	// Build the output spill. The module buffers must be contiguous, starting with vsn 0.
+	std::vector<unsigned int> spill;
+	spill.reserve(totalWords);
+	for(size_t vsn = 0; vsn < moduleData.size(); vsn++){
+		spill.push_back(moduleData.at(vsn).size() + 2); // Buffer length (including the two header words).
+		spill.push_back(vsn); // Module number.
+		spill.insert(spill.end(), moduleData.at(vsn).begin(), moduleData.at(vsn).end());
+	}
+
+	if(output->Write((char *)spill.data(), spill.size()) < 0)
+		errStr << "skimUnpacker: ERROR! Failed to write spill of " << spill.size() << " words to output file!\n";
+	else
+		numSpillsWritten++;
+
+	moduleData.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class skimScanner
+///////////////////////////////////////////////////////////////////////////////
+
+class skimScanner : public ScanInterface {
+  public:
+	/** Default constructor
+	  */
+	skimScanner();
+
+	/** Destructor
+	  */
+	~skimScanner(){  }
+
+	/** ExtraArguments is used to send command line arguments to classes derived
+	  * from ScanInterface.
+	  * @return Nothing.
+	  */
+	virtual void ExtraArguments();
+
+	/** ArgHelp is used to allow a derived class to add a command line option
+	  * to the main list of options.
+	  * @return Nothing.
+	  */
+	virtual void ArgHelp();
+
+	/** SyntaxStr is used to print a linux style usage message to the screen.
+	  * @param name_ The name of the program.
+	  * @return Nothing.
+	  */
+	virtual void SyntaxStr(char *name_);
+
+	/** Read the map and config files (if required) and set the event selection.
+	  * @param prefix_ String to append to the beginning of system output.
+	  * @return True upon successfully initializing and false otherwise.
+	  */
+	virtual bool Initialize(std::string prefix_="");
+
+	/** Receive various status notifications from the scan.
+	  * @param code_ The notification code passed from ScanInterface methods.
+	  * @return Nothing.
+	  */
+	virtual void Notify(const std::string &code_="");
+
+	/** Return a pointer to the Unpacker object to use for data unpacking.
+	  * If no object has been initialized, create a new one.
+	  * @return Pointer to an Unpacker object.
+	  */
+	virtual Unpacker *GetCore();
+
+  private:
+	PollOutputFile output; ///< The output .pld or .ldf file
+
+	std::string outputPrefix; ///< The output filename prefix
+	std::string channelList; ///< Comma-delimited list of channels to write to the output file
+	std::string detectorType; ///< Detector type name to select channels from the map file
+
+	double windowLow; ///< The low edge of the time window in seconds
+	double windowHigh; ///< The high edge of the time window in seconds
+
+	int outputFormat; ///< The output file format (0=.ldf, 1=.pld)
+
+	bool useWindow; ///< Flag indicating that a time window was specified
+	bool useCoincidence; ///< Flag indicating that start coincidence is required
+
+	/** Close the current output file and print the number of events written
+	  */
+	void closeOutputFile();
+};
+
+skimScanner::skimScanner() : ScanInterface(), windowLow(0), windowHigh(0), outputFormat(1), useWindow(false), useCoincidence(false) {
+}
+
+void skimScanner::closeOutputFile(){
+	if(!output.IsOpen()) return;
+
+	skimUnpacker *skim = (skimUnpacker*)GetCore();
+	std::cout << msgHeader << "Wrote " << skim->GetNumEventsWritten() << " of " << skim->GetNumEventsRead() << " events (";
+	std::cout << skim->GetNumSpillsWritten() << " spills) to \"" << output.GetCurrentFilename() << "\".\n";
+
+	float runTime = (GetFileFormat() == 1 || GetFileFormat() == 3 ? GetPldHeader()->GetRunTime() : 0.0);
+	output.CloseFile(runTime);
+}
+
+void skimScanner::ExtraArguments(){
+	if(userOpts.at(0).active){ // Channel list.
+		channelList = userOpts.at(0).argument;
+		std::cout << msgHeader << "Selecting channels \"" << channelList << "\".\n";
+	}
+	if(userOpts.at(1).active){ // Detector type.
+		detectorType = userOpts.at(1).argument;
+		lowercaseString(detectorType);
+		std::cout << msgHeader << "Selecting detector type \"" << detectorType << "\".\n";
+	}
+	if(userOpts.at(2).active){ // Time window.
+		std::string arg = userOpts.at(2).argument;
+		size_t index = arg.find(':');
+		if(index != std::string::npos){
+			windowLow = strtod(arg.substr(0, index).c_str(), NULL);
+			windowHigh = strtod(arg.substr(index+1).c_str(), NULL);
+			useWindow = true;
+			std::cout << msgHeader << "Selecting events from " << windowLow << " s to " << windowHigh << " s.\n";
+		}
+		else warnStr << msgHeader << "Warning! Invalid time window \"" << arg << "\". Expected <start:stop>.\n";
+	}
+	if(userOpts.at(3).active){ // Start coincidence.
+		std::cout << msgHeader << "Requiring start detector coincidence.\n";
+		useCoincidence = true;
+	}
+	if(userOpts.at(4).active){ // Output format.
+		std::string format = userOpts.at(4).argument;
+		if(format == "ldf") outputFormat = 0;
+		else if(format == "pld") outputFormat = 1;
+		else warnStr << msgHeader << "Warning! Invalid output format \"" << format << "\". Using pld.\n";
+	}
+}
+
+void skimScanner::ArgHelp(){
+	AddOption(optionExt("channels", required_argument, NULL, 0, "<list>", "Comma-delimited list of channel IDs (mod*16+chan or start:stop) to keep"));
+	AddOption(optionExt("type", required_argument, NULL, 0, "<type>", "Keep all channels of a detector type defined in the map file"));
+	AddOption(optionExt("window", required_argument, NULL, 0, "<start:stop>", "Keep events inside a time window (in seconds since the first event)"));
+	AddOption(optionExt("coinc", no_argument, NULL, 0, "", "Only keep raw events which contain a start signal"));
+	AddOption(optionExt("format", required_argument, NULL, 0, "<ldf|pld>", "Set the output file format (default is pld)"));
+}
+
+void skimScanner::SyntaxStr(char *name_){
+	std::cout << " usage: " << std::string(name_) << " [options]\n";
+}
+
+bool skimScanner::Initialize(std::string prefix_){
+	skimUnpacker *skim = (skimUnpacker*)GetCore();
+
+	double sysClock = 8E-9;
+
+	std::vector<int> ids;
+	if(!channelList.empty() && !parseChannelList(channelList, ids)){
+		errStr << prefix_ << "ERROR! Failed to parse channel list \"" << channelList << "\".\n";
+		return false;
+	}
+
+	// The map file and config file are only needed for type and coincidence selection.
+	if(!detectorType.empty() || useCoincidence){
+		std::string setupDirectory = this->GetSetupFilename();
+		if(setupDirectory.empty()) setupDirectory = "./setup/";
+		else if(setupDirectory.back() != '/') setupDirectory += '/';
+		std::cout << prefix_ << "Using setup directory \"" << setupDirectory << "\".\n";
+
+		std::string currentFile = setupDirectory + "map.dat";
+		std::cout << prefix_ << "Reading map file " << currentFile << "\n";
+		MapFile mapfile(currentFile.c_str());
+		if(!mapfile.IsInit()){ // Failed to read map file.
+			errStr << prefix_ << "Failed to read map file '" << currentFile << "'.\n";
+			return false;
+		}
+
+		currentFile = setupDirectory + "config.dat";
+		std::cout << prefix_ << "Reading config file " << currentFile << "\n";
+		ConfigFile configfile(currentFile.c_str());
+		if(!configfile.IsInit()){ // Failed to read config file.
+			errStr << prefix_ << "Failed to read configuration file '" << currentFile << "'.\n";
+			return false;
+		}
+		sysClock = configfile.sysClock;
+
+		if(!detectorType.empty() && mapfile.GetAllOccurances(detectorType, ids) == 0){
+			errStr << prefix_ << "ERROR! Detector type \"" << detectorType << "\" not found in map file.\n";
+			return false;
+		}
+
+		if(useCoincidence){
+			int startMod, startChan;
+			if(!mapfile.GetFirstStart(startMod, startChan)){
+				errStr << prefix_ << "ERROR! No start detector defined in map file.\n";
+				return false;
+			}
+			if(configfile.buildMethod < 2){
+				warnStr << prefix_ << "Warning! Raw event build method (" << configfile.buildMethod << ") is invalid for coincidence mode.\n";
+				configfile.buildMethod = 2;
+			}
+			skim->SetEventWidth(configfile.eventWidth * (1E-6 / configfile.sysClock));
+			skim->SetEventDelay(configfile.eventDelay * (1E-6 / configfile.sysClock));
+			skim->SetRawEventMode(configfile.buildMethod);
+			skim->SetStartChannel(startMod, startChan);
+			skim->SetCoincidence(startMod*16 + startChan);
+			std::cout << prefix_ << "Set start channel to (" << startMod << ", " << startChan << ").\n";
+		}
+	}
+
+	if(!useCoincidence) // Pass every channel event through the unpacker.
+		skim->SetRawEventMode(0);
+
+	for(std::vector<int>::iterator iter = ids.begin(); iter != ids.end(); ++iter)
+		skim->AddChannel(*iter);
+	if(!ids.empty())
+		std::cout << prefix_ << "Selected " << ids.size() << " channels.\n";
+
+	if(useWindow)
+		skim->SetTimeWindow(windowLow / sysClock, windowHigh / sysClock);
+
+	// Use the output filename to get the output prefix.
+	std::string extension = get_extension(GetOutputFilename(), outputPrefix);
+	if(extension == "ldf") outputFormat = 0;
+	else if(extension == "pld") outputFormat = 1;
+	if(outputPrefix.empty() || extension == "root") outputPrefix = "skim";
+
+	output.SetFileFormat(outputFormat);
+	output.SetDebugMode(DebugMode());
+	skim->SetOutputFile(&output);
+
+	return ScanInterface::Initialize(prefix_);
+}
+
+void skimScanner::Notify(const std::string &code_/*=""*/){
+	if(code_ == "START_SCAN"){  }
+	else if(code_ == "STOP_SCAN"){  }
+	else if(code_ == "SCAN_COMPLETE"){
+		std::cout << msgHeader << "Scan complete.\n";
+		closeOutputFile();
+	}
+	else if(code_ == "LOAD_FILE"){
+		closeOutputFile();
+
+		// Copy the run title and number from the input file header.
+		std::string title;
+		unsigned int runNumber;
+		if(GetFileFormat() == 0){
+			title = GetLdfHeader()->GetRunTitle();
+			runNumber = GetLdfHeader()->GetRunNumber();
+		}
+		else{
+			title = GetPldHeader()->GetRunTitle();
+			runNumber = GetPldHeader()->GetRunNumber();
+		}
+
+		if(!output.OpenNewFile(title, runNumber, outputPrefix, "")){
+			errStr << msgHeader << "ERROR! Failed to open output file with prefix \"" << outputPrefix << "\"!\n";
+			return;
+		}
+		std::cout << msgHeader << "Writing skimmed data to \"" << output.GetCurrentFilename() << "\".\n";
+		((skimUnpacker*)GetCore())->ResetFirstTime();
+	}
+	else if(code_ == "REWIND_FILE"){  }
+	else if(code_ == "RESTART"){  }
+	else{ std::cout << msgHeader << "Unknown notification code '" << code_ << "'!\n"; }
+}
+
+Unpacker *skimScanner::GetCore(){
+	if(!core){ core = (Unpacker*)(new skimUnpacker()); }
+	return core;
+}
+
+int main(int argc, char *argv[]){
+	// Define a new skimmer object.
+	skimScanner scanner;
+
+	// Set the output message prefix.
+	scanner.SetProgramName(std::string(PROG_NAME));
+
+	// Initialize the scanner.
+	if(!scanner.Setup(argc, argv))
+		return 1;
+
+	// Run the main loop.
+	int retval = scanner.Execute();
+
+	scanner.Close();
+
+	return retval;
+}
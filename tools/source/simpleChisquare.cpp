@@ -15,21 +15,19 @@
 size_t Nelements=0;
 double *xval, *yval;
 
+interpolator theoryCurve;
+
 double comp(double *x, double *p){
-	for(size_t i = 1; i < Nelements; i++){
-		if(xval[i-1] <= x[0] && x[0] < xval[i]){
-			return p[0]*(yval[i-1]+(x[0]-xval[i-1])*(yval[i]-yval[i-1])/(xval[i]-xval[i-1]));
-		}
-	}
+	double y;
+	if(theoryCurve.interpolate(x[0], y))
+		return p[0]*y;
 	return -1;
 }
 
 double comp2(double *x, double *p){
-	for(size_t i = 1; i < Nelements; i++){
-		if(xval[i-1] <= x[0] && x[0] < xval[i]){
-			return p[0]*(yval[i-1]+(x[0]-xval[i-1])*(yval[i]-yval[i-1])/(xval[i]-xval[i-1])) + p[1];
-		}
-	}
+	double y;
+	if(theoryCurve.interpolate(x[0], y))
+		return p[0]*y + p[1];
 	return -1;
 }
 
@@ -169,6 +167,7 @@ bool chisquare::compute(){
 	xval = gT->GetX();
 	yval = gT->GetY();
 	Nelements = gT->GetN();
+	theoryCurve.setPoints(xval, yval, Nelements);
 
 	std::cout << "THEORETICAL=" << gT->GetN() << " points, EXPERIMENTAL=" << gE->GetN() << " points";
 	
@@ -4,8 +4,16 @@
 #include <signal.h>
 #include <unistd.h>
 #include <limits.h>
+#include <sys/stat.h>
 #include <stdlib.h>
-
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "TROOT.h"
 #include "TApplication.h"
 #include "TSystem.h"
 #include "TCanvas.h"
@@ -14,6 +22,10 @@
 #include "TH1.h"
 #include "TH2.h"
 #include "TCutG.h"
+#include "TNamed.h"
+#include "TTreeFormula.h"
+#include "TTreeFormulaManager.h"
+#include "Math/MinimizerOptions.h"
 
 #include "CTerminal.h"
 #include "optionHandler.hpp"
@@ -21,6 +33,8 @@
 #include "simpleTool.hpp"
 
 #define USLEEP_WAIT_TIME 1E4 // = 0.01 seconds
+#define PARALLEL_TASK_ENTRIES 50000 // Minimum number of entries processed by a thread at once.
+#define BINNING_ENTRIES 1000000 // Number of entries used to find the axis limits of the 2d histogram.
 
 const double pi = 3.1415926536;
 const double cvac = 29.9792458; // cm/ns
@@ -103,17 +117,24 @@ bool splitFilename(const std::string &str, std::string &left, std::string &right
 // class interpolator
 ///////////////////////////////////////////////////////////////////////////////
 
-interpolator::interpolator(){ }
+interpolator::interpolator() : isUniform(false), xstep(0), lastIndex(1) { }
 
-interpolator::interpolator(const char *fname_){
+interpolator::interpolator(const char *fname_) : isUniform(false), xstep(0), lastIndex(1) {
 	load(fname_);
 }
 
+interpolator::interpolator(const double *x_, const double *y_, const size_t &N_) : isUniform(false), xstep(0), lastIndex(1) {
+	setPoints(x_, y_, N_);
+}
+
 bool interpolator::load(const char *fname_){
 	std::ifstream ifile(fname_);
 	
 	if(!ifile.good()) return false;
 
+	xvals.clear();
+	yvals.clear();
+
 	double x, y;
 	while(true){
 		ifile >> x >> y;
@@ -125,19 +146,27 @@ bool interpolator::load(const char *fname_){
 	
 	ifile.close();
 
+	prepare();
+
+	return !xvals.empty();
+}
+
+bool interpolator::setPoints(const double *x_, const double *y_, const size_t &N_){
+	xvals.assign(x_, x_+N_);
+	yvals.assign(y_, y_+N_);
+
+	prepare();
+
 	return !xvals.empty();
 }
 
 bool interpolator::interpolate(const double &x_, double &y){
-	for(size_t i = 1; i < xvals.size(); i++){
-		if(xvals[i-1] <= x_ && xvals[i] > x_){
-			double x1 = xvals[i-1]; double x2 = xvals[i];
-			double y1 = yvals[i-1]; double y2 = yvals[i];
-			y = y1 + (x_-x1)*(y2-y1)/(x2-x1);
-			return true;
-		}
-	}
-	return false;
+	size_t i;
+	if(!findInterval(x_, i)) return false;
+	double x1 = xvals[i-1]; double x2 = xvals[i];
+	double y1 = yvals[i-1]; double y2 = yvals[i];
+	y = y1 + (x_-x1)*(y2-y1)/(x2-x1);
+	return true;
 }
 
 double interpolator::interpolate(const double &x_){
@@ -147,6 +176,87 @@ double interpolator::interpolate(const double &x_){
 	return -9999;
 }
 
+size_t interpolator::interpolate(const double *x_, double *y, const size_t &N_, const double &defaultVal_/*=-9999*/){
+	size_t count = 0;
+	for(size_t i = 0; i < N_; i++){
+		if(interpolate(x_[i], y[i])) count++;
+		else y[i] = defaultVal_;
+	}
+	return count;
+}
+
+void interpolator::prepare(){
+	lastIndex = 1;
+	isUniform = false;
+	xstep = 0;
+
+	// Sort the points by x, keeping the order of points with equal x.
+	bool sorted = true;
+	for(size_t i = 1; i < xvals.size(); i++){
+		if(xvals[i] < xvals[i-1]){
+			sorted = false;
+			break;
+		}
+	}
+	if(!sorted){
+		std::vector<std::pair<double, double> > points;
+		for(size_t i = 0; i < xvals.size(); i++)
+			points.push_back(std::make_pair(xvals[i], yvals[i]));
+		std::stable_sort(points.begin(), points.end(), [](const std::pair<double, double> &l, const std::pair<double, double> &r){ return l.first < r.first; });
+		for(size_t i = 0; i < points.size(); i++){
+			xvals[i] = points[i].first;
+			yvals[i] = points[i].second;
+		}
+	}
+
+	// Check for evenly spaced points.
+	if(xvals.size() < 3) return;
+	double step = (xvals.back()-xvals.front())/(xvals.size()-1);
+	if(step <= 0) return;
+	double tolerance = 1E-6*step;
+	for(size_t i = 1; i < xvals.size(); i++){
+		if(std::fabs(xvals[i]-xvals[0]-i*step) > tolerance) return;
+	}
+	isUniform = true;
+	xstep = step;
+}
+
+/** Find the interval containing a value.
+  * \param[in]  x_ Value to search for.
+  * \param[out] index Upper index of the interval, such that xvals[index-1] <= x_ < xvals[index].
+  * \return True if the value is inside the range of the points and false otherwise.
+  */
+bool interpolator::findInterval(const double &x_, size_t &index){
+	const size_t N = xvals.size();
+	if(N < 2 || !(x_ >= xvals.front()) || x_ >= xvals.back()) return false;
+
+	if(isUniform){ // Compute the interval directly, then correct for rounding.
+		index = (size_t)((x_-xvals.front())/xstep) + 1;
+		if(index >= N) index = N-1;
+		while(index > 1 && x_ < xvals[index-1]) index--;
+		while(index < N-1 && x_ >= xvals[index]) index++;
+		return true;
+	}
+
+	// Check the previous interval and the one following it.
+	if(lastIndex < N && xvals[lastIndex-1] <= x_){
+		if(x_ < xvals[lastIndex]){
+			index = lastIndex;
+			return true;
+		}
+		if(lastIndex+1 < N && x_ < xvals[lastIndex+1]){
+			index = ++lastIndex;
+			return true;
+		}
+	}
+
+	// Find the first point which is greater than x_.
+	index = std::upper_bound(xvals.begin(), xvals.end(), x_) - xvals.begin();
+	lastIndex = index;
+
+	return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // class progressBar
 ///////////////////////////////////////////////////////////////////////////////
@@ -174,6 +284,100 @@ void progressBar::finalize(){
 	std::cout << "  Working - 0% [" << std::string(length, '=') << "] 100% Done!\n";
 }
 
+void progressBar::update(const long long &entry_){
+	if(chunkSize <= 0) return;
+	bool changed = false;
+	while(chunkCount < length && entry_ >= (chunkCount+1)*chunkSize){
+		progStr[chunkCount++] = '=';
+		changed = true;
+	}
+	if(changed) std::cout << "  Working - 0% [" << progStr << "] 100%\r" << std::flush;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel processing
+///////////////////////////////////////////////////////////////////////////////
+
+/// A range of entries from one input file which is processed by a single thread.
+struct parallelTask{
+	size_t file; ///< Index of the input file
+	long long first; ///< First entry of the range
+	long long last; ///< One past the last entry of the range
+	TTree *output; ///< Output entries of the range (NULL if the tool has no output tree)
+	bool done; ///< Set to true once the range has been processed
+
+	parallelTask(const size_t &file_, const long long &first_, const long long &last_) : file(file_), first(first_), last(last_), output(NULL), done(false) { }
+};
+
+/// State shared by all threads of simpleTool::processParallel.
+struct parallelState{
+	std::vector<std::string> filenames; ///< Input files, in the order in which they were specified
+	std::vector<parallelTask> tasks; ///< Entry ranges of all input files, in input order
+	std::string treename; ///< Name of the input tree
+	bool writeOutput; ///< Set to true if the tool has an output tree
+	std::atomic<size_t> nextTask; ///< Index of the next task to be processed
+	std::atomic<long long> numProcessed; ///< Number of entries processed by all threads
+	std::atomic<bool> failed; ///< Set to true if a thread failed to load its input
+	std::mutex taskMutex; ///< Mutex protecting the output and the done flag of all tasks
+
+	parallelState() : writeOutput(false), nextTask(0), numProcessed(0), failed(false) { }
+};
+
+/** Process tasks until none remain (executed by each thread of simpleTool::processParallel).
+  * \param[in]  state_ Pointer to the state shared by all threads.
+  * \param[in]  worker_ Pointer to the worker used by this thread.
+  * \return Nothing.
+  */
+static void processTasks(parallelState *state_, simpleToolWorker *worker_){
+	TFile *file = NULL;
+	TTree *tree = NULL;
+	size_t currentFile = 0;
+	while(!state_->failed){
+		size_t index = state_->nextTask++;
+		if(index >= state_->tasks.size()) break;
+		parallelTask &task = state_->tasks[index];
+
+		// Tasks are ordered by input file, so a thread usually keeps reading the same file.
+		if(!file || task.file != currentFile){
+			if(file){
+				file->Close();
+				delete file;
+			}
+			currentFile = task.file;
+			file = new TFile(state_->filenames[currentFile].c_str(), "READ");
+			tree = (file->IsOpen() ? (TTree*)file->Get(state_->treename.c_str()) : NULL);
+			if(!tree || !worker_->setInputBranches(tree, currentFile)){
+				std::cout << " Error! Failed to load input TTree '" << state_->treename << "' from '" << state_->filenames[currentFile] << "'.\n";
+				state_->failed = true;
+				break;
+			}
+		}
+
+		TTree *output = NULL;
+		if(state_->writeOutput){
+			output = new TTree("parallel", "Parallel output");
+			output->SetDirectory(0);
+			worker_->setOutputBranches(output);
+		}
+
+		for(long long entry = task.first; entry < task.last; entry++){
+			if(tree->GetEntry(entry) <= 0) continue;
+			if(worker_->processEntry() && output) output->Fill();
+		}
+
+		state_->numProcessed += task.last - task.first;
+
+		state_->taskMutex.lock();
+		task.output = output;
+		task.done = true;
+		state_->taskMutex.unlock();
+	}
+	if(file){
+		file->Close();
+		delete file;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // class simpleTool
 ///////////////////////////////////////////////////////////////////////////////
@@ -204,6 +408,8 @@ simpleTool::simpleTool(){
 	entries_to_process = 0;
 	max_entries_to_process = -1;
 	current_entry = 0;
+
+	num_threads = std::thread::hardware_concurrency();
 	
 	baseOpts.push_back(optionExt("help", no_argument, NULL, 'h', "", "Display this dialogue."));
 	baseOpts.push_back(optionExt("input", required_argument, NULL, 'i', "<filename>", "Specifies an input file to analyze."));
@@ -213,6 +419,7 @@ simpleTool::simpleTool(){
 	baseOpts.push_back(optionExt("multi", required_argument, NULL, 'm', "<N>", "Specify multiple input filenames e.g. filename.root, filename-1.root, ..., filename-N.root."));
 	baseOpts.push_back(optionExt("start", required_argument, NULL, 's', "<N>", "Specify the start entry in the input tree (default=0)."));
 	baseOpts.push_back(optionExt("entries", required_argument, NULL, 'e', "<N>", "Specify the number of entries to process from the input tree."));
+	baseOpts.push_back(optionExt("threads", required_argument, NULL, 0, "<N>", "Specify the number of threads used by tools which support parallel processing (default is the number of cores)."));
 
 	optstr = "hi:o:n:C:m:s:e:";
 
@@ -265,6 +472,137 @@ bool simpleTool::getNextEntry(){
 	return (intree->GetEntry(current_entry++) > 0);
 }
 
+/** Process all entries of all input files using a pool of threads. The entries of each file are split
+  * along the cluster boundaries of the input tree and processed by the workers returned by createWorker().
+  * Output entries are copied to the output tree (if there is one) in input order, and the histograms of
+  * all workers are merged once all entries have been processed. If the output tree has no branches, the
+  * output branches of a worker are added to it. Consumes the list of input files.
+  * \return True if all input files were processed and false otherwise.
+  */
+bool simpleTool::processParallel(){
+	parallelState state;
+	state.treename = input_objname;
+	state.writeOutput = (outtree != NULL);
+
+	// Split the entries of all input files into tasks along the cluster boundaries of the input trees.
+	long long totalEntries = 0;
+	while(!filename_list.empty()){
+		input_filename = filename_list.front();
+		filename_list.pop_front();
+
+		TFile *file = new TFile(input_filename.c_str(), "READ");
+		TTree *tree = (file->IsOpen() ? (TTree*)file->Get(input_objname.c_str()) : NULL);
+		if(!tree){
+			std::cout << " Error! Failed to load input TTree '" << input_objname << "' from '" << input_filename << "'.\n";
+			file->Close();
+			delete file;
+			return false;
+		}
+
+		// The start entry and maximum number of entries apply to each file, as with loadInputTree.
+		long long numEntries = tree->GetEntries();
+		long long first = start_entry;
+		long long last = first + (max_entries_to_process > 0 && max_entries_to_process < numEntries ? max_entries_to_process : numEntries);
+		if(last > numEntries) last = numEntries;
+
+		size_t fileIndex = state.filenames.size();
+		state.filenames.push_back(input_filename);
+
+		if(first < last){
+			TTree::TClusterIterator clusters = tree->GetClusterIterator(first);
+			long long taskStart = first;
+			while(clusters() < last){
+				long long clusterEnd = clusters.GetNextEntry();
+				if(clusterEnd > last) clusterEnd = last;
+				if(clusterEnd - taskStart >= PARALLEL_TASK_ENTRIES || clusterEnd == last){
+					state.tasks.push_back(parallelTask(fileIndex, taskStart, clusterEnd));
+					totalEntries += clusterEnd - taskStart;
+					taskStart = clusterEnd;
+				}
+			}
+		}
+
+		file->Close();
+		delete file;
+	}
+
+	if(state.tasks.empty()){
+		std::cout << " Error! Input trees have zero entries.\n";
+		return false;
+	}
+
+	unsigned int nThreads = (num_threads < state.tasks.size() ? num_threads : state.tasks.size());
+	if(nThreads == 0) nThreads = 1;
+
+	// Each thread uses its own worker. One additional worker provides the buffers of the output tree.
+	std::vector<simpleToolWorker*> workers;
+	for(unsigned int i = 0; i <= nThreads; i++){
+		simpleToolWorker *worker = createWorker();
+		if(!worker){
+			std::cout << " Error! Parallel processing is not supported by this tool.\n";
+			for(std::vector<simpleToolWorker*>::iterator iter = workers.begin(); iter != workers.end(); iter++)
+				delete (*iter);
+			return false;
+		}
+		workers.push_back(worker);
+	}
+	if(outtree && outtree->GetNbranches() == 0)
+		workers.back()->setOutputBranches(outtree);
+
+	ROOT::EnableThreadSafety();
+
+	std::cout << " Processing " << state.filenames.size() << " files (" << state.tasks.size() << " tasks) using " << nThreads << " threads.\n";
+	pbar.start(totalEntries);
+
+	std::vector<std::thread> threads;
+	for(unsigned int i = 0; i < nThreads; i++)
+		threads.push_back(std::thread(processTasks, &state, workers[i]));
+
+	// Copy the output of each task to the output tree as soon as all previous tasks have been copied.
+	size_t nextOutput = 0;
+	while(nextOutput < state.tasks.size() && !state.failed){
+		state.taskMutex.lock();
+		bool done = state.tasks[nextOutput].done;
+		TTree *output = state.tasks[nextOutput].output;
+		state.tasks[nextOutput].output = NULL;
+		state.taskMutex.unlock();
+
+		if(!done){
+			pbar.update(state.numProcessed);
+			usleep(USLEEP_WAIT_TIME);
+			continue;
+		}
+
+		if(output){
+			outtree->CopyAddresses(output);
+			for(long long entry = 0; entry < output->GetEntries(); entry++){
+				output->GetEntry(entry);
+				outtree->Fill();
+			}
+			delete output;
+		}
+		nextOutput++;
+	}
+
+	for(std::vector<std::thread>::iterator iter = threads.begin(); iter != threads.end(); iter++)
+		iter->join();
+
+	// Merge the histograms of all workers in a fixed order.
+	if(!state.failed){
+		pbar.finalize();
+		for(unsigned int i = 0; i < nThreads; i++)
+			workers[i]->merge();
+	}
+
+	for(std::vector<parallelTask>::iterator iter = state.tasks.begin(); iter != state.tasks.end(); iter++){
+		if(iter->output) delete iter->output;
+	}
+	for(std::vector<simpleToolWorker*>::iterator iter = workers.begin(); iter != workers.end(); iter++)
+		delete (*iter);
+
+	return !state.failed;
+}
+
 /** Get the full pathname from an input string.
   * \param[in]  path_ The user specified filename. May be relative or absolute.
   * \return String containing the full path to the input file.
@@ -327,6 +665,14 @@ bool simpleTool::setup(int argc, char *argv[]){
 	//complaints we can either change it to getopt, or implement our own class. 
 	while ( (retval = getopt_long(argc, argv, optstr.c_str(), longOpts.data(), &idx)) != -1) {
 		if(retval == 0x0){ // Long option
+			if(strcmp("threads", longOpts[idx].name) == 0){
+				num_threads = strtoul(optarg, NULL, 0);
+				if(num_threads == 0){
+					std::cout << " Error: Invalid number of threads (" << optarg << ")!\n";
+					return false;
+				}
+				continue;
+			}
 			for(std::vector<optionExt>::iterator iter = userOpts.begin(); iter != userOpts.end(); iter++){
 				if(strcmp(iter->name, longOpts[idx].name) == 0){
 					iter->active = true;
@@ -539,13 +885,15 @@ simpleHistoFitter::simpleHistoFitter() : simpleTool() {
 	h1d = NULL;
 	h2d = NULL;
 
-	nEntries = 1E6;
+	nEntries = 0;
 
 	draw_string = "";
 	expr_string = "";
 	
 	useProjX = true;
 
+	batchMode = false;
+
 	firstChildOption = 0;
 	
 	histStartID = 0;
@@ -665,6 +1013,302 @@ double simpleHistoFitter::getMaximum(TH1 *h1_, const double &lowVal_, const doub
 	return maximum;
 }
 
+/// Worker of simpleHistoFitter::fillFromTrees, filling its own copy of the 2d histogram.
+class histFillWorker : public simpleToolWorker{
+  public:
+	histFillWorker(TH2 *h2_, const std::vector<std::string> &exprs_, const std::string &gate_) : output(h2_), exprs(exprs_), gate(gate_), fx(NULL), fy(NULL), fgate(NULL) {
+		std::stringstream name; name << "h2d_fill" << this;
+		hist = (TH2*)h2_->Clone(name.str().c_str());
+		hist->SetDirectory(0);
+	}
+
+	~histFillWorker(){
+		deleteFormulas();
+		delete hist;
+	}
+
+	bool setInputBranches(TTree *intree_, const size_t &fileIndex_){
+		deleteFormulas();
+
+		// The expressions are compiled once for each input tree. The formula manager is owned by the formulas.
+		fx = new TTreeFormula("fx", exprs[1].c_str(), intree_);
+		fy = new TTreeFormula("fy", exprs[0].c_str(), intree_);
+		if(!gate.empty()) fgate = new TTreeFormula("fgate", gate.c_str(), intree_);
+		if(fx->GetNdim() == 0 || fy->GetNdim() == 0 || (fgate && fgate->GetNdim() == 0)) return false;
+
+		TTreeFormulaManager *manager = new TTreeFormulaManager();
+		manager->Add(fx);
+		manager->Add(fy);
+		if(fgate) manager->Add(fgate);
+		manager->Sync();
+
+		return true;
+	}
+
+	bool processEntry(){
+		// Expressions may contain arrays, so fill the histogram for each instance of the expressions.
+		int ndata = fx->GetManager()->GetNdata();
+		for(int i = 0; i < ndata; i++){
+			double weight = (fgate ? fgate->EvalInstance(i) : 1);
+			if(weight == 0) continue;
+			hist->Fill(fx->EvalInstance(i), fy->EvalInstance(i), weight);
+		}
+		return false;
+	}
+
+	void merge(){
+		output->Add(hist);
+	}
+
+  private:
+	TH2 *output; ///< Histogram of the tool
+	TH2 *hist; ///< Histogram filled by this worker
+	
+	std::vector<std::string> exprs; ///< Expressions for the y and x axes, as written in the draw string
+	std::string gate; ///< Expression used to gate and weight the entries
+
+	TTreeFormula *fx; ///< Compiled expression for the x-axis
+	TTreeFormula *fy; ///< Compiled expression for the y-axis
+	TTreeFormula *fgate; ///< Compiled gate expression
+
+	void deleteFormulas(){
+		delete fx;
+		delete fy;
+		delete fgate;
+		fx = fy = fgate = NULL;
+	}
+};
+
+simpleToolWorker *simpleHistoFitter::createWorker(){
+	if(!h2d || fill_exprs.size() != 2) return NULL;
+	return new histFillWorker(h2d, fill_exprs, expr_string);
+}
+
+bool simpleHistoFitter::fillFromTrees(){
+	if(!intree && !loadInputTree())
+		return false;
+
+	// Split the draw string into the expressions for each axis, ignoring the histogram name and binning.
+	std::string varexp = draw_string.substr(0, draw_string.find(">>"));
+	fill_exprs.clear();
+	int depth = 0;
+	size_t start = 0;
+	for(size_t i = 0; i < varexp.size(); i++){
+		if(varexp[i] == '(' || varexp[i] == '[') depth++;
+		else if(varexp[i] == ')' || varexp[i] == ']') depth--;
+		else if(varexp[i] == ':' && depth == 0){
+			if(i+1 < varexp.size() && varexp[i+1] == ':'){ i++; continue; } // Scope operator.
+			fill_exprs.push_back(varexp.substr(start, i-start));
+			start = i+1;
+		}
+	}
+	fill_exprs.push_back(varexp.substr(start));
+	if(fill_exprs.size() != 2){
+		std::cout << " Error! Draw string must contain two expressions (\"y:x\").\n";
+		return false;
+	}
+
+	// Use root to choose the binning of the histogram from the first input file.
+	long long binningEntries = (nEntries > 0 && nEntries < BINNING_ENTRIES ? nEntries : BINNING_ENTRIES);
+	std::cout << " " << input_objname << "->Draw(\"" << draw_string << "\", \"" << expr_string << "\", \"goff\", " << binningEntries << ");\n";
+	if(intree->Draw(draw_string.c_str(), expr_string.c_str(), "goff", binningEntries) <= 0 || !intree->GetHistogram()){
+		std::cout << " Error! Failed to draw the 2d histogram.\n";
+		return false;
+	}
+
+	h2d = (TH2*)(intree->GetHistogram()->Clone("h2d"));
+	h2d->SetDirectory(0);
+	h2d->Reset();
+
+	// Fill the histogram from all entries of all input files.
+	if(nEntries > 0)
+		max_entries_to_process = nEntries;
+	filename_list.push_front(input_filename);
+
+	std::cout << " Filling TH2...\n";
+	if(!processParallel()){
+		std::cout << " Error! Failed to fill the 2d histogram.\n";
+		return false;
+	}
+	std::cout << " Filled TH2 with " << h2d->GetEntries() << " entries.\n";
+
+	return true;
+}
+
+std::string simpleHistoFitter::getCacheKey(){
+	std::stringstream key;
+	key << "tree=" << input_objname << ";draw=" << draw_string << ";expr=" << expr_string;
+	key << ";start=" << start_entry << ";entries=" << (nEntries > 0 ? (long long)nEntries : max_entries_to_process);
+
+	// Identify each input file by its path, size, and modification time.
+	std::vector<std::string> filenames(1, input_filename);
+	filenames.insert(filenames.end(), filename_list.begin(), filename_list.end());
+	for(std::vector<std::string>::iterator iter = filenames.begin(); iter != filenames.end(); iter++){
+		struct stat info;
+		key << ";file=" << getRealPath(*iter);
+		if(stat(iter->c_str(), &info) == 0)
+			key << "," << info.st_size << "," << info.st_mtime;
+	}
+
+	return key.str();
+}
+
+int simpleHistoFitter::getAllProjections(TH2 *h2_, std::vector<TH1D*> &hists_){
+	hists_.clear();
+	if(!h2_) return -1;
+
+	const int numProjections = getNumProjections(h2_);
+	const int nBinsX = h2_->GetNbinsX();
+	const int nBinsY = h2_->GetNbinsY();
+
+	// Create all projection histograms up front, so that the bins of the 2d histogram are visited only once.
+	hists_.assign(numProjections, NULL);
+	for(int i = 1; i <= numProjections; i++){
+		if(i < histStartID || (histStopID >= 0 && i > histStopID)) continue;
+		std::stringstream name; name << "bin";
+		if(i < 10)       name << "00" << i;
+		else if(i < 100) name << "0" << i;
+		else             name << i;
+		std::stringstream title; title << getBinLowEdge(h2_, i);
+		hists_[i-1] = getProjectionHist(h2_, name.str().c_str(), title.str().c_str());
+		hists_[i-1]->SetDirectory(0);
+	}
+
+	// Global bin numbers of a 2d histogram run along the x-axis first, including the underflow and overflow bins.
+	std::vector<double> totals(numProjections, 0.0);
+	for(int j = 1; j <= nBinsY; j++){
+		for(int i = 1; i <= nBinsX; i++){
+			int proj = (useProjX ? j : i);
+			if(!hists_[proj-1]) continue;
+			double binContent = h2_->GetBinContent(i + (nBinsX+2)*j);
+			hists_[proj-1]->GetArray()[useProjX ? i : j] = binContent;
+			totals[proj-1] += binContent;
+		}
+	}
+
+	int count = 0;
+	for(int i = 0; i < numProjections; i++){
+		if(!hists_[i]) continue;
+		if(totals[i] > 0.0){
+			hists_[i]->SetEntries(totals[i]);
+			count++;
+		}
+		else{
+			delete hists_[i];
+			hists_[i] = NULL;
+		}
+	}
+
+	return count;
+}
+
+const std::vector<std::vector<double> > *simpleHistoFitter::getSeeds(const std::string &label_){
+	std::map<std::string, std::vector<std::vector<double> > >::iterator iter = seeds.find(label_);
+	if(iter == seeds.end()) return NULL;
+	return &iter->second;
+}
+
+/** Fit projections until none remain (executed by each thread of simpleHistoFitter::processBatch).
+  * \param[in]  fitter_ Pointer to the fitter.
+  * \param[in]  hists_ Projection histograms (NULL projections are skipped).
+  * \param[in]  nextProj_ Index of the next projection to be fitted.
+  * \param[out] logs_ Console output for each projection.
+  * \param[out] results_ Fit results for each projection.
+  * \param[out] calibs_ Calibration lines for each projection.
+  * \param[out] success_ Set for each projection which was fitted successfully.
+  * \return Nothing.
+  */
+void simpleHistoFitter::fitProjections(const std::vector<TH1D*> *hists_, std::atomic<size_t> *nextProj_, std::vector<std::string> *logs_,
+                                       std::vector<std::string> *results_, std::vector<std::string> *calibs_, std::vector<char> *success_){
+	while(true){
+		size_t index = (*nextProj_)++;
+		if(index >= hists_->size()) break;
+		TH1D *h1 = hists_->at(index);
+		if(!h1) continue;
+
+		std::stringstream log, results, calib;
+		success_->at(index) = fitProjection(h1, h1->GetTitle(), log, results, calib);
+		logs_->at(index) = log.str();
+		results_->at(index) = results.str();
+		calibs_->at(index) = calib.str();
+	}
+}
+
+bool simpleHistoFitter::processBatch(const std::string &resultsHeader_, const std::string &calFilename_/*=""*/, const std::string &calHeader_/*=""*/){
+	std::vector<TH1D*> hists;
+	int numHists = getAllProjections(h2d, hists);
+	if(numHists <= 0){
+		std::cout << " Error! Input histogram has no non-empty projections.\n";
+		return false;
+	}
+
+	unsigned int nThreads = (num_threads < (unsigned int)numHists ? num_threads : numHists);
+	if(nThreads == 0) nThreads = 1;
+
+	std::cout << " Fitting " << numHists << " projections using " << nThreads << " threads.\n";
+
+	ROOT::EnableThreadSafety();
+
+	// The default minimizer (TMinuit) uses global state and may not be used by several threads at once.
+	if(nThreads > 1)
+		ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+
+	std::vector<std::string> logs(hists.size());
+	std::vector<std::string> results(hists.size());
+	std::vector<std::string> calibs(hists.size());
+	std::vector<char> success(hists.size(), 0);
+	std::atomic<size_t> nextProj(0);
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for(unsigned int i = 0; i < nThreads; i++)
+		threads.push_back(std::thread(&simpleHistoFitter::fitProjections, this, &hists, &nextProj, &logs, &results, &calibs, &success));
+	for(std::vector<std::thread>::iterator iter = threads.begin(); iter != threads.end(); iter++)
+		iter->join();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	// Write the results in projection order.
+	std::ofstream resultsFile("fitresults.dat");
+	resultsFile << resultsHeader_;
+
+	std::ofstream calFile;
+	if(!calFilename_.empty()){
+		calFile.open(calFilename_.c_str());
+		calFile << calHeader_;
+	}
+
+	TFile *reviewFile = new TFile("fitresults.root", "RECREATE");
+
+	int numSuccess = 0;
+	for(size_t i = 0; i < hists.size(); i++){
+		if(!hists[i]) continue;
+		std::cout << " Processing channel ID " << i+1 << "... " << (success[i] ? "DONE" : "FAILED") << "\n" << logs[i];
+		resultsFile << results[i];
+		if(calFile.is_open()) calFile << calibs[i];
+		if(success[i]) numSuccess++;
+
+		// The fitted functions are stored with each histogram.
+		reviewFile->cd();
+		hists[i]->Write();
+		delete hists[i];
+	}
+
+	reviewFile->Close();
+	delete reviewFile;
+
+	resultsFile.close();
+	if(calFile.is_open()) calFile.close();
+
+	std::cout << "\n Fitted " << numSuccess << " of " << numHists << " projections in " << elapsed << " s.\n";
+	std::cout << " Wrote results to 'fitresults.dat'";
+	if(!calFilename_.empty()) std::cout << " and '" << calFilename_ << "'";
+	std::cout << ", and fitted projections to 'fitresults.root'.\n";
+
+	return (numSuccess > 0);
+}
+
 void simpleHistoFitter::addOptions(){
 	addOption(optionExt("draw", required_argument, NULL, 0, "<drawstr>", "Root draw string to fill the 2d histogram."), userOpts, optstr);
 	addOption(optionExt("expr", required_argument, NULL, 0, "<exprstr>", "Root expression logic string to use for filling 2d histogram."), userOpts, optstr);
@@ -672,7 +1316,10 @@ void simpleHistoFitter::addOptions(){
 	addOption(optionExt("debug", no_argument, NULL, 'd', "", "Enable debug mode."), userOpts, optstr);
 	addOption(optionExt("y-axis", no_argument, NULL, 'y', "", "Project along the y-axis instead of the x-axis."), userOpts, optstr);
 	addOption(optionExt("range", required_argument, NULL, 'r', "<range>", "Process a range of bins from the input histogram (specify range as start:stop e.g. 15:21)."), userOpts, optstr);
-	addOption(optionExt("entries", required_argument, NULL, 'N', "<entries>", "Fille histogram only from the first N entries from the input file (default = 1E6)."), userOpts, optstr);
+	addOption(optionExt("entries", required_argument, NULL, 'N', "<entries>", "Fill histogram only from the first N entries of each input file (default = all entries)."), userOpts, optstr);
+	addOption(optionExt("batch", no_argument, NULL, 0, "", "Fit all projections without user input using a pool of threads (see --threads)."), userOpts, optstr);
+	addOption(optionExt("seed", required_argument, NULL, 0, "<fname>", "Seed batch fits using the results file of a previous run."), userOpts, optstr);
+	addOption(optionExt("cache", required_argument, NULL, 0, "<dir>", "Cache 2d histograms filled from input trees in a directory."), userOpts, optstr);
 
 	// Add derived classes to the vector of all command line options.
 	firstChildOption = userOpts.size();
@@ -698,6 +1345,37 @@ bool simpleHistoFitter::processArgs(){
 	}
 	if(userOpts.at(6).active)
 		nEntries = strtoul(userOpts.at(6).argument.c_str(), NULL, 0);
+	if(userOpts.at(7).active)
+		batchMode = true;
+	if(userOpts.at(8).active){
+		seed_filename = userOpts.at(8).argument;
+
+		std::ifstream seedFile(seed_filename.c_str());
+		if(!seedFile.good()){
+			std::cout << " Error! Failed to open seed file '" << seed_filename << "'.\n";
+			return false;
+		}
+
+		// Each line starts with the label of a projection, followed by the results for that projection.
+		std::string line;
+		while(std::getline(seedFile, line)){
+			std::stringstream stream(line);
+			std::string label;
+			if(!(stream >> label) || label.empty() || label[0] == '#' || label == "id") continue;
+			std::vector<double> row;
+			double value;
+			while(stream >> value)
+				row.push_back(value);
+			seeds[label].push_back(row);
+		}
+		seedFile.close();
+
+		std::cout << " Loaded previous results for " << seeds.size() << " projections from '" << seed_filename << "'.\n";
+	}
+	if(userOpts.at(9).active){
+		cache_dir = userOpts.at(9).argument;
+		if(!cache_dir.empty() && cache_dir[cache_dir.size()-1] != '/') cache_dir += '/';
+	}
 
 	return processChildArgs();
 }
@@ -711,20 +1389,46 @@ TH2 *simpleHistoFitter::fillHistogram(){
 		}
 	}
 	else{
-		if(!intree && !loadInputTree())
-			return NULL;
-
-		std::cout << " " << input_objname << "->Draw(\"" << draw_string << "\", \"" << expr_string << "\", \"COLZ\", " << nEntries << ");\n";
-		std::cout << " Filling TH2... " << std::flush;
-		if(intree->Draw(draw_string.c_str(), expr_string.c_str(), "COLZ", nEntries) > 0){
-			std::cout << "DONE\n";
+		// Check for a cached histogram filled from the same inputs.
+		std::string cacheKey, cacheFilename;
+		if(!cache_dir.empty()){
+			cacheKey = getCacheKey();
+			std::stringstream stream;
+			stream << cache_dir << "h2d_" << std::hex << std::hash<std::string>()(cacheKey) << ".root";
+			cacheFilename = stream.str();
+
+			TFile cacheFile(cacheFilename.c_str(), "READ");
+			if(cacheFile.IsOpen()){
+				TNamed *key = (TNamed*)cacheFile.Get("key");
+				TH2 *cached = (TH2*)cacheFile.Get("h2d");
+				if(key && cached && cacheKey == key->GetTitle()){
+					h2d = (TH2*)cached->Clone("h2d");
+					h2d->SetDirectory(0);
+					std::cout << " Loaded 2d histogram from cache file '" << cacheFilename << "'.\n";
+				}
+				cacheFile.Close();
+			}
 		}
-		else{
-			std::cout << "FAILED\n";
-			return NULL;
+
+		if(!h2d){
+			if(!fillFromTrees())
+				return NULL;
+
+			// Cache the histogram for later sessions.
+			if(!cacheFilename.empty()){
+				TDirectory *prevDir = gDirectory;
+				TFile cacheFile(cacheFilename.c_str(), "RECREATE");
+				if(cacheFile.IsOpen()){
+					TNamed key("key", cacheKey.c_str());
+					key.Write();
+					h2d->Write("h2d");
+					cacheFile.Close();
+					std::cout << " Wrote 2d histogram to cache file '" << cacheFilename << "'.\n";
+				}
+				else std::cout << " Warning! Failed to open cache file '" << cacheFilename << "'.\n";
+				prevDir->cd();
+			}
 		}
-	
-		h2d = (TH2*)(intree->GetHistogram()->Clone("h2d"));
 
 		filledFromTree = true;
 	}
@@ -761,7 +1465,7 @@ int simpleHistoFitter::execute(int argc, char *argv[], bool drawh2_/*=false*/){
 	if(!fillHistogram())
 		return 3;
 	
-	if(drawh2_ || filledFromTree){
+	if(!batchMode && (drawh2_ || filledFromTree)){
 		openCanvas1();
 		can1->SetLogz();
 		can1->cd();
@@ -771,7 +1475,8 @@ int simpleHistoFitter::execute(int argc, char *argv[], bool drawh2_/*=false*/){
 		can1->WaitPrimitive();
 	}
 
-	openCanvas2();
+	if(!batchMode)
+		openCanvas2();
 
 	if(!process())
 		return 4;
@@ -677,6 +677,11 @@ bool specFitter::processChildArgs(){
 }
 
 bool specFitter::process(){
+	if(batchMode){ // The fit model is selected using the control panel.
+		std::cout << " Error: Batch mode is not supported by specFitter.\n";
+		return false;
+	}
+
 	if(!h2d || !can2) return false;
 
 	// Initialize the gui panel.
@@ -0,0 +1,316 @@
+/** \file spillSender.cpp
+  * \brief Stand-in for the poll2 network broadcast. Replays the spills of a .pld or .ldf
+  *  file over UDP using the poll2 spill chunk format so that shared-memory mode may be tested
+  *  without a running data acquisition.
+  *
+  * Each spill is split into chunks of at most 4050 words. Every chunk is preceded
+  * by two words, the chunk number (starting at 1) and the total number of chunks.
+  *
+  * Spills may be paced by a fixed data or spill rate, or by the pixie timestamps of the
+  * spills (optionally scaled). Chunk loss, chunk reordering, and bursts of spills may be
+  * injected to test the receiver under poor network conditions.
+  */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hribf_buffers.h"
+#include "poll2_socket.h"
+#include "optionHandler.hpp"
+
+#define POLL2_CHUNK_WORDS 4050 // Maximum number of spill data words in a single poll2 chunk.
+
+/// Faults injected into the stream of spill chunks.
+class faultModel{
+  public:
+	double loss; ///< Probability of dropping a chunk
+	double reorder; ///< Probability of swapping a chunk with the following chunk
+
+	unsigned long numDropped; ///< Number of chunks which were dropped
+	unsigned long numReordered; ///< Number of chunks which were swapped
+
+	std::mt19937 rng; ///< Random number generator used to inject faults
+
+	faultModel() : loss(0), reorder(0), numDropped(0), numReordered(0), rng(0), uniform(0, 1) { }
+
+	/// Return true with a given probability.
+	bool roll(const double &prob_){ return (prob_ > 0 && uniform(rng) < prob_); }
+
+  private:
+	std::uniform_real_distribution<double> uniform;
+};
+
+/** Send a single spill as a series of poll2 chunks.
+  * @param client_ Pointer to an initialized Client.
+  * @param data_ Pointer to the spill data.
+  * @param nWords_ Length of the spill (in words).
+  * @param chunk_ Array used to build each chunk (must be at least POLL2_CHUNK_WORDS+2 words long).
+  * @param chunkDelay_ Time to wait between chunks (in us).
+  * @param faults_ Faults to inject into the chunk stream.
+  * @return The number of bytes sent, or -1 if a send failed.
+  */
+long sendSpill(Client *client_, unsigned int *data_, const unsigned int &nWords_, unsigned int *chunk_, const double &chunkDelay_, faultModel &faults_){
+	unsigned int totalChunks = nWords_/POLL2_CHUNK_WORDS + (nWords_ % POLL2_CHUNK_WORDS != 0 ? 1 : 0);
+
+	// Choose the order in which the chunks are sent.
+	std::vector<unsigned int> order(totalChunks);
+	for(unsigned int i = 0; i < totalChunks; i++)
+		order[i] = i;
+	for(unsigned int i = 0; i+1 < totalChunks; i++){
+		if(faults_.roll(faults_.reorder)){
+			std::swap(order[i], order[i+1]);
+			faults_.numReordered++;
+			i++;
+		}
+	}
+
+	long nBytes = 0;
+	for(std::vector<unsigned int>::iterator iter = order.begin(); iter != order.end(); iter++){
+		unsigned int i = *iter;
+		if(faults_.roll(faults_.loss)){
+			faults_.numDropped++;
+			continue;
+		}
+		unsigned int nChunkWords = (i+1 < totalChunks ? POLL2_CHUNK_WORDS : nWords_ - i*POLL2_CHUNK_WORDS);
+		chunk_[0] = i+1;
+		chunk_[1] = totalChunks;
+		memcpy(&chunk_[2], &data_[i*POLL2_CHUNK_WORDS], nChunkWords*4);
+		if(client_->SendMessage((char*)chunk_, (nChunkWords+2)*4) < 0)
+			return -1;
+		nBytes += (nChunkWords+2)*4;
+		if(chunkDelay_ > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds((long)chunkDelay_));
+	}
+	return nBytes;
+}
+
+/** Find the earliest pixie timestamp in a spill.
+  * @param data_ Pointer to the spill data.
+  * @param nWords_ Length of the spill (in words).
+  * @param time_ The earliest event time in the spill (in system clock ticks).
+  * @return True if the spill contains at least one event and false otherwise.
+  */
+bool getSpillTime(const unsigned int *data_, const unsigned int &nWords_, double &time_){
+	bool found = false;
+	unsigned int nWords_read = 0;
+	while(nWords_read + 2 <= nWords_){
+		unsigned int lenRec = data_[nWords_read];
+		unsigned int vsn = data_[nWords_read+1];
+		if(lenRec < 2 || lenRec > nWords_ - nWords_read) break;
+
+		// Only read pixie module buffers (see Unpacker::ReadSpill).
+		if(vsn < 14 && lenRec != 6){
+			unsigned int bufIndex = nWords_read + 2;
+			while(bufIndex + 3 <= nWords_read + lenRec){
+				unsigned int eventLength = (data_[bufIndex] & 0x1FFE0000) >> 17;
+				if(eventLength == 0) break;
+				double eventTime = data_[bufIndex+1] + (data_[bufIndex+2] & 0x0000FFFF) * 4294967296.0;
+				if(!found || eventTime < time_) time_ = eventTime;
+				found = true;
+				bufIndex += eventLength;
+			}
+		}
+		nWords_read += lenRec;
+	}
+	return found;
+}
+
+int main(int argc, char *argv[]){
+	optionHandler handler;
+	handler.add(optionExt("input", required_argument, NULL, 'i', "<filename>", "Specify the input .pld or .ldf file to replay"));
+	handler.add(optionExt("address", required_argument, NULL, 'a', "<address>", "Specify the destination address (default=localhost)"));
+	handler.add(optionExt("port", required_argument, NULL, 'p', "<port>", "Specify the destination port (default=5555)"));
+	handler.add(optionExt("rate", required_argument, NULL, 'r', "<MB/s>", "Limit the average data rate (default is no limit)"));
+	handler.add(optionExt("spill-rate", required_argument, NULL, 's', "<Hz>", "Limit the number of spills sent per second"));
+	handler.add(optionExt("chunk-delay", required_argument, NULL, 'c', "<us>", "Wait between sending individual chunks of a spill"));
+	handler.add(optionExt("loop", required_argument, NULL, 'l', "<N>", "Replay the input file N times (0 to loop forever, default=1)"));
+	handler.add(optionExt("verbose", no_argument, NULL, 'v', "", "Print information about each spill"));
+	handler.add(optionExt("realtime", required_argument, NULL, 't', "<scale>", "Send spills at the times given by their pixie timestamps, sped up by a factor of <scale> (1 for real time)"));
+	handler.add(optionExt("clock", required_argument, NULL, 0, "<ns>", "Specify the pixie system clock period used with --realtime (default=8 ns)"));
+	handler.add(optionExt("loss", required_argument, NULL, 0, "<fraction>", "Drop a random fraction of all spill chunks"));
+	handler.add(optionExt("reorder", required_argument, NULL, 0, "<fraction>", "Swap a random fraction of all spill chunks with the following chunk"));
+	handler.add(optionExt("burst", required_argument, NULL, 'b', "<N>", "Send spills in bursts of N, keeping the average rate (default=1)"));
+	handler.add(optionExt("seed", required_argument, NULL, 0, "<seed>", "Specify the seed used to inject faults (default=0)"));
+
+	if(!handler.setup(argc, argv))
+		return 1;
+
+	if(!handler.getOption(0)->active){
+		std::cout << " ERROR: No input filename specified!\n";
+		return 1;
+	}
+	std::string filename = handler.getOption(0)->argument;
+
+	std::string address = "localhost";
+	if(handler.getOption(1)->active)
+		address = handler.getOption(1)->argument;
+
+	int port = 5555;
+	if(handler.getOption(2)->active)
+		port = strtol(handler.getOption(2)->argument.c_str(), NULL, 0);
+
+	double byteRate = 0; // Bytes per second.
+	if(handler.getOption(3)->active)
+		byteRate = strtod(handler.getOption(3)->argument.c_str(), NULL)*1E6;
+
+	double spillRate = 0; // Spills per second.
+	if(handler.getOption(4)->active)
+		spillRate = strtod(handler.getOption(4)->argument.c_str(), NULL);
+
+	double chunkDelay = 0; // Microseconds.
+	if(handler.getOption(5)->active)
+		chunkDelay = strtod(handler.getOption(5)->argument.c_str(), NULL);
+
+	unsigned int numLoops = 1;
+	if(handler.getOption(6)->active)
+		numLoops = strtoul(handler.getOption(6)->argument.c_str(), NULL, 0);
+
+	bool verbose = handler.getOption(7)->active;
+
+	double timeScale = 0; // Speed-up of the pixie timestamps.
+	if(handler.getOption(8)->active){
+		timeScale = strtod(handler.getOption(8)->argument.c_str(), NULL);
+		if(timeScale <= 0){
+			std::cout << " ERROR: Invalid real time scale factor (" << handler.getOption(8)->argument << ")!\n";
+			return 1;
+		}
+	}
+
+	double clockPeriod = 8E-9; // Seconds per system clock tick.
+	if(handler.getOption(9)->active)
+		clockPeriod = strtod(handler.getOption(9)->argument.c_str(), NULL)*1E-9;
+
+	faultModel faults;
+	if(handler.getOption(10)->active)
+		faults.loss = strtod(handler.getOption(10)->argument.c_str(), NULL);
+	if(handler.getOption(11)->active)
+		faults.reorder = strtod(handler.getOption(11)->argument.c_str(), NULL);
+
+	unsigned int burstSize = 1;
+	if(handler.getOption(12)->active)
+		burstSize = strtoul(handler.getOption(12)->argument.c_str(), NULL, 0);
+	if(burstSize == 0) burstSize = 1;
+
+	if(handler.getOption(13)->active)
+		faults.rng.seed(strtoul(handler.getOption(13)->argument.c_str(), NULL, 0));
+
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if(!file.good()){
+		std::cout << " ERROR: Failed to open input file \"" << filename << "\"!\n";
+		return 1;
+	}
+
+	// Use the ldf format for files ending in .ldf and the pld format otherwise.
+	bool ldfFormat = (filename.size() > 4 && filename.substr(filename.size()-4) == ".ldf");
+
+	PLD_header pldHead;
+	PLD_data pldData;
+	DIR_buffer dirBuff;
+	HEAD_buffer headBuff;
+	DATA_buffer dataBuff;
+	unsigned int runNumber;
+	if(!ldfFormat){
+		if(!pldHead.Read(&file)){
+			std::cout << " ERROR: Failed to read .pld header from input file!\n";
+			return 1;
+		}
+		runNumber = pldHead.GetRunNumber();
+	}
+	else{
+		if(!dirBuff.Read(&file) || !headBuff.Read(&file)){
+			std::cout << " ERROR: Failed to read .ldf header from input file!\n";
+			return 1;
+		}
+		runNumber = dirBuff.GetRunNumber();
+	}
+	std::streampos dataStart = file.tellg();
+
+	// The buffer grows to fit spills larger than the maximum size in the header.
+	SpillBuffer data(!ldfFormat ? pldHead.GetMaxSpillSize() : 0);
+	std::vector<unsigned int> chunk(POLL2_CHUNK_WORDS+2);
+
+	Client client;
+	if(!client.Init(address.c_str(), port)){
+		std::cout << " ERROR: Failed to open socket to " << address << ":" << port << "!\n";
+		return 1;
+	}
+
+	std::cout << " Replaying \"" << filename << "\" (run " << runNumber << ") to " << address << ":" << port << std::endl;
+
+	unsigned long numSpills = 0;
+	double totalBytes = 0;
+	double sendTime = 0; // Time to send the current spill, relative to the start time (in s).
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	for(unsigned int loop = 0; numLoops == 0 || loop < numLoops; loop++){
+		file.clear();
+		file.seekg(dataStart);
+		pldData.Reset();
+		dataBuff.Reset();
+
+		// Spill timestamps of each pass through the file are relative to its first spill.
+		double firstSpillTime = -1;
+		double loopStartTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		unsigned int nBytes;
+		while(true){
+			if(!ldfFormat){
+				if(!pldData.Read(&file, &data, nBytes)) break;
+			}
+			else{
+				bool fullSpill, badSpill;
+				if(!dataBuff.Read(&file, &data, nBytes, fullSpill, badSpill)){
+					if(dataBuff.GetRetval() == 2 || dataBuff.GetRetval() == 6) break;
+					continue;
+				}
+				if(!fullSpill || badSpill) continue;
+			}
+
+			// Find the time to send this spill. Spills are never sent earlier than the previous spill.
+			double spillTime;
+			if(timeScale > 0 && getSpillTime(data.GetData(), nBytes/4, spillTime)){
+				if(firstSpillTime < 0) firstSpillTime = spillTime;
+				sendTime = std::max(sendTime, loopStartTime + (spillTime - firstSpillTime)*clockPeriod/timeScale);
+			}
+			if(byteRate > 0)
+				sendTime = std::max(sendTime, totalBytes/byteRate);
+			if(spillRate > 0)
+				sendTime = std::max(sendTime, numSpills/spillRate);
+
+			// Spills inside of a burst are sent immediately after the first spill of the burst.
+			if(sendTime > 0 && numSpills % burstSize == 0)
+				std::this_thread::sleep_until(startTime + std::chrono::microseconds((long)(sendTime*1E6)));
+
+			long nSent = sendSpill(&client, data.GetData(), nBytes/4, chunk.data(), chunkDelay, faults);
+			if(nSent < 0){
+				std::cout << " ERROR: Failed to send spill " << numSpills << "!\n";
+				return 1;
+			}
+
+			numSpills++;
+			totalBytes += nSent;
+			if(verbose)
+				std::cout << "  Spill " << numSpills << ": " << nBytes/4 << " words at t=" << sendTime << " s\n";
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << " Sent " << numSpills << " spills (" << totalBytes/1E6 << " MB) in " << elapsed << " s";
+	if(elapsed > 0)
+		std::cout << " (" << totalBytes/1E6/elapsed << " MB/s)";
+	std::cout << std::endl;
+	if(faults.loss > 0 || faults.reorder > 0)
+		std::cout << " Dropped " << faults.numDropped << " chunks and reordered " << faults.numReordered << " chunks.\n";
+
+	client.Close();
+
+	return 0;
+}
@@ -34,7 +34,19 @@ double doubleWoodsSaxon(double *x, double *p){
 	return (p[0]/(1+std::exp((x[0]-0.5*p[1]-p[2])/p[4])));
 }
 
-double integrateHistogram(TH1 *h, const double &start, const double &stop){
+/** 1d gaussian, equivalent to the root "gaus" function, which is safe to use in several threads.
+  * \param[in] x: x[0] = T in ns
+  * \param[in] p:
+  *  p[0] = Amplitude
+  *  p[1] = Mean in ns
+  *  p[2] = Sigma in ns
+  */
+double gaussian(double *x, double *p){
+	double arg = (x[0]-p[1])/p[2];
+	return p[0]*std::exp(-0.5*arg*arg);
+}
+
+double integrateHistogram(TH1 *h, const double &start, const double &stop, std::ostream &log){
 	double sum = 0;
 	for(int i = 1; i <= h->GetNbinsX(); i++){
 		sum += h->GetBinContent(i);
@@ -43,7 +55,7 @@ double integrateHistogram(TH1 *h, const double &start, const double &stop){
 	double sum2 = 0;
 	int startBin = h->FindBin(start);
 	int stopBin = h->FindBin(stop);
-	std::cout << " start=" << startBin << ", stop=" << stopBin << std::endl;
+	log << " start=" << startBin << ", stop=" << stopBin << std::endl;
 	for(int i = startBin; i <= stopBin; i++){
 		sum2 += h->GetBinContent(i);
 	}
@@ -63,6 +75,10 @@ class timeAlign : public simpleHistoFitter {
 
 	bool classicMode;
 
+	bool fitChannel(TH1D *h1, TF1 *f1, const std::string &label, const char *fitOpt, std::ostream &log, std::ostream &results, std::ostream &calib);
+
+	bool fitProjection(TH1D *h1_, const std::string &label_, std::ostream &log_, std::ostream &results_, std::ostream &calib_);
+
   public:
 	timeAlign() : simpleHistoFitter(), fitRangeMult(2), detectorLength(60), detectorWidth(3), timeOffset(0), betaFrac(0.5), numPeaks(1), classicMode(false) { }
 
@@ -102,53 +118,177 @@ bool timeAlign::processChildArgs(){
 	return true;
 }
 
-bool timeAlign::process(){
-	if(!h2d || !can2) return false;
+/** Fit the distribution of a single channel and output the results.
+  * \param[in]  h1 Projection histogram of the channel.
+  * \param[in]  f1 Fit function (double Woods-Saxon, or gaussian in classic mode).
+  * \param[in]  label Label of the channel.
+  * \param[in]  fitOpt Root fit options.
+  * \param[out] log Console output.
+  * \param[out] results Fit results (fitresults.dat).
+  * \param[out] calib Calibration output (bars.cal, or time.cal in classic mode).
+  * \return True if the fit succeeded and false otherwise.
+  */
+bool timeAlign::fitChannel(TH1D *h1, TF1 *f1, const std::string &label, const char *fitOpt, std::ostream &log, std::ostream &results, std::ostream &calib){
+	double xmin, xmax;
 
-	TH1D *h1 = getProjectionHist(h2d);
-	TF1 *f1;
-	//TMarker *m1;
+	// Initial fitting parameters.
+	double v0, beta, t0, a, b;
+	double cbar;
 
-	std::ofstream ofile1("fitresults.dat");
-	std::ofstream ofile2;
+	const std::vector<std::vector<double> > *prev = getSeeds(label);
 
-	double xmin, xmax;
+	if(!classicMode){
+		if(prev && prev->front().size() >= 5){ // Use the results of the previous run.
+			v0 = prev->front().at(0);
+			beta = prev->front().at(1);
+			t0 = prev->front().at(2);
+			a = prev->front().at(3);
+			b = prev->front().at(4);
+		}
+		else{
+			// Approximate the initial parameters of the fit.
+			t0 = h1->GetMean();
+			v0 = h1->GetBinContent(h1->FindBin(t0));
+			beta = 2.35*h1->GetStdDev();	
+
+			a = 0.5; // ?
+			b = 0.5; // ?
+		}
+
+		// Calculate the fitting range.
+		xmin = t0-fitRangeMult*(beta/2);
+		xmax = t0+fitRangeMult*(beta/2);
+
+		// Set the initial fit conditions.
+		f1->SetParameters(v0, beta, t0, a, b);	
+	}
+	else{
+		double xmean = 9999;
+		double ymean = 9999;
+
+		if(prev && prev->front().size() >= 2){ // Use the results of the previous run.
+			xmean = prev->front().at(1);
+			ymean = prev->front().at(0);
+		}
+		else{
+			// Search for peaks.
+			TSpectrum spec(numPeaks);
+			spec.Search(h1, 2, (batchMode ? "goff" : ""));
+
+			// Find the earliest peak.
+			for(int j = 0; j < spec.GetNPeaks(); j++){
+				if(spec.GetPositionX()[j] < xmean){
+					xmean = spec.GetPositionX()[j];
+					ymean = spec.GetPositionY()[j];
+				}
+			}
+		}
+
+		// Set the initial conditions.
+		f1->SetParameters(ymean, xmean, 1);
+
+		// Calculate the fitting range.
+		xmin = xmean - fitRangeMult/2;
+		xmax = xmean + fitRangeMult/2;
+	}
 	
+	log << "  Range: " << xmin << ", " << xmax << std::endl;
+
+	f1->SetRange(xmin, xmax);
+	h1->Fit(f1, fitOpt);
+
+	if(f1->GetNDF() <= 0){
+		log << "  Fit failed!\n";
+		return false;
+	}
+
+	// Output the fit results.
+	if(!classicMode){
+		double xLo = f1->GetX(betaFrac*f1->GetParameter(0), xmin, 0);
+		double xHi = f1->GetX(betaFrac*f1->GetParameter(0), 0, xmax);
+		double beta = xHi-xLo;
+		if(debug){
+			log << " Using beta fraction of " << betaFrac << ": xLow=" << xLo << " ns, xHigh=" << xHi << " ns, FWHM=" << beta << " ns, I=" << 100*integrateHistogram(h1, xLo, xHi, log) << "%\n";
+		}
+		
+		// Calculate bar speed-of-light.
+		cbar = 2*detectorLength/beta;
+
+		log << "  Fit: chi^2 = " << f1->GetChisquare()/f1->GetNDF() << ", t0 = " << f1->GetParameter(2) << " ns, cbar  = " << cbar << " cm/ns\n";
+		log << "  T0=" << detectorLength/(2*cbar) << " ns is the corresponding detector length time offset.\n";
+		results << label;
+		for(int j = 0; j < 5; j++) results << "\t" << f1->GetParameter(j);
+		results << "\t" << f1->GetChisquare()/f1->GetNDF() << std::endl;
+		calib << label << "\t" << f1->GetParameter(2) << "\t" << beta << "\t" << cbar << "\t" << detectorLength << "\t" << detectorWidth << std::endl;
+	}
+	else{
+		log << "  Fit: chi^2 = " << f1->GetChisquare()/f1->GetNDF() << ", t0 = " << f1->GetParameter(1) << " ns\n";
+		results << label << "\t" << f1->GetParameter(0) << "\t" << f1->GetParameter(1) << "\t" << f1->GetParameter(2) << "\t" << f1->GetChisquare()/f1->GetNDF() << std::endl;
+		calib << label << "\t" << f1->GetParameter(1) << std::endl;
+	}
+
+	return true;
+}
+
+bool timeAlign::fitProjection(TH1D *h1_, const std::string &label_, std::ostream &log_, std::ostream &results_, std::ostream &calib_){
+	// Each thread uses its own fit function.
+	std::string fname = "f1_" + label_;
+	TF1 f1(fname.c_str(), (!classicMode ? doubleWoodsSaxon : gaussian), 0, 1, (!classicMode ? 5 : 3));
+	return fitChannel(h1_, &f1, label_, "QR0+", log_, results_, calib_);
+}
+
+bool timeAlign::process(){
+	if(!h2d || (!batchMode && !can2)) return false;
+
+	std::string resultsHeader, calFilename, calHeader;
 	if(!classicMode){
-		can2->cd();
 		std::cout << "Using detector length of " << detectorLength << " cm.\n";
 		std::cout << "Using detector width of " << detectorWidth << " cm.\n";
 		std::cout << "Using fitting range of " << fitRangeMult << " multiples of beta.\n"; 
-		f1 = new TF1("f1", doubleWoodsSaxon, 0, 1, 5);
 
-		ofile1 << "id\tv0\tbeta\tt0\ta\tb\tchi2\n";
+		resultsHeader = "id\tv0\tbeta\tt0\ta\tb\tchi2\n";
 		
-		ofile2.open("bars.cal");
-		ofile2 << "#Compute the right-left time difference offset (t0) for a given bar pair such\n";
-		ofile2 << "# that dT = tR - tL - t0 = 0 ns. Also calculate the speed-of-light in the bar\n";
-		ofile2 << "# using cbar = 2d/beta where d is the total length of the bar and beta is the\n";
-		ofile2 << "# FWHM of the time difference distribution.\n";
-		ofile2 << "#id\tt0(ns)\tbeta(ns)\tcbar(cm/ns)\tlength(cm)\twidth(cm)\n";
+		calFilename = "bars.cal";
+		calHeader = "#Compute the right-left time difference offset (t0) for a given bar pair such\n"
+		            "# that dT = tR - tL - t0 = 0 ns. Also calculate the speed-of-light in the bar\n"
+		            "# using cbar = 2d/beta where d is the total length of the bar and beta is the\n"
+		            "# FWHM of the time difference distribution.\n"
+		            "#id\tt0(ns)\tbeta(ns)\tcbar(cm/ns)\tlength(cm)\twidth(cm)\n";
 	}
 	else{
-		can2->cd()->SetLogy();
 		std::cout << "Using \"classic\" mode with time offset of " << timeOffset << " ns.\n";
 		std::cout << "Using fitting range of " << fitRangeMult << " units.\n"; 
-		f1 = new TF1("f1", "gaus", 0, 1);
 
-		ofile1 << "id\tA\tmean\tsigma\tchi2\n";	
+		resultsHeader = "id\tA\tmean\tsigma\tchi2\n";	
 	
-		ofile2.open("time.cal");
-		ofile2 << "#Set the time offset for a given scan channel (16*m + c, where m is the module\n";
-		ofile2 << "# module and c is the channel) relative to the start detector. The following\n";
-		ofile2 << "# operation is applied, T = T' - t0 where T is the calibrated time, T' is\n";
-		ofile2 << "# the uncalibrated time, and t0 is given below (all in ns).\n";
-		ofile2 << "#id\tt0(ns)\n";
+		calFilename = "time.cal";
+		calHeader = "#Set the time offset for a given scan channel (16*m + c, where m is the module\n"
+		            "# module and c is the channel) relative to the start detector. The following\n"
+		            "# operation is applied, T = T' - t0 where T is the calibrated time, T' is\n"
+		            "# the uncalibrated time, and t0 is given below (all in ns).\n"
+		            "#id\tt0(ns)\n";
 	}
 
-	// Initial fitting parameters.
-	double v0, beta, t0, a, b;
-	double cbar;
+	if(batchMode)
+		return processBatch(resultsHeader, calFilename, calHeader);
+
+	TH1D *h1 = getProjectionHist(h2d);
+	TF1 *f1;
+
+	std::ofstream ofile1("fitresults.dat");
+	std::ofstream ofile2(calFilename.c_str());
+
+	ofile1 << resultsHeader;
+	ofile2 << calHeader;
+	
+	if(!classicMode){
+		can2->cd();
+		f1 = new TF1("f1", doubleWoodsSaxon, 0, 1, 5);
+	}
+	else{
+		can2->cd()->SetLogy();
+		f1 = new TF1("f1", "gaus", 0, 1);
+	}
 
 	int numProjections = getNumProjections(h2d);
 	for(int i = 1; i <= numProjections; i++){
@@ -159,125 +299,19 @@ bool timeAlign::process(){
 			std::stringstream stream; stream << getBinLowEdge(h2d, i);
 			h1->SetTitle(stream.str().c_str());
 			
-			if(!classicMode){
-				/*double crossLeft, crossRight;
-
-				// Get the amplitude of the distribution from the user.
-				std::cout << "  Mark the center of the distribution (t0,v0)\n";
-				m1 = (TMarker*)can2->WaitPrimitive("TMarker");
-				t0 = m1->GetX();
-				v0 = m1->GetY();
-				delete m1;
-				
-				// Draw the FWHM line.
-				TLine line(h1->GetXaxis()->GetXmin(), v0/2, h1->GetXaxis()->GetXmax(), v0/2);
-				line.Draw("SAME");
+			if(classicMode && debug){
+				can2->Clear();
+				h1->Draw();
 				can2->Update();
-
-				// Get the left crossing point.
-				std::cout << "  Mark the left crossing-point\n";
-				m1 = (TMarker*)can2->WaitPrimitive("TMarker");
-				crossLeft = m1->GetX();
-				delete m1;	
-				
-				// Get the left crossing point.
-				std::cout << "  Mark the right crossing-point\n";
-				m1 = (TMarker*)can2->WaitPrimitive("TMarker");
-				crossRight = m1->GetX();
-				delete m1;
-
-				// Calculate the FWHM.
-				beta = crossRight-crossLeft;*/
-
-				// Approximate the initial parameters of the fit.
-				t0 = h1->GetMean();
-				v0 = h1->GetBinContent(h1->FindBin(t0));
-				beta = 2.35*h1->GetStdDev();	
-
-				a = 0.5; // ?
-				b = 0.5; // ?
-
-				// Calculate the fitting range.
-				xmin = t0-fitRangeMult*(beta/2);
-				xmax = t0+fitRangeMult*(beta/2);
-
-				// Set the initial fit conditions.
-				f1->SetParameters(v0, beta, t0, a, b);	
 			}
-			else{
-				if(debug){
-					can2->Clear();
-					h1->Draw();
-					can2->Update();
-				}
-			
-				/*m1 = (TMarker*)can2->WaitPrimitive("TMarker");
-				xmin = m1->GetX();
-				m1->Delete();
-				m1 = (TMarker*)can2->WaitPrimitive("TMarker");
-				xmax = m1->GetX();
-				m1->Delete();*/
-
-				// Search for peaks.
-				TSpectrum spec(numPeaks);
-				spec.Search(h1);
-
-				double xmean = 9999;
-				double ymean = 9999;
-
-				// Find the earliest peak.
-				for(int j = 0; j < spec.GetNPeaks(); j++){
-					if(spec.GetPositionX()[j] < xmean){
-						xmean = spec.GetPositionX()[j];
-						ymean = spec.GetPositionY()[j];
-					}
-				}
-
-				// Set the initial conditions.
-				f1->SetParameters(xmean, ymean, 1);
 
-				// Calculate the fitting range.
-				xmin = xmean - fitRangeMult/2;
-				xmax = xmean + fitRangeMult/2;
-			}
-			
-			std::cout << "  Range: " << xmin << ", " << xmax << std::endl;
-	
-			f1->SetRange(xmin, xmax);
-			h1->Fit(f1, "QR");
+			fitChannel(h1, f1, stream.str(), "QR", std::cout, ofile1, ofile2);
 		
 			if(debug){
 				f1->Draw("SAME");
 				can2->Update();
 				can2->WaitPrimitive();
 			}
-
-			// Output the fit results.
-			if(!classicMode){
-				double xLo = f1->GetX(betaFrac*f1->GetParameter(0), xmin, 0);
-				double xHi = f1->GetX(betaFrac*f1->GetParameter(0), 0, xmax);
-				double beta = xHi-xLo;
-				if(debug){
-					std::cout << " Using beta fraction of " << betaFrac << ": xLow=" << xLo << " ns, xHigh=" << xHi << " ns, FWHM=" << beta << " ns, I=" << 100*integrateHistogram(h1, xLo, xHi) << "%\n";
-				}
-				
-				// Calculate bar speed-of-light.
-				cbar = 2*detectorLength/beta;
-
-				std::cout << "  Fit: chi^2 = " << f1->GetChisquare()/f1->GetNDF() << ", t0 = " << f1->GetParameter(2) << " ns, cbar  = " << cbar << " cm/ns\n";
-				std::cout << "  T0=" << detectorLength/(2*cbar) << " ns is the corresponding detector length time offset.\n";
-				ofile1 << stream.str();
-				for(int j = 0; j < 5; j++) ofile1 << "\t" << f1->GetParameter(j);
-				ofile1 << "\t" << f1->GetChisquare()/f1->GetNDF() << std::endl;
-				ofile2 << stream.str() << "\t" << f1->GetParameter(2) << "\t" << beta << "\t" << cbar << "\t" << detectorLength << "\t" << detectorWidth << std::endl;
-			}
-			else{
-				std::cout << "  Fit: chi^2 = " << f1->GetChisquare()/f1->GetNDF() << ", t0 = " << f1->GetParameter(1) << " ns\n";
-				ofile1 << stream.str() << "\t" << f1->GetParameter(0) << "\t" << f1->GetParameter(1) << "\t" << f1->GetParameter(2) << "\t" << f1->GetChisquare()/f1->GetNDF() << std::endl;
-				ofile2 << stream.str() << "\t" << f1->GetParameter(1) << std::endl;
-			}
-			//can2->WaitPrimitive();
-			//sleep(2);
 		}
 		else std::cout << "FAILED\n";
 	}
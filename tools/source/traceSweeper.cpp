@@ -0,0 +1,818 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "ScanInterface.hpp"
+#include "Unpacker.hpp"
+#include "XiaData.hpp"
+#include "helperFunctions.h"
+
+#include "MapFile.hpp"
+#include "ConfigFile.hpp"
+#include "ColorTerm.hpp"
+
+// Define the name of the program.
+#if not defined(PROG_NAME)
+#define PROG_NAME "traceSweeper"
+#endif
+
+/** Parse a parameter grid string with the format "start:stop:step". A single value may also
+  * be specified, in which case the grid will contain only that value.
+  * @param input_ The grid specification string.
+  * @param values Vector of all grid values read from the input string.
+  * @return True if the grid was parsed successfully and false otherwise.
+  */
+bool parseGrid(const std::string &input_, std::vector<double> &values){
+	values.clear();
+	std::vector<double> args;
+	std::string entry;
+	for(size_t i = 0; i <= input_.size(); i++){
+		if(i < input_.size() && input_[i] != ':'){
+			entry += input_[i];
+			continue;
+		}
+		if(entry.empty()) return false;
+		args.push_back(strtod(entry.c_str(), NULL));
+		entry = "";
+	}
+	if(args.size() == 1){
+		values.push_back(args.front());
+		return true;
+	}
+	if(args.size() != 3 || args[2] <= 0 || args[1] < args[0]) return false;
+	for(double value = args[0]; value <= args[1] + 1E-6*args[2]; value += args[2])
+		values.push_back(value);
+	return !values.empty();
+}
+
+/** Compute the full width at half maximum of the largest peak in the range [low_, high_) of a histogram.
+  * The half maximum crossings are found using linear interpolation between bins.
+  * @param hist_ Vector of histogram bin contents.
+  * @param low_ The first bin to search.
+  * @param high_ One past the last bin to search.
+  * @param center The index of the bin containing the peak maximum.
+  * @return The FWHM in bins, or -1 if the half maximum is not crossed on both sides of the peak.
+  */
+double computeFWHM(const std::vector<double> &hist_, const size_t &low_, const size_t &high_, size_t &center){
+	if(high_ <= low_ + 2) return -1;
+	center = low_;
+	for(size_t i = low_; i < high_; i++){
+		if(hist_[i] > hist_[center]) center = i;
+	}
+	double half = hist_[center]/2;
+	if(half <= 0) return -1;
+
+	// Search to the left of the maximum.
+	double left = -1;
+	for(size_t i = center; i > low_; i--){
+		if(hist_[i-1] < half){
+			left = (i-1) + (half - hist_[i-1])/(hist_[i] - hist_[i-1]);
+			break;
+		}
+	}
+
+	// Search to the right of the maximum.
+	double right = -1;
+	for(size_t i = center; i+1 < high_; i++){
+		if(hist_[i+1] < half){
+			right = i + (hist_[i] - half)/(hist_[i] - hist_[i+1]);
+			break;
+		}
+	}
+
+	if(left < 0 || right < 0) return -1;
+	return (right - left);
+}
+
+/** Compute the bin which best separates a histogram into two classes by maximizing the
+  * between-class variance (Otsu's method).
+  * @param hist_ Vector of histogram bin contents.
+  * @return The index of the first bin of the upper class.
+  */
+size_t computeOtsu(const std::vector<double> &hist_){
+	double total = 0, sum = 0;
+	for(size_t i = 0; i < hist_.size(); i++){
+		total += hist_[i];
+		sum += i*hist_[i];
+	}
+
+	double weightLow = 0, sumLow = 0;
+	double bestVariance = -1;
+	size_t threshold = hist_.size()/2;
+	for(size_t i = 0; i+1 < hist_.size(); i++){
+		weightLow += hist_[i];
+		sumLow += i*hist_[i];
+		double weightHigh = total - weightLow;
+		if(weightLow <= 0) continue;
+		if(weightHigh <= 0) break;
+		double meanLow = sumLow/weightLow;
+		double meanHigh = (sum - sumLow)/weightHigh;
+		double variance = weightLow*weightHigh*(meanLow - meanHigh)*(meanLow - meanHigh);
+		if(variance > bestVariance){
+			bestVariance = variance;
+			threshold = i+1;
+		}
+	}
+	return threshold;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class sweepChannel
+///////////////////////////////////////////////////////////////////////////////
+
+/// Decoded traces and pre-computed trace quantities for a single pixie channel.
+class sweepChannel{
+  public:
+	int id; ///< The pixie ID of the channel (mod*16+chan)
+	std::string type; ///< The detector type name from the map file
+	double mapF; ///< The CFD fraction currently defined in the map file
+
+	std::vector<unsigned short> samples; ///< All cached ADC samples, stored contiguously
+	std::vector<size_t> offsets; ///< Offset of each trace in the sample array
+	std::vector<unsigned short> lengths; ///< Length of each trace (in ADC clock ticks)
+	std::vector<double> coarse; ///< Time of each trace relative to the high resolution start time (in ns), not including the trace phase
+	std::vector<float> baselines; ///< Baseline of each trace
+	std::vector<float> maxima; ///< Baseline corrected maximum of each trace
+	std::vector<unsigned short> maxIndices; ///< Index of the maximum of each trace
+
+	/** Default constructor
+	  */
+	sweepChannel() : id(-1), mapF(0.5) { }
+
+	/** Get the number of cached traces
+	  */
+	size_t size() const { return offsets.size(); }
+
+	/** Add a trace to the cache
+	  */
+	void add(ChannelEvent *event_, const double &coarse_);
+};
+
+void sweepChannel::add(ChannelEvent *event_, const double &coarse_){
+	offsets.push_back(samples.size());
+	lengths.push_back(event_->traceLength);
+	samples.insert(samples.end(), event_->adcTrace, event_->adcTrace + event_->traceLength);
+	coarse.push_back(coarse_);
+	baselines.push_back(event_->baseline);
+	maxima.push_back(event_->maximum);
+	maxIndices.push_back(event_->max_index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class sweepTask
+///////////////////////////////////////////////////////////////////////////////
+
+/// A single point on the parameter grid of a single channel.
+class sweepTask{
+  public:
+	size_t channel; ///< Index of the channel in the channel cache
+	bool timing; ///< True for a CFD timing point and false for an integration window (PSD) point
+
+	double par[3]; ///< CFD F, D, L (timing) or short window low, short window high (PSD)
+
+	double metric; ///< Timing FWHM (in ns) or PSD figure-of-merit. Negative if the point could not be evaluated
+	double centroid; ///< Time centroid (in ns) or PSD threshold
+	unsigned long entries; ///< Number of traces which were successfully analyzed
+
+	/** Default constructor
+	  */
+	sweepTask() : channel(0), timing(true), metric(-1), centroid(0), entries(0) { par[0] = par[1] = par[2] = 0; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class sweepUnpacker
+///////////////////////////////////////////////////////////////////////////////
+
+class sweepUnpacker : public Unpacker {
+  public:
+	/** Default constructor
+	  */
+	sweepUnpacker();
+
+	/** Destructor
+	  */
+	~sweepUnpacker(){  }
+
+	/** Set the channel map and the clock periods (in ns) used to build the trace cache
+	  */
+	void SetMap(MapFile *map_, const int &startID_, const double &sysClock_, const double &adcClock_);
+
+	/** Only cache channels of a given detector type (empty string for all types)
+	  */
+	void SetType(const std::string &type_){ detectorType = type_; }
+
+	/** Set the maximum number of traces to cache for each channel
+	  */
+	void SetMaxEvents(const size_t &max_){ maxEvents = max_; }
+
+	/** Get the cached channels
+	  */
+	std::vector<sweepChannel> *GetChannels(){ return &channels; }
+
+	/** Get the number of raw events which contained a valid start
+	  */
+	unsigned long GetNumStarts() const { return numStarts; }
+
+  private:
+	MapFile *mapfile; ///< Pointer to the channel map
+
+	std::string detectorType; ///< Detector type to cache (empty for all types)
+
+	std::vector<sweepChannel> channels; ///< Cached traces for each channel
+	std::vector<int> channelIndex; ///< Index into the channel cache for each pixie ID (-1 if not cached)
+
+	ChannelEvent decoder; ///< Scratch event used to compute the baseline and maximum of each trace
+
+	double sysClock; ///< The system clock period (in ns)
+	double adcClock; ///< The ADC clock period (in ns)
+
+	int startID; ///< The pixie ID of the start detector
+	double startF; ///< The CFD fraction used for the start detector
+
+	size_t maxEvents; ///< Maximum number of cached traces per channel
+
+	unsigned long numStarts; ///< Number of raw events with a valid start
+
+	/** Get the cache index for a channel event, or -1 if the channel is not to be cached
+	  */
+	int getChannel(XiaData *event_);
+
+	/** Compute the start time and cache the traces of all other channels in the raw event.
+	  * @param addr_ Pointer to a ScanInterface object.
+	  * @return Nothing.
+	  */
+	virtual void ProcessRawEvent(ScanInterface *addr_=NULL);
+};
+
+sweepUnpacker::sweepUnpacker() : Unpacker(), mapfile(NULL), sysClock(8), adcClock(4), startID(-1), startF(0.5), maxEvents(10000), numStarts(0) {
+}
+
+void sweepUnpacker::SetMap(MapFile *map_, const int &startID_, const double &sysClock_, const double &adcClock_){
+	mapfile = map_;
+	startID = startID_;
+	sysClock = sysClock_;
+	adcClock = adcClock_;
+
+	int mod, chan;
+	mapfile->GetModChan(startID, mod, chan);
+	MapEntry *entry = mapfile->GetMapEntry(mod, chan);
+	if(entry) entry->getArg(0, startF);
+}
+
+int sweepUnpacker::getChannel(XiaData *event_){
+	int id = event_->getID();
+	if(id < 0 || id == startID) return -1;
+	if(id < (int)channelIndex.size() && channelIndex[id] != -2)
+		return channelIndex[id];
+
+	if((int)channelIndex.size() < id+1)
+		channelIndex.resize(id+1, -2);
+
+	// Look up the channel in the map the first time it is encountered.
+	MapEntry *entry = mapfile->GetMapEntry(event_);
+	if(!entry || entry->type == "ignore" || (!detectorType.empty() && entry->type != detectorType)){
+		channelIndex[id] = -1;
+		return -1;
+	}
+
+	channels.push_back(sweepChannel());
+	channels.back().id = id;
+	channels.back().type = entry->type;
+	entry->getArg(0, channels.back().mapF);
+	channelIndex[id] = channels.size()-1;
+
+	return channelIndex[id];
+}
+
+void sweepUnpacker::ProcessRawEvent(ScanInterface *addr_/*=NULL*/){
+	// Find the start signal.
+	XiaData *start = NULL;
+	for(std::deque<XiaData*>::iterator iter = rawEvent.begin(); iter != rawEvent.end(); ++iter){
+		if((*iter)->getID() == startID){
+			start = (*iter);
+			break;
+		}
+	}
+
+	if(start && start->traceLength > 0){
+		// Compute the high resolution time of the start.
+		decoder.Clear();
+		decoder.copyTrace((char *)start->adcTrace, start->traceLength);
+		if(decoder.ComputeBaseline() >= 0 && decoder.AnalyzePolyCFD(startF) > 0){
+			double startPhase = decoder.phase;
+			numStarts++;
+
+			// Cache the traces of all other channels.
+			for(std::deque<XiaData*>::iterator iter = rawEvent.begin(); iter != rawEvent.end(); ++iter){
+				if((*iter) == start || (*iter)->traceLength == 0) continue;
+
+				int index = getChannel(*iter);
+				if(index < 0 || channels[index].size() >= maxEvents) continue;
+
+				decoder.Clear();
+				decoder.copyTrace((char *)(*iter)->adcTrace, (*iter)->traceLength);
+				if(decoder.ComputeBaseline() < 0) continue;
+
+				channels[index].add(&decoder, ((*iter)->time - start->time)*sysClock - startPhase*adcClock);
+			}
+		}
+	}
+
+	// Delete all events in the raw event.
+	Unpacker::ProcessRawEvent(addr_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class sweepScanner
+///////////////////////////////////////////////////////////////////////////////
+
+class sweepScanner : public ScanInterface {
+  public:
+	/** Default constructor
+	  */
+	sweepScanner();
+
+	/** Destructor
+	  */
+	~sweepScanner();
+
+	/** ExtraArguments is used to send command line arguments to classes derived
+	  * from ScanInterface.
+	  * @return Nothing.
+	  */
+	virtual void ExtraArguments();
+
+	/** ArgHelp is used to allow a derived class to add a command line option
+	  * to the main list of options.
+	  * @return Nothing.
+	  */
+	virtual void ArgHelp();
+
+	/** SyntaxStr is used to print a linux style usage message to the screen.
+	  * @param name_ The name of the program.
+	  * @return Nothing.
+	  */
+	virtual void SyntaxStr(char *name_);
+
+	/** Read the map and config files and set up the raw event builder.
+	  * @param prefix_ String to append to the beginning of system output.
+	  * @return True upon successfully initializing and false otherwise.
+	  */
+	virtual bool Initialize(std::string prefix_="");
+
+	/** Receive various status notifications from the scan.
+	  * @param code_ The notification code passed from ScanInterface methods.
+	  * @return Nothing.
+	  */
+	virtual void Notify(const std::string &code_="");
+
+	/** Return a pointer to the Unpacker object to use for data unpacking.
+	  * If no object has been initialized, create a new one.
+	  * @return Pointer to an Unpacker object.
+	  */
+	virtual Unpacker *GetCore();
+
+  private:
+	MapFile *mapfile; ///< The channel map
+
+	std::string detectorType; ///< Detector type name to select channels from the map file
+	std::string reportFilename; ///< Path to the output file for the full grid report
+
+	std::vector<double> gridF; ///< CFD fraction grid
+	std::vector<double> gridD; ///< CFD delay grid (traditional CFD only)
+	std::vector<double> gridL; ///< CFD length grid (traditional CFD only)
+	std::vector<double> gridLow2; ///< Short integration window low edge grid (in ADC ticks before the maximum)
+	std::vector<double> gridHigh2; ///< Short integration window high edge grid (in ADC ticks after the maximum)
+
+	std::vector<sweepTask> tasks; ///< All grid points for all channels
+
+	double adcClock; ///< The ADC clock period (in ns)
+	double timeRange; ///< Half-width of the time difference histograms (in ns)
+
+	int fittingLow; ///< Long integration window low edge (in ADC ticks before the maximum)
+	int fittingHigh; ///< Long integration window high edge (in ADC ticks after the maximum)
+
+	size_t maxEvents; ///< Maximum number of cached traces per channel
+	unsigned int numThreads; ///< Number of worker threads
+
+	bool useTraditional; ///< Use traditional CFD instead of polynomial CFD
+	bool sweepComplete; ///< Set to true once the sweep has been run
+
+	std::atomic<size_t> nextTask; ///< Index of the next grid point to be evaluated
+
+	/** Build the list of grid points for all cached channels
+	  */
+	void buildTasks();
+
+	/** Evaluate grid points until none remain (executed by each worker thread)
+	  */
+	void worker();
+
+	/** Evaluate a single CFD timing grid point
+	  */
+	void evaluateTiming(sweepTask &task_, ChannelEvent &scratch_, size_t &cfdLength_);
+
+	/** Evaluate a single integration window grid point
+	  */
+	void evaluatePSD(sweepTask &task_, ChannelEvent &scratch_);
+
+	/** Run the parameter sweep on all cached traces and print the results
+	  */
+	void runSweep();
+
+	/** Print the optimum parameters for each channel and write the report file
+	  */
+	void printResults();
+};
+
+sweepScanner::sweepScanner() : ScanInterface(), mapfile(NULL), adcClock(4), timeRange(20), fittingLow(5), fittingHigh(30), maxEvents(10000),
+                               numThreads(std::thread::hardware_concurrency()), useTraditional(false), sweepComplete(false), nextTask(0) {
+	parseGrid("0.1:0.9:0.1", gridF);
+	parseGrid("1", gridD);
+	parseGrid("1", gridL);
+	parseGrid("-10:0:2", gridLow2);
+	parseGrid("10:30:4", gridHigh2);
+	if(numThreads == 0) numThreads = 1;
+}
+
+sweepScanner::~sweepScanner(){
+	if(mapfile) delete mapfile;
+}
+
+void sweepScanner::buildTasks(){
+	std::vector<sweepChannel> *channels = ((sweepUnpacker*)GetCore())->GetChannels();
+
+	tasks.clear();
+	for(size_t i = 0; i < channels->size(); i++){
+		if(channels->at(i).size() == 0) continue;
+		for(std::vector<double>::iterator f = gridF.begin(); f != gridF.end(); ++f){
+			for(std::vector<double>::iterator d = gridD.begin(); d != gridD.end(); ++d){
+				for(std::vector<double>::iterator l = gridL.begin(); l != gridL.end(); ++l){
+					sweepTask task;
+					task.channel = i;
+					task.timing = true;
+					task.par[0] = (*f);
+					task.par[1] = (*d);
+					task.par[2] = (*l);
+					tasks.push_back(task);
+					if(!useTraditional) break;
+				}
+				if(!useTraditional) break;
+			}
+		}
+		for(std::vector<double>::iterator low = gridLow2.begin(); low != gridLow2.end(); ++low){
+			for(std::vector<double>::iterator high = gridHigh2.begin(); high != gridHigh2.end(); ++high){
+				if(-(*low) >= (*high)) continue; // Empty window.
+				sweepTask task;
+				task.channel = i;
+				task.timing = false;
+				task.par[0] = (*low);
+				task.par[1] = (*high);
+				tasks.push_back(task);
+			}
+		}
+	}
+}
+
+void sweepScanner::evaluateTiming(sweepTask &task_, ChannelEvent &scratch_, size_t &cfdLength_){
+	sweepChannel &chan = ((sweepUnpacker*)GetCore())->GetChannels()->at(task_.channel);
+
+	std::vector<double> times;
+	times.reserve(chan.size());
+	for(size_t i = 0; i < chan.size(); i++){
+		scratch_.copyTrace((char *)&chan.samples[chan.offsets[i]], chan.lengths[i]);
+		scratch_.baseline = chan.baselines[i];
+		scratch_.maximum = chan.maxima[i];
+		scratch_.max_index = chan.maxIndices[i];
+		scratch_.computed = TRACE_BASELINE; // Use the cached baseline and maximum.
+		if(useTraditional){
+			// The CFD array is only allocated once, make sure it is large enough.
+			if(scratch_.traceLength > cfdLength_){
+				if(scratch_.cfdvals) delete[] scratch_.cfdvals;
+				scratch_.cfdvals = NULL;
+				cfdLength_ = scratch_.traceLength;
+			}
+			scratch_.AnalyzeCFD(task_.par[0], (size_t)task_.par[1], (size_t)task_.par[2]);
+		}
+		else scratch_.AnalyzePolyCFD(task_.par[0]);
+		if(scratch_.phase > 0)
+			times.push_back(chan.coarse[i] + scratch_.phase*adcClock);
+	}
+	task_.entries = times.size();
+	if(times.size() < 10) return;
+
+	// Histogram the time differences around the median.
+	std::nth_element(times.begin(), times.begin()+times.size()/2, times.end());
+	double median = times[times.size()/2];
+	const size_t nBins = 200;
+	const double binWidth = 2*timeRange/nBins;
+	const double low = median - timeRange;
+	std::vector<double> hist(nBins, 0);
+	for(std::vector<double>::iterator iter = times.begin(); iter != times.end(); ++iter){
+		double bin = ((*iter) - low)/binWidth;
+		if(bin >= 0 && bin < nBins) hist[(size_t)bin] += 1;
+	}
+
+	size_t center;
+	double fwhm = computeFWHM(hist, 0, nBins, center);
+	if(fwhm < 0) return;
+	task_.metric = fwhm*binWidth;
+	task_.centroid = low + (center+0.5)*binWidth;
+}
+
+void sweepScanner::evaluatePSD(sweepTask &task_, ChannelEvent &scratch_){
+	sweepChannel &chan = ((sweepUnpacker*)GetCore())->GetChannels()->at(task_.channel);
+
+	const size_t nBins = 256;
+	std::vector<double> hist(nBins, 0);
+	for(size_t i = 0; i < chan.size(); i++){
+		scratch_.copyTrace((char *)&chan.samples[chan.offsets[i]], chan.lengths[i]);
+		scratch_.baseline = chan.baselines[i];
+		scratch_.computed = TRACE_BASELINE; // Use the cached baseline.
+
+		// Integration windows are relative to the maximum, clamp them to the start of the trace.
+		int maxIndex = chan.maxIndices[i];
+		int start = std::max(0, maxIndex - fittingLow);
+		int start2 = std::max(0, maxIndex - (int)task_.par[0]);
+		if(scratch_.IntegratePulse(start, maxIndex + fittingHigh) <= 0) continue;
+		if(scratch_.IntegratePulse2(start2, maxIndex + (int)task_.par[1]) == -9999) continue;
+
+		double ratio = scratch_.qdc2/scratch_.qdc;
+		if(ratio < 0 || ratio >= 1) continue;
+		hist[(size_t)(ratio*nBins)] += 1;
+		task_.entries++;
+	}
+	if(task_.entries < 10) return;
+
+	// Split the ratio distribution into two classes and compute the figure-of-merit.
+	size_t threshold = computeOtsu(hist);
+	size_t center1, center2;
+	double fwhm1 = computeFWHM(hist, 0, threshold, center1);
+	double fwhm2 = computeFWHM(hist, threshold, nBins, center2);
+	if(fwhm1 <= 0 || fwhm2 <= 0) return;
+	task_.metric = std::fabs((double)center2 - (double)center1)/(fwhm1 + fwhm2);
+	task_.centroid = (double)threshold/nBins;
+}
+
+void sweepScanner::worker(){
+	ChannelEvent scratch;
+	size_t cfdLength = 0;
+	while(true){
+		size_t index = nextTask++;
+		if(index >= tasks.size()) break;
+		if(tasks[index].timing) evaluateTiming(tasks[index], scratch, cfdLength);
+		else evaluatePSD(tasks[index], scratch);
+	}
+	if(scratch.cfdvals){ // Clear() does not free the CFD array.
+		delete[] scratch.cfdvals;
+		scratch.cfdvals = NULL;
+	}
+}
+
+void sweepScanner::runSweep(){
+	if(sweepComplete) return;
+	sweepComplete = true;
+
+	sweepUnpacker *sweep = (sweepUnpacker*)GetCore();
+	std::vector<sweepChannel> *channels = sweep->GetChannels();
+
+	size_t totalTraces = 0;
+	for(std::vector<sweepChannel>::iterator iter = channels->begin(); iter != channels->end(); ++iter)
+		totalTraces += iter->size();
+	std::cout << msgHeader << "Cached " << totalTraces << " traces from " << channels->size() << " channels (" << sweep->GetNumStarts() << " starts).\n";
+
+	buildTasks();
+	if(tasks.empty()){
+		warnStr << msgHeader << "Warning! No traces to analyze.\n";
+		return;
+	}
+
+	unsigned int nThreads = std::min((size_t)numThreads, tasks.size());
+	std::cout << msgHeader << "Evaluating " << tasks.size() << " grid points using " << nThreads << " threads.\n";
+
+	nextTask = 0;
+	std::vector<std::thread> workers;
+	for(unsigned int i = 0; i < nThreads; i++)
+		workers.push_back(std::thread(&sweepScanner::worker, this));
+	for(std::vector<std::thread>::iterator iter = workers.begin(); iter != workers.end(); ++iter)
+		iter->join();
+
+	printResults();
+}
+
+void sweepScanner::printResults(){
+	std::vector<sweepChannel> *channels = ((sweepUnpacker*)GetCore())->GetChannels();
+
+	std::vector<int> bestTiming(channels->size(), -1);
+	std::vector<int> bestPSD(channels->size(), -1);
+	for(size_t i = 0; i < tasks.size(); i++){
+		const sweepTask &task = tasks[i];
+		if(task.metric <= 0) continue;
+		if(task.timing){
+			int &best = bestTiming[task.channel];
+			if(best < 0 || task.metric < tasks[best].metric) best = i;
+		}
+		else{
+			int &best = bestPSD[task.channel];
+			if(best < 0 || task.metric > tasks[best].metric) best = i;
+		}
+	}
+
+	std::cout << msgHeader << "Optimum parameters:\n";
+	std::cout << "  mod  chan  type          traces  map F  | best F";
+	if(useTraditional) std::cout << "  D   L ";
+	std::cout << "  FWHM (ns)  | low2  high2  FOM\n";
+	for(size_t i = 0; i < channels->size(); i++){
+		const sweepChannel &chan = channels->at(i);
+		std::cout << "  " << std::setw(3) << chan.id/16 << "  " << std::setw(4) << chan.id%16 << "  " << std::setw(12) << std::left << chan.type << std::right;
+		std::cout << "  " << std::setw(6) << chan.size() << "  " << std::setw(5) << chan.mapF << "  | ";
+		if(bestTiming[i] >= 0){
+			const sweepTask &task = tasks[bestTiming[i]];
+			std::cout << std::setw(6) << task.par[0];
+			if(useTraditional) std::cout << "  " << std::setw(2) << task.par[1] << "  " << std::setw(2) << task.par[2];
+			std::cout << "  " << std::setw(9) << task.metric << "  | ";
+		}
+		else{
+			std::cout << std::setw(6) << "-";
+			if(useTraditional) std::cout << "   -   -";
+			std::cout << "  " << std::setw(9) << "-" << "  | ";
+		}
+		if(bestPSD[i] >= 0){
+			const sweepTask &task = tasks[bestPSD[i]];
+			std::cout << std::setw(4) << task.par[0] << "  " << std::setw(5) << task.par[1] << "  " << task.metric << std::endl;
+		}
+		else std::cout << std::setw(4) << "-" << "  " << std::setw(5) << "-" << "  -\n";
+	}
+
+	if(reportFilename.empty()) return;
+
+	std::ofstream report(reportFilename.c_str());
+	if(!report.good()){
+		errStr << msgHeader << "ERROR! Failed to open report file \"" << reportFilename << "\".\n";
+		return;
+	}
+	report << "# Long integration window = [max-" << fittingLow << ", max+" << fittingHigh << "]\n";
+	report << "# mod\tchan\ttype\tmode\tpar0\tpar1\tpar2\tentries\tmetric\tcentroid\n";
+	for(std::vector<sweepTask>::iterator iter = tasks.begin(); iter != tasks.end(); ++iter){
+		const sweepChannel &chan = channels->at(iter->channel);
+		report << chan.id/16 << "\t" << chan.id%16 << "\t" << chan.type << "\t" << (iter->timing ? (useTraditional ? "cfd" : "poly") : "psd") << "\t";
+		report << iter->par[0] << "\t" << iter->par[1] << "\t" << iter->par[2] << "\t" << iter->entries << "\t" << iter->metric << "\t" << iter->centroid << std::endl;
+	}
+	report.close();
+	std::cout << msgHeader << "Wrote " << tasks.size() << " grid points to \"" << reportFilename << "\".\n";
+}
+
+void sweepScanner::ExtraArguments(){
+	if(userOpts.at(0).active){ // Detector type.
+		detectorType = userOpts.at(0).argument;
+		lowercaseString(detectorType);
+		std::cout << msgHeader << "Selecting detector type \"" << detectorType << "\".\n";
+	}
+	if(userOpts.at(1).active && !parseGrid(userOpts.at(1).argument, gridF)) // CFD fraction.
+		warnStr << msgHeader << "Warning! Invalid CFD fraction grid \"" << userOpts.at(1).argument << "\".\n";
+	if(userOpts.at(2).active){ // CFD delay.
+		if(!parseGrid(userOpts.at(2).argument, gridD))
+			warnStr << msgHeader << "Warning! Invalid CFD delay grid \"" << userOpts.at(2).argument << "\".\n";
+		useTraditional = true;
+	}
+	if(userOpts.at(3).active){ // CFD length.
+		if(!parseGrid(userOpts.at(3).argument, gridL))
+			warnStr << msgHeader << "Warning! Invalid CFD length grid \"" << userOpts.at(3).argument << "\".\n";
+		useTraditional = true;
+	}
+	if(userOpts.at(4).active){ // Long integration window.
+		std::string arg = userOpts.at(4).argument;
+		size_t index = arg.find(':');
+		if(index != std::string::npos){
+			fittingLow = strtol(arg.substr(0, index).c_str(), NULL, 0);
+			fittingHigh = strtol(arg.substr(index+1).c_str(), NULL, 0);
+		}
+		else warnStr << msgHeader << "Warning! Invalid integration window \"" << arg << "\". Expected <low:high>.\n";
+	}
+	if(userOpts.at(5).active && !parseGrid(userOpts.at(5).argument, gridLow2)) // Short window low edge.
+		warnStr << msgHeader << "Warning! Invalid short window grid \"" << userOpts.at(5).argument << "\".\n";
+	if(userOpts.at(6).active && !parseGrid(userOpts.at(6).argument, gridHigh2)) // Short window high edge.
+		warnStr << msgHeader << "Warning! Invalid short window grid \"" << userOpts.at(6).argument << "\".\n";
+	if(userOpts.at(7).active) // Maximum number of traces.
+		maxEvents = strtoul(userOpts.at(7).argument.c_str(), NULL, 0);
+	if(userOpts.at(8).active){ // Number of threads.
+		numThreads = strtoul(userOpts.at(8).argument.c_str(), NULL, 0);
+		if(numThreads == 0) numThreads = 1;
+	}
+	if(userOpts.at(9).active) // Time difference range.
+		timeRange = strtod(userOpts.at(9).argument.c_str(), NULL);
+	if(userOpts.at(10).active) // Report file.
+		reportFilename = userOpts.at(10).argument;
+}
+
+void sweepScanner::ArgHelp(){
+	AddOption(optionExt("type", required_argument, NULL, 0, "<type>", "Only analyze channels of a detector type defined in the map file"));
+	AddOption(optionExt("fraction", required_argument, NULL, 0, "<start:stop:step>", "CFD fraction grid (default is 0.1:0.9:0.1)"));
+	AddOption(optionExt("delay", required_argument, NULL, 0, "<start:stop:step>", "CFD delay grid in ADC ticks (enables traditional CFD)"));
+	AddOption(optionExt("length", required_argument, NULL, 0, "<start:stop:step>", "CFD length grid in ADC ticks (enables traditional CFD)"));
+	AddOption(optionExt("long", required_argument, NULL, 0, "<low:high>", "Long integration window relative to the maximum (default is 5:30)"));
+	AddOption(optionExt("low2", required_argument, NULL, 0, "<start:stop:step>", "Short window low edge grid, ticks before the maximum (default is -10:0:2)"));
+	AddOption(optionExt("high2", required_argument, NULL, 0, "<start:stop:step>", "Short window high edge grid, ticks after the maximum (default is 10:30:4)"));
+	AddOption(optionExt("max-events", required_argument, NULL, 0, "<N>", "Maximum number of traces to cache per channel (default is 10000)"));
+	AddOption(optionExt("threads", required_argument, NULL, 0, "<N>", "Number of worker threads (default is the number of cores)"));
+	AddOption(optionExt("range", required_argument, NULL, 0, "<ns>", "Half-width of the time difference histograms (default is 20 ns)"));
+	AddOption(optionExt("report", required_argument, NULL, 0, "<file>", "Write the results for every grid point to a file"));
+}
+
+void sweepScanner::SyntaxStr(char *name_){
+	std::cout << " usage: " << std::string(name_) << " [options]\n";
+}
+
+bool sweepScanner::Initialize(std::string prefix_){
+	sweepUnpacker *sweep = (sweepUnpacker*)GetCore();
+
+	std::string setupDirectory = this->GetSetupFilename();
+	if(setupDirectory.empty()) setupDirectory = "./setup/";
+	else if(setupDirectory.back() != '/') setupDirectory += '/';
+	std::cout << prefix_ << "Using setup directory \"" << setupDirectory << "\".\n";
+
+	std::string currentFile = setupDirectory + "map.dat";
+	std::cout << prefix_ << "Reading map file " << currentFile << "\n";
+	mapfile = new MapFile(currentFile.c_str());
+	if(!mapfile->IsInit()){ // Failed to read map file.
+		errStr << prefix_ << "Failed to read map file '" << currentFile << "'.\n";
+		return false;
+	}
+
+	currentFile = setupDirectory + "config.dat";
+	std::cout << prefix_ << "Reading config file " << currentFile << "\n";
+	ConfigFile configfile(currentFile.c_str());
+	if(!configfile.IsInit()){ // Failed to read config file.
+		errStr << prefix_ << "Failed to read configuration file '" << currentFile << "'.\n";
+		return false;
+	}
+	adcClock = configfile.adcClock*1E9;
+
+	int startMod, startChan;
+	if(!mapfile->GetFirstStart(startMod, startChan)){
+		errStr << prefix_ << "ERROR! No start detector defined in map file.\n";
+		return false;
+	}
+	if(configfile.buildMethod < 2){
+		warnStr << prefix_ << "Warning! Raw event build method (" << configfile.buildMethod << ") is invalid for timing analysis.\n";
+		configfile.buildMethod = 2;
+	}
+	sweep->SetEventWidth(configfile.eventWidth * (1E-6 / configfile.sysClock));
+	sweep->SetEventDelay(configfile.eventDelay * (1E-6 / configfile.sysClock));
+	sweep->SetRawEventMode(configfile.buildMethod);
+	sweep->SetStartChannel(startMod, startChan);
+	std::cout << prefix_ << "Set start channel to (" << startMod << ", " << startChan << ").\n";
+
+	sweep->SetMap(mapfile, startMod*16 + startChan, configfile.sysClock*1E9, adcClock);
+	sweep->SetType(detectorType);
+	sweep->SetMaxEvents(maxEvents);
+
+	std::cout << prefix_ << "CFD method is " << (useTraditional ? "traditional" : "polynomial") << ", " << gridF.size()*(useTraditional ? gridD.size()*gridL.size() : 1) << " timing grid points.\n";
+	std::cout << prefix_ << "Long integration window is [max-" << fittingLow << ", max+" << fittingHigh << "], " << gridLow2.size()*gridHigh2.size() << " short window grid points.\n";
+
+	return ScanInterface::Initialize(prefix_);
+}
+
+void sweepScanner::Notify(const std::string &code_/*=""*/){
+	if(code_ == "START_SCAN"){  }
+	else if(code_ == "STOP_SCAN"){  }
+	else if(code_ == "SCAN_COMPLETE"){
+		std::cout << msgHeader << "Scan complete.\n";
+		runSweep();
+	}
+	else if(code_ == "LOAD_FILE"){  }
+	else if(code_ == "REWIND_FILE"){  }
+	else if(code_ == "RESTART"){  }
+	else{ std::cout << msgHeader << "Unknown notification code '" << code_ << "'!\n"; }
+}
+
+Unpacker *sweepScanner::GetCore(){
+	if(!core){ core = (Unpacker*)(new sweepUnpacker()); }
+	return core;
+}
+
+int main(int argc, char *argv[]){
+	// Define a new sweeper object.
+	sweepScanner scanner;
+
+	// Set the output message prefix.
+	scanner.SetProgramName(std::string(PROG_NAME));
+
+	// Initialize the scanner.
+	if(!scanner.Setup(argc, argv))
+		return 1;
+
+	// Run the main loop.
+	int retval = scanner.Execute();
+
+	scanner.Close();
+
+	return retval;
+}
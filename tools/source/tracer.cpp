@@ -1,52 +1,335 @@
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 
 #include "TFile.h"
 #include "TTree.h"
 #include "TBranch.h"
 #include "TCanvas.h"
 #include "TH2I.h"
+#include "TTreeFormula.h"
 
 #include "simpleTool.hpp"
 #include "Structures.hpp"
 
 #define ADC_CLOCK 4 // ns per ADC clock tick
 
+#define TRACE_INDEX_MAGIC "TRCINDEX"
+#define TRACE_INDEX_VERSION 1
+
+/// Summary of a single ADC trace, used to select traces without reading the trace tree.
+class traceRecord{
+  public:
+	long long entry; ///< Entry of the trace tree
+	int cluster; ///< Index of the tree cluster containing the entry
+	short loc; ///< Detector location (-1 if unknown)
+	unsigned short index; ///< Index of the trace within the entry
+	unsigned short maxADC; ///< Maximum ADC value (not baseline corrected)
+	unsigned short maxBin; ///< ADC tick of the maximum
+	unsigned short pileup; ///< Set to 1 if a second pulse was found in the trace
+
+	traceRecord() : entry(0), cluster(0), loc(-1), index(0), maxADC(0), maxBin(0), pileup(0) { }
+};
+
+/// Index of all traces of a trace tree. The index is written next to the input file the first
+/// time the file is viewed, so that later sessions may jump straight to the traces they need.
+class traceIndex{
+  public:
+	std::vector<traceRecord> records; ///< Summary of each trace
+	std::vector<long long> clusters; ///< First entry of each tree cluster
+
+	/** Build the index by reading every entry of the trace tree.
+	  * \param[in]  tree_   Pointer to the trace tree, with the address of the trace branch set.
+	  * \param[in]  trace_  Pointer to the trace read from the tree.
+	  * \param[in]  data_   Pointer to the data tree of the same file, used to find detector locations (may be NULL).
+	  * \param[in]  branch_ Name of the trace branch.
+	  * \param[in]  pbar_   Progress bar to update.
+	  */
+	void build(TTree *tree_, Trace *&trace_, TTree *data_, const std::string &branch_, progressBar &pbar_);
+
+	/** Load the index from a file.
+	  * \param[in]  fname_ Path to the index file.
+	  * \param[in]  key_   Description of the input file. The index is only loaded if the keys match.
+	  * \return True upon success and false otherwise.
+	  */
+	bool load(const std::string &fname_, const std::string &key_);
+
+	/** Write the index to a file.
+	  * \param[in]  fname_ Path to the index file.
+	  * \param[in]  key_   Description of the input file.
+	  * \return True upon success and false otherwise.
+	  */
+	bool save(const std::string &fname_, const std::string &key_);
+
+  private:
+	/// Return true if a trace contains a second pulse with at least half the height of the maximum.
+	static bool findPileup(const unsigned short *wave_, const size_t &len_, const unsigned short &maxADC_);
+};
+
+void traceIndex::build(TTree *tree_, Trace *&trace_, TTree *data_, const std::string &branch_, progressBar &pbar_){
+	records.clear();
+	clusters.clear();
+
+	long long numEntries = tree_->GetEntries();
+
+	TTree::TClusterIterator iter = tree_->GetClusterIterator(0);
+	long long first;
+	while((first = iter()) < numEntries)
+		clusters.push_back(first);
+
+	// Detector locations are only stored in the data tree, which has one entry for each trace tree entry.
+	TTreeFormula *locations = NULL;
+	if(data_ && data_->GetEntries() == numEntries){
+		locations = new TTreeFormula("loc", (branch_+".loc").c_str(), data_);
+		if(locations->GetNdim() == 0){
+			delete locations;
+			locations = NULL;
+		}
+	}
+	if(!locations)
+		std::cout << " Warning! Detector locations are not available for branch \"" << branch_ << "\".\n";
+
+	int cluster = 0;
+	pbar_.start(numEntries);
+	for(long long entry = 0; entry < numEntries; entry++){
+		pbar_.check(entry);
+		if(tree_->GetEntry(entry) <= 0 || trace_->wave.empty() || trace_->mult == 0) continue;
+
+		while(cluster+1 < (int)clusters.size() && clusters[cluster+1] <= entry)
+			cluster++;
+
+		int numLoc = 0;
+		if(locations){
+			data_->LoadTree(entry);
+			numLoc = locations->GetNdata();
+		}
+
+		// Traces of all hits in the event are stored back to back.
+		size_t len = trace_->wave.size()/trace_->mult;
+		for(unsigned int i = 0; i < trace_->mult; i++){
+			const unsigned short *wave = &trace_->wave[i*len];
+
+			traceRecord record;
+			record.entry = entry;
+			record.cluster = cluster;
+			record.index = i;
+			for(size_t j = 0; j < len; j++){
+				if(wave[j] > record.maxADC){
+					record.maxADC = wave[j];
+					record.maxBin = j;
+				}
+			}
+			record.pileup = findPileup(wave, len, record.maxADC);
+			if(numLoc == (int)trace_->mult)
+				record.loc = (short)locations->EvalInstance(i);
+
+			records.push_back(record);
+		}
+	}
+	pbar_.finalize();
+
+	delete locations;
+}
+
+bool traceIndex::load(const std::string &fname_, const std::string &key_){
+	std::ifstream file(fname_.c_str(), std::ios::binary);
+	if(!file.good()) return false;
+
+	char magic[8];
+	unsigned int version, keyLength;
+	file.read(magic, 8);
+	file.read((char *)&version, 4);
+	file.read((char *)&keyLength, 4);
+	if(!file.good() || memcmp(magic, TRACE_INDEX_MAGIC, 8) != 0 || version != TRACE_INDEX_VERSION || keyLength != key_.length())
+		return false;
+
+	std::string key(keyLength, ' ');
+	file.read(&key[0], keyLength);
+	if(!file.good() || key != key_) return false;
+
+	unsigned long long numClusters, numRecords;
+	file.read((char *)&numClusters, 8);
+	file.read((char *)&numRecords, 8);
+	if(!file.good()) return false;
+
+	clusters.resize(numClusters);
+	records.resize(numRecords);
+	file.read((char *)clusters.data(), numClusters*sizeof(long long));
+	file.read((char *)records.data(), numRecords*sizeof(traceRecord));
+	if(!file.good()){
+		clusters.clear();
+		records.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool traceIndex::save(const std::string &fname_, const std::string &key_){
+	std::ofstream file(fname_.c_str(), std::ios::binary);
+	if(!file.good()) return false;
+
+	unsigned int version = TRACE_INDEX_VERSION;
+	unsigned int keyLength = key_.length();
+	unsigned long long numClusters = clusters.size();
+	unsigned long long numRecords = records.size();
+	file.write(TRACE_INDEX_MAGIC, 8);
+	file.write((char *)&version, 4);
+	file.write((char *)&keyLength, 4);
+	file.write(key_.c_str(), keyLength);
+	file.write((char *)&numClusters, 8);
+	file.write((char *)&numRecords, 8);
+	file.write((char *)clusters.data(), numClusters*sizeof(long long));
+	file.write((char *)records.data(), numRecords*sizeof(traceRecord));
+
+	return file.good();
+}
+
+bool traceIndex::findPileup(const unsigned short *wave_, const size_t &len_, const unsigned short &maxADC_){
+	size_t numBaseline = (len_ >= 80 ? len_/10 : 8);
+	if(numBaseline >= len_) return false;
+
+	double baseline = 0;
+	for(size_t i = 0; i < numBaseline; i++)
+		baseline += wave_[i];
+	baseline /= numBaseline;
+
+	double height = maxADC_ - baseline;
+	if(height <= 0) return false;
+
+	// Count rising edges through half of the pulse height. The trace must fall below a
+	// quarter of the pulse height before another edge is counted.
+	double upper = baseline + height/2;
+	double lower = baseline + height/4;
+	int numPulses = 0;
+	bool armed = true;
+	for(size_t i = 0; i < len_; i++){
+		if(armed && wave_[i] >= upper){
+			if(++numPulses > 1) return true;
+			armed = false;
+		}
+		else if(!armed && wave_[i] < lower)
+			armed = true;
+	}
+
+	return false;
+}
+
 class tracer : public simpleTool {
   private:
 	unsigned int tlength;
- 
+
 	Trace *trace;
 
 	TBranch *branch;
- 	
+
 	TH2I *hist;
 
+	std::string branchName;
+	std::string indexFilename;
+
+	int location;
+	int minADC;
+	int maxADC;
+	int pileupMode; // 0 = all traces, 1 = only pileup, -1 = no pileup
+	long long stopEntry;
+
+	bool rebuildIndex;
+	bool listMode;
+
+	traceIndex index;
+
 	bool setAddresses();
 
+	std::string getIndexKey();
+
+	bool loadIndex();
+
+	bool select(const traceRecord &record_);
+
   public:
 	tracer();
 
 	~tracer();
-	
+
 	void addOptions();
-	
+
 	bool processArgs();
-	
+
 	int execute(int argc, char *argv[]);
 };
 
 bool tracer::setAddresses(){
 	if(!intree) return false;
 
-	intree->SetBranchAddress("trace", &trace, &branch);
-	
+	// Only read the selected trace branch.
+	intree->SetBranchStatus("*", 0);
+	intree->SetBranchStatus(branchName.c_str(), 1);
+	intree->SetBranchStatus((branchName+".*").c_str(), 1);
+	intree->SetBranchAddress(branchName.c_str(), &trace, &branch);
+
 	return (branch != NULL);
 }
 
-tracer::tracer() : simpleTool(), tlength(0), trace(NULL), branch(NULL), hist(NULL) {
-	max_entries_to_process = 1; 
+/** Get the key describing the input file and trace branch used to build the index.
+  */
+std::string tracer::getIndexKey(){
+	std::stringstream key;
+	key << "file=" << full_input_filename;
+
+	struct stat info;
+	if(stat(input_filename.c_str(), &info) == 0)
+		key << "," << info.st_size << "," << info.st_mtime;
+
+	key << ";tree=" << input_objname << ";branch=" << branchName << ";entries=" << intree->GetEntries();
+
+	return key.str();
+}
+
+/** Load the trace index of the input file, building it if it does not exist or is out of date.
+  * \return True upon success and false otherwise.
+  */
+bool tracer::loadIndex(){
+	if(indexFilename.empty())
+		indexFilename = input_filename + "." + branchName + ".idx";
+
+	std::string key = getIndexKey();
+	if(!rebuildIndex && index.load(indexFilename, key)){
+		std::cout << " Loaded index of " << index.records.size() << " traces from '" << indexFilename << "'.\n";
+		return true;
+	}
+
+	std::cout << " Building index of trace branch \"" << branchName << "\"...\n";
+	TTree *datatree = (TTree*)infile->Get("data");
+	index.build(intree, trace, datatree, branchName, pbar);
+	std::cout << " Found " << index.records.size() << " traces in " << index.clusters.size() << " clusters.\n";
+
+	if(index.save(indexFilename, key))
+		std::cout << " Wrote trace index to '" << indexFilename << "'.\n";
+	else
+		std::cout << " Warning! Failed to write trace index to '" << indexFilename << "'.\n";
+
+	return true;
+}
+
+/** Return true if a trace passes all user selections.
+  */
+bool tracer::select(const traceRecord &record_){
+	if(record_.entry < start_entry || (stopEntry >= 0 && record_.entry >= stopEntry)) return false;
+	if(location >= 0 && record_.loc != location) return false;
+	if(minADC >= 0 && record_.maxADC < minADC) return false;
+	if(maxADC >= 0 && record_.maxADC > maxADC) return false;
+	if((pileupMode > 0 && !record_.pileup) || (pileupMode < 0 && record_.pileup)) return false;
+	return true;
+}
+
+tracer::tracer() : simpleTool(), tlength(0), trace(NULL), branch(NULL), hist(NULL), branchName("trace"), indexFilename(""), location(-1),
+                   minADC(-1), maxADC(-1), pileupMode(0), stopEntry(-1), rebuildIndex(false), listMode(false) {
+	max_entries_to_process = 1;
 	input_objname = "trace";
 }
 
@@ -55,9 +338,45 @@ tracer::~tracer(){
 }
 
 void tracer::addOptions(){
+	addOption(optionExt("branch", required_argument, NULL, 'b', "<name>", "Specify the name of the trace branch (default=\"trace\")."), userOpts, optstr);
+	addOption(optionExt("loc", required_argument, NULL, 'l', "<location>", "Only show traces from a detector location."), userOpts, optstr);
+	addOption(optionExt("min-adc", required_argument, NULL, 0, "<adc>", "Only show traces with a maximum ADC value of at least <adc>."), userOpts, optstr);
+	addOption(optionExt("max-adc", required_argument, NULL, 0, "<adc>", "Only show traces with a maximum ADC value of at most <adc>."), userOpts, optstr);
+	addOption(optionExt("pileup", no_argument, NULL, 0, "", "Only show traces with pileup."), userOpts, optstr);
+	addOption(optionExt("no-pileup", no_argument, NULL, 0, "", "Only show traces without pileup."), userOpts, optstr);
+	addOption(optionExt("stop", required_argument, NULL, 0, "<N>", "Only show traces from entries before <N>."), userOpts, optstr);
+	addOption(optionExt("index", required_argument, NULL, 0, "<filename>", "Specify the trace index file (default=<input>.<branch>.idx)."), userOpts, optstr);
+	addOption(optionExt("rebuild", no_argument, NULL, 0, "", "Rebuild the trace index even if it is up to date."), userOpts, optstr);
+	addOption(optionExt("list", no_argument, NULL, 0, "", "Print the selected traces instead of drawing them."), userOpts, optstr);
 }
 
 bool tracer::processArgs(){
+	if(userOpts.at(0).active)
+		branchName = userOpts.at(0).argument;
+	if(userOpts.at(1).active)
+		location = strtol(userOpts.at(1).argument.c_str(), NULL, 0);
+	if(userOpts.at(2).active)
+		minADC = strtol(userOpts.at(2).argument.c_str(), NULL, 0);
+	if(userOpts.at(3).active)
+		maxADC = strtol(userOpts.at(3).argument.c_str(), NULL, 0);
+	if(userOpts.at(4).active)
+		pileupMode = 1;
+	if(userOpts.at(5).active)
+		pileupMode = -1;
+	if(userOpts.at(6).active)
+		stopEntry = strtoll(userOpts.at(6).argument.c_str(), NULL, 0);
+	if(userOpts.at(7).active)
+		indexFilename = userOpts.at(7).argument;
+	if(userOpts.at(8).active)
+		rebuildIndex = true;
+	if(userOpts.at(9).active)
+		listMode = true;
+
+	if(userOpts.at(4).active && userOpts.at(5).active){
+		std::cout << " Error: Cannot specify both --pileup and --no-pileup!\n";
+		return false;
+	}
+
 	return true;
 }
 
@@ -81,7 +400,7 @@ int tracer::execute(int argc, char *argv[]){
 		std::cout << " Error: Failed to load input file \"" << input_filename << "\".\n";
 		return 3;
 	}
-	
+
 	if(!loadInputTree()){
 		std::cout << " Error: Failed to load TTree \"" << input_objname << "\".\n";
 		return 4;
@@ -92,33 +411,75 @@ int tracer::execute(int argc, char *argv[]){
 		return 5;
 	}
 
+	if(!loadIndex())
+		return 6;
+
+	// Select traces using the index.
+	std::vector<const traceRecord*> selected;
+	for(std::vector<traceRecord>::const_iterator iter = index.records.begin(); iter != index.records.end(); iter++){
+		if(max_entries_to_process > 0 && (long long)selected.size() >= max_entries_to_process) break;
+		if(select(*iter)) selected.push_back(&(*iter));
+	}
+
+	if(selected.empty()){
+		std::cout << " No traces match the selection.\n";
+		return 0;
+	}
+
+	std::cout << " Selected " << selected.size() << " traces.\n";
+
+	if(listMode){
+		std::cout << "entry\tindex\tcluster\tloc\tmaxADC\tmaxBin\tpileup\n";
+		for(std::vector<const traceRecord*>::iterator iter = selected.begin(); iter != selected.end(); iter++)
+			std::cout << (*iter)->entry << "\t" << (*iter)->index << "\t" << (*iter)->cluster << "\t" << (*iter)->loc << "\t" << (*iter)->maxADC << "\t" << (*iter)->maxBin << "\t" << (*iter)->pileup << "\n";
+		return 0;
+	}
+
+	// Read only the entries containing selected traces. Records are ordered by entry.
+	int *contents = NULL;
 	unsigned int count = 0;
-	while(getNextEntry()){
-		// Skip empty traces.
-		if(trace->wave.empty()) continue;
+	long long currentEntry = -1;
+	bool entryRead = false;
+	for(std::vector<const traceRecord*>::iterator iter = selected.begin(); iter != selected.end(); iter++){
+		if((*iter)->entry != currentEntry){
+			currentEntry = (*iter)->entry;
+			entryRead = (intree->GetEntry(currentEntry) > 0);
+		}
+
+		// Skip all records of an entry which could not be read.
+		if(!entryRead) continue;
 
 		// Get the trace length.
 		if(count == 0){
 			tlength = trace->wave.size()/trace->mult;
 			std::cout << " Trace length is " << tlength << " ADC ticks (" << tlength*ADC_CLOCK << " ns).\n";
-			hist = new TH2I("hist", "Traces", tlength, 0, tlength*ADC_CLOCK, max_entries_to_process, 0, max_entries_to_process);
+			hist = new TH2I("hist", "Traces", tlength, 0, tlength*ADC_CLOCK, selected.size(), 0, selected.size());
 			hist->SetStats(0);
+			contents = hist->GetArray();
 		}
-	
-		int globalBin;
-		for(unsigned int i = 0; i < tlength; i++){
-			globalBin = hist->GetBin(i, count);
-			hist->SetBinContent(globalBin, trace->wave.at(i));
-		}
+
+		// Copy the trace into its row of the histogram.
+		unsigned int len = trace->wave.size()/trace->mult;
+		if(len > tlength) len = tlength;
+		const unsigned short *wave = &trace->wave[(*iter)->index*(trace->wave.size()/trace->mult)];
+		int *row = &contents[(count+1)*(tlength+2)+1];
+		for(unsigned int i = 0; i < len; i++)
+			row[i] = wave[i];
 		count++;
 	}
 
+	if(!hist){
+		std::cout << " Error: Failed to read selected traces from \"" << input_objname << "\".\n";
+		return 7;
+	}
+	hist->SetEntries(count*tlength);
+
 	openCanvas1();
 	hist->Draw("COLZ");
 
 	// Wait for the user to issue ctrl^c or ctrl^z.
 	this->wait();
-	
+
 	if(!output_filename.empty()){
 		outfile->cd();
 		can1->Write("canvas");
@@ -130,6 +491,6 @@ int tracer::execute(int argc, char *argv[]){
 
 int main(int argc, char *argv[]){
 	tracer obj;
-	
+
 	return obj.execute(argc, argv);
 }